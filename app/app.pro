@@ -136,6 +136,11 @@ unix:if(!macx|disable-prebuilts) {
             packagesExist(x11) {
                 DEFINES += HAS_X11
                 PKGCONFIG += x11
+
+                packagesExist(xcb-present) {
+                    CONFIG += xcb-present
+                    PKGCONFIG += xcb xcb-present
+                }
             }
         }
     }
@@ -164,6 +169,7 @@ SOURCES += \
     backend/nvaddress.cpp \
     backend/nvapp.cpp \
     cli/pair.cpp \
+    cli/replay.cpp \
     main.cpp \
     backend/computerseeker.cpp \
     backend/identitymanager.cpp \
@@ -198,6 +204,11 @@ SOURCES += \
     settings/mappingmanager.cpp \
     gui/sdlgamepadkeynavigation.cpp \
     streaming/video/overlaymanager.cpp \
+    streaming/video/decodeunitcapture.cpp \
+    streaming/video/frametimeline.cpp \
+    streaming/video/framepool.cpp \
+    streaming/video/capabilitycache.cpp \
+    streaming/video/probescheduler.cpp \
     backend/systemproperties.cpp \
     streaming/video/videoenhancement.cpp \
     wm.cpp
@@ -207,6 +218,7 @@ HEADERS += \
     backend/nvaddress.h \
     backend/nvapp.h \
     cli/pair.h \
+    cli/replay.h \
     settings/compatfetcher.h \
     settings/mappingfetcher.h \
     utils.h \
@@ -237,6 +249,11 @@ HEADERS += \
     settings/mappingmanager.h \
     gui/sdlgamepadkeynavigation.h \
     streaming/video/overlaymanager.h \
+    streaming/video/decodeunitcapture.h \
+    streaming/video/frametimeline.h \
+    streaming/video/framepool.h \
+    streaming/video/capabilitycache.h \
+    streaming/video/probescheduler.h \
     backend/systemproperties.h \
     streaming/video/videoenhancement.h
 
@@ -248,17 +265,24 @@ ffmpeg {
     SOURCES += \
         streaming/video/ffmpeg.cpp \
         streaming/video/ffmpeg-renderers/genhwaccel.cpp \
+        streaming/video/ffmpeg-renderers/cpucolorconverter.cpp \
         streaming/video/ffmpeg-renderers/sdlvid.cpp \
         streaming/video/ffmpeg-renderers/swframemapper.cpp \
-        streaming/video/ffmpeg-renderers/pacer/pacer.cpp
+        streaming/video/ffmpeg-renderers/pacer/framequeue.cpp \
+        streaming/video/ffmpeg-renderers/pacer/pacer.cpp \
+        streaming/video/ffmpeg-renderers/pacer/softwarevsyncsource.cpp
 
     HEADERS += \
         streaming/video/ffmpeg.h \
         streaming/video/ffmpeg-renderers/renderer.h \
         streaming/video/ffmpeg-renderers/genhwaccel.h \
+        streaming/video/ffmpeg-renderers/cpucolorconverter.h \
         streaming/video/ffmpeg-renderers/sdlvid.h \
+        streaming/video/ffmpeg-renderers/surfacecache.h \
         streaming/video/ffmpeg-renderers/swframemapper.h \
-        streaming/video/ffmpeg-renderers/pacer/pacer.h
+        streaming/video/ffmpeg-renderers/pacer/framequeue.h \
+        streaming/video/ffmpeg-renderers/pacer/pacer.h \
+        streaming/video/ffmpeg-renderers/pacer/softwarevsyncsource.h
 }
 libva {
     message(VAAPI renderer selected)
@@ -521,6 +545,13 @@ wayland {
     SOURCES += streaming/video/ffmpeg-renderers/pacer/waylandvsyncsource.cpp
     HEADERS += streaming/video/ffmpeg-renderers/pacer/waylandvsyncsource.h
 }
+xcb-present {
+    message(X11 Present V-sync source enabled)
+
+    DEFINES += HAS_XCB_PRESENT
+    SOURCES += streaming/video/ffmpeg-renderers/pacer/x11presentvsyncsource.cpp
+    HEADERS += streaming/video/ffmpeg-renderers/pacer/x11presentvsyncsource.h
+}
 
 RESOURCES += \
     resources.qrc \
@@ -30,7 +30,7 @@ private:
         bool supportsHdr;
         QSize maximumResolution;
 
-        Session::getDecoderInfo(m_Properties->testWindow, hasHardwareAcceleration, rendererAlwaysFullScreen, supportsHdr, maximumResolution);
+        Session::getDecoderInfo(*m_Properties->probeScheduler, hasHardwareAcceleration, rendererAlwaysFullScreen, supportsHdr, maximumResolution);
 
         // Propagate the decoder properties to the SystemProperties singleton and emit any change signals on the main thread
         QMetaObject::invokeMethod(m_Properties, "updateDecoderProperties",
@@ -134,6 +134,9 @@ void SystemProperties::updateDecoderProperties(bool hasHardwareAcceleration, boo
         emit supportsHdrChanged();
     }
 
+    delete probeScheduler;
+    probeScheduler = nullptr;
+
     SDL_DestroyWindow(testWindow);
     testWindow = nullptr;
     SDL_QuitSubSystem(SDL_INIT_VIDEO);
@@ -205,6 +208,8 @@ void SystemProperties::startAsyncLoad()
         }
     }
 
+    probeScheduler = new DecoderProbeScheduler(testWindow);
+
     systemPropertyQueryThread = new SystemPropertyQueryThread(this);
     systemPropertyQueryThread->start();
 }
@@ -5,6 +5,8 @@
 
 #include "SDL_compat.h"
 
+class DecoderProbeScheduler;
+
 class SystemProperties : public QObject
 {
     Q_OBJECT
@@ -61,6 +63,7 @@ private slots:
 private:
     QThread* systemPropertyQueryThread = nullptr;
     SDL_Window* testWindow = nullptr;
+    DecoderProbeScheduler* probeScheduler = nullptr;
 
     // Properties set by the constructor
     bool isRunningWayland;
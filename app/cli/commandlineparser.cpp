@@ -161,6 +161,7 @@ GlobalCommandLineParser::ParseResult GlobalCommandLineParser::parse(const QStrin
         "  quit            Quit the currently running app\n"
         "  stream          Start streaming an app\n"
         "  pair            Pair a new host\n"
+        "  replay          Decode and render a decode unit capture without a host\n"
         "\n"
         "See 'moonlight <action> --help' for help of specific action."
     );
@@ -192,6 +193,8 @@ GlobalCommandLineParser::ParseResult GlobalCommandLineParser::parse(const QStrin
                 return PairRequested;
             } else if (action == "list") {
                 return ListRequested;
+            } else if (action == "replay") {
+                return ReplayRequested;
             }
         }
 
@@ -610,3 +613,100 @@ bool ListCommandLineParser::isVerbose() const
 {
     return m_Verbose;
 }
+
+ReplayCommandLineParser::ReplayCommandLineParser()
+    : m_Seed(0),
+      m_Unthrottled(false)
+{
+    m_VideoDecoderMap = {
+        {"auto",     StreamingPreferences::VDS_AUTO},
+        {"software", StreamingPreferences::VDS_FORCE_SOFTWARE},
+        {"hardware", StreamingPreferences::VDS_FORCE_HARDWARE},
+    };
+}
+
+ReplayCommandLineParser::~ReplayCommandLineParser()
+{
+}
+
+void ReplayCommandLineParser::parse(const QStringList &args, StreamingPreferences *preferences)
+{
+    CommandLineParser parser;
+    parser.setupCommonOptions();
+    parser.setApplicationDescription(
+        "\n"
+        "Decodes and renders a capture recorded with DECODE_UNIT_CAPTURE_FILE\n"
+        "without connecting to a host. The exit code is non-zero if the replay\n"
+        "fails or the decoder rejects any frames.\n"
+        "\n"
+        "Set SDL_VIDEODRIVER=dummy or run under Xvfb to replay without a display."
+    );
+    parser.addPositionalArgument("replay", "replay capture");
+    parser.addPositionalArgument("file", "Decode unit capture file", "<file>");
+
+    parser.addChoiceOption("profile", "arrival profile", {"recorded", "smooth", "jittery", "bursty"});
+    parser.addValueOption("seed", "random seed for the arrival profile");
+    parser.addFlagOption("unthrottled", "Submit frames as fast as the decoder accepts them");
+    parser.addToggleOption("vsync", "V-Sync");
+    parser.addToggleOption("frame-pacing", "frame pacing");
+    parser.addToggleOption("performance-overlay", "show performance overlay");
+    parser.addChoiceOption("video-decoder", "video decoder", m_VideoDecoderMap.keys());
+
+    if (!parser.parse(args)) {
+        parser.showError(parser.errorText());
+    }
+
+    parser.handleUnknownOptions();
+
+    if (parser.isSet("profile")) {
+        m_ArrivalProfile = parser.getChoiceOptionValue("profile").toLower();
+    }
+
+    if (parser.isSet("seed")) {
+        m_Seed = (quint32)parser.getIntOption("seed");
+    }
+
+    m_Unthrottled = parser.isSet("unthrottled");
+
+    preferences->enableVsync = parser.getToggleOptionValue("vsync", preferences->enableVsync);
+    preferences->framePacing = parser.getToggleOptionValue("frame-pacing", preferences->framePacing);
+    preferences->showPerformanceOverlay = parser.getToggleOptionValue("performance-overlay", preferences->showPerformanceOverlay);
+
+    if (parser.isSet("video-decoder")) {
+        preferences->videoDecoderSelection = mapValue(m_VideoDecoderMap, parser.getChoiceOptionValue("video-decoder"));
+    }
+
+    // There's nothing to configure on a host, so always run in a window
+    preferences->windowMode = StreamingPreferences::WM_WINDOWED;
+
+    // This method will not return and terminates the process if --version or
+    // --help is specified
+    parser.handleHelpAndVersionOptions();
+
+    // Verify that the capture file has been provided
+    auto posArgs = parser.positionalArguments();
+    if (posArgs.length() < 2) {
+        parser.showError("Capture file not provided");
+    }
+    m_CaptureFile = posArgs.at(1);
+}
+
+QString ReplayCommandLineParser::getCaptureFile() const
+{
+    return m_CaptureFile;
+}
+
+QString ReplayCommandLineParser::getArrivalProfile() const
+{
+    return m_ArrivalProfile;
+}
+
+quint32 ReplayCommandLineParser::getSeed() const
+{
+    return m_Seed;
+}
+
+bool ReplayCommandLineParser::isUnthrottled() const
+{
+    return m_Unthrottled;
+}
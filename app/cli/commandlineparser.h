@@ -14,6 +14,7 @@ public:
         QuitRequested,
         PairRequested,
         ListRequested,
+        ReplayRequested,
     };
 
     GlobalCommandLineParser();
@@ -92,3 +93,24 @@ private:
     bool m_PrintCSV;
     bool m_Verbose;
 };
+
+class ReplayCommandLineParser
+{
+public:
+    ReplayCommandLineParser();
+    virtual ~ReplayCommandLineParser();
+
+    void parse(const QStringList &args, StreamingPreferences *preferences);
+
+    QString getCaptureFile() const;
+    QString getArrivalProfile() const;
+    quint32 getSeed() const;
+    bool isUnthrottled() const;
+
+private:
+    QString m_CaptureFile;
+    QString m_ArrivalProfile;
+    quint32 m_Seed;
+    bool m_Unthrottled;
+    QMap<QString, StreamingPreferences::VideoDecoderSelection> m_VideoDecoderMap;
+};
@@ -0,0 +1,73 @@
+#include "replay.h"
+
+#include "backend/nvcomputer.h"
+#include "streaming/session.h"
+
+#include <QCoreApplication>
+
+namespace CliReplay
+{
+
+Launcher::Launcher(ReplayCommandLineParser arguments, StreamingPreferences *preferences, QObject *parent)
+    : QObject(parent),
+      m_Arguments(arguments),
+      m_Preferences(preferences),
+      m_Computer(nullptr),
+      m_Session(nullptr)
+{
+}
+
+Launcher::~Launcher()
+{
+    delete m_Session;
+    delete m_Computer;
+}
+
+void Launcher::execute()
+{
+    // Session picks up the capture through the same environment variables
+    // used to replay from the GUI, so the replay path stays identical.
+    qputenv("DECODE_UNIT_REPLAY_FILE", m_Arguments.getCaptureFile().toUtf8());
+    if (!m_Arguments.getArrivalProfile().isEmpty()) {
+        qputenv("DECODE_UNIT_REPLAY_PROFILE", m_Arguments.getArrivalProfile().toUtf8());
+    }
+    qputenv("DECODE_UNIT_REPLAY_SEED", QByteArray::number(m_Arguments.getSeed()));
+    qputenv("DECODE_UNIT_REPLAY_UNTHROTTLED", m_Arguments.isUnthrottled() ? "1" : "0");
+
+    // There is no host, so the session streams from a placeholder computer
+    NvApp app;
+    app.name = "Decode unit replay";
+    m_Computer = new NvComputer();
+    m_Computer->name = "Decode unit replay";
+
+    m_Session = new Session(m_Computer, app, m_Preferences);
+    connect(m_Session, &Session::displayLaunchError,
+            this, &Launcher::onDisplayLaunchError);
+    connect(m_Session, &Session::readyForDeletion,
+            this, &Launcher::onReadyForDeletion);
+
+    if (!m_Session->initialize(nullptr)) {
+        fprintf(stderr, "Failed to start replay of %s\n", qPrintable(m_Arguments.getCaptureFile()));
+        QCoreApplication::exit(1);
+        return;
+    }
+
+    // Run the replay to completion
+    m_Session->start();
+}
+
+void Launcher::onDisplayLaunchError(QString text)
+{
+    fprintf(stderr, "%s\n", qPrintable(text));
+}
+
+void Launcher::onReadyForDeletion()
+{
+    int replayedFrames, rejectedFrames;
+    m_Session->getDecodeUnitReplayResult(replayedFrames, rejectedFrames);
+
+    fprintf(stdout, "Replayed %d frames (%d rejected by the decoder)\n", replayedFrames, rejectedFrames);
+    QCoreApplication::exit(replayedFrames > 0 && rejectedFrames == 0 ? 0 : 1);
+}
+
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "commandlineparser.h"
+
+#include <QObject>
+
+class NvComputer;
+class Session;
+class StreamingPreferences;
+
+namespace CliReplay
+{
+
+class Launcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Launcher(ReplayCommandLineParser arguments, StreamingPreferences *preferences, QObject *parent = nullptr);
+    ~Launcher();
+
+    Q_INVOKABLE void execute();
+
+private slots:
+    void onDisplayLaunchError(QString text);
+    void onReadyForDeletion();
+
+private:
+    ReplayCommandLineParser m_Arguments;
+    StreamingPreferences *m_Preferences;
+    NvComputer *m_Computer;
+    Session *m_Session;
+};
+
+}
@@ -872,6 +872,14 @@ Flickable {
                             text: qsTr("Ultra Low (1 frame)")
                             val: 2
                         }
+                        ListElement {
+                            text: qsTr("Adaptive (1-3 frames)")
+                            val: 3
+                        }
+                        ListElement {
+                            text: qsTr("Variable Refresh Rate")
+                            val: 4
+                        }
                     }
                     function reinitialize() {
                         currentIndex = StreamingPreferences.framePacingMode
@@ -41,6 +41,7 @@
 #include "cli/quitstream.h"
 #include "cli/startstream.h"
 #include "cli/pair.h"
+#include "cli/replay.h"
 #include "cli/commandlineparser.h"
 #include "path.h"
 #include "utils.h"
@@ -956,6 +957,19 @@ int main(int argc, char *argv[])
             hasGUI = false;
             break;
         }
+    case GlobalCommandLineParser::ReplayRequested:
+        {
+            StreamingPreferences* preferences = StreamingPreferences::get();
+            ReplayCommandLineParser replayParser;
+            replayParser.parse(app.arguments(), preferences);
+            auto launcher = new CliReplay::Launcher(replayParser, preferences, &app);
+
+            // The session pumps its own event loop and exits the app when
+            // the replay ends, so it must start from inside app.exec().
+            QMetaObject::invokeMethod(launcher, "execute", Qt::QueuedConnection);
+            hasGUI = false;
+            break;
+        }
     }
 
     if (hasGUI) {
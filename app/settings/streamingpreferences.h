@@ -132,7 +132,9 @@ public:
     {
         FPM_BALANCED = 0,
         FPM_LOW_LATENCY = 1,
-        FPM_ULTRA_LOW = 2
+        FPM_ULTRA_LOW = 2,
+        FPM_ADAPTIVE = 3,
+        FPM_VRR = 4
     };
     Q_ENUM(FramePacingMode);
 
@@ -123,6 +123,11 @@ SdlInputHandler::SdlInputHandler(StreamingPreferences& prefs, int streamWidth, i
     m_SpecialKeyCombos[KeyComboToggleVsrOverlay].scanCode = SDL_SCANCODE_G;
     m_SpecialKeyCombos[KeyComboToggleVsrOverlay].enabled = true;
 
+    m_SpecialKeyCombos[KeyComboDumpFrameTimeline].keyCombo = KeyComboDumpFrameTimeline;
+    m_SpecialKeyCombos[KeyComboDumpFrameTimeline].keyCode = SDLK_t;
+    m_SpecialKeyCombos[KeyComboDumpFrameTimeline].scanCode = SDL_SCANCODE_T;
+    m_SpecialKeyCombos[KeyComboDumpFrameTimeline].enabled = true;
+
     m_OldIgnoreDevices = SDL_GetHint(SDL_HINT_GAMECONTROLLER_IGNORE_DEVICES);
     m_OldIgnoreDevicesExcept = SDL_GetHint(SDL_HINT_GAMECONTROLLER_IGNORE_DEVICES_EXCEPT);
 
@@ -78,6 +78,13 @@ void SdlInputHandler::performSpecialKeyCombo(KeyCombo combo)
         }
         break;
 
+    case KeyComboDumpFrameTimeline:
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Detected frame timeline dump combo");
+
+        Session::get()->getFrameTimeline().dumpChromeTrace(FrameTimeline::getDefaultDumpPath());
+        break;
+
     case KeyComboToggleMouseMode:
         SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                     "Detected mouse mode toggle combo");
@@ -230,7 +237,8 @@ void SdlInputHandler::updateVsrOverlayText()
             prefs->muteOnFocusLoss ? "ON " : "OFF");
     } else {
         bool isHdr = !!(Session::get()->m_ActiveVideoFormat & VIDEO_FORMAT_MASK_10BIT);
-        bool isVrr = !prefs->enableVsync;
+        bool isVrr = !prefs->enableVsync ||
+                (prefs->framePacing && prefs->framePacingMode == StreamingPreferences::FPM_VRR);
         snprintf(contentLines, sizeof(contentLines),
             "%s Frame Pacing:  [%s]\n"
             "%s DisplayLink:   [%s]\n"
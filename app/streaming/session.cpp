@@ -290,7 +290,8 @@ void Session::clSetAdaptiveTriggers(uint16_t controllerNumber, uint8_t eventFlag
 
 bool Session::chooseDecoder(StreamingPreferences::VideoDecoderSelection vds,
                             SDL_Window* window, int videoFormat, int width, int height,
-                            int frameRate, bool enableVsync, bool enableFramePacing, bool enableVideoEnhancement, bool testOnly, IVideoDecoder*& chosenDecoder)
+                            int frameRate, bool enableVsync, bool enableFramePacing, bool enableVideoEnhancement, bool testOnly,
+                            bool prewarm, IVideoDecoder*& chosenDecoder)
 {
     DECODER_PARAMETERS params;
 
@@ -317,7 +318,10 @@ bool Session::chooseDecoder(StreamingPreferences::VideoDecoderSelection vds,
     params.superResolutionMode = static_cast<int>(StreamingPreferences::get()->superResolutionMode);
     params.useDisplayLink = StreamingPreferences::get()->useDisplayLink;
     params.tripleBuffering = StreamingPreferences::get()->tripleBuffering;
+    params.enableVrr = enableVsync && enableFramePacing &&
+            StreamingPreferences::get()->framePacingMode == StreamingPreferences::FPM_VRR;
     params.testOnly = testOnly;
+    params.prewarm = prewarm;
     params.vds = vds;
 
     SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
@@ -362,6 +366,48 @@ bool Session::chooseDecoder(StreamingPreferences::VideoDecoderSelection vds,
     return false;
 }
 
+bool Session::probeDecoder(StreamingPreferences::VideoDecoderSelection vds,
+                           SDL_Window* window, int videoFormat, int width, int height,
+                           int frameRate, bool enableVideoEnhancement, DecoderProbeResult& result)
+{
+    StreamingPreferences* prefs = StreamingPreferences::get();
+
+    // Include every preference that can influence which decoder or renderer is chosen
+    QString probeKey = QString("%1/%2/%3x%4x%5/%6/%7/%8/%9")
+            .arg(vds)
+            .arg(videoFormat, 0, 16)
+            .arg(width).arg(height).arg(frameRate)
+            .arg(enableVideoEnhancement)
+            .arg(static_cast<int>(prefs->superResolutionMode))
+            .arg(prefs->useDisplayLink)
+            .arg(prefs->tripleBuffering);
+
+    if (DecoderCapabilityCache::get().lookup(probeKey, result)) {
+        return result.available;
+    }
+
+    IVideoDecoder* decoder;
+    if (chooseDecoder(vds, window, videoFormat, width, height, frameRate,
+                      false, false, enableVideoEnhancement, true, false, decoder)) {
+        result.available = true;
+        result.isHardwareAccelerated = decoder->isHardwareAccelerated();
+        result.isAlwaysFullScreen = decoder->isAlwaysFullScreen();
+        result.isHdrSupported = decoder->isHdrSupported();
+        result.maxResolution = decoder->getDecoderMaxResolution();
+        result.capabilities = decoder->getDecoderCapabilities();
+        result.colorspace = decoder->getDecoderColorspace();
+        result.colorRange = decoder->getDecoderColorRange();
+        delete decoder;
+    }
+    else {
+        result = {};
+        result.available = false;
+    }
+
+    DecoderCapabilityCache::get().store(probeKey, result);
+    return result.available;
+}
+
 int Session::drSetup(int videoFormat, int width, int height, int frameRate, void *, int)
 {
     s_ActiveSession->m_ActiveVideoFormat = videoFormat;
@@ -369,6 +415,16 @@ int Session::drSetup(int videoFormat, int width, int height, int frameRate, void
     s_ActiveSession->m_ActiveVideoHeight = height;
     s_ActiveSession->m_ActiveVideoFrameRate = frameRate;
 
+    QString captureFile = qEnvironmentVariable("DECODE_UNIT_CAPTURE_FILE");
+    if (!captureFile.isEmpty() && s_ActiveSession->m_DecodeUnitPlayer == nullptr) {
+        delete s_ActiveSession->m_DecodeUnitRecorder;
+        s_ActiveSession->m_DecodeUnitRecorder = new DecodeUnitRecorder();
+        if (!s_ActiveSession->m_DecodeUnitRecorder->open(captureFile, videoFormat, width, height, frameRate)) {
+            delete s_ActiveSession->m_DecodeUnitRecorder;
+            s_ActiveSession->m_DecodeUnitRecorder = nullptr;
+        }
+    }
+
     // Defer decoder setup until we've started streaming so we
     // don't have to hide and show the SDL window (which seems to
     // cause pointer hiding to break on Windows).
@@ -408,50 +464,56 @@ int Session::drSubmitDecodeUnit(PDECODE_UNIT du)
     }
 }
 
-void Session::getDecoderInfo(SDL_Window* window,
+void Session::getDecoderInfo(DecoderProbeScheduler& probeScheduler,
                              bool& isHardwareAccelerated, bool& isFullScreenOnly,
                              bool& isHdrSupported, QSize& maxResolution)
 {
-    IVideoDecoder* decoder;
+    DecoderProbeResult probe;
+    bool enableVideoEnhancement = StreamingPreferences::get()->videoEnhancing;
+
+    // Start every probe we might need up front, since most of them are
+    // independent and the driver initialization overlaps well.
+    probeScheduler.prefetch(StreamingPreferences::VDS_FORCE_HARDWARE, VIDEO_FORMAT_H265_MAIN10, 1920, 1080, 60, enableVideoEnhancement);
+    probeScheduler.prefetch(StreamingPreferences::VDS_FORCE_HARDWARE, VIDEO_FORMAT_AV1_MAIN10, 1920, 1080, 60, enableVideoEnhancement);
+    probeScheduler.prefetch(StreamingPreferences::VDS_FORCE_HARDWARE, VIDEO_FORMAT_H265, 1920, 1080, 60, enableVideoEnhancement);
+    probeScheduler.prefetch(StreamingPreferences::VDS_AUTO, VIDEO_FORMAT_H264, 1920, 1080, 60, enableVideoEnhancement);
+    probeScheduler.prefetch(StreamingPreferences::VDS_FORCE_SOFTWARE, VIDEO_FORMAT_H265_MAIN10, 1920, 1080, 60, false);
+    probeScheduler.prefetch(StreamingPreferences::VDS_FORCE_SOFTWARE, VIDEO_FORMAT_AV1_MAIN10, 1920, 1080, 60, false);
 
     // Since AV1 support on the host side is in its infancy, let's not consider
     // _only_ a working AV1 decoder to be acceptable and still show the warning
     // dialog indicating lack of hardware decoding support.
 
     // Try an HEVC Main10 decoder first to see if we have HDR support
-    if (chooseDecoder(StreamingPreferences::VDS_FORCE_HARDWARE,
-                      window, VIDEO_FORMAT_H265_MAIN10, 1920, 1080, 60,
-                      false, false, StreamingPreferences::get()->videoEnhancing, true, decoder)) {
-        isHardwareAccelerated = decoder->isHardwareAccelerated();
-        isFullScreenOnly = decoder->isAlwaysFullScreen();
-        isHdrSupported = decoder->isHdrSupported();
-        maxResolution = decoder->getDecoderMaxResolution();
-        delete decoder;
-
+    if (probeScheduler.probe(StreamingPreferences::VDS_FORCE_HARDWARE,
+                             VIDEO_FORMAT_H265_MAIN10, 1920, 1080, 60,
+                             enableVideoEnhancement, probe)) {
+        isHardwareAccelerated = probe.isHardwareAccelerated;
+        isFullScreenOnly = probe.isAlwaysFullScreen;
+        isHdrSupported = probe.isHdrSupported;
+        maxResolution = probe.maxResolution;
         return;
     }
 
     // Try an AV1 Main10 decoder next to see if we have HDR support
-    if (chooseDecoder(StreamingPreferences::VDS_FORCE_HARDWARE,
-                      window, VIDEO_FORMAT_AV1_MAIN10, 1920, 1080, 60,
-                      false, false, StreamingPreferences::get()->videoEnhancing, true, decoder)) {
+    if (probeScheduler.probe(StreamingPreferences::VDS_FORCE_HARDWARE,
+                             VIDEO_FORMAT_AV1_MAIN10, 1920, 1080, 60,
+                             enableVideoEnhancement, probe)) {
         // If we've got a working AV1 Main 10-bit decoder, we'll enable the HDR checkbox
         // but we will still continue probing to get other attributes for HEVC or H.264
         // decoders. See the AV1 comment at the top of the function for more info.
-        isHdrSupported = decoder->isHdrSupported();
-        delete decoder;
+        isHdrSupported = probe.isHdrSupported;
     }
     else {
         // If we found no hardware decoders with HDR, check for a renderer
         // that supports HDR rendering with software decoded frames.
-        if (chooseDecoder(StreamingPreferences::VDS_FORCE_SOFTWARE,
-                          window, VIDEO_FORMAT_H265_MAIN10, 1920, 1080, 60,
-                          false, false, false, true, decoder) ||
-            chooseDecoder(StreamingPreferences::VDS_FORCE_SOFTWARE,
-                          window, VIDEO_FORMAT_AV1_MAIN10, 1920, 1080, 60,
-                          false, false, false, true, decoder)) {
-            isHdrSupported = decoder->isHdrSupported();
-            delete decoder;
+        if (probeScheduler.probe(StreamingPreferences::VDS_FORCE_SOFTWARE,
+                                 VIDEO_FORMAT_H265_MAIN10, 1920, 1080, 60,
+                                 false, probe) ||
+            probeScheduler.probe(StreamingPreferences::VDS_FORCE_SOFTWARE,
+                                 VIDEO_FORMAT_AV1_MAIN10, 1920, 1080, 60,
+                                 false, probe)) {
+            isHdrSupported = probe.isHdrSupported;
         }
         else {
             // We weren't compiled with an HDR-capable renderer or we don't
@@ -461,41 +523,35 @@ void Session::getDecoderInfo(SDL_Window* window,
     }
 
     // Try a regular hardware accelerated HEVC decoder now
-    if (chooseDecoder(StreamingPreferences::VDS_FORCE_HARDWARE,
-                      window, VIDEO_FORMAT_H265, 1920, 1080, 60,
-                      false, false, StreamingPreferences::get()->videoEnhancing, true, decoder)) {
-        isHardwareAccelerated = decoder->isHardwareAccelerated();
-        isFullScreenOnly = decoder->isAlwaysFullScreen();
-        maxResolution = decoder->getDecoderMaxResolution();
-        delete decoder;
-
+    if (probeScheduler.probe(StreamingPreferences::VDS_FORCE_HARDWARE,
+                             VIDEO_FORMAT_H265, 1920, 1080, 60,
+                             enableVideoEnhancement, probe)) {
+        isHardwareAccelerated = probe.isHardwareAccelerated;
+        isFullScreenOnly = probe.isAlwaysFullScreen;
+        maxResolution = probe.maxResolution;
         return;
     }
 
 
 #if 0 // See AV1 comment at the top of this function
-    if (chooseDecoder(StreamingPreferences::VDS_FORCE_HARDWARE,
-                      window, VIDEO_FORMAT_AV1_MAIN8, 1920, 1080, 60,
-                      false, false, m_Preferences->videoEnhancing, true, decoder)) {
-        isHardwareAccelerated = decoder->isHardwareAccelerated();
-        isFullScreenOnly = decoder->isAlwaysFullScreen();
-        maxResolution = decoder->getDecoderMaxResolution();
-        delete decoder;
-
+    if (probeScheduler.probe(StreamingPreferences::VDS_FORCE_HARDWARE,
+                             VIDEO_FORMAT_AV1_MAIN8, 1920, 1080, 60,
+                             m_Preferences->videoEnhancing, probe)) {
+        isHardwareAccelerated = probe.isHardwareAccelerated;
+        isFullScreenOnly = probe.isAlwaysFullScreen;
+        maxResolution = probe.maxResolution;
         return;
     }
 #endif
 
     // If we still didn't find a hardware decoder, try H.264 now.
     // This will fall back to software decoding, so it should always work.
-    if (chooseDecoder(StreamingPreferences::VDS_AUTO,
-                      window, VIDEO_FORMAT_H264, 1920, 1080, 60,
-                      false, false, StreamingPreferences::get()->videoEnhancing, true, decoder)) {
-        isHardwareAccelerated = decoder->isHardwareAccelerated();
-        isFullScreenOnly = decoder->isAlwaysFullScreen();
-        maxResolution = decoder->getDecoderMaxResolution();
-        delete decoder;
-
+    if (probeScheduler.probe(StreamingPreferences::VDS_AUTO,
+                             VIDEO_FORMAT_H264, 1920, 1080, 60,
+                             enableVideoEnhancement, probe)) {
+        isHardwareAccelerated = probe.isHardwareAccelerated;
+        isFullScreenOnly = probe.isAlwaysFullScreen;
+        maxResolution = probe.maxResolution;
         return;
     }
 
@@ -504,38 +560,33 @@ void Session::getDecoderInfo(SDL_Window* window,
 }
 
 Session::DecoderAvailability
-Session::getDecoderAvailability(SDL_Window* window,
+Session::getDecoderAvailability(DecoderProbeScheduler& probeScheduler,
                                 StreamingPreferences::VideoDecoderSelection vds,
                                 int videoFormat, int width, int height, int frameRate)
 {
-    IVideoDecoder* decoder;
+    DecoderProbeResult probe;
 
-    if (!chooseDecoder(vds, window, videoFormat, width, height, frameRate, false, false, StreamingPreferences::get()->videoEnhancing, true, decoder)) {
+    if (!probeScheduler.probe(vds, videoFormat, width, height, frameRate, StreamingPreferences::get()->videoEnhancing, probe)) {
         return DecoderAvailability::None;
     }
 
-    bool hw = decoder->isHardwareAccelerated();
-
-    delete decoder;
-
-    return hw ? DecoderAvailability::Hardware : DecoderAvailability::Software;
+    return probe.isHardwareAccelerated ? DecoderAvailability::Hardware : DecoderAvailability::Software;
 }
 
-bool Session::populateDecoderProperties(SDL_Window* window)
+bool Session::populateDecoderProperties(DecoderProbeScheduler& probeScheduler)
 {
-    IVideoDecoder* decoder;
-
-    if (!chooseDecoder(m_Preferences->videoDecoderSelection,
-                       window,
-                       m_SupportedVideoFormats.first(),
-                       m_StreamConfig.width,
-                       m_StreamConfig.height,
-                       m_StreamConfig.fps,
-                       false, false, m_Preferences->videoEnhancing, true, decoder)) {
+    DecoderProbeResult probe;
+
+    if (!probeScheduler.probe(m_Preferences->videoDecoderSelection,
+                              m_SupportedVideoFormats.first(),
+                              m_StreamConfig.width,
+                              m_StreamConfig.height,
+                              m_StreamConfig.fps,
+                              m_Preferences->videoEnhancing, probe)) {
         return false;
     }
 
-    m_VideoCallbacks.capabilities = decoder->getDecoderCapabilities();
+    m_VideoCallbacks.capabilities = probe.capabilities;
     if (m_VideoCallbacks.capabilities & CAPABILITY_PULL_RENDERER) {
         // It is an error to pass a push callback when in pull mode
         m_VideoCallbacks.submitDecodeUnit = nullptr;
@@ -550,7 +601,7 @@ bool Session::populateDecoderProperties(SDL_Window* window)
                     m_StreamConfig.colorSpace);
     }
     else {
-        m_StreamConfig.colorSpace = decoder->getDecoderColorspace();
+        m_StreamConfig.colorSpace = probe.colorspace;
     }
 
     if (Utils::getEnvironmentVariableOverride("COLOR_RANGE_OVERRIDE", &m_StreamConfig.colorRange)) {
@@ -559,15 +610,13 @@ bool Session::populateDecoderProperties(SDL_Window* window)
                     m_StreamConfig.colorRange);
     }
     else {
-        m_StreamConfig.colorRange = decoder->getDecoderColorRange();
+        m_StreamConfig.colorRange = probe.colorRange;
     }
 
-    if (decoder->isAlwaysFullScreen()) {
+    if (probe.isAlwaysFullScreen) {
         m_IsFullScreen = true;
     }
 
-    delete decoder;
-
     return true;
 }
 
@@ -591,7 +640,18 @@ Session::Session(NvComputer* computer, NvApp& app, StreamingPreferences *prefere
       m_OpusDecoder(nullptr),
       m_AudioRenderer(nullptr),
       m_AudioSampleCount(0),
-      m_DropAudioEndTime(0)
+      m_DropAudioEndTime(0),
+      m_DecodeUnitPlayer(nullptr),
+      m_DecodeUnitRecorder(nullptr),
+      m_ReplayedFrames(0),
+      m_RejectedReplayFrames(0),
+      m_PrewarmPending(false),
+      m_PrewarmedDecoder(nullptr),
+      m_PrewarmVideoFormat(0),
+      m_PrewarmVideoWidth(0),
+      m_PrewarmVideoHeight(0),
+      m_PrewarmVideoFrameRate(0),
+      m_PrewarmVsync(false)
 #ifdef Q_OS_DARWIN
       , m_PowerAssertionId(0)
       , m_DisplayAssertionId(0)
@@ -605,6 +665,8 @@ Session::~Session()
     // NB: This may not get destroyed for a long time! Don't put any non-trivial cleanup here.
     // Use Session::exec() or DeferredSessionCleanupTask instead.
 
+    delete m_DecodeUnitPlayer;
+    delete m_DecodeUnitRecorder;
     SDL_DestroyMutex(m_DecoderLock);
 }
 
@@ -665,6 +727,24 @@ bool Session::initialize(QQuickWindow* qtWindow)
     m_StreamConfig.width = m_Preferences->width;
     m_StreamConfig.height = m_Preferences->height;
 
+    // Replay a decode unit capture instead of streaming from the host. The stream
+    // dimensions come from the capture, since those are what the DUs contain.
+    QString replayFile = qEnvironmentVariable("DECODE_UNIT_REPLAY_FILE");
+    if (!replayFile.isEmpty()) {
+        m_DecodeUnitPlayer = new DecodeUnitPlayer();
+        if (!m_DecodeUnitPlayer->setArrivalProfile(qEnvironmentVariable("DECODE_UNIT_REPLAY_PROFILE"),
+                                                   (quint32)qEnvironmentVariableIntValue("DECODE_UNIT_REPLAY_SEED")) ||
+                !m_DecodeUnitPlayer->open(replayFile, qEnvironmentVariableIntValue("DECODE_UNIT_REPLAY_UNTHROTTLED") == 0)) {
+            delete m_DecodeUnitPlayer;
+            m_DecodeUnitPlayer = nullptr;
+            SDL_QuitSubSystem(SDL_INIT_VIDEO);
+            return false;
+        }
+
+        m_StreamConfig.width = m_DecodeUnitPlayer->getWidth();
+        m_StreamConfig.height = m_DecodeUnitPlayer->getHeight();
+    }
+
     int x, y, width, height;
     getWindowDimensions(x, y, width, height);
 
@@ -744,6 +824,35 @@ bool Session::initialize(QQuickWindow* qtWindow)
                 "Audio channel mask: %X",
                 CHANNEL_MASK_FROM_AUDIO_CONFIGURATION(m_StreamConfig.audioConfiguration));
 
+    // Start checking for FFmpeg decoders for the formats that codec selection
+    // and validateLaunch() are most likely to probe.
+    DecoderProbeScheduler* probeScheduler = new DecoderProbeScheduler(testWindow);
+    {
+        QVector<int> likelyFormats;
+
+        if (m_Preferences->enableYUV444) {
+            likelyFormats.append(m_Preferences->enableHdr ? VIDEO_FORMAT_H265_REXT10_444 : VIDEO_FORMAT_H265_REXT8_444);
+            if (m_Preferences->enableHdr) {
+                likelyFormats.append(VIDEO_FORMAT_AV1_HIGH10_444);
+                likelyFormats.append(VIDEO_FORMAT_H265_REXT8_444);
+            }
+        }
+        else {
+            likelyFormats.append(m_Preferences->enableHdr ? VIDEO_FORMAT_H265_MAIN10 : VIDEO_FORMAT_H265);
+            if (m_Preferences->enableHdr) {
+                likelyFormats.append(VIDEO_FORMAT_AV1_MAIN10);
+                likelyFormats.append(VIDEO_FORMAT_H265);
+            }
+        }
+        likelyFormats.append(VIDEO_FORMAT_H264);
+
+        for (int videoFormat : std::as_const(likelyFormats)) {
+            probeScheduler->prefetch(m_Preferences->videoDecoderSelection, videoFormat,
+                                     m_StreamConfig.width, m_StreamConfig.height, m_StreamConfig.fps,
+                                     m_Preferences->videoEnhancing);
+        }
+    }
+
     // Start with all codecs and profiles in priority order
     m_SupportedVideoFormats.append(VIDEO_FORMAT_AV1_HIGH10_444);
     m_SupportedVideoFormats.append(VIDEO_FORMAT_AV1_MAIN10);
@@ -766,7 +875,7 @@ bool Session::initialize(QQuickWindow* qtWindow)
         // H.264 is already the lowest priority codec, so we don't need to do
         // any probing for deprioritization for it here.
 
-        auto hevcDA = getDecoderAvailability(testWindow,
+        auto hevcDA = getDecoderAvailability(*probeScheduler,
                                              m_Preferences->videoDecoderSelection,
                                              m_Preferences->enableYUV444 ?
                                                  (m_Preferences->enableHdr ? VIDEO_FORMAT_H265_REXT10_444 : VIDEO_FORMAT_H265_REXT8_444) :
@@ -779,7 +888,7 @@ bool Session::initialize(QQuickWindow* qtWindow)
             m_SupportedVideoFormats.removeByMask(VIDEO_FORMAT_MASK_H265 & VIDEO_FORMAT_MASK_10BIT);
 
             // Check if we have 10-bit AV1 support
-            auto av1DA = getDecoderAvailability(testWindow,
+            auto av1DA = getDecoderAvailability(*probeScheduler,
                                                 m_Preferences->videoDecoderSelection,
                                                 m_Preferences->enableYUV444 ? VIDEO_FORMAT_AV1_HIGH10_444 : VIDEO_FORMAT_AV1_MAIN10,
                                                 m_StreamConfig.width,
@@ -792,7 +901,7 @@ bool Session::initialize(QQuickWindow* qtWindow)
                 // There are no available 10-bit profiles, so reprobe for 8-bit HEVC
                 // and we'll proceed as normal for an SDR streaming scenario.
                 SDL_assert(!(m_SupportedVideoFormats & VIDEO_FORMAT_MASK_10BIT));
-                hevcDA = getDecoderAvailability(testWindow,
+                hevcDA = getDecoderAvailability(*probeScheduler,
                                                 m_Preferences->videoDecoderSelection,
                                                 m_Preferences->enableYUV444 ? VIDEO_FORMAT_H265_REXT8_444 : VIDEO_FORMAT_H265,
                                                 m_StreamConfig.width,
@@ -812,7 +921,7 @@ bool Session::initialize(QQuickWindow* qtWindow)
 
 #if 0
         // TODO: Determine if AV1 is better depending on the decoder
-        if (getDecoderAvailability(testWindow,
+        if (getDecoderAvailability(*probeScheduler,
                                    m_Preferences->videoDecoderSelection,
                                    m_Preferences->enableYUV444 ?
                                         (m_Preferences->enableHdr ? VIDEO_FORMAT_AV1_HIGH10_444 : VIDEO_FORMAT_AV1_HIGH8_444) :
@@ -963,7 +1072,7 @@ bool Session::initialize(QQuickWindow* qtWindow)
 
     // Check for validation errors/warnings and emit
     // signals for them, if appropriate
-    bool ret = validateLaunch(testWindow);
+    bool ret = validateLaunch(*probeScheduler);
 
     if (ret) {
         // Video format is now locked in
@@ -971,9 +1080,10 @@ bool Session::initialize(QQuickWindow* qtWindow)
 
         // Populate decoder-dependent properties.
         // Must be done after validateLaunch() since m_StreamConfig is finalized.
-        ret = populateDecoderProperties(testWindow);
+        ret = populateDecoderProperties(*probeScheduler);
     }
 
+    delete probeScheduler;
     SDL_DestroyWindow(testWindow);
 
     if (!ret) {
@@ -993,8 +1103,26 @@ void Session::emitLaunchWarning(QString text)
     }
 }
 
-bool Session::validateLaunch(SDL_Window* testWindow)
+bool Session::validateLaunch(DecoderProbeScheduler& probeScheduler)
 {
+    if (m_DecodeUnitPlayer != nullptr) {
+        // There's no host to validate against. The capture dictates the video format.
+        m_SupportedVideoFormats.clear();
+        m_SupportedVideoFormats.append(m_DecodeUnitPlayer->getVideoFormat());
+
+        if (getDecoderAvailability(probeScheduler,
+                                   m_Preferences->videoDecoderSelection,
+                                   m_DecodeUnitPlayer->getVideoFormat(),
+                                   m_DecodeUnitPlayer->getWidth(),
+                                   m_DecodeUnitPlayer->getHeight(),
+                                   m_DecodeUnitPlayer->getFrameRate()) == DecoderAvailability::None) {
+            emit displayLaunchError(tr("No video decoder is available for the format of this capture."));
+            return false;
+        }
+
+        return true;
+    }
+
     if (!m_Computer->isSupportedServerVersion) {
         emit displayLaunchError(tr("The version of GeForce Experience on %1 is not supported by this build of Moonlight. You must update Moonlight to stream from %1.").arg(m_Computer->name));
         return false;
@@ -1023,7 +1151,7 @@ bool Session::validateLaunch(SDL_Window* testWindow)
             if (!m_Preferences->enableHdr && // HDR is checked below
                  m_Preferences->videoDecoderSelection == StreamingPreferences::VDS_AUTO && // Force hardware decoding checked below
                  m_Preferences->videoCodecConfig != StreamingPreferences::VCC_AUTO && // Auto VCC is already checked in initialize()
-                 getDecoderAvailability(testWindow,
+                 getDecoderAvailability(probeScheduler,
                                         m_Preferences->videoDecoderSelection,
                                         VIDEO_FORMAT_AV1_MAIN8,
                                         m_StreamConfig.width,
@@ -1053,7 +1181,7 @@ bool Session::validateLaunch(SDL_Window* testWindow)
             if (!m_Preferences->enableHdr && // HDR is checked below
                  m_Preferences->videoDecoderSelection == StreamingPreferences::VDS_AUTO && // Force hardware decoding checked below
                  m_Preferences->videoCodecConfig != StreamingPreferences::VCC_AUTO && // Auto VCC is already checked in initialize()
-                 getDecoderAvailability(testWindow,
+                 getDecoderAvailability(probeScheduler,
                                         m_Preferences->videoDecoderSelection,
                                         VIDEO_FORMAT_H265,
                                         m_StreamConfig.width,
@@ -1070,7 +1198,7 @@ bool Session::validateLaunch(SDL_Window* testWindow)
 
     if (!(m_SupportedVideoFormats & ~VIDEO_FORMAT_MASK_H264) &&
             m_Preferences->videoDecoderSelection == StreamingPreferences::VDS_AUTO &&
-            getDecoderAvailability(testWindow,
+            getDecoderAvailability(probeScheduler,
                                    m_Preferences->videoDecoderSelection,
                                    VIDEO_FORMAT_H264,
                                    m_StreamConfig.width,
@@ -1082,7 +1210,7 @@ bool Session::validateLaunch(SDL_Window* testWindow)
         }
         else {
             if (m_Computer->maxLumaPixelsHEVC == 0 &&
-                    getDecoderAvailability(testWindow,
+                    getDecoderAvailability(probeScheduler,
                                            m_Preferences->videoDecoderSelection,
                                            VIDEO_FORMAT_H265,
                                            m_StreamConfig.width,
@@ -1114,7 +1242,7 @@ bool Session::validateLaunch(SDL_Window* testWindow)
 
             // Check that the available HDR-capable codecs on the client and server are compatible
             if (m_SupportedVideoFormats.maskByServerCodecModes(m_Computer->serverCodecModeSupport & SCM_AV1_MAIN10)) {
-                auto da = getDecoderAvailability(testWindow,
+                auto da = getDecoderAvailability(probeScheduler,
                                                  m_Preferences->videoDecoderSelection,
                                                  VIDEO_FORMAT_AV1_MAIN10,
                                                  m_StreamConfig.width,
@@ -1132,7 +1260,7 @@ bool Session::validateLaunch(SDL_Window* testWindow)
                 }
             }
             if (m_SupportedVideoFormats.maskByServerCodecModes(m_Computer->serverCodecModeSupport & SCM_HEVC_MAIN10)) {
-                auto da = getDecoderAvailability(testWindow,
+                auto da = getDecoderAvailability(probeScheduler,
                                                  m_Preferences->videoDecoderSelection,
                                                  VIDEO_FORMAT_H265_MAIN10,
                                                  m_StreamConfig.width,
@@ -1174,7 +1302,7 @@ bool Session::validateLaunch(SDL_Window* testWindow)
             else if (m_Preferences->videoDecoderSelection != StreamingPreferences::VDS_FORCE_SOFTWARE) {
                 while (!m_SupportedVideoFormats.isEmpty() &&
                        (m_SupportedVideoFormats.front() & VIDEO_FORMAT_MASK_YUV444) &&
-                       getDecoderAvailability(testWindow,
+                       getDecoderAvailability(probeScheduler,
                                               m_Preferences->videoDecoderSelection,
                                               m_SupportedVideoFormats.front(),
                                               m_StreamConfig.width,
@@ -1254,7 +1382,7 @@ bool Session::validateLaunch(SDL_Window* testWindow)
 
     if (m_Preferences->videoDecoderSelection == StreamingPreferences::VDS_FORCE_HARDWARE &&
             !(m_SupportedVideoFormats & VIDEO_FORMAT_MASK_10BIT) && // HDR was already checked for hardware decode support above
-            getDecoderAvailability(testWindow,
+            getDecoderAvailability(probeScheduler,
                                    m_Preferences->videoDecoderSelection,
                                    m_SupportedVideoFormats.front(),
                                    m_StreamConfig.width,
@@ -1297,7 +1425,8 @@ private:
         // Only quit the running app if our session terminated gracefully
         bool shouldQuit =
                 !m_Session->m_UnexpectedTermination &&
-                m_Session->m_Preferences->quitAppAfter;
+                m_Session->m_Preferences->quitAppAfter &&
+                m_Session->m_DecodeUnitPlayer == nullptr;
 
         // Notify the UI
         if (shouldQuit) {
@@ -1313,7 +1442,19 @@ private:
         SDL_assert(m_Session->m_VideoDecoder == nullptr);
 
         // Finish cleanup of the connection state
-        LiStopConnection();
+        if (m_Session->m_DecodeUnitPlayer == nullptr) {
+            LiStopConnection();
+        }
+
+        // The decoder is gone, so nothing else can be using these
+        if (m_Session->m_DecodeUnitPlayer != nullptr) {
+            m_Session->m_ReplayedFrames = m_Session->m_DecodeUnitPlayer->getReplayedFrames();
+            m_Session->m_RejectedReplayFrames = m_Session->m_DecodeUnitPlayer->getRejectedFrames();
+        }
+        delete m_Session->m_DecodeUnitPlayer;
+        m_Session->m_DecodeUnitPlayer = nullptr;
+        delete m_Session->m_DecodeUnitRecorder;
+        m_Session->m_DecodeUnitRecorder = nullptr;
 
         // Perform a best-effort app quit
         if (shouldQuit) {
@@ -1351,7 +1492,8 @@ void Session::getWindowDimensions(int& x, int& y,
     // Create our window on the same display that Qt's UI
     // was being displayed on.
     else {
-        Q_ASSERT(m_QtWindow != nullptr);
+        // Headless replays from the command line have no Qt UI
+        Q_ASSERT(m_QtWindow != nullptr || m_DecodeUnitPlayer != nullptr);
         if (m_QtWindow != nullptr) {
             QScreen* screen = m_QtWindow->screen();
             if (screen != nullptr) {
@@ -1635,6 +1777,20 @@ bool Session::startConnectionAsync()
                    m_Preferences->debandEnabled ? "on" : "off",
                    m_Preferences->debandStrength);
 #endif
+    if (m_DecodeUnitPlayer != nullptr) {
+        // Nothing to negotiate with the host. Just set up the video stream
+        // the way the capture describes it.
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Skipping host connection for decode unit replay");
+        drSetup(m_DecodeUnitPlayer->getVideoFormat(),
+                m_DecodeUnitPlayer->getWidth(),
+                m_DecodeUnitPlayer->getHeight(),
+                m_DecodeUnitPlayer->getFrameRate(),
+                nullptr, 0);
+        emit connectionStarted();
+        return true;
+    }
+
     // The UI should have ensured the old game was already quit
     // if we decide to stream a different game.
     Q_ASSERT(m_Computer->currentGameId == 0 ||
@@ -1843,6 +1999,15 @@ void Session::start()
     // NB: m_InputHandler must be initialize before starting the connection.
     m_InputHandler = new SdlInputHandler(*m_Preferences, m_StreamConfig.width, m_StreamConfig.height);
 
+    // Build the decoder on the main thread while the connection is being established.
+    // This is queued ahead of exec(), so it always runs first.
+    if (qEnvironmentVariableIntValue("DECODER_PREWARM") != 0 || !qEnvironmentVariableIsSet("DECODER_PREWARM")) {
+        m_PrewarmPending = true;
+        QMetaObject::invokeMethod(this, [this]() {
+            prewarmDecoder();
+        }, Qt::QueuedConnection);
+    }
+
     // Kick off the async connection thread then return to the caller to pump the event loop
     auto thread = new AsyncConnectionStartThread(this);
     QObject::connect(thread, &QThread::finished, this, &Session::exec);
@@ -1862,23 +2027,8 @@ void Session::interrupt()
     SDL_PushEvent(&event);
 }
 
-void Session::exec()
+bool Session::createWindow(Uint32 extraFlags)
 {
-    // If the connection failed, clean up and abort the connection.
-    if (!m_AsyncConnectionSuccess) {
-        delete m_InputHandler;
-        m_InputHandler = nullptr;
-        SDL_QuitSubSystem(SDL_INIT_VIDEO);
-        QThreadPool::globalInstance()->start(new DeferredSessionCleanupTask(this));
-        return;
-    }
-
-    // Pump the Qt event loop one last time before we create our SDL window
-    // This is sometimes necessary for the QML code to process any signals
-    // we've emitted from the async connection thread.
-    QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-    QCoreApplication::sendPostedEvents();
-
     int x, y, width, height;
     getWindowDimensions(x, y, width, height);
 
@@ -1936,7 +2086,7 @@ void Session::exec()
                                 y,
                                 width,
                                 height,
-                                defaultWindowFlags | StreamUtils::getPlatformWindowFlags());
+                                defaultWindowFlags | extraFlags | StreamUtils::getPlatformWindowFlags());
     if (!m_Window) {
         SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
                     "SDL_CreateWindow() failed with platform flags: %s",
@@ -1947,22 +2097,16 @@ void Session::exec()
                                     y,
                                     width,
                                     height,
-                                    defaultWindowFlags);
+                                    defaultWindowFlags | extraFlags);
         if (!m_Window) {
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                          "SDL_CreateWindow() failed: %s",
                          SDL_GetError());
 
-            delete m_InputHandler;
-            m_InputHandler = nullptr;
-            SDL_QuitSubSystem(SDL_INIT_VIDEO);
-            QThreadPool::globalInstance()->start(new DeferredSessionCleanupTask(this));
-            return;
+            return false;
         }
     }
 
-    m_InputHandler->setWindow(m_Window);
-
     QSvgRenderer svgIconRenderer(QString(":/res/moonlight.svg"));
     QImage svgImage(ICON_SIZE, ICON_SIZE, QImage::Format_RGBA8888);
     svgImage.fill(0);
@@ -1984,6 +2128,163 @@ void Session::exec()
     }
 #endif
 
+    // SDL keeps its own copy of the icon
+    if (iconSurface != nullptr) {
+        SDL_FreeSurface(iconSurface);
+    }
+
+    return true;
+}
+
+bool Session::isVsyncUsable()
+{
+    // If the stream exceeds the display refresh rate (plus some slack),
+    // forcefully disable V-sync to allow the stream to render faster
+    // than the display.
+    int displayHz = StreamUtils::getDisplayRefreshRate(m_Window);
+    if (m_Preferences->enableVsync && displayHz + 5 < m_StreamConfig.fps) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Disabling V-sync because refresh rate limit exceeded");
+        return false;
+    }
+
+    return m_Preferences->enableVsync;
+}
+
+// Runs on the main thread while the connection is being established
+void Session::prewarmDecoder()
+{
+    // Too late if we've already started streaming
+    if (!m_PrewarmPending) {
+        return;
+    }
+    m_PrewarmPending = false;
+
+    // We must build the decoder for the window we'll actually stream in,
+    // so create it now but keep it hidden until exec() shows it. The window
+    // stays windowed until exec() enters full-screen, and the renderer gets
+    // that size change like any other through notifyWindowChanged().
+    if (!createWindow(SDL_WINDOW_HIDDEN)) {
+        return;
+    }
+
+    // Assume we'll get the stream we asked for. If the host negotiates
+    // something else, this decoder will just be thrown away.
+    if (m_DecodeUnitPlayer != nullptr) {
+        m_PrewarmVideoFormat = m_DecodeUnitPlayer->getVideoFormat();
+        m_PrewarmVideoWidth = m_DecodeUnitPlayer->getWidth();
+        m_PrewarmVideoHeight = m_DecodeUnitPlayer->getHeight();
+        m_PrewarmVideoFrameRate = m_DecodeUnitPlayer->getFrameRate();
+    }
+    else {
+        m_PrewarmVideoFormat = m_SupportedVideoFormats.front();
+        m_PrewarmVideoWidth = m_StreamConfig.width;
+        m_PrewarmVideoHeight = m_StreamConfig.height;
+        m_PrewarmVideoFrameRate = m_StreamConfig.fps;
+    }
+    m_PrewarmVsync = isVsyncUsable();
+
+    // The decoder is built on this thread, since it's the one that will
+    // render with it (or hand it to the render thread) once exec() adopts it
+    uint64_t startTimeUs = LiGetMicroseconds();
+    if (!chooseDecoder(m_Preferences->videoDecoderSelection,
+                       m_Window, m_PrewarmVideoFormat, m_PrewarmVideoWidth,
+                       m_PrewarmVideoHeight, m_PrewarmVideoFrameRate,
+                       m_PrewarmVsync,
+                       m_PrewarmVsync && m_Preferences->framePacing,
+                       m_Preferences->videoEnhancing,
+                       false,
+                       true,
+                       m_PrewarmedDecoder)) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Failed to prewarm decoder. It will be created after connecting.");
+        m_PrewarmedDecoder = nullptr;
+        return;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Prewarmed decoder for %dx%dx%d (format 0x%x) in %.2f ms",
+                m_PrewarmVideoWidth, m_PrewarmVideoHeight, m_PrewarmVideoFrameRate,
+                m_PrewarmVideoFormat, (LiGetMicroseconds() - startTimeUs) / 1000.0);
+}
+
+bool Session::adoptPrewarmedDecoder()
+{
+    IVideoDecoder* decoder = m_PrewarmedDecoder;
+    m_PrewarmedDecoder = nullptr;
+
+    if (decoder == nullptr) {
+        return false;
+    }
+
+    if (m_PrewarmVideoFormat != m_ActiveVideoFormat ||
+            m_PrewarmVideoWidth != m_ActiveVideoWidth ||
+            m_PrewarmVideoHeight != m_ActiveVideoHeight ||
+            m_PrewarmVideoFrameRate != m_ActiveVideoFrameRate ||
+            m_PrewarmVsync != isVsyncUsable()) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Discarding prewarmed decoder for %dx%dx%d (format 0x%x)",
+                    m_PrewarmVideoWidth, m_PrewarmVideoHeight, m_PrewarmVideoFrameRate,
+                    m_PrewarmVideoFormat);
+        delete decoder;
+        return false;
+    }
+
+    if (!decoder->startDecoding()) {
+        delete decoder;
+        return false;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Using prewarmed decoder");
+
+    SDL_LockMutex(m_DecoderLock);
+    m_VideoDecoder = decoder;
+    SDL_UnlockMutex(m_DecoderLock);
+
+    return true;
+}
+
+void Session::exec()
+{
+    // Prewarming is pointless once we get here
+    m_PrewarmPending = false;
+
+    // If the connection failed, clean up and abort the connection.
+    if (!m_AsyncConnectionSuccess) {
+        delete m_PrewarmedDecoder;
+        m_PrewarmedDecoder = nullptr;
+        if (m_Window != nullptr) {
+            SDL_DestroyWindow(m_Window);
+            m_Window = nullptr;
+        }
+        delete m_InputHandler;
+        m_InputHandler = nullptr;
+        SDL_QuitSubSystem(SDL_INIT_VIDEO);
+        QThreadPool::globalInstance()->start(new DeferredSessionCleanupTask(this));
+        return;
+    }
+
+    // Pump the Qt event loop one last time before we create our SDL window
+    // This is sometimes necessary for the QML code to process any signals
+    // we've emitted from the async connection thread.
+    QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
+    QCoreApplication::sendPostedEvents();
+
+    // The window already exists if we created it to prewarm the decoder
+    if (m_Window != nullptr) {
+        SDL_ShowWindow(m_Window);
+    }
+    else if (!createWindow(0)) {
+        delete m_InputHandler;
+        m_InputHandler = nullptr;
+        SDL_QuitSubSystem(SDL_INIT_VIDEO);
+        QThreadPool::globalInstance()->start(new DeferredSessionCleanupTask(this));
+        return;
+    }
+
+    m_InputHandler->setWindow(m_Window);
+
     // Update the window display mode based on our current monitor
     // for if/when we enter full-screen mode.
     updateOptimalWindowDisplayMode();
@@ -2009,6 +2310,22 @@ void Session::exec()
         needsPostDecoderCreationCapture = true;
     }
 
+    // Use the decoder we built during the connection handshake if it matches
+    // the negotiated stream. Otherwise, we'll create one when the window is shown.
+    if (adoptPrewarmedDecoder()) {
+        if (needsPostDecoderCreationCapture) {
+            m_InputHandler->setCaptureActive(true);
+            needsPostDecoderCreationCapture = false;
+        }
+
+        if (m_DecodeUnitPlayer == nullptr) {
+            LiRequestIdrFrame();
+        }
+
+        m_VideoDecoder->setHdrMode(LiGetCurrentHostDisplayHdrMode());
+        m_InputHandler->updatePointerRegionLock();
+    }
+
     // Stop text input. SDL enables it by default
     // when we initialize the video subsystem, but this
     // causes an IME popup when certain keys are held down
@@ -2311,16 +2628,7 @@ void Session::exec()
             SDL_FlushEvent(SDL_RENDER_DEVICE_RESET);
 
             {
-                // If the stream exceeds the display refresh rate (plus some slack),
-                // forcefully disable V-sync to allow the stream to render faster
-                // than the display.
-                int displayHz = StreamUtils::getDisplayRefreshRate(m_Window);
-                bool enableVsync = m_Preferences->enableVsync;
-                if (displayHz + 5 < m_StreamConfig.fps) {
-                    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
-                                "Disabling V-sync because refresh rate limit exceeded");
-                    enableVsync = false;
-                }
+                bool enableVsync = isVsyncUsable();
 
                 // Choose a new decoder (hopefully the same one, but possibly
                 // not if a GPU was removed or something).
@@ -2331,10 +2639,15 @@ void Session::exec()
                                    enableVsync && m_Preferences->framePacing,
                                    m_Preferences->videoEnhancing,
                                    false,
+                                   false,
                                    s_ActiveSession->m_VideoDecoder)) {
                     SDL_UnlockMutex(m_DecoderLock);
                     SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                                  "Failed to recreate decoder after reset");
+
+                    // Our cached probe results said this would work, so don't trust them next time
+                    DecoderCapabilityCache::get().invalidate();
+
                     emit displayLaunchError(tr("Unable to initialize video decoder. Please check your streaming settings and try again."));
                     goto DispatchDeferredCleanup;
                 }
@@ -2348,8 +2661,11 @@ void Session::exec()
                 }
             }
 
-            // Request an IDR frame to complete the reset
-            LiRequestIdrFrame();
+            // Request an IDR frame to complete the reset. A replay can't produce
+            // one on demand, so the decoder will just wait for the next IDR frame.
+            if (m_DecodeUnitPlayer == nullptr) {
+                LiRequestIdrFrame();
+            }
 
             // Set HDR mode. We may miss the callback if we're in the middle
             // of recreating our decoder at the time the HDR transition happens.
@@ -2474,6 +2790,11 @@ DispatchDeferredCleanup:
     m_VideoDecoder = nullptr;
     SDL_UnlockMutex(m_DecoderLock);
 
+    // Dump the per-frame timeline if the user asked for it at session end
+    if (qEnvironmentVariableIsSet("FRAME_TIMELINE_FILE")) {
+        m_FrameTimeline.dumpChromeTrace(FrameTimeline::getDefaultDumpPath());
+    }
+
     // Propagate state changes from the SDL window back to the Qt window
     //
     // NB: We're making a conscious decision not to propagate the maximized
@@ -2503,10 +2824,6 @@ DispatchDeferredCleanup:
     // the renderer may want to interact with the window
     SDL_DestroyWindow(m_Window);
 
-    if (iconSurface != nullptr) {
-        SDL_FreeSurface(iconSurface);
-    }
-
     SDL_QuitSubSystem(SDL_INIT_VIDEO);
 
     // Cleanup can take a while, so dispatch it to a worker thread.
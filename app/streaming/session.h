@@ -10,6 +10,10 @@
 #include "video/decoder.h"
 #include "audio/renderers/renderer.h"
 #include "video/overlaymanager.h"
+#include "video/decodeunitcapture.h"
+#include "video/frametimeline.h"
+#include "video/capabilitycache.h"
+#include "video/probescheduler.h"
 
 class SupportedVideoFormatList : public QList<int>
 {
@@ -96,6 +100,7 @@ class Session : public QObject
     friend class SdlInputHandler;
     friend class DeferredSessionCleanupTask;
     friend class AsyncConnectionStartThread;
+    friend class DecoderProbeScheduler;
 
 public:
     explicit Session(NvComputer* computer, NvApp& app, StreamingPreferences *preferences = nullptr);
@@ -107,7 +112,7 @@ public:
     Q_PROPERTY(QStringList launchWarnings MEMBER m_LaunchWarnings NOTIFY launchWarningsChanged);
 
     static
-    void getDecoderInfo(SDL_Window* window,
+    void getDecoderInfo(DecoderProbeScheduler& probeScheduler,
                         bool& isHardwareAccelerated, bool& isFullScreenOnly,
                         bool& isHdrSupported, QSize& maxResolution);
 
@@ -126,6 +131,30 @@ public:
         return m_Preferences;
     }
 
+    FrameTimeline& getFrameTimeline()
+    {
+        return m_FrameTimeline;
+    }
+
+    // Non-null when the decoder should be fed from a capture file instead of the host
+    DecodeUnitPlayer* getDecodeUnitPlayer()
+    {
+        return m_DecodeUnitPlayer;
+    }
+
+    // Non-null when DUs received from the host should be captured to a file
+    DecodeUnitRecorder* getDecodeUnitRecorder()
+    {
+        return m_DecodeUnitRecorder;
+    }
+
+    // Frames the decoder accepted and rejected during the last decode unit replay
+    void getDecodeUnitReplayResult(int& replayedFrames, int& rejectedFrames)
+    {
+        replayedFrames = m_ReplayedFrames;
+        rejectedFrames = m_RejectedReplayFrames;
+    }
+
     void flushWindowEvents();
 
     void setShouldExit(bool quitHostApp = false);
@@ -153,11 +182,11 @@ private:
 
     bool startConnectionAsync();
 
-    bool validateLaunch(SDL_Window* testWindow);
+    bool validateLaunch(DecoderProbeScheduler& probeScheduler);
 
     void emitLaunchWarning(QString text);
 
-    bool populateDecoderProperties(SDL_Window* window);
+    bool populateDecoderProperties(DecoderProbeScheduler& probeScheduler);
 
     IAudioRenderer* createAudioRenderer(const POPUS_MULTISTREAM_CONFIGURATION opusConfig);
 
@@ -176,6 +205,14 @@ private:
 
     void updateOptimalWindowDisplayMode();
 
+    bool createWindow(Uint32 extraFlags);
+
+    bool isVsyncUsable();
+
+    void prewarmDecoder();
+
+    bool adoptPrewarmedDecoder();
+
     enum class DecoderAvailability {
         None,
         Software,
@@ -183,7 +220,7 @@ private:
     };
 
     static
-    DecoderAvailability getDecoderAvailability(SDL_Window* window,
+    DecoderAvailability getDecoderAvailability(DecoderProbeScheduler& probeScheduler,
                                                StreamingPreferences::VideoDecoderSelection vds,
                                                int videoFormat, int width, int height, int frameRate);
 
@@ -192,7 +229,13 @@ private:
                        SDL_Window* window, int videoFormat, int width, int height,
                        int frameRate, bool enableVsync, bool enableFramePacing,
                        bool enableVideoEnhancement, bool testOnly,
-                       IVideoDecoder*& chosenDecoder);
+                       bool prewarm, IVideoDecoder*& chosenDecoder);
+
+    static
+    bool probeDecoder(StreamingPreferences::VideoDecoderSelection vds,
+                      SDL_Window* window, int videoFormat, int width, int height,
+                      int frameRate, bool enableVideoEnhancement,
+                      DecoderProbeResult& result);
 
     static
     void clStageStarting(int stage);
@@ -285,6 +328,21 @@ private:
     Uint32 m_DropAudioEndTime;
 
     Overlay::OverlayManager m_OverlayManager;
+    FrameTimeline m_FrameTimeline;
+
+    DecodeUnitPlayer* m_DecodeUnitPlayer;
+    DecodeUnitRecorder* m_DecodeUnitRecorder;
+    int m_ReplayedFrames;
+    int m_RejectedReplayFrames;
+
+    // Decoder built speculatively while the connection is established
+    bool m_PrewarmPending;
+    IVideoDecoder* m_PrewarmedDecoder;
+    int m_PrewarmVideoFormat;
+    int m_PrewarmVideoWidth;
+    int m_PrewarmVideoHeight;
+    int m_PrewarmVideoFrameRate;
+    bool m_PrewarmVsync;
 
 #ifdef Q_OS_DARWIN
     uint32_t m_PowerAssertionId;
@@ -3,6 +3,11 @@
 #include <Qt>
 #include <QDir>
 
+#include <Limelight.h>
+
+#include <chrono>
+#include <thread>
+
 #ifdef Q_OS_DARWIN
 #include <ApplicationServices/ApplicationServices.h>
 #endif
@@ -429,3 +434,23 @@ void StreamUtils::exitAsyncLoggingMode()
 {
     g_AsyncLoggingEnabled.deref();
 }
+
+// Timer slack means a sleep can overshoot by up to about this much,
+// so we spin for the last part of a wait instead of sleeping.
+#ifdef Q_OS_WINDOWS
+#define PRECISE_WAIT_SPIN_US 1500
+#else
+#define PRECISE_WAIT_SPIN_US 250
+#endif
+
+void StreamUtils::waitUntilUs(uint64_t deadlineUs)
+{
+    uint64_t nowUs = LiGetMicroseconds();
+    if (nowUs + PRECISE_WAIT_SPIN_US < deadlineUs) {
+        std::this_thread::sleep_for(std::chrono::microseconds(deadlineUs - nowUs - PRECISE_WAIT_SPIN_US));
+    }
+
+    while (LiGetMicroseconds() < deadlineUs) {
+        std::this_thread::yield();
+    }
+}
@@ -37,4 +37,9 @@ public:
 
     static
     void exitAsyncLoggingMode();
+
+    // Sleeps until the given LiGetMicroseconds() time with sub-millisecond
+    // accuracy by sleeping for most of the wait and spinning for the rest
+    static
+    void waitUntilUs(uint64_t deadlineUs);
 };
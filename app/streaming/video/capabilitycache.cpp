@@ -0,0 +1,284 @@
+#include "capabilitycache.h"
+#include "path.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QJsonDocument>
+#include <QSysInfo>
+
+#include "SDL_compat.h"
+
+#ifdef HAVE_FFMPEG
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+}
+#endif
+
+#ifdef HAVE_LIBVA
+#include <va/va.h>
+#endif
+
+#ifdef HAVE_LIBPLACEBO_VULKAN
+#include <libplacebo/config.h>
+#endif
+
+#ifdef Q_OS_WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <dxgi.h>
+#endif
+
+#define CACHE_FILE_NAME "decodercaps.json"
+
+// Bump this if the format of the cached entries changes
+#define CACHE_FORMAT_VERSION 1
+
+DecoderCapabilityCache& DecoderCapabilityCache::get()
+{
+    static DecoderCapabilityCache s_Cache;
+    return s_Cache;
+}
+
+DecoderCapabilityCache::DecoderCapabilityCache()
+    : m_Enabled(qEnvironmentVariableIntValue("DECODER_CAPABILITY_CACHE") != 0 ||
+                !qEnvironmentVariableIsSet("DECODER_CAPABILITY_CACHE")),
+      m_Loaded(false),
+      m_Dirty(false)
+{
+}
+
+QString DecoderCapabilityCache::computeSystemIdentity()
+{
+    QStringList parts;
+
+    parts << QString::number(CACHE_FORMAT_VERSION)
+          << VERSION_STR
+          << QSysInfo::kernelVersion()
+          << QSysInfo::productVersion()
+          << QSysInfo::currentCpuArchitecture()
+          << QGuiApplication::platformName()
+          << SDL_GetCurrentVideoDriver();
+
+    SDL_version sdlVersion;
+    SDL_GetVersion(&sdlVersion);
+    parts << QString("SDL %1.%2.%3").arg(sdlVersion.major).arg(sdlVersion.minor).arg(sdlVersion.patch);
+
+    // Renderer selection and HDR support depend on the attached displays
+    for (int i = 0; i < SDL_GetNumVideoDisplays(); i++) {
+        SDL_DisplayMode mode;
+        if (SDL_GetDesktopDisplayMode(i, &mode) == 0) {
+            parts << QString("Display %1: %2x%3x%4 %5")
+                     .arg(SDL_GetDisplayName(i))
+                     .arg(mode.w).arg(mode.h).arg(mode.refresh_rate)
+                     .arg(SDL_GetPixelFormatName(mode.format));
+        }
+    }
+
+#ifdef HAVE_FFMPEG
+    parts << QString("FFmpeg %1 avcodec %2 avutil %3")
+             .arg(av_version_info())
+             .arg(avcodec_version())
+             .arg(avutil_version());
+#endif
+
+#ifdef HAVE_LIBVA
+    parts << QString("libva " VA_VERSION_S) << qEnvironmentVariable("LIBVA_DRIVER_NAME");
+#endif
+
+#ifdef HAVE_LIBPLACEBO_VULKAN
+    parts << QString("libplacebo %1").arg(PL_API_VER);
+#endif
+
+#if defined(Q_OS_WIN32)
+    // Enumerating adapters doesn't initialize the driver, so it's cheap
+    IDXGIFactory1* factory;
+    if (SUCCEEDED(CreateDXGIFactory1(__uuidof(IDXGIFactory1), (void**)&factory))) {
+        IDXGIAdapter1* adapter;
+        for (UINT i = 0; factory->EnumAdapters1(i, &adapter) != DXGI_ERROR_NOT_FOUND; i++) {
+            DXGI_ADAPTER_DESC1 desc;
+            LARGE_INTEGER umdVersion = {};
+
+            if (SUCCEEDED(adapter->GetDesc1(&desc))) {
+                adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &umdVersion);
+                parts << QString("GPU %1 %2:%3 %4")
+                         .arg(QString::fromWCharArray(desc.Description))
+                         .arg(desc.VendorId, 4, 16, QChar('0'))
+                         .arg(desc.DeviceId, 4, 16, QChar('0'))
+                         .arg(umdVersion.QuadPart);
+            }
+            adapter->Release();
+        }
+        factory->Release();
+    }
+#elif defined(Q_OS_LINUX)
+    // PCI IDs and kernel driver of each DRM device
+    for (const QFileInfo& card : QDir("/sys/class/drm").entryInfoList({ "card*" }, QDir::Dirs | QDir::NoDotAndDotDot)) {
+        QDir deviceDir(card.absoluteFilePath() + "/device");
+        if (!deviceDir.exists()) {
+            continue;
+        }
+
+        QFile vendorFile(deviceDir.filePath("vendor"));
+        QFile deviceFile(deviceDir.filePath("device"));
+        QString vendor = vendorFile.open(QIODevice::ReadOnly) ? vendorFile.readAll().trimmed() : QString();
+        QString device = deviceFile.open(QIODevice::ReadOnly) ? deviceFile.readAll().trimmed() : QString();
+        parts << QString("GPU %1 %2:%3 %4")
+                 .arg(card.fileName(), vendor, device,
+                      QFileInfo(deviceDir.filePath("driver")).symLinkTarget());
+    }
+
+    // The proprietary NVIDIA driver reports its version here
+    QFile nvidiaVersion("/proc/driver/nvidia/version");
+    if (nvidiaVersion.open(QIODevice::ReadOnly)) {
+        parts << QString::fromUtf8(nvidiaVersion.readLine()).trimmed();
+    }
+
+    // We can't query the Mesa/VA driver version without loading it, but
+    // package upgrades replace the files and change these directories.
+    QStringList driverDirs = {
+        "/usr/lib/dri",
+        "/usr/lib64/dri",
+        "/usr/lib/x86_64-linux-gnu/dri",
+        "/usr/lib/aarch64-linux-gnu/dri",
+        "/usr/lib/arm-linux-gnueabihf/dri",
+        "/usr/share/vulkan/icd.d",
+    };
+    driverDirs << qEnvironmentVariable("LIBVA_DRIVERS_PATH").split(':');
+    for (const QString& dir : std::as_const(driverDirs)) {
+        QFileInfo info(dir);
+        if (!dir.isEmpty() && info.exists()) {
+            parts << QString("%1 %2").arg(dir).arg(info.lastModified().toSecsSinceEpoch());
+        }
+    }
+#endif
+
+    return QCryptographicHash::hash(parts.join('\n').toUtf8(), QCryptographicHash::Sha256).toHex();
+}
+
+void DecoderCapabilityCache::loadIfNeeded()
+{
+    if (m_Loaded) {
+        return;
+    }
+
+    m_Loaded = true;
+    m_Identity = computeSystemIdentity();
+
+    QFile cacheFile(Path::getCacheFileInfo(CACHE_FILE_NAME).absoluteFilePath());
+    if (!cacheFile.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QJsonObject root = QJsonDocument::fromJson(cacheFile.readAll()).object();
+    if (root.value("identity").toString() != m_Identity) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "System configuration changed. Decoder capability cache is stale.");
+        return;
+    }
+
+    m_Entries = root.value("entries").toObject();
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Loaded %d cached decoder probe results",
+                (int)m_Entries.size());
+}
+
+void DecoderCapabilityCache::save()
+{
+    QJsonObject persistentEntries;
+    for (auto it = m_Entries.constBegin(); it != m_Entries.constEnd(); ++it) {
+        if (it->toObject().value("available").toBool()) {
+            persistentEntries.insert(it.key(), it.value());
+        }
+    }
+
+    QJsonObject root;
+    root.insert("identity", m_Identity);
+    root.insert("entries", persistentEntries);
+
+    Path::writeCacheFile(CACHE_FILE_NAME, QJsonDocument(root).toJson(QJsonDocument::Compact));
+}
+
+bool DecoderCapabilityCache::lookup(const QString& probeKey, DecoderProbeResult& result)
+{
+    if (!m_Enabled) {
+        return false;
+    }
+
+    QMutexLocker locker(&m_Lock);
+
+    loadIfNeeded();
+
+    auto it = m_Entries.constFind(probeKey);
+    if (it == m_Entries.constEnd()) {
+        return false;
+    }
+
+    QJsonObject entry = it->toObject();
+    result.available = entry.value("available").toBool();
+    result.isHardwareAccelerated = entry.value("hw").toBool();
+    result.isAlwaysFullScreen = entry.value("fullScreenOnly").toBool();
+    result.isHdrSupported = entry.value("hdr").toBool();
+    result.maxResolution = QSize(entry.value("maxWidth").toInt(), entry.value("maxHeight").toInt());
+    result.capabilities = entry.value("capabilities").toInt();
+    result.colorspace = entry.value("colorspace").toInt();
+    result.colorRange = entry.value("colorRange").toInt();
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Using cached decoder probe result for %s",
+                qPrintable(probeKey));
+    return true;
+}
+
+void DecoderCapabilityCache::store(const QString& probeKey, const DecoderProbeResult& result)
+{
+    if (!m_Enabled) {
+        return;
+    }
+
+    QMutexLocker locker(&m_Lock);
+
+    loadIfNeeded();
+
+    QJsonObject entry;
+    entry.insert("available", result.available);
+    entry.insert("hw", result.isHardwareAccelerated);
+    entry.insert("fullScreenOnly", result.isAlwaysFullScreen);
+    entry.insert("hdr", result.isHdrSupported);
+    entry.insert("maxWidth", result.maxResolution.width());
+    entry.insert("maxHeight", result.maxResolution.height());
+    entry.insert("capabilities", result.capabilities);
+    entry.insert("colorspace", result.colorspace);
+    entry.insert("colorRange", result.colorRange);
+    m_Entries.insert(probeKey, entry);
+
+    // Failed probes are only kept in memory
+    if (result.available) {
+        m_Dirty = true;
+    }
+}
+
+void DecoderCapabilityCache::flush()
+{
+    QMutexLocker locker(&m_Lock);
+
+    if (m_Dirty) {
+        save();
+        m_Dirty = false;
+    }
+}
+
+void DecoderCapabilityCache::invalidate()
+{
+    QMutexLocker locker(&m_Lock);
+
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                "Invalidating decoder capability cache");
+
+    m_Entries = QJsonObject();
+    m_Dirty = false;
+    Path::deleteCacheFile(CACHE_FILE_NAME);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QJsonObject>
+#include <QMutex>
+#include <QSize>
+#include <QString>
+
+// The parts of a test-only decoder that callers of Session::chooseDecoder()
+// actually look at. These are cached so we don't have to initialize GPU
+// drivers and decode test frames on every launch.
+struct DecoderProbeResult
+{
+    bool available;
+    bool isHardwareAccelerated;
+    bool isAlwaysFullScreen;
+    bool isHdrSupported;
+    QSize maxResolution;
+    int capabilities;
+    int colorspace;
+    int colorRange;
+};
+
+// Persists decoder probe results across launches. The whole cache is tied to
+// an identity string built from the app version, OS, GPU/driver, display
+// configuration and FFmpeg/libva/libplacebo versions. If any of those change,
+// the cache is discarded and everything is probed again.
+//
+// Only successful probes are written to disk. A failed probe may be caused by
+// a transient driver or display problem, so it is remembered for the rest of
+// this process and probed again on the next launch.
+//
+// Set DECODER_CAPABILITY_CACHE=0 to bypass the cache entirely.
+class DecoderCapabilityCache
+{
+public:
+    static DecoderCapabilityCache& get();
+
+    bool lookup(const QString& probeKey, DecoderProbeResult& result);
+
+    void store(const QString& probeKey, const DecoderProbeResult& result);
+
+    // Writes entries added by store() to disk if there are any
+    void flush();
+
+    // Called if a decoder fails in a way the cached results didn't predict
+    void invalidate();
+
+private:
+    DecoderCapabilityCache();
+
+    void loadIfNeeded();
+
+    void save();
+
+    static QString computeSystemIdentity();
+
+    QMutex m_Lock;
+    bool m_Enabled;
+    bool m_Loaded;
+    bool m_Dirty;
+    QString m_Identity;
+    QJsonObject m_Entries;
+};
@@ -8,6 +8,10 @@
 
 #define MAX_SLICES 4
 
+// Frame queue delay histogram with fixed-width buckets. The last bucket is unbounded.
+#define PACER_LATENCY_HISTOGRAM_BUCKETS 64
+#define PACER_LATENCY_HISTOGRAM_BUCKET_US 500
+
 typedef struct _VIDEO_STATS {
     uint32_t receivedFrames;
     uint32_t decodedFrames;
@@ -23,6 +27,33 @@ typedef struct _VIDEO_STATS {
     uint64_t totalDecodeTimeUs;                // high-res (1us)
     uint64_t totalPacerTimeUs;                 // high-res (1us)
     uint64_t totalRenderTimeUs;                // high-res (1us)
+    uint32_t packetBufferAllocations;          // heap allocations for packet assembly
+    uint64_t packetBytesCopied;                // bytes copied during packet assembly
+    uint32_t frameAllocations;                 // heap allocations for decoded frames and their side data
+    uint64_t totalVsyncJitterUs;               // high-res (1us) from V-sync sources with timestamps
+    uint32_t maxVsyncJitterUs;                 // high-res (1us) from V-sync sources with timestamps
+    uint32_t vsyncIntervals;                   // V-sync intervals measured for jitter
+    uint32_t pacerQueueDepth;                  // current queue depth limit in adaptive pacing mode
+    uint32_t pacerTargetQueueDepth;            // queue depth wanted by the adaptive pacing controller
+    uint32_t pacerWakeups;                     // Pacer threads woken by a frame handoff
+    uint64_t totalPacerWakeLatencyUs;          // high-res (1us) from handoff to the woken thread running
+    uint32_t pacerQueueContention;             // Pacer queue removals that raced with the other thread
+    uint64_t totalRenderLeadUs;                // high-res (1us) from latching a frame to its target V-sync
+    uint32_t latchedFrames;                    // frames latched for rendering by the Pacer's V-sync thread
+    uint32_t missedRenderDeadlines;            // latched frames that missed their target V-sync
+    uint32_t vrrDelayedFrames;                 // frames held back to stay under the VRR display's maximum refresh rate
+    uint64_t totalVrrDelayUs;                  // high-res (1us) spent holding frames back for VRR
+    uint32_t pacerLatencyHistogram[PACER_LATENCY_HISTOGRAM_BUCKETS]; // rendered frames by time spent in Pacer's queues
+    uint64_t totalJudderUs;                    // high-res (1us) difference between present and content frame intervals
+    uint32_t maxJudderUs;                      // high-res (1us) difference between present and content frame intervals
+    uint32_t judderSamples;                    // present intervals measured for judder
+    uint64_t totalKmsCommitTimeUs;             // high-res (1us) spent flipping the video plane in DrmRenderer
+    uint32_t maxKmsCommitTimeUs;               // high-res (1us) spent flipping the video plane in DrmRenderer
+    uint32_t kmsCommits;                       // video plane flips timed for KMS commit cost
+    uint64_t totalFbLookupTimeUs;              // high-res (1us) spent finding or importing a frame's KMS framebuffer
+    uint32_t maxFbLookupTimeUs;                // high-res (1us) spent finding or importing a frame's KMS framebuffer
+    uint32_t fbLookups;                        // frames timed for KMS framebuffer lookup cost
+    uint32_t framebufferImports;               // KMS framebuffers created for frames rather than reused
     uint32_t lastRtt;                          // low-res from enet (1ms)
     uint32_t lastRttVariance;                  // low-res from enet (1ms)
     double totalFps;                           // high-res
@@ -56,7 +87,9 @@ typedef struct _DECODER_PARAMETERS {
     int superResolutionMode; // StreamingPreferences::SuperResolutionMode
     bool useDisplayLink;     // Snapshot of display link preference at session start
     bool tripleBuffering;    // Snapshot of triple buffering preference at session start
+    bool enableVrr;          // Present frames on arrival and let the display refresh when they do
     bool testOnly;
+    bool prewarm;            // Built before the connection is established. Call startDecoding() once it is.
 } DECODER_PARAMETERS, *PDECODER_PARAMETERS;
 
 #define WINDOW_STATE_CHANGE_SIZE 0x01
@@ -89,4 +122,5 @@ public:
     virtual void renderFrameOnMainThread() = 0;
     virtual void setHdrMode(bool enabled) = 0;
     virtual bool notifyWindowChanged(PWINDOW_STATE_CHANGE_INFO info) = 0;
+    virtual bool startDecoding() = 0;
 };
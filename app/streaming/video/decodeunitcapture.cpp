@@ -0,0 +1,439 @@
+#include "decodeunitcapture.h"
+
+// Sanity limits to avoid huge allocations when reading a corrupt capture
+#define MAX_CAPTURE_ENTRIES 4096
+#define MAX_CAPTURE_ENTRY_LENGTH (64 * 1024 * 1024)
+
+// Jittery profile: every frame is delayed by up to this much
+// and some are stalled much longer, as with Wi-Fi retransmits.
+#define JITTERY_MAX_DELAY_US 4000
+#define JITTERY_STALL_PERCENT 2
+#define JITTERY_STALL_MIN_US 20000
+#define JITTERY_STALL_MAX_US 50000
+
+// Bursty profile: frames are released together in groups this large
+#define BURSTY_GROUP_FRAMES 4
+
+DecodeUnitRecorder::DecodeUnitRecorder()
+    : m_RecordedFrames(0)
+{
+}
+
+DecodeUnitRecorder::~DecodeUnitRecorder()
+{
+    if (m_File.isOpen()) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Captured %d decode units to %s",
+                    m_RecordedFrames,
+                    qPrintable(m_File.fileName()));
+    }
+}
+
+bool DecodeUnitRecorder::open(const QString& path, int videoFormat, int width, int height, int frameRate)
+{
+    m_File.setFileName(path);
+    if (!m_File.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to open decode unit capture file %s: %s",
+                     qPrintable(path),
+                     qPrintable(m_File.errorString()));
+        return false;
+    }
+
+    m_Stream.setDevice(&m_File);
+    m_Stream.setByteOrder(QDataStream::LittleEndian);
+
+    m_Stream << (quint32)DECODE_UNIT_CAPTURE_MAGIC
+             << (quint32)DECODE_UNIT_CAPTURE_VERSION
+             << (qint32)videoFormat
+             << (qint32)width
+             << (qint32)height
+             << (qint32)frameRate;
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Capturing decode units to %s",
+                qPrintable(path));
+    return true;
+}
+
+void DecodeUnitRecorder::record(PDECODE_UNIT du)
+{
+    if (!m_File.isOpen()) {
+        return;
+    }
+
+    qint32 entryCount = 0;
+    for (PLENTRY entry = du->bufferList; entry != nullptr; entry = entry->next) {
+        entryCount++;
+    }
+
+    m_Stream << (qint32)du->frameNumber
+             << (qint32)du->frameType
+             << (quint32)du->rtpTimestamp
+             << (quint16)du->frameHostProcessingLatency
+             << (quint64)du->receiveTimeUs
+             << (quint64)du->enqueueTimeUs
+             << (qint32)du->fullLength
+             << entryCount;
+
+    for (PLENTRY entry = du->bufferList; entry != nullptr; entry = entry->next) {
+        m_Stream << (qint32)entry->bufferType << (qint32)entry->length;
+        m_Stream.writeRawData(entry->data, entry->length);
+    }
+
+    if (m_Stream.status() != QDataStream::Ok) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to write decode unit capture: %s",
+                     qPrintable(m_File.errorString()));
+        m_File.close();
+        return;
+    }
+
+    m_RecordedFrames++;
+}
+
+DecodeUnitPlayer::DecodeUnitPlayer()
+    : m_Realtime(true),
+      m_Finished(false),
+      m_HasPendingRecord(false),
+      m_VideoFormat(0),
+      m_Width(0),
+      m_Height(0),
+      m_FrameRate(0),
+      m_ArrivalProfile(ArrivalProfile::Recorded),
+      m_RandomState(1),
+      m_DueOffsetUs(0),
+      m_FirstReceiveTimeUs(0),
+      m_StartTimeUs(0),
+      m_ReplayedFrames(0),
+      m_RejectedFrames(0),
+      m_WakeLock(SDL_CreateMutex()),
+      m_WakeCond(SDL_CreateCond()),
+      m_WakeRequested(false)
+{
+    SDL_zero(m_DecodeUnit);
+}
+
+DecodeUnitPlayer::~DecodeUnitPlayer()
+{
+    SDL_DestroyCond(m_WakeCond);
+    SDL_DestroyMutex(m_WakeLock);
+}
+
+bool DecodeUnitPlayer::setArrivalProfile(const QString& name, quint32 seed)
+{
+    if (name.isEmpty() || name == "recorded") {
+        m_ArrivalProfile = ArrivalProfile::Recorded;
+    }
+    else if (name == "smooth") {
+        m_ArrivalProfile = ArrivalProfile::Smooth;
+    }
+    else if (name == "jittery") {
+        m_ArrivalProfile = ArrivalProfile::Jittery;
+    }
+    else if (name == "bursty") {
+        m_ArrivalProfile = ArrivalProfile::Bursty;
+    }
+    else {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unknown decode unit replay profile: %s",
+                     qPrintable(name));
+        return false;
+    }
+
+    // xorshift32 gets stuck at zero
+    m_RandomState = seed != 0 ? seed : 1;
+    return true;
+}
+
+bool DecodeUnitPlayer::open(const QString& path, bool realtime)
+{
+    m_File.setFileName(path);
+    if (!m_File.open(QIODevice::ReadOnly)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to open decode unit replay file %s: %s",
+                     qPrintable(path),
+                     qPrintable(m_File.errorString()));
+        return false;
+    }
+
+    m_Stream.setDevice(&m_File);
+    m_Stream.setByteOrder(QDataStream::LittleEndian);
+
+    quint32 magic, version;
+    qint32 videoFormat, width, height, frameRate;
+    m_Stream >> magic >> version >> videoFormat >> width >> height >> frameRate;
+    if (m_Stream.status() != QDataStream::Ok ||
+            magic != DECODE_UNIT_CAPTURE_MAGIC ||
+            version != DECODE_UNIT_CAPTURE_VERSION) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "%s is not a supported decode unit capture",
+                     qPrintable(path));
+        m_File.close();
+        return false;
+    }
+
+    m_VideoFormat = videoFormat;
+    m_Width = width;
+    m_Height = height;
+    m_FrameRate = frameRate;
+    m_Realtime = realtime;
+
+    const char* cadence;
+    if (!realtime) {
+        cadence = "unthrottled";
+    }
+    else {
+        switch (m_ArrivalProfile) {
+        case ArrivalProfile::Smooth:
+            cadence = "smooth cadence";
+            break;
+        case ArrivalProfile::Jittery:
+            cadence = "jittery cadence";
+            break;
+        case ArrivalProfile::Bursty:
+            cadence = "bursty cadence";
+            break;
+        case ArrivalProfile::Recorded:
+        default:
+            cadence = "original cadence";
+            break;
+        }
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Replaying decode units from %s (%dx%dx%d, format 0x%x, %s)",
+                qPrintable(path),
+                width, height, frameRate, videoFormat,
+                cadence);
+    return true;
+}
+
+bool DecodeUnitPlayer::readNextRecord()
+{
+    if (m_HasPendingRecord) {
+        return true;
+    }
+    else if (m_Finished) {
+        return false;
+    }
+
+    qint32 frameNumber, frameType, fullLength, entryCount;
+    quint32 rtpTimestamp;
+    quint16 hostProcessingLatency;
+    quint64 receiveTimeUs, enqueueTimeUs;
+    m_Stream >> frameNumber >> frameType >> rtpTimestamp >> hostProcessingLatency
+             >> receiveTimeUs >> enqueueTimeUs >> fullLength >> entryCount;
+    if (m_Stream.status() != QDataStream::Ok || entryCount <= 0 || entryCount > MAX_CAPTURE_ENTRIES) {
+        finish();
+        return false;
+    }
+
+    m_Entries.resize(entryCount);
+    m_EntryData.resize(entryCount);
+    for (int i = 0; i < entryCount; i++) {
+        qint32 bufferType, length;
+        m_Stream >> bufferType >> length;
+        if (m_Stream.status() != QDataStream::Ok || length < 0 || length > MAX_CAPTURE_ENTRY_LENGTH) {
+            finish();
+            return false;
+        }
+
+        m_EntryData[i].resize(length);
+        if (m_Stream.readRawData(m_EntryData[i].data(), length) != length) {
+            finish();
+            return false;
+        }
+
+        m_Entries[i].next = (i + 1 < entryCount) ? &m_Entries[i + 1] : nullptr;
+        m_Entries[i].data = m_EntryData[i].data();
+        m_Entries[i].length = length;
+        m_Entries[i].bufferType = bufferType;
+    }
+
+    if (m_FirstReceiveTimeUs == 0) {
+        m_FirstReceiveTimeUs = receiveTimeUs;
+        m_StartTimeUs = LiGetMicroseconds();
+    }
+
+    m_DueOffsetUs = getNextDueOffsetUs(receiveTimeUs - m_FirstReceiveTimeUs);
+
+    SDL_zero(m_DecodeUnit);
+    m_DecodeUnit.frameNumber = frameNumber;
+    m_DecodeUnit.frameType = frameType;
+    m_DecodeUnit.rtpTimestamp = rtpTimestamp;
+    m_DecodeUnit.frameHostProcessingLatency = hostProcessingLatency;
+
+    // Keep the original receive timestamps for now. They're rebased onto
+    // our clock when the DU is handed out.
+    m_DecodeUnit.receiveTimeUs = receiveTimeUs;
+    m_DecodeUnit.enqueueTimeUs = enqueueTimeUs;
+    m_DecodeUnit.fullLength = fullLength;
+    m_DecodeUnit.bufferList = m_Entries.data();
+
+    m_HasPendingRecord = true;
+    return true;
+}
+
+quint32 DecodeUnitPlayer::nextRandom()
+{
+    // xorshift32 is plenty for this and is the same on every platform
+    m_RandomState ^= m_RandomState << 13;
+    m_RandomState ^= m_RandomState >> 17;
+    m_RandomState ^= m_RandomState << 5;
+    return m_RandomState;
+}
+
+// Returns when the next DU is due relative to the start of the replay
+uint64_t DecodeUnitPlayer::getNextDueOffsetUs(uint64_t recordedOffsetUs)
+{
+    if (m_ArrivalProfile == ArrivalProfile::Recorded || m_FrameRate <= 0) {
+        return recordedOffsetUs;
+    }
+
+    uint64_t frameIndex = m_ReplayedFrames + m_RejectedFrames;
+    uint64_t dueOffsetUs;
+
+    switch (m_ArrivalProfile) {
+    case ArrivalProfile::Smooth:
+        dueOffsetUs = frameIndex * 1000000 / m_FrameRate;
+        break;
+
+    case ArrivalProfile::Jittery:
+        dueOffsetUs = frameIndex * 1000000 / m_FrameRate;
+        if (nextRandom() % 100 < JITTERY_STALL_PERCENT) {
+            dueOffsetUs += JITTERY_STALL_MIN_US + nextRandom() % (JITTERY_STALL_MAX_US - JITTERY_STALL_MIN_US);
+        }
+        else {
+            dueOffsetUs += nextRandom() % JITTERY_MAX_DELAY_US;
+        }
+        break;
+
+    case ArrivalProfile::Bursty:
+        // Each group is released when its last frame would have arrived
+        dueOffsetUs = (frameIndex - frameIndex % BURSTY_GROUP_FRAMES + BURSTY_GROUP_FRAMES - 1) * 1000000 / m_FrameRate;
+        break;
+
+    default:
+        SDL_assert(false);
+        return recordedOffsetUs;
+    }
+
+    // Frames still arrive in order, so a delayed frame holds back the ones after it
+    return SDL_max(dueOffsetUs, m_DueOffsetUs);
+}
+
+void DecodeUnitPlayer::finish()
+{
+    if (m_Finished) {
+        return;
+    }
+
+    m_Finished = true;
+
+    uint64_t elapsedUs = m_StartTimeUs != 0 ? LiGetMicroseconds() - m_StartTimeUs : 0;
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Decode unit replay finished: %d frames (%d rejected) in %.2f ms (%.2f FPS)",
+                m_ReplayedFrames,
+                m_RejectedFrames,
+                elapsedUs / 1000.0,
+                elapsedUs != 0 ? m_ReplayedFrames * 1000000.0 / elapsedUs : 0.0);
+
+    // End the session now that we're out of data
+    SDL_Event event;
+    event.type = SDL_QUIT;
+    event.quit.timestamp = SDL_GetTicks();
+    SDL_PushEvent(&event);
+}
+
+bool DecodeUnitPlayer::waitForNextDecodeUnit(PDECODE_UNIT* du, int timeoutMs)
+{
+    bool woken = false;
+    uint64_t deadlineUs = timeoutMs >= 0 ? LiGetMicroseconds() + (uint64_t)timeoutMs * 1000 : UINT64_MAX;
+
+    if (!readNextRecord()) {
+        // Nothing left to replay, so just wait to be stopped
+        SDL_LockMutex(m_WakeLock);
+        while (!m_WakeRequested) {
+            uint64_t nowUs = LiGetMicroseconds();
+            if (nowUs >= deadlineUs) {
+                break;
+            }
+
+            if (deadlineUs == UINT64_MAX) {
+                SDL_CondWait(m_WakeCond, m_WakeLock);
+            }
+            else {
+                SDL_CondWaitTimeout(m_WakeCond, m_WakeLock, (Uint32)((deadlineUs - nowUs + 999) / 1000));
+            }
+        }
+        m_WakeRequested = false;
+        SDL_UnlockMutex(m_WakeLock);
+        return false;
+    }
+
+    if (m_Realtime) {
+        uint64_t dueTimeUs = m_StartTimeUs + m_DueOffsetUs;
+        uint64_t wakeTimeUs = SDL_min(dueTimeUs, deadlineUs);
+
+        SDL_LockMutex(m_WakeLock);
+        for (;;) {
+            uint64_t nowUs = LiGetMicroseconds();
+            if (m_WakeRequested || nowUs >= wakeTimeUs) {
+                break;
+            }
+
+            SDL_CondWaitTimeout(m_WakeCond, m_WakeLock, (Uint32)((wakeTimeUs - nowUs + 999) / 1000));
+        }
+        woken = m_WakeRequested;
+        m_WakeRequested = false;
+        SDL_UnlockMutex(m_WakeLock);
+    }
+
+    if (woken) {
+        // Leave the record pending for the next call
+        return false;
+    }
+
+    return pollNextDecodeUnit(du);
+}
+
+bool DecodeUnitPlayer::pollNextDecodeUnit(PDECODE_UNIT* du)
+{
+    if (!readNextRecord()) {
+        return false;
+    }
+
+    uint64_t nowUs = LiGetMicroseconds();
+    if (m_Realtime && nowUs < m_StartTimeUs + m_DueOffsetUs) {
+        return false;
+    }
+
+    // Rebase the timestamps onto our clock, preserving the original reassembly time
+    m_DecodeUnit.receiveTimeUs = nowUs - (m_DecodeUnit.enqueueTimeUs - m_DecodeUnit.receiveTimeUs);
+    m_DecodeUnit.enqueueTimeUs = nowUs;
+
+    *du = &m_DecodeUnit;
+    return true;
+}
+
+void DecodeUnitPlayer::completeDecodeUnit(int drStatus)
+{
+    SDL_assert(m_HasPendingRecord);
+    m_HasPendingRecord = false;
+
+    if (drStatus == DR_OK) {
+        m_ReplayedFrames++;
+    }
+    else {
+        m_RejectedFrames++;
+    }
+}
+
+void DecodeUnitPlayer::wake()
+{
+    SDL_LockMutex(m_WakeLock);
+    m_WakeRequested = true;
+    SDL_CondSignal(m_WakeCond);
+    SDL_UnlockMutex(m_WakeLock);
+}
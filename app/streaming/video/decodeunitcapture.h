@@ -0,0 +1,113 @@
+#pragma once
+
+#include <Limelight.h>
+#include "SDL_compat.h"
+
+#include <QFile>
+#include <QDataStream>
+#include <QByteArray>
+#include <QVector>
+
+// Decode unit capture files are a small header describing the stream
+// followed by one record per DECODE_UNIT. Each record holds the DU
+// metadata and its full LENTRY chain, so a replay presents exactly the
+// same buffers to the decoder that the live connection did.
+#define DECODE_UNIT_CAPTURE_MAGIC 0x55444C4E // 'NLDU'
+#define DECODE_UNIT_CAPTURE_VERSION 1
+
+class DecodeUnitRecorder
+{
+public:
+    DecodeUnitRecorder();
+    ~DecodeUnitRecorder();
+
+    bool open(const QString& path, int videoFormat, int width, int height, int frameRate);
+
+    // Called on the decoder thread for every DU reaching submitDecodeUnit()
+    void record(PDECODE_UNIT du);
+
+private:
+    QFile m_File;
+    QDataStream m_Stream;
+    int m_RecordedFrames;
+};
+
+class DecodeUnitPlayer
+{
+public:
+    // When DUs become due during a realtime replay. The synthetic profiles
+    // replace the recorded arrival times with a fixed cadence at the capture's
+    // frame rate, optionally disturbed in a repeatable way, so the same
+    // capture can be used to compare how Pacer handles each kind of network.
+    enum class ArrivalProfile {
+        Recorded,   // Original arrival times from the capture
+        Smooth,     // Perfect cadence
+        Jittery,    // Cadence plus random delays and occasional stalls, like Wi-Fi
+        Bursty      // Cadence, but released in groups of frames
+    };
+
+    DecodeUnitPlayer();
+    ~DecodeUnitPlayer();
+
+    // Returns false if the profile name is unknown. Must be called before open().
+    bool setArrivalProfile(const QString& name, quint32 seed);
+
+    // If realtime is false, DUs are returned as fast as the decoder consumes them
+    bool open(const QString& path, bool realtime);
+
+    int getVideoFormat() { return m_VideoFormat; }
+    int getWidth() { return m_Width; }
+    int getHeight() { return m_Height; }
+    int getFrameRate() { return m_FrameRate; }
+    int getReplayedFrames() { return m_ReplayedFrames; }
+    int getRejectedFrames() { return m_RejectedFrames; }
+
+    // Blocks until the next DU is due. Returns false if woken by wake(),
+    // once the end of the capture has been reached, or if timeoutMs is not
+    // negative and no DU became due within that time.
+    bool waitForNextDecodeUnit(PDECODE_UNIT* du, int timeoutMs = -1);
+
+    // Returns false immediately if the next DU isn't due yet
+    bool pollNextDecodeUnit(PDECODE_UNIT* du);
+
+    // Releases the DU returned by the last successful wait/poll call
+    void completeDecodeUnit(int drStatus);
+
+    // Interrupts waitForNextDecodeUnit() (used when stopping the decoder thread)
+    void wake();
+
+private:
+    bool readNextRecord();
+    uint64_t getNextDueOffsetUs(uint64_t recordedOffsetUs);
+    quint32 nextRandom();
+    void finish();
+
+    QFile m_File;
+    QDataStream m_Stream;
+    bool m_Realtime;
+    bool m_Finished;
+    bool m_HasPendingRecord;
+
+    int m_VideoFormat;
+    int m_Width;
+    int m_Height;
+    int m_FrameRate;
+
+    // Storage for the current record. The LENTRY chain points into m_EntryData.
+    DECODE_UNIT m_DecodeUnit;
+    QVector<LENTRY> m_Entries;
+    QVector<QByteArray> m_EntryData;
+
+    ArrivalProfile m_ArrivalProfile;
+    quint32 m_RandomState;
+    uint64_t m_DueOffsetUs;
+
+    uint64_t m_FirstReceiveTimeUs;
+    uint64_t m_StartTimeUs;
+    int m_ReplayedFrames;
+    int m_RejectedFrames;
+
+    SDL_mutex* m_WakeLock;
+    SDL_cond* m_WakeCond;
+    bool m_WakeRequested;
+};
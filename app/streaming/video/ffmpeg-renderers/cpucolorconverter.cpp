@@ -0,0 +1,736 @@
+#include "cpucolorconverter.h"
+#include "utils.h"
+
+#include <cmath>
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_CONVERTER_X86_KERNELS
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define CPU_CONVERTER_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+// PQ content is mapped so this many nits becomes SDR reference white
+#define TONEMAP_SDR_WHITE_NITS 203.0
+#define TONEMAP_PEAK_NITS 1000.0
+
+// Relative luminance above which highlights are compressed
+#define TONEMAP_KNEE 0.75
+
+// Limits how much chroma is boosted along with the luma of dark pixels
+#define TONEMAP_MAX_CHROMA_GAIN 2.0
+
+// Chroma gains are stored as 4.12 fixed point
+#define TONEMAP_CHROMA_GAIN_BITS 12
+
+static void convertRow_C(const uint16_t* src, uint8_t* dst, int count,
+                         int shift, const uint16_t* bias)
+{
+    for (int x = 0; x < count; x++) {
+        int value = (src[x] + bias[x & 3]) >> shift;
+        dst[x] = (uint8_t)SDL_min(value, 255);
+    }
+}
+
+static void interleaveRow_C(const uint16_t* srcU, const uint16_t* srcV, uint8_t* dst, int count,
+                            int shift, const uint16_t* bias)
+{
+    for (int x = 0; x < count; x++) {
+        int u = (srcU[x] + bias[x & 1]) >> shift;
+        int v = (srcV[x] + bias[x & 1]) >> shift;
+        dst[x * 2] = (uint8_t)SDL_min(u, 255);
+        dst[x * 2 + 1] = (uint8_t)SDL_min(v, 255);
+    }
+}
+
+#ifdef CPU_CONVERTER_X86_KERNELS
+
+TARGET_SSE2
+static void convertRow_SSE2(const uint16_t* src, uint8_t* dst, int count,
+                            int shift, const uint16_t* bias)
+{
+    const __m128i biasVec = _mm_set_epi16((short)bias[3], (short)bias[2], (short)bias[1], (short)bias[0],
+                                          (short)bias[3], (short)bias[2], (short)bias[1], (short)bias[0]);
+    const __m128i shiftVec = _mm_cvtsi32_si128(shift);
+    int x = 0;
+
+    for (; x + 16 <= count; x += 16) {
+        __m128i lo = _mm_loadu_si128((const __m128i*)(src + x));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(src + x + 8));
+        lo = _mm_srl_epi16(_mm_adds_epu16(lo, biasVec), shiftVec);
+        hi = _mm_srl_epi16(_mm_adds_epu16(hi, biasVec), shiftVec);
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(lo, hi));
+    }
+
+    // x stays a multiple of 4, so the bias phase is unchanged for the tail
+    convertRow_C(src + x, dst + x, count - x, shift, bias);
+}
+
+TARGET_SSE2
+static void interleaveRow_SSE2(const uint16_t* srcU, const uint16_t* srcV, uint8_t* dst, int count,
+                               int shift, const uint16_t* bias)
+{
+    // Both samples of each UV pair get the same bias
+    const __m128i biasVec = _mm_set1_epi32(bias[0] | (bias[1] << 16));
+    const __m128i shiftVec = _mm_cvtsi32_si128(shift);
+    int x = 0;
+
+    for (; x + 8 <= count; x += 8) {
+        __m128i u = _mm_loadu_si128((const __m128i*)(srcU + x));
+        __m128i v = _mm_loadu_si128((const __m128i*)(srcV + x));
+        u = _mm_srl_epi16(_mm_adds_epu16(u, biasVec), shiftVec);
+        v = _mm_srl_epi16(_mm_adds_epu16(v, biasVec), shiftVec);
+        _mm_storeu_si128((__m128i*)(dst + x * 2),
+                         _mm_packus_epi16(_mm_unpacklo_epi16(u, v), _mm_unpackhi_epi16(u, v)));
+    }
+
+    interleaveRow_C(srcU + x, srcV + x, dst + x * 2, count - x, shift, bias);
+}
+
+TARGET_AVX2
+static void convertRow_AVX2(const uint16_t* src, uint8_t* dst, int count,
+                            int shift, const uint16_t* bias)
+{
+    const __m256i biasVec = _mm256_set1_epi64x((long long)bias[0] | ((long long)bias[1] << 16) |
+                                               ((long long)bias[2] << 32) | ((long long)bias[3] << 48));
+    const __m128i shiftVec = _mm_cvtsi32_si128(shift);
+    int x = 0;
+
+    for (; x + 32 <= count; x += 32) {
+        __m256i lo = _mm256_loadu_si256((const __m256i*)(src + x));
+        __m256i hi = _mm256_loadu_si256((const __m256i*)(src + x + 16));
+        lo = _mm256_srl_epi16(_mm256_adds_epu16(lo, biasVec), shiftVec);
+        hi = _mm256_srl_epi16(_mm256_adds_epu16(hi, biasVec), shiftVec);
+
+        // packus works within each 128-bit lane, so put the quadwords back in order
+        __m256i packed = _mm256_packus_epi16(lo, hi);
+        _mm256_storeu_si256((__m256i*)(dst + x), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+
+    convertRow_SSE2(src + x, dst + x, count - x, shift, bias);
+}
+
+TARGET_AVX2
+static void interleaveRow_AVX2(const uint16_t* srcU, const uint16_t* srcV, uint8_t* dst, int count,
+                               int shift, const uint16_t* bias)
+{
+    const __m256i biasVec = _mm256_set1_epi32(bias[0] | (bias[1] << 16));
+    const __m128i shiftVec = _mm_cvtsi32_si128(shift);
+    int x = 0;
+
+    for (; x + 16 <= count; x += 16) {
+        __m256i u = _mm256_loadu_si256((const __m256i*)(srcU + x));
+        __m256i v = _mm256_loadu_si256((const __m256i*)(srcV + x));
+        u = _mm256_srl_epi16(_mm256_adds_epu16(u, biasVec), shiftVec);
+        v = _mm256_srl_epi16(_mm256_adds_epu16(v, biasVec), shiftVec);
+
+        // The in-lane unpack and pack cancel out, leaving UV pairs in order
+        __m256i packed = _mm256_packus_epi16(_mm256_unpacklo_epi16(u, v), _mm256_unpackhi_epi16(u, v));
+        _mm256_storeu_si256((__m256i*)(dst + x * 2), packed);
+    }
+
+    interleaveRow_SSE2(srcU + x, srcV + x, dst + x * 2, count - x, shift, bias);
+}
+
+#endif
+
+#ifdef CPU_CONVERTER_NEON_KERNELS
+
+static void convertRow_NEON(const uint16_t* src, uint8_t* dst, int count,
+                            int shift, const uint16_t* bias)
+{
+    const uint16_t biasPattern[8] = { bias[0], bias[1], bias[2], bias[3], bias[0], bias[1], bias[2], bias[3] };
+    const uint16x8_t biasVec = vld1q_u16(biasPattern);
+    const int16x8_t shiftVec = vdupq_n_s16((int16_t)-shift);
+    int x = 0;
+
+    for (; x + 16 <= count; x += 16) {
+        uint16x8_t lo = vqaddq_u16(vld1q_u16(src + x), biasVec);
+        uint16x8_t hi = vqaddq_u16(vld1q_u16(src + x + 8), biasVec);
+        lo = vshlq_u16(lo, shiftVec);
+        hi = vshlq_u16(hi, shiftVec);
+        vst1q_u8(dst + x, vcombine_u8(vqmovn_u16(lo), vqmovn_u16(hi)));
+    }
+
+    convertRow_C(src + x, dst + x, count - x, shift, bias);
+}
+
+static void interleaveRow_NEON(const uint16_t* srcU, const uint16_t* srcV, uint8_t* dst, int count,
+                               int shift, const uint16_t* bias)
+{
+    // Both samples of each UV pair get the same bias
+    const uint16_t biasPattern[8] = { bias[0], bias[1], bias[0], bias[1], bias[0], bias[1], bias[0], bias[1] };
+    const uint16x8_t biasVec = vld1q_u16(biasPattern);
+    const int16x8_t shiftVec = vdupq_n_s16((int16_t)-shift);
+    int x = 0;
+
+    for (; x + 8 <= count; x += 8) {
+        uint8x8x2_t uv;
+        uv.val[0] = vqmovn_u16(vshlq_u16(vqaddq_u16(vld1q_u16(srcU + x), biasVec), shiftVec));
+        uv.val[1] = vqmovn_u16(vshlq_u16(vqaddq_u16(vld1q_u16(srcV + x), biasVec), shiftVec));
+        vst2_u8(dst + x * 2, uv);
+    }
+
+    interleaveRow_C(srcU + x, srcV + x, dst + x * 2, count - x, shift, bias);
+}
+
+#endif
+
+// Tone mapped luma goes through a lookup table, so there's no SIMD version
+static void toneMapRow(const uint16_t* src, uint8_t* dst, int count,
+                       int sampleShift, const uint16_t* lut,
+                       int shift, const uint16_t* bias)
+{
+    for (int x = 0; x < count; x++) {
+        int value = (lut[(src[x] >> sampleShift) & 1023] + bias[x & 3]) >> shift;
+        dst[x] = (uint8_t)SDL_min(value, 255);
+    }
+}
+
+// Scales each chroma pair around neutral by the gain its 2x2 luma block
+// got from the tone map, so saturation follows the compressed luma.
+// srcU and srcV are read every chromaStep samples.
+static void toneMapChromaRow(const uint16_t* lumaTop, const uint16_t* lumaBottom, int width,
+                             const uint16_t* srcU, const uint16_t* srcV, int chromaStep,
+                             uint8_t* dst, int count, int sampleShift, const uint16_t* gainLut,
+                             int shift, const uint16_t* bias)
+{
+    for (int x = 0; x < count; x++) {
+        int x0 = x * 2;
+        int x1 = SDL_min(x0 + 1, width - 1);
+        int luma = ((lumaTop[x0] >> sampleShift) + (lumaTop[x1] >> sampleShift) +
+                    (lumaBottom[x0] >> sampleShift) + (lumaBottom[x1] >> sampleShift) + 2) >> 2;
+        int gain = gainLut[luma & 1023];
+
+        int u = (srcU[x * chromaStep] >> sampleShift) - 512;
+        int v = (srcV[x * chromaStep] >> sampleShift) - 512;
+        u = SDL_clamp(512 + ((u * gain) / (1 << TONEMAP_CHROMA_GAIN_BITS)), 0, 1023);
+        v = SDL_clamp(512 + ((v * gain) / (1 << TONEMAP_CHROMA_GAIN_BITS)), 0, 1023);
+
+        // Both samples of the pair get the same bias
+        u = ((u << sampleShift) + bias[x & 1]) >> shift;
+        v = ((v << sampleShift) + bias[x & 1]) >> shift;
+        dst[x * 2] = (uint8_t)SDL_min(u, 255);
+        dst[x * 2 + 1] = (uint8_t)SDL_min(v, 255);
+    }
+}
+
+static SDL_bool isAlwaysSupported(void)
+{
+    return SDL_TRUE;
+}
+
+// Fastest first, so the first supported kernel is the default
+static const CpuColorConverter::DownConversionKernel k_DownConversionKernels[] = {
+#if defined(CPU_CONVERTER_X86_KERNELS)
+    { "AVX2", SDL_HasAVX2, convertRow_AVX2, interleaveRow_AVX2 },
+    { "SSE2", SDL_HasSSE2, convertRow_SSE2, interleaveRow_SSE2 },
+#elif defined(CPU_CONVERTER_NEON_KERNELS)
+    { "NEON", isAlwaysSupported, convertRow_NEON, interleaveRow_NEON },
+#endif
+    { "C", isAlwaysSupported, convertRow_C, interleaveRow_C },
+};
+
+const CpuColorConverter::DownConversionKernel* CpuColorConverter::findDownConversionKernel(const char* name)
+{
+    for (const DownConversionKernel& kernel : k_DownConversionKernels) {
+        if ((name == nullptr || SDL_strcasecmp(name, kernel.name) == 0) && kernel.isSupported()) {
+            return &kernel;
+        }
+    }
+
+    return nullptr;
+}
+
+bool CpuColorConverter::isDownConversionKernelSupported(const char* name)
+{
+    return findDownConversionKernel(name) != nullptr;
+}
+
+CpuColorConverter::CpuColorConverter()
+    : m_ThreadCount(0),
+      m_WorkSemaphore(nullptr),
+      m_SliceCount(0),
+      m_NextConsumedSlice(0),
+      m_Failed(false),
+      m_Width(0),
+      m_ChromaShift(0),
+      m_SrcFrame(nullptr),
+      m_DstFrame(nullptr),
+      m_DownConvert(false),
+      m_SemiPlanarSource(false),
+      m_SampleShift(0),
+      m_Dither(false),
+      m_ToneMap(false),
+      m_ConvertRow(nullptr),
+      m_InterleaveRow(nullptr)
+{
+    SDL_zero(m_Threads);
+    SDL_zero(m_Slices);
+    SDL_zero(m_DstData);
+    SDL_zero(m_DstLinesize);
+    SDL_zero(m_ToneMapLut);
+    SDL_zero(m_ChromaGainLut);
+    SDL_AtomicSet(&m_NextSlice, 0);
+    SDL_AtomicSet(&m_Stopping, 0);
+}
+
+CpuColorConverter::~CpuColorConverter()
+{
+    destroy();
+}
+
+void CpuColorConverter::destroy()
+{
+    if (m_ThreadCount != 0) {
+        finishFrame();
+
+        SDL_AtomicSet(&m_Stopping, 1);
+        for (int i = 0; i < m_ThreadCount; i++) {
+            SDL_SemPost(m_WorkSemaphore);
+        }
+        for (int i = 0; i < m_ThreadCount; i++) {
+            SDL_WaitThread(m_Threads[i], nullptr);
+            m_Threads[i] = nullptr;
+        }
+        m_ThreadCount = 0;
+        SDL_AtomicSet(&m_Stopping, 0);
+    }
+
+    for (int i = 0; i < m_SliceCount; i++) {
+        sws_freeContext(m_Slices[i].context);
+        SDL_DestroySemaphore(m_Slices[i].done);
+    }
+    SDL_zero(m_Slices);
+    m_SliceCount = m_NextConsumedSlice = 0;
+
+    if (m_WorkSemaphore != nullptr) {
+        SDL_DestroySemaphore(m_WorkSemaphore);
+        m_WorkSemaphore = nullptr;
+    }
+
+    av_frame_free(&m_DstFrame);
+    m_SrcFrame = nullptr;
+    SDL_zero(m_DstData);
+    SDL_zero(m_DstLinesize);
+    m_DownConvert = false;
+    m_ToneMap = false;
+}
+
+bool CpuColorConverter::isDownConversion(enum AVPixelFormat srcFormat, enum AVPixelFormat dstFormat)
+{
+    return (srcFormat == AV_PIX_FMT_P010 || srcFormat == AV_PIX_FMT_YUV420P10) &&
+           dstFormat == AV_PIX_FMT_NV12;
+}
+
+void CpuColorConverter::initializeToneMap(bool fullRange)
+{
+    // SMPTE ST 2084 constants
+    const double m1 = 2610.0 / 16384.0;
+    const double m2 = 2523.0 / 4096.0 * 128.0;
+    const double c1 = 3424.0 / 4096.0;
+    const double c2 = 2413.0 / 4096.0 * 32.0;
+    const double c3 = 2392.0 / 4096.0 * 32.0;
+
+    const double peak = TONEMAP_PEAK_NITS / TONEMAP_SDR_WHITE_NITS;
+
+    for (int code = 0; code < 1024; code++) {
+        // Decode the 10-bit code to a normalized PQ signal
+        double signal;
+        if (fullRange) {
+            signal = code / 1023.0;
+        }
+        else {
+            signal = (code - 64) / 876.0;
+        }
+        signal = SDL_clamp(signal, 0.0, 1.0);
+
+        // PQ EOTF to absolute luminance, then relative to SDR white
+        double p = pow(signal, 1.0 / m2);
+        double nits = 10000.0 * pow(SDL_max(p - c1, 0.0) / (c2 - c3 * p), 1.0 / m1);
+        double x = nits / TONEMAP_SDR_WHITE_NITS;
+
+        // Leave everything below the knee alone and roll off highlights
+        // with extended Reinhard so the peak lands exactly on 1.0
+        if (x > TONEMAP_KNEE) {
+            double range = 1.0 - TONEMAP_KNEE;
+            double over = (x - TONEMAP_KNEE) / range;
+            double overPeak = (peak - TONEMAP_KNEE) / range;
+            over = over * (1.0 + over / (overPeak * overPeak)) / (1.0 + over);
+            x = TONEMAP_KNEE + range * over;
+        }
+        x = SDL_clamp(x, 0.0, 1.0);
+
+        // Re-encode with an SDR display gamma
+        double sdr = pow(x, 1.0 / 2.4);
+        int outCode;
+        if (fullRange) {
+            outCode = (int)lround(sdr * 1023.0);
+        }
+        else {
+            outCode = (int)lround(64.0 + 876.0 * sdr);
+        }
+
+        m_ToneMapLut[code] = (uint16_t)(outCode << m_SampleShift);
+
+        // Chroma is scaled by the same ratio as the luma signal. Near black
+        // the ratio is ill-conditioned, so it is capped.
+        double gain = signal > 0.0 ? sdr / signal : TONEMAP_MAX_CHROMA_GAIN;
+        gain = SDL_min(gain, TONEMAP_MAX_CHROMA_GAIN);
+        m_ChromaGainLut[code] = (uint16_t)lround(gain * (1 << TONEMAP_CHROMA_GAIN_BITS));
+    }
+}
+
+bool CpuColorConverter::initialize(const AVFrame* frame, enum AVPixelFormat dstFormat)
+{
+    destroy();
+
+    enum AVPixelFormat srcFormat = (enum AVPixelFormat)frame->format;
+    int height = frame->height;
+
+    const AVPixFmtDescriptor* srcDesc = av_pix_fmt_desc_get(srcFormat);
+    const AVPixFmtDescriptor* dstDesc = av_pix_fmt_desc_get(dstFormat);
+    if (srcDesc == nullptr || dstDesc == nullptr) {
+        SDL_assert(false);
+        return false;
+    }
+
+    m_Width = frame->width;
+    m_DownConvert = isDownConversion(srcFormat, dstFormat);
+
+    const char* kernelName = "swscale";
+    if (m_DownConvert) {
+        // P010 samples are MSB-aligned, while YUV420P10 samples are LSB-aligned
+        m_SemiPlanarSource = srcFormat == AV_PIX_FMT_P010;
+        m_SampleShift = m_SemiPlanarSource ? 6 : 0;
+
+        if (!Utils::getEnvironmentVariableOverride("CPU_CONVERTER_DITHER", &m_Dither)) {
+            m_Dither = true;
+        }
+
+        if (frame->color_trc == AVCOL_TRC_SMPTE2084) {
+            if (!Utils::getEnvironmentVariableOverride("CPU_CONVERTER_TONEMAP", &m_ToneMap)) {
+                m_ToneMap = true;
+            }
+            if (m_ToneMap) {
+                initializeToneMap(frame->color_range == AVCOL_RANGE_JPEG);
+            }
+        }
+
+        const DownConversionKernel* kernel = nullptr;
+        QByteArray kernelOverride = qgetenv("CPU_CONVERTER_KERNEL");
+        if (!kernelOverride.isEmpty()) {
+            kernel = findDownConversionKernel(kernelOverride.constData());
+            if (kernel == nullptr) {
+                SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                            "CPU_CONVERTER_KERNEL=%s is not supported on this CPU",
+                            kernelOverride.constData());
+            }
+        }
+        if (kernel == nullptr) {
+            kernel = findDownConversionKernel(nullptr);
+        }
+
+        m_ConvertRow = kernel->convertRow;
+        m_InterleaveRow = kernel->interleaveRow;
+        kernelName = kernel->name;
+    }
+    else {
+        // We only write to the first plane of the destination
+        SDL_assert(!(dstDesc->flags & AV_PIX_FMT_FLAG_PLANAR));
+    }
+
+    int threadCount;
+    if (!Utils::getEnvironmentVariableOverride("CPU_CONVERTER_THREADS", &threadCount)) {
+        threadCount = SDL_GetCPUCount();
+    }
+    threadCount = SDL_clamp(threadCount, 1, CPU_CONVERTER_MAX_THREADS);
+
+    m_DstFrame = av_frame_alloc();
+    if (m_DstFrame == nullptr) {
+        return false;
+    }
+
+    // The buffer is allocated on first use, since callers that
+    // convert into their own buffers never need it
+    m_DstFrame->width = m_Width;
+    m_DstFrame->height = height;
+    m_DstFrame->format = dstFormat;
+
+    // Slices must start on a chroma row, so each one is a self-contained image.
+    // Chroma interpolation can't see across slice edges, but the formats we
+    // convert with swscale are usually 4:4:4 where there is nothing to interpolate.
+    m_ChromaShift = srcDesc->log2_chroma_h;
+    int sliceAlignment = 1 << m_ChromaShift;
+    int targetSlices = threadCount * CPU_CONVERTER_SLICES_PER_THREAD;
+    int sliceHeight = (height + targetSlices - 1) / targetSlices;
+    sliceHeight = (sliceHeight + sliceAlignment - 1) & ~(sliceAlignment - 1);
+
+    for (int y = 0; y < height; y += sliceHeight) {
+        Slice& slice = m_Slices[m_SliceCount];
+
+        slice.y = y;
+        slice.height = SDL_min(sliceHeight, height - y);
+        if (!m_DownConvert) {
+            slice.context = sws_getContext(m_Width, slice.height, srcFormat,
+                                           m_Width, slice.height, dstFormat,
+                                           0, nullptr, nullptr, nullptr);
+        }
+        slice.done = SDL_CreateSemaphore(0);
+        m_SliceCount++;
+
+        if ((!m_DownConvert && slice.context == nullptr) || slice.done == nullptr) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Failed to create color conversion slice");
+            destroy();
+            return false;
+        }
+    }
+
+    // Nothing is in flight yet
+    m_NextConsumedSlice = m_SliceCount;
+
+    m_WorkSemaphore = SDL_CreateSemaphore(0);
+    if (m_WorkSemaphore == nullptr) {
+        destroy();
+        return false;
+    }
+
+    for (int i = 0; i < threadCount; i++) {
+        m_Threads[i] = SDL_CreateThread(CpuColorConverter::workerThreadProc, "CpuConvert", this);
+        if (m_Threads[i] == nullptr) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "SDL_CreateThread() failed: %s",
+                         SDL_GetError());
+            break;
+        }
+
+        m_ThreadCount++;
+    }
+
+    if (m_ThreadCount == 0) {
+        destroy();
+        return false;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Converting %s to %s on the CPU with %d threads (%d slices) using %s%s%s",
+                av_get_pix_fmt_name(srcFormat),
+                av_get_pix_fmt_name(dstFormat),
+                m_ThreadCount,
+                m_SliceCount,
+                kernelName,
+                m_Dither ? " with dithering" : "",
+                m_ToneMap ? " and PQ tone mapping" : "");
+    return true;
+}
+
+int CpuColorConverter::workerThreadProc(void* context)
+{
+    CpuColorConverter* me = reinterpret_cast<CpuColorConverter*>(context);
+
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+
+    for (;;) {
+        SDL_SemWait(me->m_WorkSemaphore);
+        if (SDL_AtomicGet(&me->m_Stopping)) {
+            break;
+        }
+
+        // Take slices until none are left. A worker that wakes up late
+        // may find the frame already finished by the others.
+        int sliceIndex;
+        while ((sliceIndex = SDL_AtomicAdd(&me->m_NextSlice, 1)) < me->m_SliceCount) {
+            me->convertSlice(me->m_Slices[sliceIndex]);
+        }
+    }
+
+    return 0;
+}
+
+void CpuColorConverter::downConvertSlice(const Slice& slice)
+{
+    // Dropping 2 bits of a 10-bit sample, wherever it sits in the 16-bit word
+    int shift = m_SampleShift + 2;
+
+    // With dithering, add a 2x2 ordered dither pattern of the dropped bits.
+    // Otherwise just round to nearest. Chroma uses the same pattern over
+    // UV pairs, so both samples of a pair always get the same bias.
+    uint16_t bias[2][2];
+    if (m_Dither) {
+        bias[0][0] = 0 << m_SampleShift;
+        bias[0][1] = 2 << m_SampleShift;
+        bias[1][0] = 3 << m_SampleShift;
+        bias[1][1] = 1 << m_SampleShift;
+    }
+    else {
+        bias[0][0] = bias[0][1] = bias[1][0] = bias[1][1] = 2 << m_SampleShift;
+    }
+
+    // The same patterns laid out for ConvertRowFunc, which indexes by bias[x & 3]
+    const uint16_t lumaBias[2][4] = {
+        { bias[0][0], bias[0][1], bias[0][0], bias[0][1] },
+        { bias[1][0], bias[1][1], bias[1][0], bias[1][1] },
+    };
+    const uint16_t chromaPairBias[2][4] = {
+        { bias[0][0], bias[0][0], bias[0][1], bias[0][1] },
+        { bias[1][0], bias[1][0], bias[1][1], bias[1][1] },
+    };
+
+    for (int y = slice.y; y < slice.y + slice.height; y++) {
+        const uint16_t* src = (const uint16_t*)(m_SrcFrame->data[0] + (ptrdiff_t)m_SrcFrame->linesize[0] * y);
+        uint8_t* dst = m_DstData[0] + (ptrdiff_t)m_DstLinesize[0] * y;
+
+        if (m_ToneMap) {
+            toneMapRow(src, dst, m_Width, m_SampleShift, m_ToneMapLut, shift, lumaBias[y & 1]);
+        }
+        else {
+            m_ConvertRow(src, dst, m_Width, shift, lumaBias[y & 1]);
+        }
+    }
+
+    // Slices start on even rows, so each one owns its chroma rows
+    int chromaWidth = (m_Width + 1) / 2;
+    int chromaEnd = (slice.y + slice.height + 1) / 2;
+    for (int y = slice.y / 2; y < chromaEnd; y++) {
+        uint8_t* dst = m_DstData[1] + (ptrdiff_t)m_DstLinesize[1] * y;
+        const uint16_t* srcU = (const uint16_t*)(m_SrcFrame->data[1] + (ptrdiff_t)m_SrcFrame->linesize[1] * y);
+        const uint16_t* srcV = m_SemiPlanarSource ?
+                    srcU + 1 :
+                    (const uint16_t*)(m_SrcFrame->data[2] + (ptrdiff_t)m_SrcFrame->linesize[2] * y);
+
+        if (m_ToneMap) {
+            // Chroma follows the tone mapped luma of its 2x2 block
+            int lumaY = y * 2;
+            int lumaBottomY = SDL_min(lumaY + 1, m_SrcFrame->height - 1);
+            const uint16_t* lumaTop = (const uint16_t*)(m_SrcFrame->data[0] + (ptrdiff_t)m_SrcFrame->linesize[0] * lumaY);
+            const uint16_t* lumaBottom = (const uint16_t*)(m_SrcFrame->data[0] + (ptrdiff_t)m_SrcFrame->linesize[0] * lumaBottomY);
+            toneMapChromaRow(lumaTop, lumaBottom, m_Width,
+                             srcU, srcV, m_SemiPlanarSource ? 2 : 1,
+                             dst, chromaWidth, m_SampleShift, m_ChromaGainLut,
+                             shift, bias[y & 1]);
+        }
+        else if (m_SemiPlanarSource) {
+            m_ConvertRow(srcU, dst, chromaWidth * 2, shift, chromaPairBias[y & 1]);
+        }
+        else {
+            m_InterleaveRow(srcU, srcV, dst, chromaWidth, shift, bias[y & 1]);
+        }
+    }
+}
+
+void CpuColorConverter::convertSlice(Slice& slice)
+{
+    if (m_DownConvert) {
+        downConvertSlice(slice);
+        slice.failed = false;
+        SDL_SemPost(slice.done);
+        return;
+    }
+
+    const uint8_t* srcData[AV_NUM_DATA_POINTERS] = {};
+    for (int i = 0; i < AV_NUM_DATA_POINTERS && m_SrcFrame->data[i] != nullptr; i++) {
+        // Only the chroma planes are subsampled
+        int shift = (i == 1 || i == 2) ? m_ChromaShift : 0;
+        srcData[i] = m_SrcFrame->data[i] + (ptrdiff_t)m_SrcFrame->linesize[i] * (slice.y >> shift);
+    }
+
+    uint8_t* dstData[4] = { m_DstData[0] + (ptrdiff_t)m_DstLinesize[0] * slice.y };
+    int dstLinesize[4] = { m_DstLinesize[0] };
+
+    slice.failed = sws_scale(slice.context, srcData, m_SrcFrame->linesize, 0, slice.height,
+                             dstData, dstLinesize) <= 0;
+
+    SDL_SemPost(slice.done);
+}
+
+void CpuColorConverter::submitFrame(AVFrame* frame)
+{
+    if (m_DstFrame->buf[0] == nullptr) {
+        int err = av_frame_get_buffer(m_DstFrame, 0);
+        if (err < 0) {
+            char string[AV_ERROR_MAX_STRING_SIZE];
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "av_frame_get_buffer() failed: %s",
+                         av_make_error_string(string, sizeof(string), err));
+
+            // Report the failure from waitForNextSlice() and finishFrame()
+            finishFrame();
+            m_Failed = true;
+            return;
+        }
+    }
+
+    submitFrame(frame, m_DstFrame->data, m_DstFrame->linesize);
+}
+
+void CpuColorConverter::submitFrame(AVFrame* frame, uint8_t* const dstData[4], const int dstLinesize[4])
+{
+    // The previous frame must be completely finished first
+    finishFrame();
+
+    m_SrcFrame = frame;
+    for (int i = 0; i < 4; i++) {
+        m_DstData[i] = dstData[i];
+        m_DstLinesize[i] = dstLinesize[i];
+    }
+    m_NextConsumedSlice = 0;
+
+    // This is a full barrier, so workers see the new frame
+    SDL_AtomicSet(&m_NextSlice, 0);
+
+    for (int i = 0; i < m_ThreadCount; i++) {
+        SDL_SemPost(m_WorkSemaphore);
+    }
+}
+
+bool CpuColorConverter::waitForNextSlice(SDL_Rect* rect, uint8_t** pixels, int* pitch)
+{
+    if (m_Failed || m_NextConsumedSlice >= m_SliceCount) {
+        return false;
+    }
+
+    Slice& slice = m_Slices[m_NextConsumedSlice];
+    SDL_SemWait(slice.done);
+    m_NextConsumedSlice++;
+
+    if (slice.failed) {
+        // Remember the failure for finishFrame()
+        m_Failed = true;
+        return false;
+    }
+
+    rect->x = 0;
+    rect->y = slice.y;
+    rect->w = m_Width;
+    rect->h = slice.height;
+    *pixels = m_DstData[0] + (ptrdiff_t)m_DstLinesize[0] * slice.y;
+    *pitch = m_DstLinesize[0];
+    return true;
+}
+
+bool CpuColorConverter::finishFrame()
+{
+    while (m_NextConsumedSlice < m_SliceCount) {
+        Slice& slice = m_Slices[m_NextConsumedSlice++];
+        SDL_SemWait(slice.done);
+        m_Failed |= slice.failed;
+    }
+
+    bool succeeded = !m_Failed;
+    m_Failed = false;
+    m_SrcFrame = nullptr;
+    return succeeded;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "SDL_compat.h"
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+// Upper bound on conversion worker threads
+#define CPU_CONVERTER_MAX_THREADS 8
+
+// Each worker converts this many slices per frame, so the first slices
+// finish early enough to overlap their upload with the rest of the frame.
+#define CPU_CONVERTER_SLICES_PER_THREAD 2
+
+#define CPU_CONVERTER_MAX_SLICES (CPU_CONVERTER_MAX_THREADS * CPU_CONVERTER_SLICES_PER_THREAD)
+
+// Converts frames on the CPU for renderers that can't upload the frame's
+// format directly. The frame is split into horizontal slices and a
+// persistent pool of worker threads converts them in parallel. The caller
+// consumes the finished slices from top to bottom, so it can upload each
+// slice while the workers are still converting the ones below it.
+//
+// Most conversions use a separate SwsContext for each slice. 10-bit 4:2:0
+// frames (P010 and YUV420P10) converted to NV12 use our own SIMD kernels
+// instead, which can dither and tone map PQ content to SDR in the same pass.
+// tests/cpuconverter benchmarks them against swscale.
+//
+// Set CPU_CONVERTER_THREADS to override the number of worker threads and
+// CPU_CONVERTER_DITHER=0 or CPU_CONVERTER_TONEMAP=0 to disable those steps
+// of 10-bit down-conversion. CPU_CONVERTER_KERNEL=C, SSE2, AVX2 or NEON
+// forces a down-conversion kernel the CPU supports.
+class CpuColorConverter
+{
+public:
+    CpuColorConverter();
+    ~CpuColorConverter();
+
+    // Prepares to convert frames with the same format and properties as this one
+    bool initialize(const AVFrame* frame, enum AVPixelFormat dstFormat);
+
+    // Returns true if initialize() would use the SIMD down-conversion kernels
+    static bool isDownConversion(enum AVPixelFormat srcFormat, enum AVPixelFormat dstFormat);
+
+    // Returns true if the named down-conversion kernel can run on this CPU
+    static bool isDownConversionKernelSupported(const char* name);
+
+    // Starts converting the frame into our own buffer. The frame must not be
+    // modified or freed until finishFrame() has been called.
+    void submitFrame(AVFrame* frame);
+
+    // Same as above, but converts into the caller's buffer (like a locked
+    // texture), which must also stay valid until finishFrame() is called.
+    void submitFrame(AVFrame* frame, uint8_t* const dstData[4], const int dstLinesize[4]);
+
+    // Blocks until the next slice from the top is converted. Returns false
+    // once all slices have been consumed or if conversion failed.
+    bool waitForNextSlice(SDL_Rect* rect, uint8_t** pixels, int* pitch);
+
+    // Waits for any slices that weren't consumed. Returns false if any
+    // slice of the frame failed to convert. The frame may be freed after.
+    bool finishFrame();
+
+    // Row kernels for 10-bit down-conversion. Each sample has a bias added,
+    // is shifted right by shift, then saturated to 8 bits. ConvertRowFunc
+    // adds bias[x & 3] to sample x. InterleaveRowFunc adds bias[x & 1] to
+    // both samples of pair x.
+    typedef void (*ConvertRowFunc)(const uint16_t* src, uint8_t* dst, int count,
+                                   int shift, const uint16_t* bias);
+    typedef void (*InterleaveRowFunc)(const uint16_t* srcU, const uint16_t* srcV, uint8_t* dst, int count,
+                                      int shift, const uint16_t* bias);
+
+    // A set of row kernels for one instruction set
+    struct DownConversionKernel {
+        const char* name;
+        SDL_bool (*isSupported)(void);
+        ConvertRowFunc convertRow;
+        InterleaveRowFunc interleaveRow;
+    };
+
+private:
+    // Returns the named kernel, or the fastest one if name is null.
+    // Returns null if the named kernel is unknown or unsupported.
+    static const DownConversionKernel* findDownConversionKernel(const char* name);
+
+    struct Slice {
+        SwsContext* context;
+        int y;
+        int height;
+        SDL_sem* done;
+        bool failed;
+    };
+
+    static int workerThreadProc(void* context);
+
+    void convertSlice(Slice& slice);
+
+    void downConvertSlice(const Slice& slice);
+
+    void initializeToneMap(bool fullRange);
+
+    void destroy();
+
+    SDL_Thread* m_Threads[CPU_CONVERTER_MAX_THREADS];
+    int m_ThreadCount;
+    SDL_sem* m_WorkSemaphore;
+    SDL_atomic_t m_NextSlice;
+    SDL_atomic_t m_Stopping;
+
+    Slice m_Slices[CPU_CONVERTER_MAX_SLICES];
+    int m_SliceCount;
+    int m_NextConsumedSlice;
+    bool m_Failed;
+
+    int m_Width;
+    int m_ChromaShift;
+    AVFrame* m_SrcFrame;
+    AVFrame* m_DstFrame;
+    uint8_t* m_DstData[4];
+    int m_DstLinesize[4];
+
+    // 10-bit down-conversion state
+    bool m_DownConvert;
+    bool m_SemiPlanarSource;
+    int m_SampleShift;
+    bool m_Dither;
+    bool m_ToneMap;
+    uint16_t m_ToneMapLut[1024];
+    uint16_t m_ChromaGainLut[1024];
+    ConvertRowFunc m_ConvertRow;
+    InterleaveRowFunc m_InterleaveRow;
+};
@@ -67,6 +67,7 @@ extern "C" {
 #include <string.h>
 
 #include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "streaming/streamutils.h"
 #include "streaming/session.h"
@@ -150,11 +151,33 @@ DrmRenderer::DrmRenderer(AVHWDeviceType hwDeviceType, IFFmpegRenderer *backendRe
       m_VideoFormat(0),
       m_OverlayCompositionSurface(nullptr),
       m_OverlayRects{},
+      m_OverlayShadows{},
       m_Version(nullptr),
       m_HdrOutputMetadataBlobId(0),
       m_OutputRect{},
       m_SwFrameMapper(this),
-      m_CurrentSwFrameIdx(0)
+      m_CurrentSwFrameIdx(0),
+      m_DirectDecodeEnabled(false),
+      m_DirectDecodeForced(false),
+      m_DecodeBufferPool(nullptr),
+      m_DecodePoolFormat(AV_PIX_FMT_NONE),
+      m_DecodePoolWidth(0),
+      m_DecodePoolHeight(0),
+      m_DecodePoolAlignedWidth(0),
+      m_DecodePoolAlignedHeight(0),
+      m_DecodePoolLinesizeAlign{},
+      m_FbCacheEnabled(true),
+      m_FbCache([this](uint32_t& fbId) {
+          // FBs still on a plane are freed once they're replaced
+          m_PropSetter.releaseRetainedFb(fbId);
+      }),
+      m_KmsCommitTimeUs(0),
+      m_MaxKmsCommitTimeUs(0),
+      m_KmsCommits(0),
+      m_FbLookupTimeUs(0),
+      m_MaxFbLookupTimeUs(0),
+      m_FbLookups(0),
+      m_FramebufferImports(0)
 #ifdef HAVE_EGL
     , m_EglImageFactory(this)
 #endif
@@ -170,6 +193,10 @@ DrmRenderer::~DrmRenderer()
         SDL_FreeSurface(m_OverlayCompositionSurface);
     }
 
+    for (int i = 0; i < Overlay::OverlayMax; i++) {
+        setOverlayShadow((Overlay::OverlayType)i, nullptr);
+    }
+
     if (m_DrmStateModified) {
         // Ensure we're out of HDR mode
         setHdrMode(false);
@@ -208,6 +235,14 @@ DrmRenderer::~DrmRenderer()
         m_PropSetter.apply();
     }
 
+    // The planes are disabled now, so this frees all cached FBs
+    m_FbCache.flush();
+    m_PropSetter.apply();
+
+    // The decoder and Pacer are gone, so no frames reference these anymore
+    av_buffer_pool_uninit(&m_DecodeBufferPool);
+    SDL_assert(m_DecodeBuffers.empty());
+
     for (int i = 0; i < k_SwFrameCount; i++) {
         if (m_SwFrame[i].primeFd) {
             close(m_SwFrame[i].primeFd);
@@ -274,6 +309,10 @@ bool DrmRenderer::prepareDecoderContext(AVCodecContext* context, AVDictionary**
 
 bool DrmRenderer::prepareDecoderContextInGetFormat(AVCodecContext*, AVPixelFormat)
 {
+    // The surface pool is being reset, so the render thread
+    // must drop the FBs it has cached for the old surfaces.
+    m_FbCache.reset();
+
 #ifdef HAVE_EGL
     // The surface pool is being reset, so clear the cached EGLImages
     m_EglImageFactory.resetCache();
@@ -351,11 +390,11 @@ void DrmRenderer::prepareToRender()
         m_PropSetter.set(*prop, contentType.toStdString());
     }
 
-    // Enable VRR if V-sync is off by default
+    // Enable VRR if V-sync is off or we're pacing for VRR by default
     if (auto prop = m_Crtc.property("VRR_ENABLED")) {
         bool enableVrr;
         if (!Utils::getEnvironmentVariableOverride("DRM_ENABLE_VRR", &enableVrr)) {
-            enableVrr = !m_Vsync;
+            enableVrr = !m_Vsync || m_Vrr;
         }
 
         m_PropSetter.set(*prop, prop->clamp(enableVrr ? 1 : 0));
@@ -427,6 +466,7 @@ bool DrmRenderer::initialize(PDECODER_PARAMETERS params)
     m_Window = params->window;
     m_VideoFormat = params->videoFormat;
     m_Vsync = params->enableVsync;
+    m_Vrr = params->enableVrr;
     m_SwFrameMapper.setVideoFormat(params->videoFormat);
 
     // Try to get the FD that we're sharing with SDL
@@ -611,6 +651,23 @@ bool DrmRenderer::initialize(PDECODER_PARAMETERS params)
 
     m_PropSetter.initialize(m_DrmFd, atomic, !params->enableVsync);
 
+    bool directDecode;
+    if (Utils::getEnvironmentVariableOverride("DRM_DIRECT_DECODE", &directDecode)) {
+        m_DirectDecodeEnabled = directDecode;
+        m_DirectDecodeForced = directDecode;
+    }
+    else {
+        // Decode directly into dumb buffers when we're rendering software frames,
+        // but only if isDecodeBufferReadFast() finds that their mapping is cached
+        m_DirectDecodeEnabled = true;
+        m_DirectDecodeForced = false;
+    }
+
+    if (!Utils::getEnvironmentVariableOverride("DRM_FB_CACHE", &m_FbCacheEnabled)) {
+        // Reuse FBs for the decoder's surfaces by default
+        m_FbCacheEnabled = true;
+    }
+
     drmModePlaneRes* planeRes = drmModeGetPlaneResources(m_DrmFd);
     if (planeRes == nullptr) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
@@ -966,6 +1023,11 @@ int DrmRenderer::getRendererAttributes()
     // This renderer does not buffer any frames in the graphics pipeline
     attributes |= RENDERER_ATTRIBUTE_NO_BUFFERING;
 
+    // Without V-sync, we commit with async page flips
+    if (!m_Vsync) {
+        attributes |= RENDERER_ATTRIBUTE_NONBLOCKING_PRESENT;
+    }
+
 #ifdef GL_IS_SLOW
     // Restrict streaming resolution to 1080p on the Pi 4 while in the desktop environment.
     // EGL performance is extremely poor and just barely hits 1080p60 on Bookworm. This also
@@ -1062,6 +1124,369 @@ void DrmRenderer::setHdrMode(bool enabled)
     }
 }
 
+void DrmRenderer::notifyFrameQueued(AVFrame* frame)
+{
+    // Start reading back hwframes that will go through mapSoftwareFrame()
+    if (frame->hw_frames_ctx != nullptr && frame->format != AV_PIX_FMT_DRM_PRIME && !m_DrmPrimeBackend) {
+        m_SwFrameMapper.prefetchSwFrame(frame);
+    }
+}
+
+int DrmRenderer::getDecoderBuffer(AVCodecContext* context, AVFrame* frame, int flags)
+{
+    // Only use dumb buffers for frames we scan out ourselves. Anything
+    // else would have to read the frame back from uncached memory.
+    if (!m_DirectDecodeEnabled || !m_SupportsDirectRendering || context->hw_frames_ctx != nullptr) {
+        return avcodec_default_get_buffer2(context, frame, flags);
+    }
+
+    auto drmFormatTuple = k_AvToDrmFormatMap.find((AVPixelFormat)frame->format);
+    if (drmFormatTuple == k_AvToDrmFormatMap.end() ||
+            (!m_SupportedVideoPlaneFormats.empty() &&
+             m_SupportedVideoPlaneFormats.find(drmFormatTuple->second) == m_SupportedVideoPlaneFormats.end())) {
+        return avcodec_default_get_buffer2(context, frame, flags);
+    }
+
+    std::lock_guard lg { m_DecodeBufferLock };
+
+    AVBufferRef* buffer;
+    if (m_DecodeBufferPool == nullptr ||
+            frame->format != m_DecodePoolFormat ||
+            frame->width != m_DecodePoolWidth ||
+            frame->height != m_DecodePoolHeight) {
+        // Buffers from the old pool are freed when their frames are
+        av_buffer_pool_uninit(&m_DecodeBufferPool);
+
+        m_DecodePoolFormat = (AVPixelFormat)frame->format;
+        m_DecodePoolWidth = frame->width;
+        m_DecodePoolHeight = frame->height;
+        m_DecodePoolAlignedWidth = frame->width;
+        m_DecodePoolAlignedHeight = frame->height;
+        avcodec_align_dimensions2(context,
+                                  &m_DecodePoolAlignedWidth,
+                                  &m_DecodePoolAlignedHeight,
+                                  m_DecodePoolLinesizeAlign);
+
+        m_DecodeBufferPool = av_buffer_pool_init2(0, this, allocDecodeBuffer, nullptr);
+
+        // The FBs we've cached are for buffers from the old pool
+        m_FbCache.reset();
+
+        // Make sure the plane can actually scan out of these buffers
+        buffer = m_DecodeBufferPool ? av_buffer_pool_get(m_DecodeBufferPool) : nullptr;
+        if (buffer == nullptr || !testDecodeBufferPool(buffer)) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Unable to decode directly into dumb buffers. Frames will be copied instead.");
+            av_buffer_unref(&buffer);
+            av_buffer_pool_uninit(&m_DecodeBufferPool);
+            m_DirectDecodeEnabled = false;
+            return avcodec_default_get_buffer2(context, frame, flags);
+        }
+        // NB: This rejects write-combined dumb buffers, which is what most SoC
+        // display drivers (like vc4 on the Raspberry Pi) hand out. Those devices
+        // always take the copy path, even where decoding into the dumb buffer
+        // would still win overall, unless DRM_DIRECT_DECODE=1 is set.
+        else if (!m_DirectDecodeForced && !isDecodeBufferReadFast(buffer)) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Not decoding directly into dumb buffers because reading them is slow (likely write-combined). "
+                        "Frames will be copied instead. Set DRM_DIRECT_DECODE=1 to decode into them anyway.");
+            av_buffer_unref(&buffer);
+            av_buffer_pool_uninit(&m_DecodeBufferPool);
+            m_DirectDecodeEnabled = false;
+            return avcodec_default_get_buffer2(context, frame, flags);
+        }
+
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Decoding directly into dumb buffers: %dx%d (aligned to %dx%d)",
+                    m_DecodePoolWidth,
+                    m_DecodePoolHeight,
+                    m_DecodePoolAlignedWidth,
+                    m_DecodePoolAlignedHeight);
+    }
+    else {
+        buffer = av_buffer_pool_get(m_DecodeBufferPool);
+        if (buffer == nullptr) {
+            // Fall back to copying this frame if we've exhausted dumb buffer memory
+            return avcodec_default_get_buffer2(context, frame, flags);
+        }
+    }
+
+    DecodeBuffer* decodeBuffer = nullptr;
+    for (auto db : m_DecodeBuffers) {
+        if (db->mapping == buffer->data) {
+            decodeBuffer = db;
+            break;
+        }
+    }
+    SDL_assert(decodeBuffer != nullptr);
+
+    frame->buf[0] = buffer;
+    for (int i = 0; i < decodeBuffer->planes; i++) {
+        frame->data[i] = buffer->data + decodeBuffer->offsets[i];
+        frame->linesize[i] = decodeBuffer->pitches[i];
+    }
+    frame->extended_data = frame->data;
+
+    return 0;
+}
+
+#if FF_API_BUFFER_SIZE_T
+AVBufferRef* DrmRenderer::allocDecodeBuffer(void* opaque, int)
+#else
+AVBufferRef* DrmRenderer::allocDecodeBuffer(void* opaque, size_t)
+#endif
+{
+    auto me = (DrmRenderer*)opaque;
+    std::lock_guard lg { me->m_DecodeBufferLock };
+
+    const AVPixFmtDescriptor* formatDesc = av_pix_fmt_desc_get(me->m_DecodePoolFormat);
+    int planes = av_pix_fmt_count_planes(me->m_DecodePoolFormat);
+    int step = formatDesc->comp[0].step;
+
+    // We derive the chroma pitch from the luma pitch like mapSoftwareFrame(),
+    // so the luma pitch must be aligned enough for every plane to satisfy the
+    // decoder's stride alignment. The driver picks the final pitch for scanout,
+    // so we ask for a width that's already aligned and then verify its choice.
+    int chromaPitchShift = planes == 3 ? formatDesc->log2_chroma_w : 0;
+    int pitchAlign = me->m_DecodePoolLinesizeAlign[0];
+    for (int i = 1; i < planes; i++) {
+        pitchAlign = FFMAX(pitchAlign, me->m_DecodePoolLinesizeAlign[i] << chromaPitchShift);
+    }
+
+    struct drm_mode_create_dumb createBuf = {};
+    createBuf.bpp = step * 8;
+    createBuf.width = FFALIGN(me->m_DecodePoolAlignedWidth * step, pitchAlign) / step;
+    createBuf.height = me->m_DecodePoolAlignedHeight;
+    if (planes > 1) {
+        createBuf.height += 2 * AV_CEIL_RSHIFT(me->m_DecodePoolAlignedHeight,
+                                               formatDesc->log2_chroma_w +
+                                               formatDesc->log2_chroma_h);
+    }
+
+    // Leave an extra row for decoders that read slightly past the last plane
+    createBuf.height += 1;
+
+    int err = drmIoctl(me->m_DrmFd, DRM_IOCTL_MODE_CREATE_DUMB, &createBuf);
+    if (err < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "DRM_IOCTL_MODE_CREATE_DUMB failed: %d",
+                     errno);
+        return nullptr;
+    }
+
+    auto decodeBuffer = new DecodeBuffer();
+    decodeBuffer->renderer = me;
+    decodeBuffer->handle = createBuf.handle;
+    decodeBuffer->primeFd = -1;
+    decodeBuffer->size = createBuf.size;
+    decodeBuffer->format = k_AvToDrmFormatMap.at(me->m_DecodePoolFormat);
+    decodeBuffer->planes = planes;
+    me->m_DecodeBuffers.push_back(decodeBuffer);
+
+    if (createBuf.pitch % pitchAlign != 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Dumb buffer pitch %u doesn't meet decoder alignment of %d",
+                    createBuf.pitch,
+                    pitchAlign);
+        freeDecodeBuffer(decodeBuffer, nullptr);
+        return nullptr;
+    }
+
+    uint64_t offset = 0;
+    for (int i = 0; i < planes; i++) {
+        int planeHeight;
+
+        if (i == 0) {
+            planeHeight = me->m_DecodePoolAlignedHeight;
+            decodeBuffer->pitches[i] = createBuf.pitch;
+        }
+        else {
+            planeHeight = AV_CEIL_RSHIFT(me->m_DecodePoolAlignedHeight, formatDesc->log2_chroma_h);
+
+            // First argument to AV_CEIL_RSHIFT() *must* be signed for correct behavior!
+            decodeBuffer->pitches[i] = AV_CEIL_RSHIFT((ptrdiff_t)createBuf.pitch, formatDesc->log2_chroma_w);
+
+            // If UV planes are interleaved, double the pitch to count both U+V together
+            if (planes == 2) {
+                decodeBuffer->pitches[i] <<= 1;
+            }
+        }
+
+        decodeBuffer->offsets[i] = offset;
+        offset += (uint64_t)decodeBuffer->pitches[i] * planeHeight;
+    }
+
+    if (offset > createBuf.size) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Dumb buffer is too small for decoded frame: %" PRIu64 " < %" PRIu64,
+                     (uint64_t)createBuf.size,
+                     offset);
+        freeDecodeBuffer(decodeBuffer, nullptr);
+        return nullptr;
+    }
+
+    // The decoder reads reference frames back, so the mapping must be readable
+    if (!me->mapDumbBuffer(decodeBuffer->handle, decodeBuffer->size, (void**)&decodeBuffer->mapping, true)) {
+        freeDecodeBuffer(decodeBuffer, nullptr);
+        return nullptr;
+    }
+
+    err = drmPrimeHandleToFD(me->m_DrmFd, decodeBuffer->handle, O_CLOEXEC, &decodeBuffer->primeFd);
+    if (err < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "drmPrimeHandleToFD() failed: %d",
+                     errno);
+        decodeBuffer->primeFd = -1;
+        freeDecodeBuffer(decodeBuffer, nullptr);
+        return nullptr;
+    }
+
+    AVBufferRef* buffer = av_buffer_create(decodeBuffer->mapping, decodeBuffer->size,
+                                           freeDecodeBuffer, decodeBuffer, 0);
+    if (buffer == nullptr) {
+        freeDecodeBuffer(decodeBuffer, nullptr);
+        return nullptr;
+    }
+
+    return buffer;
+}
+
+void DrmRenderer::freeDecodeBuffer(void* opaque, uint8_t*)
+{
+    auto decodeBuffer = (DecodeBuffer*)opaque;
+    auto me = decodeBuffer->renderer;
+    std::lock_guard lg { me->m_DecodeBufferLock };
+
+    me->m_DecodeBuffers.erase(std::remove(me->m_DecodeBuffers.begin(), me->m_DecodeBuffers.end(), decodeBuffer),
+                              me->m_DecodeBuffers.end());
+
+    if (decodeBuffer->mapping) {
+        munmap(decodeBuffer->mapping, decodeBuffer->size);
+    }
+    if (decodeBuffer->primeFd >= 0) {
+        close(decodeBuffer->primeFd);
+    }
+    if (decodeBuffer->handle) {
+        struct drm_mode_destroy_dumb destroyBuf = {};
+        destroyBuf.handle = decodeBuffer->handle;
+        drmIoctl(me->m_DrmFd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroyBuf);
+    }
+
+    delete decodeBuffer;
+}
+
+bool DrmRenderer::testDecodeBufferPool(AVBufferRef* buffer)
+{
+    std::lock_guard lg { m_DecodeBufferLock };
+
+    for (auto decodeBuffer : m_DecodeBuffers) {
+        if (decodeBuffer->mapping != buffer->data) {
+            continue;
+        }
+
+        uint32_t handles[4] = {};
+        uint32_t pitches[4] = {};
+        uint32_t offsets[4] = {};
+        for (int i = 0; i < decodeBuffer->planes; i++) {
+            handles[i] = decodeBuffer->handle;
+            pitches[i] = decodeBuffer->pitches[i];
+            offsets[i] = decodeBuffer->offsets[i];
+        }
+
+        uint32_t fbId;
+        int err = drmModeAddFB2(m_DrmFd, m_DecodePoolWidth, m_DecodePoolHeight,
+                                decodeBuffer->format,
+                                handles, pitches, offsets, &fbId, 0);
+        if (err < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "drmModeAddFB2() failed for decoder dumb buffer: %d",
+                         err);
+            return false;
+        }
+
+        drmModeRmFB(m_DrmFd, fbId);
+        return true;
+    }
+
+    return false;
+}
+
+static uint64_t timeMemoryRead(const uint8_t* data, size_t size)
+{
+    uint64_t startUs = LiGetMicroseconds();
+
+    // Read one word of each cache line, like the decoder's strided reads
+    volatile uint64_t sum = 0;
+    for (size_t i = 0; i + sizeof(uint64_t) <= size; i += 64) {
+        uint64_t value;
+        memcpy(&value, data + i, sizeof(value));
+        sum = sum + value;
+    }
+
+    return LiGetMicroseconds() - startUs;
+}
+
+bool DrmRenderer::isDecodeBufferReadFast(AVBufferRef* buffer)
+{
+    // Dumb buffers are often write-combined, which is fine for the copy
+    // path but makes every reference frame read by the decoder uncached.
+    size_t size = SDL_min((size_t)buffer->size, (size_t)DRM_DIRECT_DECODE_READ_TEST_SIZE);
+    std::vector<uint8_t> systemMemory(size, 1);
+
+    // Take the faster of two passes, so both are measured with warm TLBs
+    uint64_t dumbUs = SDL_min(timeMemoryRead(buffer->data, size), timeMemoryRead(buffer->data, size));
+    uint64_t systemUs = SDL_min(timeMemoryRead(systemMemory.data(), size), timeMemoryRead(systemMemory.data(), size));
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Reading %zu KB took %" PRIu64 " us from a dumb buffer and %" PRIu64 " us from system memory",
+                size / 1024,
+                dumbUs,
+                systemUs);
+
+    return dumbUs <= SDL_max(systemUs, (uint64_t)1) * DRM_DIRECT_DECODE_MAX_READ_PENALTY;
+}
+
+bool DrmRenderer::mapDecodeBufferFrame(AVFrame* frame, AVDRMFrameDescriptor* mappedFrame)
+{
+    // Frames from getDecoderBuffer() have a single buffer
+    if (frame->buf[0] == nullptr || frame->buf[1] != nullptr) {
+        return false;
+    }
+
+    std::lock_guard lg { m_DecodeBufferLock };
+
+    for (auto decodeBuffer : m_DecodeBuffers) {
+        if (decodeBuffer->mapping != frame->buf[0]->data) {
+            continue;
+        }
+
+        SDL_zerop(mappedFrame);
+
+        mappedFrame->nb_objects = 1;
+        mappedFrame->objects[0].fd = decodeBuffer->primeFd;
+        mappedFrame->objects[0].size = decodeBuffer->size;
+
+        // Dumb buffers are implicitly linear (see mapSoftwareFrame())
+        mappedFrame->objects[0].format_modifier = DRM_FORMAT_MOD_INVALID;
+
+        mappedFrame->nb_layers = 1;
+
+        auto &layer = mappedFrame->layers[0];
+        layer.format = decodeBuffer->format;
+        layer.nb_planes = decodeBuffer->planes;
+        for (int i = 0; i < decodeBuffer->planes; i++) {
+            // Use the frame's data pointers to account for any cropping
+            layer.planes[i].object_index = 0;
+            layer.planes[i].offset = frame->data[i] - frame->buf[0]->data;
+            layer.planes[i].pitch = frame->linesize[i];
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
 bool DrmRenderer::mapSoftwareFrame(AVFrame *frame, AVDRMFrameDescriptor *mappedFrame)
 {
     bool ret = false;
@@ -1244,14 +1669,16 @@ bool DrmRenderer::mapSoftwareFrame(AVFrame *frame, AVDRMFrameDescriptor *mappedF
 
 Exit:
     if (freeFrame) {
-        av_frame_free(&frame);
+        m_SwFrameMapper.releaseSwFrame(&frame);
     }
 
     return ret;
 }
 
-bool DrmRenderer::mapDumbBuffer(uint32_t handle, size_t size, void** mapping)
+bool DrmRenderer::mapDumbBuffer(uint32_t handle, size_t size, void** mapping, bool readable)
 {
+    int prot = readable ? (PROT_READ | PROT_WRITE) : PROT_WRITE;
+
     struct drm_mode_map_dumb mapBuf = {};
     mapBuf.handle = handle;
     int err = drmIoctl(m_DrmFd, DRM_IOCTL_MODE_MAP_DUMB, &mapBuf);
@@ -1267,11 +1694,11 @@ bool DrmRenderer::mapDumbBuffer(uint32_t handle, size_t size, void** mapping)
     // chopped off when passed via the normal mmap() call using 32-bit off_t. We avoid this issue
     // by explicitly calling mmap64() to ensure the 64-bit offset is never truncated.
 #if defined(__GLIBC__) && QT_POINTER_SIZE == 4
-    *mapping = mmap64(nullptr, size, PROT_WRITE, MAP_SHARED, m_DrmFd, mapBuf.offset);
+    *mapping = mmap64(nullptr, size, prot, MAP_SHARED, m_DrmFd, mapBuf.offset);
 #else
-    *mapping = mmap(nullptr, size, PROT_WRITE, MAP_SHARED, m_DrmFd, mapBuf.offset);
+    *mapping = mmap(nullptr, size, prot, MAP_SHARED, m_DrmFd, mapBuf.offset);
 #endif
-    if (mapping == MAP_FAILED) {
+    if (*mapping == MAP_FAILED) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                      "mmap() failed for dumb buffer: %d",
                      errno);
@@ -1356,6 +1783,12 @@ void DrmRenderer::enterOverlayCompositionMode()
         }
     }
 
+    // The composition surface starts out empty, so the next update
+    // of each overlay must be drawn in full
+    for (int i = 0; i < Overlay::OverlayMax; i++) {
+        setOverlayShadow((Overlay::OverlayType)i, nullptr);
+    }
+
     struct drm_mode_create_dumb createBuf = {};
     uint32_t fbId;
     void* mapping = nullptr;
@@ -1416,71 +1849,153 @@ Fail:
     drmIoctl(m_DrmFd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroyBuf);
 }
 
+static inline uint32_t getOverlayPixel(SDL_Surface* surface, const SDL_Rect& rect, int x, int y)
+{
+    // Anything outside of the overlay is transparent
+    if (surface == nullptr ||
+            x < rect.x || x >= rect.x + rect.w ||
+            y < rect.y || y >= rect.y + rect.h) {
+        return 0;
+    }
+
+    auto pixelRow = (uint8_t*)surface->pixels + ((y - rect.y) * surface->pitch);
+    return ((uint32_t*)pixelRow)[x - rect.x];
+}
+
+int DrmRenderer::computeOverlayDamage(Overlay::OverlayType type, SDL_Surface* newSurface,
+                                      const SDL_Rect& overlayRect, SDL_Rect* damageRects)
+{
+    SDL_Surface* oldSurface = m_OverlayShadows[type];
+    const SDL_Rect& oldRect = m_OverlayRects[type];
+
+    // We must cover the old overlay area too in case it shrank or moved
+    SDL_Rect unionRect;
+    SDL_UnionRect(&overlayRect, &oldRect, &unionRect);
+
+    // Without the previous contents, the whole area is damaged
+    if (oldSurface == nullptr ||
+            oldSurface->format->format != newSurface->format->format ||
+            newSurface->format->BytesPerPixel != 4) {
+        damageRects[0] = unionRect;
+        return 1;
+    }
+
+    bool sameRect = SDL_RectEquals(&overlayRect, &oldRect);
+    int damageRectCount = 0;
+
+    for (int y = unionRect.y; y < unionRect.y + unionRect.h; y++) {
+        // Most rows of text overlays don't change between updates
+        if (sameRect &&
+                memcmp((uint8_t*)newSurface->pixels + ((y - overlayRect.y) * newSurface->pitch),
+                       (uint8_t*)oldSurface->pixels + ((y - oldRect.y) * oldSurface->pitch),
+                       overlayRect.w * 4) == 0) {
+            continue;
+        }
+
+        // Find the span of changed pixels in this row
+        int left = unionRect.x + unionRect.w;
+        for (int x = unionRect.x; x < unionRect.x + unionRect.w; x++) {
+            if (getOverlayPixel(newSurface, overlayRect, x, y) != getOverlayPixel(oldSurface, oldRect, x, y)) {
+                left = x;
+                break;
+            }
+        }
+        if (left == unionRect.x + unionRect.w) {
+            continue;
+        }
+
+        int right = left;
+        for (int x = unionRect.x + unionRect.w - 1; x > left; x--) {
+            if (getOverlayPixel(newSurface, overlayRect, x, y) != getOverlayPixel(oldSurface, oldRect, x, y)) {
+                right = x;
+                break;
+            }
+        }
+
+        SDL_Rect rowRect = { left, y, right - left + 1, 1 };
+
+        // Merge adjacent changed rows into a single rect. If we run out of
+        // rects, grow the last one to cover the remaining damage.
+        if (damageRectCount > 0 &&
+                (damageRects[damageRectCount - 1].y + damageRects[damageRectCount - 1].h == y ||
+                 damageRectCount == DRM_OVERLAY_MAX_DAMAGE_RECTS)) {
+            SDL_UnionRect(&damageRects[damageRectCount - 1], &rowRect, &damageRects[damageRectCount - 1]);
+        }
+        else {
+            damageRects[damageRectCount++] = rowRect;
+        }
+    }
+
+    return damageRectCount;
+}
+
+void DrmRenderer::setOverlayShadow(Overlay::OverlayType type, SDL_Surface* surface)
+{
+    if (m_OverlayShadows[type] != nullptr) {
+        SDL_FreeSurface(m_OverlayShadows[type]);
+    }
+    m_OverlayShadows[type] = surface;
+}
+
 void DrmRenderer::blitOverlayToCompositionSurface(Overlay::OverlayType type, SDL_Surface* newSurface, SDL_Rect* overlayRect)
 {
     SDL_assert(m_OverlayCompositionSurface);
 
     if (newSurface && overlayRect) {
-        // Disable blending of the source surface when blitting
-        SDL_SetSurfaceBlendMode(newSurface, SDL_BLENDMODE_NONE);
-
         // Premultiply alpha in place, so we can blit directly into the composition surface
         // without having to read anything (which may be very costly due to UC/WC memory)
         SDL_PremultiplyAlpha(newSurface->w, newSurface->h,
                              newSurface->format->format, newSurface->pixels, newSurface->pitch,
                              newSurface->format->format, newSurface->pixels, newSurface->pitch);
 
-        // Compute the union of the current and previous overlay rects. Our draw operation
-        // will need to cover this entire area to ensure the old dirty area is covered.
-        SDL_Rect overlayUnionRect;
-        SDL_UnionRect(overlayRect, &m_OverlayRects[type], &overlayUnionRect);
+        SDL_assert(newSurface->format->format == m_OverlayCompositionSurface->format->format);
 
-        // If the new overlay completely covers the old overlay, blit it all at once
-        if (SDL_RectEquals(&overlayUnionRect, overlayRect)) {
-            SDL_BlitSurface(newSurface, nullptr, m_OverlayCompositionSurface, overlayRect);
-        }
-        else {
-            SDL_assert(newSurface->format->format == m_OverlayCompositionSurface->format->format);
+        // Compare against the last surface we drew to find the rows that actually
+        // changed. This also covers any part of the old overlay we need to clear.
+        SDL_Rect damageRects[DRM_OVERLAY_MAX_DAMAGE_RECTS];
+        int damageRectCount = computeOverlayDamage(type, newSurface, *overlayRect, damageRects);
+        auto bpp = m_OverlayCompositionSurface->format->BytesPerPixel;
 
-            // Draw the surface row-by-row to ensure we clear the dirty area from the previous surface
+        for (int i = 0; i < damageRectCount; i++) {
+            const SDL_Rect& damageRect = damageRects[i];
+
+            // Draw the damaged area row-by-row to clear the dirty area from the previous surface
             // without causing flickering, which would be noticeable if we cleared the whole area first.
-            for (int y = overlayUnionRect.y; y < overlayUnionRect.y + overlayUnionRect.h; y++) {
+            for (int y = damageRect.y; y < damageRect.y + damageRect.h; y++) {
                 auto dstPixelRow =
                     (uint8_t*)m_OverlayCompositionSurface->pixels +
                     (y * m_OverlayCompositionSurface->pitch);
-                auto bpp = m_OverlayCompositionSurface->format->BytesPerPixel;
 
-                if (y < overlayRect->y || y > overlayRect->y + overlayRect->h) {
-                    // Clear the whole row if the overlay doesn't intersect this row
-                    memset(dstPixelRow + (overlayUnionRect.x * bpp),
-                           0,
-                           overlayUnionRect.w * bpp);
-                }
-                else {
-                    auto srcPixelRow = (uint8_t*)newSurface->pixels + ((y - overlayRect->y) * newSurface->pitch);
-
-                    // Clear columns prior to the intersection
-                    SDL_assert(overlayRect->x >= overlayUnionRect.x);
-                    memset(dstPixelRow + (overlayUnionRect.x * bpp),
-                           0,
-                           (overlayRect->x - overlayUnionRect.x) * bpp);
-
-                    // Copy the overlay into the intersection
-                    memcpy(dstPixelRow + (overlayRect->x * bpp),
-                           srcPixelRow,
-                           overlayRect->w * bpp);
-
-                    // Clear columns after the intersection
-                    SDL_assert(overlayUnionRect.w >= overlayRect->w);
-                    memset(dstPixelRow + ((overlayRect->x + overlayRect->w) * bpp),
-                           0,
-                           (overlayUnionRect.w - overlayRect->w) * bpp);
+                // Find the part of the damaged span covered by the new overlay
+                int copyStart = SDL_max(damageRect.x, overlayRect->x);
+                int copyEnd = SDL_min(damageRect.x + damageRect.w, overlayRect->x + overlayRect->w);
+                if (y < overlayRect->y || y >= overlayRect->y + overlayRect->h || copyEnd <= copyStart) {
+                    // Clear the whole span if the overlay doesn't intersect it
+                    memset(dstPixelRow + (damageRect.x * bpp), 0, damageRect.w * bpp);
+                    continue;
                 }
+
+                auto srcPixelRow = (uint8_t*)newSurface->pixels + ((y - overlayRect->y) * newSurface->pitch);
+
+                // Clear columns prior to the intersection
+                memset(dstPixelRow + (damageRect.x * bpp),
+                       0,
+                       (copyStart - damageRect.x) * bpp);
+
+                // Copy the overlay into the intersection
+                memcpy(dstPixelRow + (copyStart * bpp),
+                       srcPixelRow + ((copyStart - overlayRect->x) * bpp),
+                       (copyEnd - copyStart) * bpp);
+
+                // Clear columns after the intersection
+                memset(dstPixelRow + (copyEnd * bpp),
+                       0,
+                       (damageRect.x + damageRect.w - copyEnd) * bpp);
             }
-        }
 
-        // Dirty the modified portion of the plane
-        m_PropSetter.damagePlane(m_OverlayPlanes[0], overlayUnionRect);
+            // Dirty the modified portion of the plane
+            m_PropSetter.damagePlane(m_OverlayPlanes[0], damageRect);
+        }
     }
     else {
         // Clear the pixels where this overlay was drawn before
@@ -1516,6 +2031,7 @@ void DrmRenderer::notifyOverlayUpdated(Overlay::OverlayType type)
                 m_PropSetter.disablePlane(m_OverlayPlanes[type]);
             }
             memset(&m_OverlayRects[type], 0, sizeof(m_OverlayRects[type]));
+            setOverlayShadow(type, nullptr);
         }
 
         return;
@@ -1526,6 +2042,9 @@ void DrmRenderer::notifyOverlayUpdated(Overlay::OverlayType type)
     if (newSurface != nullptr) {
         uint32_t dumbBuffer, fbId;
         SDL_Rect overlayRect;
+        SDL_Rect damageRects[DRM_OVERLAY_MAX_DAMAGE_RECTS];
+        int damageRectCount = 0;
+        bool overlayRectChanged = false;
 
         if (type == Overlay::OverlayStatusUpdate) {
             // Bottom Left
@@ -1543,13 +2062,22 @@ void DrmRenderer::notifyOverlayUpdated(Overlay::OverlayType type)
 
         // Try to let the display controller composite for us
         if (!m_OverlayCompositionSurface) {
+            overlayRectChanged = memcmp(&m_OverlayRects[type], &overlayRect, sizeof(overlayRect)) != 0;
+            damageRectCount = computeOverlayDamage(type, newSurface, overlayRect, damageRects);
+
+            // Skip the upload and flip if nothing visible changed
+            if (!overlayRectChanged && damageRectCount == 0) {
+                SDL_FreeSurface(newSurface);
+                return;
+            }
+
             if (!uploadSurfaceToFb(newSurface, &dumbBuffer, &fbId)) {
                 SDL_FreeSurface(newSurface);
                 return;
             }
 
             // If we changed our overlay rect, we need to reconfigure the plane
-            if (memcmp(&m_OverlayRects[type], &overlayRect, sizeof(overlayRect)) != 0) {
+            if (overlayRectChanged) {
                 if (m_PropSetter.testPlane(m_OverlayPlanes[type], m_Crtc.objectId(), fbId,
                                            overlayRect.x, overlayRect.y, overlayRect.w, overlayRect.h,
                                            0, 0,
@@ -1585,11 +2113,22 @@ void DrmRenderer::notifyOverlayUpdated(Overlay::OverlayType type)
             // NB: This takes ownership of the FB and dumb buffer, even on failure
             m_PropSetter.flipPlane(m_OverlayCompositionSurface ? m_OverlayPlanes[0] : m_OverlayPlanes[type],
                                    fbId, dumbBuffer);
+
+            // The rest of the new FB matches the old one, so let drivers
+            // that support FB_DAMAGE_CLIPS update only what changed
+            if (!overlayRectChanged) {
+                for (int i = 0; i < damageRectCount; i++) {
+                    damageRects[i].x -= overlayRect.x;
+                    damageRects[i].y -= overlayRect.y;
+                    m_PropSetter.damagePlane(m_OverlayPlanes[type], damageRects[i]);
+                }
+            }
         }
 
         memcpy(&m_OverlayRects[type], &overlayRect, sizeof(overlayRect));
 
-        SDL_FreeSurface(newSurface);
+        // Keep this surface to compare with the next update
+        setOverlayShadow(type, newSurface);
     }
 }
 
@@ -1597,6 +2136,7 @@ bool DrmRenderer::addFbForFrame(AVFrame *frame, uint32_t* newFbId, bool testMode
 {
     AVDRMFrameDescriptor mappedFrame;
     AVDRMFrameDescriptor* drmFrame;
+    bool directFrame = false;
     int err;
 
     // If we don't have a DRM PRIME frame here, we'll need to map into one
@@ -1607,6 +2147,10 @@ bool DrmRenderer::addFbForFrame(AVFrame *frame, uint32_t* newFbId, bool testMode
                 return false;
             }
         }
+        else if (frame->hw_frames_ctx == nullptr && mapDecodeBufferFrame(frame, &mappedFrame)) {
+            // The decoder wrote this frame straight into one of our dumb buffers
+            directFrame = true;
+        }
         else {
             // Otherwise, we'll map it to a software format and use dumb buffers
             if (!mapSoftwareFrame(frame, &mappedFrame)) {
@@ -1717,6 +2261,39 @@ bool DrmRenderer::addFbForFrame(AVFrame *frame, uint32_t* newFbId, bool testMode
     SDL_assert(drmFrame->nb_layers == 1);
 
     const auto &layer = drmFrame->layers[0];
+
+    // Frames from a hw_frames_ctx or our decode buffer pool cycle through
+    // a fixed set of surfaces, so we can reuse the FB we created the last
+    // time we saw each one. We identify the DMA-BUFs by inode because
+    // mapped frames may get a new FD for the same buffer each time.
+    FbCacheKey cacheKey = {};
+    bool cacheable = m_FbCacheEnabled && !testMode && (frame->hw_frames_ctx != nullptr || directFrame);
+    if (cacheable) {
+        // Decode buffer pool changes are signalled by resetting the cache
+        m_FbCache.validate(frame);
+
+        for (int i = 0; i < drmFrame->nb_objects; i++) {
+            struct stat st;
+            if (fstat(drmFrame->objects[i].fd, &st) < 0) {
+                cacheable = false;
+                break;
+            }
+            cacheKey.buffers[i] = st.st_ino;
+        }
+        for (int i = 0; i < layer.nb_planes; i++) {
+            cacheKey.pitches[i] = layer.planes[i].pitch;
+            cacheKey.offsets[i] = layer.planes[i].offset;
+        }
+        cacheKey.format = layer.format;
+        cacheKey.modifier = drmFrame->objects[0].format_modifier;
+        cacheKey.width = frame->width;
+        cacheKey.height = frame->height;
+    }
+
+    if (cacheable && m_FbCache.lookup(cacheKey, newFbId)) {
+        return true;
+    }
+
     for (int i = 0; i < layer.nb_planes; i++) {
         const auto &object = drmFrame->objects[layer.planes[i].object_index];
 
@@ -1753,9 +2330,37 @@ bool DrmRenderer::addFbForFrame(AVFrame *frame, uint32_t* newFbId, bool testMode
         return false;
     }
 
+    if (!testMode) {
+        m_FramebufferImports++;
+    }
+
+    // Keep this FB around for the next time we see this surface
+    if (cacheable && m_FbCache.insert(cacheKey, *newFbId)) {
+        m_PropSetter.retainFb(*newFbId);
+    }
+
     return true;
 }
 
+void DrmRenderer::updateRenderStats(VIDEO_STATS* stats)
+{
+    stats->totalKmsCommitTimeUs += m_KmsCommitTimeUs;
+    stats->maxKmsCommitTimeUs = qMax(stats->maxKmsCommitTimeUs, m_MaxKmsCommitTimeUs);
+    stats->kmsCommits += m_KmsCommits;
+    stats->totalFbLookupTimeUs += m_FbLookupTimeUs;
+    stats->maxFbLookupTimeUs = qMax(stats->maxFbLookupTimeUs, m_MaxFbLookupTimeUs);
+    stats->fbLookups += m_FbLookups;
+    stats->framebufferImports += m_FramebufferImports;
+
+    m_KmsCommitTimeUs = 0;
+    m_MaxKmsCommitTimeUs = 0;
+    m_KmsCommits = 0;
+    m_FbLookupTimeUs = 0;
+    m_MaxFbLookupTimeUs = 0;
+    m_FbLookups = 0;
+    m_FramebufferImports = 0;
+}
+
 bool DrmRenderer::drmFormatMatchesVideoFormat(uint32_t drmFormat, int videoFormat)
 {
     auto drmToAvTuple = k_DrmToAvFormatMap.find(drmFormat);
@@ -1783,12 +2388,19 @@ void DrmRenderer::renderFrame(AVFrame* frame)
 {
     SDL_assert(m_OutputRect.w > 0 && m_OutputRect.h > 0);
 
-    // Register a frame buffer object for this frame
+    // Register a frame buffer object for this frame. This is timed apart
+    // from the commit, since it's the part the FB cache avoids.
     uint32_t fbId;
+    uint64_t lookupStartUs = LiGetMicroseconds();
     if (!addFbForFrame(frame, &fbId, false)) {
         return;
     }
 
+    uint32_t lookupTimeUs = (uint32_t)(LiGetMicroseconds() - lookupStartUs);
+    m_FbLookupTimeUs += lookupTimeUs;
+    m_MaxFbLookupTimeUs = qMax(m_MaxFbLookupTimeUs, lookupTimeUs);
+    m_FbLookups++;
+
     if (hasFrameFormatChanged(frame)) {
         SDL_Rect src, dst;
         src.x = src.y = 0;
@@ -1851,10 +2463,16 @@ void DrmRenderer::renderFrame(AVFrame* frame)
     // NB2: Pacer references the AVFrame (which also references the AVBuffers backing the frame
     // and the opaque_ref which may store our DRM-PRIME mapping) for frames backed by DMA-BUFs in
     // order to keep those from being reused by the decoder while they're still being scanned out.
+    uint64_t commitStartUs = LiGetMicroseconds();
     m_PropSetter.flipPlane(m_VideoPlane, fbId, 0);
 
     // Apply pending atomic transaction (if in atomic mode)
     m_PropSetter.apply();
+
+    uint32_t commitTimeUs = (uint32_t)(LiGetMicroseconds() - commitStartUs);
+    m_KmsCommitTimeUs += commitTimeUs;
+    m_MaxKmsCommitTimeUs = qMax(m_MaxKmsCommitTimeUs, commitTimeUs);
+    m_KmsCommits++;
 }
 
 bool DrmRenderer::testRenderFrame(AVFrame* frame) {
@@ -1978,4 +2596,8 @@ ssize_t DrmRenderer::exportEGLImages(AVFrame *frame, EGLDisplay dpy,
     return m_EglImageFactory.exportDRMImages(frame, dpy, images);
 }
 
+int DrmRenderer::getEGLImageCacheGeneration() {
+    return m_EglImageFactory.getCacheGeneration();
+}
+
 #endif
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "renderer.h"
+#include "surfacecache.h"
 #include "swframemapper.h"
 
 #ifdef HAVE_EGL
@@ -10,10 +11,28 @@
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <set>
 #include <unordered_map>
+#include <unordered_set>
 #include <mutex>
 
+// Maximum number of decoder surfaces with a cached KMS framebuffer
+#define DRM_FB_CACHE_SIZE 32
+
+// Decoders read reference frames back from the buffers they decode into, so
+// we only decode directly into dumb buffers if reading their CPU mapping is
+// at most this many times slower than reading system memory.
+#define DRM_DIRECT_DECODE_MAX_READ_PENALTY 2
+
+// Bytes read from each kind of memory for that comparison
+#define DRM_DIRECT_DECODE_READ_TEST_SIZE (4 * 1024 * 1024)
+
+// Maximum number of damage rects tracked for each overlay update
+#define DRM_OVERLAY_MAX_DAMAGE_RECTS 8
+
 // This is only defined in Linux 6.8+ headers
 #ifndef DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP
 #define DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP	0x15
@@ -234,7 +253,7 @@ class DrmRenderer : public IFFmpegRenderer {
                 SDL_assert(!it->second.dumbBufferHandle);
 
                 if (it->second.pendingFbId) {
-                    drmModeRmFB(m_Fd, it->second.pendingFbId);
+                    freeFb(it->second.pendingFbId);
                 }
                 if (it->second.pendingDumbBuffer) {
                     struct drm_mode_destroy_dumb destroyBuf = {};
@@ -243,6 +262,9 @@ class DrmRenderer : public IFFmpegRenderer {
                 }
             }
 
+            SDL_assert(m_RetainedFbIds.empty());
+            freeReleasedFbs();
+
             if (m_AtomicReq) {
                 drmModeAtomicFree(m_AtomicReq);
             }
@@ -401,7 +423,7 @@ class DrmRenderer : public IFFmpegRenderer {
 
             // Free the unused resources
             if (fbId) {
-                drmModeRmFB(m_Fd, fbId);
+                freeFb(fbId);
             }
             if (dumbBufferHandle) {
                 struct drm_mode_destroy_dumb destroyBuf = {};
@@ -530,6 +552,8 @@ class DrmRenderer : public IFFmpegRenderer {
 
         bool apply() {
             if (!m_Atomic) {
+                std::lock_guard lg { m_Lock };
+                freeReleasedFbs();
                 return 0;
             }
 
@@ -540,6 +564,9 @@ class DrmRenderer : public IFFmpegRenderer {
             {
                 std::lock_guard lg { m_Lock };
 
+                // Free any released FBs that were replaced since the last commit
+                freeReleasedFbs();
+
                 // Create property blobs for any pending FB damage clip rects
                 for (auto &[planeId, pb] : m_PlaneBuffers) {
                     uint32_t damageBlob;
@@ -616,7 +643,7 @@ class DrmRenderer : public IFFmpegRenderer {
             for (auto it = pendingBuffers.begin(); it != pendingBuffers.end(); it++) {
                 if (err == 0 && it->second.modified) {
                     if (it->second.fbId) {
-                        drmModeRmFB(m_Fd, it->second.fbId);
+                        freeFb(it->second.fbId);
                         it->second.fbId = 0;
                     }
                     if (it->second.dumbBufferHandle) {
@@ -635,7 +662,7 @@ class DrmRenderer : public IFFmpegRenderer {
                     // Free the old pending buffers on a failed commit
                     if (it->second.pendingFbId) {
                         SDL_assert(err < 0);
-                        drmModeRmFB(m_Fd, it->second.pendingFbId);
+                        freeFb(it->second.pendingFbId);
                     }
                     if (it->second.pendingDumbBuffer) {
                         SDL_assert(err < 0);
@@ -655,6 +682,9 @@ class DrmRenderer : public IFFmpegRenderer {
                 // a flipPlane() performed by another thread that queued up another modification.
             }
 
+            // Now that the plane state is complete again, we can tell which released FBs are unused
+            freeReleasedFbs();
+
             drmModeAtomicFree(req);
             return err == 0;
         }
@@ -672,6 +702,20 @@ class DrmRenderer : public IFFmpegRenderer {
             }
         }
 
+        // Keeps the FB alive after it's replaced on a plane, so it can be flipped again later
+        void retainFb(uint32_t fbId) {
+            std::lock_guard lg { m_Lock };
+            m_RetainedFbIds.insert(fbId);
+        }
+
+        // Gives a retained FB back to us to free once it's no longer on a plane
+        void releaseRetainedFb(uint32_t fbId) {
+            std::lock_guard lg { m_Lock };
+            if (m_RetainedFbIds.erase(fbId)) {
+                m_ReleasedFbIds.push_back(fbId);
+            }
+        }
+
         void restorePropertyToInitial(const DrmProperty& prop) {
             if (!prop.isImmutable()) {
                 // We clamp() here because some DRM drivers actually initialize certain
@@ -682,12 +726,49 @@ class DrmRenderer : public IFFmpegRenderer {
         }
 
     private:
+        void freeFb(uint32_t fbId) {
+            std::lock_guard lg { m_Lock };
+            if (m_RetainedFbIds.find(fbId) == m_RetainedFbIds.end()) {
+                // Don't free a released FB again in freeReleasedFbs()
+                auto it = std::find(m_ReleasedFbIds.begin(), m_ReleasedFbIds.end(), fbId);
+                if (it != m_ReleasedFbIds.end()) {
+                    m_ReleasedFbIds.erase(it);
+                }
+
+                drmModeRmFB(m_Fd, fbId);
+            }
+        }
+
+        // Must be called with m_Lock held while m_PlaneBuffers is up to date
+        void freeReleasedFbs() {
+            for (uint32_t fbId : m_ReleasedFbIds) {
+                bool inUse = false;
+                for (auto &[planeId, pb] : m_PlaneBuffers) {
+                    if (pb.fbId == fbId || pb.pendingFbId == fbId) {
+                        inUse = true;
+                        break;
+                    }
+                }
+
+                // If a plane is still using it, the plane owns the FB now
+                if (!inUse) {
+                    drmModeRmFB(m_Fd, fbId);
+                }
+            }
+
+            m_ReleasedFbIds.clear();
+        }
+
         int m_Fd = -1;
         bool m_Atomic = false;
         bool m_AsyncFlip = false;
         std::recursive_mutex m_Lock;
         std::unordered_map<uint32_t, PlaneBuffer> m_PlaneBuffers;
 
+        // FBs that aren't freed when they're replaced on a plane
+        std::unordered_set<uint32_t> m_RetainedFbIds;
+        std::vector<uint32_t> m_ReleasedFbIds;
+
         // Legacy context
         std::unordered_map<uint32_t, PlaneConfiguration> m_PlaneConfigs;
 
@@ -713,23 +794,39 @@ public:
     virtual int getDecoderColorspace() override;
     virtual void setHdrMode(bool enabled) override;
     virtual void notifyOverlayUpdated(Overlay::OverlayType type) override;
+    virtual void notifyFrameQueued(AVFrame* frame) override;
+    virtual void updateRenderStats(VIDEO_STATS* stats) override;
+    virtual int getDecoderBuffer(AVCodecContext* context, AVFrame* frame, int flags) override;
 #ifdef HAVE_EGL
     virtual bool canExportEGL() override;
     virtual AVPixelFormat getEGLImagePixelFormat() override;
     virtual bool initializeEGL(EGLDisplay dpy, const EGLExtensions &ext) override;
     virtual ssize_t exportEGLImages(AVFrame *frame, EGLDisplay dpy, EGLImage images[EGL_MAX_PLANES]) override;
+    virtual int getEGLImageCacheGeneration() override;
 #endif
 
 private:
     const char* getDrmColorEncodingValue(AVFrame* frame);
     const char* getDrmColorRangeValue(AVFrame* frame);
     bool mapSoftwareFrame(AVFrame* frame, AVDRMFrameDescriptor* mappedFrame);
+    bool mapDecodeBufferFrame(AVFrame* frame, AVDRMFrameDescriptor* mappedFrame);
+    bool testDecodeBufferPool(AVBufferRef* buffer);
+    bool isDecodeBufferReadFast(AVBufferRef* buffer);
+#if FF_API_BUFFER_SIZE_T
+    static AVBufferRef* allocDecodeBuffer(void* opaque, int size);
+#else
+    static AVBufferRef* allocDecodeBuffer(void* opaque, size_t size);
+#endif
+    static void freeDecodeBuffer(void* opaque, uint8_t* data);
     bool addFbForFrame(AVFrame* frame, uint32_t* newFbId, bool testMode);
     bool uploadSurfaceToFb(SDL_Surface *surface, uint32_t* handle, uint32_t* fbId);
-    bool mapDumbBuffer(uint32_t handle, size_t size, void** mapping);
+    bool mapDumbBuffer(uint32_t handle, size_t size, void** mapping, bool readable = false);
     bool createFbForDumbBuffer(struct drm_mode_create_dumb* createBuf, uint32_t* fbId);
     void enterOverlayCompositionMode();
     void blitOverlayToCompositionSurface(Overlay::OverlayType type, SDL_Surface* newSurface, SDL_Rect* overlayRect);
+    int computeOverlayDamage(Overlay::OverlayType type, SDL_Surface* newSurface,
+                             const SDL_Rect& overlayRect, SDL_Rect* damageRects);
+    void setOverlayShadow(Overlay::OverlayType type, SDL_Surface* surface);
     static bool drmFormatMatchesVideoFormat(uint32_t drmFormat, int videoFormat);
 
     IFFmpegRenderer* m_BackendRenderer;
@@ -745,6 +842,7 @@ private:
     bool m_SupportsDirectRendering;
     int m_VideoFormat;
     bool m_Vsync;
+    bool m_Vrr;
     DrmPropertyMap m_Encoder;
     DrmPropertyMap m_Connector;
     DrmPropertyMap m_Crtc;
@@ -756,6 +854,9 @@ private:
     SDL_Surface* m_OverlayCompositionSurface;
     std::mutex m_OverlayLock;
     SDL_Rect m_OverlayRects[Overlay::OverlayMax];
+
+    // The last surface displayed for each overlay, used to find what changed
+    SDL_Surface* m_OverlayShadows[Overlay::OverlayMax];
     drmVersionPtr m_Version;
     uint32_t m_HdrOutputMetadataBlobId;
     SDL_Rect m_OutputRect;
@@ -776,6 +877,64 @@ private:
         int primeFd;
     } m_SwFrame[k_SwFrameCount];
 
+    // Scanout-capable dumb buffers that software decoders decode into directly
+    struct DecodeBuffer {
+        DrmRenderer* renderer;
+        uint32_t handle;
+        int primeFd;
+        uint8_t* mapping;
+        uint64_t size;
+        uint32_t format;
+        int planes;
+        uint32_t pitches[AV_DRM_MAX_PLANES];
+        uint32_t offsets[AV_DRM_MAX_PLANES];
+    };
+    // Read by decoder threads calling get_buffer2() without m_DecodeBufferLock
+    std::atomic<bool> m_DirectDecodeEnabled;
+    bool m_DirectDecodeForced;
+    std::recursive_mutex m_DecodeBufferLock;
+    AVBufferPool* m_DecodeBufferPool;
+    std::vector<DecodeBuffer*> m_DecodeBuffers;
+    AVPixelFormat m_DecodePoolFormat;
+    int m_DecodePoolWidth;
+    int m_DecodePoolHeight;
+    int m_DecodePoolAlignedWidth;
+    int m_DecodePoolAlignedHeight;
+    int m_DecodePoolLinesizeAlign[AV_NUM_DATA_POINTERS];
+
+    // KMS framebuffers for the decoder's surfaces, keyed by the inodes of their
+    // DMA-BUFs and valid for the lifetime of the hw_frames_ctx they came from
+    struct FbCacheKey {
+        uint64_t buffers[AV_DRM_MAX_PLANES];
+        uint32_t format;
+        uint64_t modifier;
+        uint32_t pitches[AV_DRM_MAX_PLANES];
+        uint32_t offsets[AV_DRM_MAX_PLANES];
+        int width;
+        int height;
+
+        bool operator==(const FbCacheKey& other) const {
+            return memcmp(buffers, other.buffers, sizeof(buffers)) == 0 &&
+                   memcmp(pitches, other.pitches, sizeof(pitches)) == 0 &&
+                   memcmp(offsets, other.offsets, sizeof(offsets)) == 0 &&
+                   format == other.format &&
+                   modifier == other.modifier &&
+                   width == other.width &&
+                   height == other.height;
+        }
+    };
+    bool m_FbCacheEnabled;
+    SurfaceCache<FbCacheKey, uint32_t, DRM_FB_CACHE_SIZE> m_FbCache;
+
+    // Render thread statistics not yet reported to Pacer
+    uint64_t m_KmsCommitTimeUs;
+    uint32_t m_MaxKmsCommitTimeUs;
+    uint32_t m_KmsCommits;
+    uint64_t m_FbLookupTimeUs;
+    uint32_t m_MaxFbLookupTimeUs;
+    uint32_t m_FbLookups;
+    uint32_t m_FramebufferImports;
+
 #ifdef HAVE_EGL
     EglImageFactory m_EglImageFactory;
 #endif
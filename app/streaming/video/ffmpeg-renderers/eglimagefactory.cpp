@@ -5,6 +5,11 @@
 #include <unistd.h>
 #endif
 
+#ifdef HAVE_DRM
+#include <sys/stat.h>
+#include <errno.h>
+#endif
+
 #include <vector>
 
 // Don't take a dependency on libdrm just for these constants
@@ -32,8 +37,30 @@ EglImageFactory::EglImageFactory(IFFmpegRenderer* renderer) :
     m_eglCreateImageKHR(nullptr),
     m_eglDestroyImageKHR(nullptr),
     m_eglQueryDmaBufFormatsEXT(nullptr),
-    m_eglQueryDmaBufModifiersEXT(nullptr)
+    m_eglQueryDmaBufModifiersEXT(nullptr),
+    m_Cache([](AVBufferRef*& imageContextRef) {
+        // Frames still holding these images keep them alive until they're freed
+        av_buffer_unref(&imageContextRef);
+    }),
+    m_CacheOverflowLogged(false),
+    m_CacheHits(0),
+    m_CacheMisses(0)
+{
+}
+
+EglImageFactory::~EglImageFactory()
+{
+    if (m_CacheHits + m_CacheMisses > 0) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "EGLImage cache: %d hits, %d misses",
+                    m_CacheHits,
+                    m_CacheMisses);
+    }
+}
+
+int EglImageFactory::getCacheGeneration()
 {
+    return m_Cache.getGeneration();
 }
 
 bool EglImageFactory::initializeEGL(EGLDisplay,
@@ -69,6 +96,88 @@ bool EglImageFactory::initializeEGL(EGLDisplay,
 
 void EglImageFactory::resetCache()
 {
+    // The exporting thread may be using the cache right now,
+    // so it will flush the cache itself on the next export.
+    m_Cache.reset();
+}
+
+void EglImageFactory::initializeCacheKey(AVFrame* frame, CacheKey* key)
+{
+    memset(key, 0, sizeof(*key));
+    key->width = frame->width;
+    key->height = frame->height;
+    key->colorspace = m_Renderer->getFrameColorspace(frame);
+    key->fullRange = m_Renderer->isFrameFullRange(frame);
+    key->chromaLocation = frame->chroma_location;
+}
+
+bool EglImageFactory::lookupCachedImages(AVFrame* frame, const CacheKey& key,
+                                         EGLImage images[EGL_MAX_PLANES], ssize_t* count)
+{
+    int cachedCount = m_Cache.getCount();
+    if (m_Cache.validate(frame)) {
+        if (cachedCount > 0) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Flushing %d cached EGLImage sets",
+                        cachedCount);
+        }
+
+        m_CacheOverflowLogged = false;
+    }
+
+    AVBufferRef* imageContextRef;
+    if (!m_Cache.lookup(key, &imageContextRef)) {
+        m_CacheMisses++;
+        return false;
+    }
+
+    auto imgCtx = (EglImageContext*)imageContextRef->data;
+
+    attachImageContext(frame, av_buffer_ref(imageContextRef));
+    memcpy(images, imgCtx->images, sizeof(EGLImage) * imgCtx->count);
+    *count = imgCtx->count;
+
+    m_CacheHits++;
+    return true;
+}
+
+void EglImageFactory::insertCachedImages(AVFrame* frame, const CacheKey& key, EglImageContext* imgCtx)
+{
+    AVBufferRef* imageContextRef = av_buffer_create((uint8_t*)imgCtx, sizeof(*imgCtx),
+                                                    freeEglImageContextBuffer,
+                                                    nullptr,
+                                                    AV_BUFFER_FLAG_READONLY);
+    if (imageContextRef == nullptr) {
+        delete imgCtx;
+        return;
+    }
+
+    AVBufferRef* cachedRef = av_buffer_ref(imageContextRef);
+    if (cachedRef != nullptr && !m_Cache.insert(key, cachedRef)) {
+        av_buffer_unref(&cachedRef);
+        if (!m_CacheOverflowLogged) {
+            m_CacheOverflowLogged = true;
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "EGLImage cache is full. Additional surfaces will be imported on each frame.");
+        }
+    }
+
+    attachImageContext(frame, imageContextRef);
+}
+
+void EglImageFactory::attachImageContext(AVFrame* frame, AVBufferRef* imageContextRef)
+{
+    if (imageContextRef == nullptr) {
+        return;
+    }
+
+    // Add a buffer reference to the frame to keep the EGLImages alive
+    // until the frame is no longer referenced, even if the cache is
+    // flushed while the frame is still waiting to be rendered.
+    frame->opaque_ref = av_buffer_create((uint8_t*)imageContextRef, sizeof(*imageContextRef),
+                                         freeEglImageContextRef,
+                                         frame->opaque_ref, // Chain any existing buffer
+                                         AV_BUFFER_FLAG_READONLY);
 }
 
 #ifdef HAVE_DRM
@@ -81,6 +190,28 @@ ssize_t EglImageFactory::exportDRMImages(AVFrame* frame, EGLDisplay dpy, EGLImag
     // DRM requires composed layers rather than separate layers per plane
     SDL_assert(drmFrame->nb_layers == 1);
 
+    // Identify the DMA-BUFs by inode, since the same buffer may be
+    // exported with a different FD number for each frame.
+    CacheKey key;
+    initializeCacheKey(frame, &key);
+    key.format = drmFrame->layers[0].format;
+    key.modifier = drmFrame->objects[0].format_modifier;
+    for (int i = 0; i < drmFrame->nb_objects && i < EGL_MAX_PLANES; i++) {
+        struct stat st;
+        if (fstat(drmFrame->objects[i].fd, &st) < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "fstat() failed on DMA-BUF: %d",
+                         errno);
+            return -1;
+        }
+        key.buffers[i] = st.st_ino;
+    }
+
+    ssize_t count;
+    if (lookupCachedImages(frame, key, images, &count)) {
+        return count;
+    }
+
     // Max 33 attributes (1 key + 1 value for each)
     const int MAX_ATTRIB_COUNT = 33 * 2;
     EGLAttrib attribs[MAX_ATTRIB_COUNT] = {
@@ -249,13 +380,8 @@ ssize_t EglImageFactory::exportDRMImages(AVFrame* frame, EGLDisplay dpy, EGLImag
     imgCtx->images[0] = images[0];
     imgCtx->count = 1;
 
-    // Add a buffer reference to the frame to automatically destroy the EGLImages
-    // when the frame is no longer referenced.
-    frame->opaque_ref = av_buffer_create((uint8_t*)imgCtx, sizeof(*imgCtx),
-                                         freeEglImageContextBuffer,
-                                         frame->opaque_ref, // Chain any existing buffer
-                                         AV_BUFFER_FLAG_READONLY);
-    return imgCtx->count;
+    insertCachedImages(frame, key, imgCtx);
+    return 1;
 }
 
 #endif
@@ -277,6 +403,17 @@ ssize_t EglImageFactory::exportVAImages(AVFrame *frame, uint32_t exportFlags, EG
         return -1;
     }
 
+    // Surface IDs are unique for the lifetime of the frames context
+    CacheKey key;
+    initializeCacheKey(frame, &key);
+    key.buffers[0] = surface_id;
+    key.format = exportFlags;
+
+    ssize_t count;
+    if (lookupCachedImages(frame, key, images, &count)) {
+        return count;
+    }
+
     VADRMPRIMESurfaceDescriptor vaFrame;
     st = vaExportSurfaceHandle(vaDeviceContext->display,
                                surface_id,
@@ -475,15 +612,11 @@ ssize_t EglImageFactory::exportVAImages(AVFrame *frame, uint32_t exportFlags, EG
         return -1;
     }
 
-    // Add a buffer reference to the frame to automatically destroy the EGLImages
-    // when the frame is no longer referenced.
-    frame->opaque_ref = av_buffer_create((uint8_t*)imgCtx, sizeof(*imgCtx),
-                                         freeEglImageContextBuffer,
-                                         frame->opaque_ref, // Chain any existing buffer
-                                         AV_BUFFER_FLAG_READONLY);
+    count = imgCtx->count;
+    memcpy(images, imgCtx->images, sizeof(EGLImage) * count);
 
-    memcpy(images, imgCtx->images, sizeof(EGLImage) * imgCtx->count);
-    return imgCtx->count;
+    insertCachedImages(frame, key, imgCtx);
+    return count;
 }
 
 #endif
@@ -578,3 +711,12 @@ void EglImageFactory::freeEglImageContextBuffer(void* opaque, uint8_t* data)
     av_buffer_unref((AVBufferRef**)&opaque);
 }
 
+void EglImageFactory::freeEglImageContextRef(void* opaque, uint8_t* data)
+{
+    auto imageContextRef = (AVBufferRef*)data;
+    av_buffer_unref(&imageContextRef);
+
+    // Free any chained buffers
+    av_buffer_unref((AVBufferRef**)&opaque);
+}
+
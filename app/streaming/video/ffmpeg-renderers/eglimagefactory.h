@@ -1,13 +1,19 @@
 #pragma once
 
 #include "renderer.h"
+#include "surfacecache.h"
 
 #ifdef HAVE_LIBVA
 #include <va/va_drmcommon.h>
 #endif
 
+#include <cstring>
 #include <optional>
 
+// Maximum number of decoder surfaces whose EGLImages we keep imported.
+// Surfaces beyond this are imported and destroyed with each frame.
+#define EGL_IMAGE_CACHE_SIZE 32
+
 class EglImageFactory
 {
     class EglImageContext {
@@ -40,11 +46,42 @@ class EglImageFactory
         PFNEGLDESTROYIMAGEKHRPROC m_eglDestroyImageKHR;
     };
 
+    // Identifies a decoder surface and the import parameters used for it
+    struct CacheKey {
+        uint64_t buffers[EGL_MAX_PLANES];
+        uint32_t format;
+        uint64_t modifier;
+        int width;
+        int height;
+        int colorspace;
+        bool fullRange;
+        enum AVChromaLocation chromaLocation;
+
+        bool operator==(const CacheKey& other) const {
+            return memcmp(buffers, other.buffers, sizeof(buffers)) == 0 &&
+                   format == other.format &&
+                   modifier == other.modifier &&
+                   width == other.width &&
+                   height == other.height &&
+                   colorspace == other.colorspace &&
+                   fullRange == other.fullRange &&
+                   chromaLocation == other.chromaLocation;
+        }
+    };
+
 public:
     EglImageFactory(IFFmpegRenderer* renderer);
+    ~EglImageFactory();
     bool initializeEGL(EGLDisplay, const EGLExtensions &ext);
+
+    // Destroys cached EGLImages once the frames using them are freed. This
+    // may be called from the decoder thread when the surface pool is reset.
     void resetCache();
 
+    // Changes each time the cached EGLImages are flushed. Only valid on
+    // the thread exporting images.
+    int getCacheGeneration();
+
 #ifdef HAVE_DRM
     ssize_t exportDRMImages(AVFrame* frame, EGLDisplay dpy, EGLImage images[EGL_MAX_PLANES]);
 #endif
@@ -57,7 +94,12 @@ public:
     bool supportsImportingModifier(EGLDisplay dpy, EGLint format, EGLuint64KHR modifier);
 
 private:
+    void initializeCacheKey(AVFrame* frame, CacheKey* key);
+    bool lookupCachedImages(AVFrame* frame, const CacheKey& key, EGLImage images[EGL_MAX_PLANES], ssize_t* count);
+    void insertCachedImages(AVFrame* frame, const CacheKey& key, EglImageContext* imgCtx);
+    void attachImageContext(AVFrame* frame, AVBufferRef* imageContextRef);
     static void freeEglImageContextBuffer(void* opaque, uint8_t* data);
+    static void freeEglImageContextRef(void* opaque, uint8_t* data);
 
     IFFmpegRenderer* m_Renderer;
     bool m_EGLExtDmaBuf;
@@ -67,4 +109,11 @@ private:
     PFNEGLDESTROYIMAGEKHRPROC m_eglDestroyImageKHR;
     PFNEGLQUERYDMABUFFORMATSEXTPROC m_eglQueryDmaBufFormatsEXT;
     PFNEGLQUERYDMABUFMODIFIERSEXTPROC m_eglQueryDmaBufModifiersEXT;
+
+    // Each entry holds a reference to an EglImageContext. Only touched by
+    // the thread exporting images, except for resetting the cache.
+    SurfaceCache<CacheKey, AVBufferRef*, EGL_IMAGE_CACHE_SIZE> m_Cache;
+    bool m_CacheOverflowLogged;
+    int m_CacheHits;
+    int m_CacheMisses;
 };
@@ -17,6 +17,36 @@
 #ifndef GL_UNPACK_ROW_LENGTH_EXT
 #define GL_UNPACK_ROW_LENGTH_EXT 0x0CF2
 #endif
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+#ifndef GL_MAP_WRITE_BIT_EXT
+#define GL_MAP_WRITE_BIT_EXT 0x0002
+#endif
+#ifndef GL_MAP_INVALIDATE_BUFFER_BIT_EXT
+#define GL_MAP_INVALIDATE_BUFFER_BIT_EXT 0x0008
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT_EXT
+#define GL_MAP_PERSISTENT_BIT_EXT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT_EXT
+#define GL_MAP_COHERENT_BIT_EXT 0x0080
+#endif
+#ifndef GL_RED_EXT
+#define GL_RED_EXT 0x1903
+#endif
+#ifndef GL_RG_EXT
+#define GL_RG_EXT 0x8227
+#endif
+#ifndef GL_R8_EXT
+#define GL_R8_EXT 0x8229
+#endif
+#ifndef GL_RG8_EXT
+#define GL_RG8_EXT 0x822B
+#endif
+
+// Rows in the upload buffers are padded to this many bytes
+#define PBO_ROW_ALIGNMENT 64
 
 typedef struct _VERTEX
 {
@@ -26,7 +56,6 @@ typedef struct _VERTEX
 
 /* TODO:
  *  - handle more pixel formats
- *  - handle software decoding
  */
 
 /* DOC/misc:
@@ -56,6 +85,8 @@ EGLRenderer::EGLRenderer(IFFmpegRenderer *backendRenderer)
         m_OverlayTextures{0},
         m_OverlayVBOs{0},
         m_OverlayVAOs{0},
+        m_OverlayAtlases{},
+        m_OverlayVertexCounts{},
         m_OverlayHasValidData{},
         m_ShaderProgram(0),
         m_OverlayShaderProgram(0),
@@ -75,10 +106,28 @@ EGLRenderer::EGLRenderer(IFFmpegRenderer *backendRenderer)
         m_eglClientWaitSync(nullptr),
         m_GlesMajorVersion(0),
         m_GlesMinorVersion(0),
-        m_HasExtUnpackSubimage(false)
+        m_HasExtUnpackSubimage(false),
+        m_SwTextures{0},
+        m_Pbos{0},
+        m_PboMappings{},
+        m_NextPbo(0),
+        m_SwFrameWidth(0),
+        m_SwFrameHeight(0),
+        m_SwLumaPitch(0),
+        m_SwChromaPitch(0),
+        m_PboSize(0),
+        m_PersistentPbos(false),
+        m_glMapBufferRange(nullptr),
+        m_glUnmapBuffer(nullptr),
+        m_glBufferStorageEXT(nullptr),
+        m_TextureCacheCount(0),
+        m_TextureCacheGeneration(0)
 {
-    SDL_assert(backendRenderer);
-    SDL_assert(backendRenderer->canExportEGL());
+    SDL_assert(!backendRenderer || backendRenderer->canExportEGL());
+
+    for (int i = 0; i < EGL_PBO_RING_SIZE; i++) {
+        m_PboFences[i] = EGL_NO_SYNC;
+    }
 }
 
 EGLRenderer::~EGLRenderer()
@@ -101,6 +150,10 @@ EGLRenderer::~EGLRenderer()
             m_glDeleteVertexArraysOES(1, &m_VideoVAO);
         }
         glDeleteTextures(EGL_MAX_PLANES, m_Textures);
+        flushTextureCache();
+
+        freeSoftwareUploadBuffers();
+        glDeleteTextures(2, m_SwTextures);
 
         glDeleteTextures(Overlay::OverlayMax, m_OverlayTextures);
         glDeleteBuffers(Overlay::OverlayMax, m_OverlayVBOs);
@@ -123,7 +176,7 @@ bool EGLRenderer::prepareDecoderContext(AVCodecContext*, AVDictionary**)
 
 void EGLRenderer::notifyOverlayUpdated(Overlay::OverlayType type)
 {
-    // We handle uploading the updated overlay texture in renderOverlay().
+    // We handle uploading the updated overlay glyphs in renderOverlay().
     // notifyOverlayUpdated() is called on an arbitrary thread, which may
     // not be have the OpenGL context current on it.
 
@@ -134,6 +187,12 @@ void EGLRenderer::notifyOverlayUpdated(Overlay::OverlayType type)
     }
 }
 
+bool EGLRenderer::supportsOverlayGlyphBatches()
+{
+    // We draw the quads straight from the glyph atlas texture
+    return true;
+}
+
 bool EGLRenderer::notifyWindowChanged(PWINDOW_STATE_CHANGE_INFO info)
 {
     // We can transparently handle size and display changes
@@ -142,102 +201,150 @@ bool EGLRenderer::notifyWindowChanged(PWINDOW_STATE_CHANGE_INFO info)
 
 bool EGLRenderer::isPixelFormatSupported(int videoFormat, AVPixelFormat pixelFormat)
 {
+    if (m_Backend == nullptr) {
+        // We can only upload 8-bit 4:2:0 software frames
+        if (videoFormat & (VIDEO_FORMAT_MASK_10BIT | VIDEO_FORMAT_MASK_YUV444)) {
+            return false;
+        }
+
+        switch (pixelFormat) {
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUVJ420P:
+        case AV_PIX_FMT_NV12:
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
     // Pixel format support should be determined by the backend renderer
     return m_Backend->isPixelFormatSupported(videoFormat, pixelFormat);
 }
 
 AVPixelFormat EGLRenderer::getPreferredPixelFormat(int videoFormat)
 {
+    if (m_Backend == nullptr) {
+        return IFFmpegRenderer::getPreferredPixelFormat(videoFormat);
+    }
+
     // Pixel format preference should be determined by the backend renderer
     return m_Backend->getPreferredPixelFormat(videoFormat);
 }
 
-void EGLRenderer::renderOverlay(Overlay::OverlayType type, int viewportWidth, int viewportHeight)
+bool EGLRenderer::uploadOverlayAtlas(Overlay::OverlayType type, SDL_Surface* atlas)
 {
-    // Do nothing if this overlay is disabled
-    if (!Session::get()->getOverlayManager().isOverlayEnabled(type)) {
-        return;
-    }
-
-    // Upload a new overlay texture if needed
-    SDL_Surface* newSurface = Session::get()->getOverlayManager().getUpdatedOverlaySurface(type);
-    if (newSurface != nullptr) {
-        SDL_assert(!SDL_MUSTLOCK(newSurface));
-        SDL_assert(newSurface->format->format == SDL_PIXELFORMAT_ARGB8888);
+    SDL_assert(!SDL_MUSTLOCK(atlas));
+    SDL_assert(atlas->format->format == SDL_PIXELFORMAT_ARGB8888);
 
-        glBindTexture(GL_TEXTURE_2D, m_OverlayTextures[type]);
+    glBindTexture(GL_TEXTURE_2D, m_OverlayTextures[type]);
 
-        // If the pixel data isn't tightly packed, it requires special handling
-        void* packedPixelData = nullptr;
-        if (newSurface->pitch != newSurface->w * newSurface->format->BytesPerPixel) {
-            if (m_GlesMajorVersion >= 3 || m_HasExtUnpackSubimage) {
-                // If we are GLES 3.0+ or have GL_EXT_unpack_subimage, GL can handle any pitch
-                SDL_assert(newSurface->pitch % newSurface->format->BytesPerPixel == 0);
-                glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, newSurface->pitch / newSurface->format->BytesPerPixel);
-            }
-            else {
-                // If we can't use GL_UNPACK_ROW_LENGTH, we must allocate a tightly packed buffer
-                // and copy our pixels there.
-                packedPixelData = malloc(newSurface->w * newSurface->h * newSurface->format->BytesPerPixel);
-                if (!packedPixelData) {
-                    SDL_FreeSurface(newSurface);
-                    return;
-                }
-
-                SDL_ConvertPixels(newSurface->w, newSurface->h,
-                                  newSurface->format->format, newSurface->pixels, newSurface->pitch,
-                                  newSurface->format->format, packedPixelData, newSurface->w * newSurface->format->BytesPerPixel);
+    // If the pixel data isn't tightly packed, it requires special handling
+    void* packedPixelData = nullptr;
+    if (atlas->pitch != atlas->w * atlas->format->BytesPerPixel) {
+        if (m_GlesMajorVersion >= 3 || m_HasExtUnpackSubimage) {
+            // If we are GLES 3.0+ or have GL_EXT_unpack_subimage, GL can handle any pitch
+            SDL_assert(atlas->pitch % atlas->format->BytesPerPixel == 0);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, atlas->pitch / atlas->format->BytesPerPixel);
+        }
+        else {
+            // If we can't use GL_UNPACK_ROW_LENGTH, we must allocate a tightly packed buffer
+            // and copy our pixels there.
+            packedPixelData = malloc(atlas->w * atlas->h * atlas->format->BytesPerPixel);
+            if (!packedPixelData) {
+                return false;
             }
+
+            SDL_ConvertPixels(atlas->w, atlas->h,
+                              atlas->format->format, atlas->pixels, atlas->pitch,
+                              atlas->format->format, packedPixelData, atlas->w * atlas->format->BytesPerPixel);
         }
+    }
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, newSurface->w, newSurface->h, 0, GL_RGBA, GL_UNSIGNED_BYTE,
-                     packedPixelData ? packedPixelData : newSurface->pixels);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, atlas->w, atlas->h, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                 packedPixelData ? packedPixelData : atlas->pixels);
 
-        if (packedPixelData) {
-            free(packedPixelData);
-        }
-        else if (newSurface->pitch != newSurface->w * newSurface->format->BytesPerPixel) {
-            glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
-        }
+    if (packedPixelData) {
+        free(packedPixelData);
+    }
+    else if (atlas->pitch != atlas->w * atlas->format->BytesPerPixel) {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
+    }
 
-        SDL_FRect overlayRect;
+    m_OverlayAtlases[type] = atlas;
+    return true;
+}
+
+void EGLRenderer::renderOverlay(Overlay::OverlayType type, int viewportWidth, int viewportHeight)
+{
+    // Do nothing if this overlay is disabled
+    if (!Session::get()->getOverlayManager().isOverlayEnabled(type)) {
+        return;
+    }
+
+    // Lay out the new overlay text if needed
+    Overlay::GlyphBatch* newBatch = Session::get()->getOverlayManager().getUpdatedOverlayGlyphBatch(type);
+    if (newBatch != nullptr) {
+        // The atlas only changes if the overlay's font does, so
+        // it's normally uploaded just once per overlay
+        if (newBatch->atlas != m_OverlayAtlases[type] && !uploadOverlayAtlas(type, newBatch->atlas)) {
+            Session::get()->getOverlayManager().releaseOverlayGlyphBatch(type, newBatch);
+            return;
+        }
 
         // These overlay positions differ from the other renderers because OpenGL
         // places the origin in the lower-left corner instead of the upper-left.
+        int overlayTop;
         if (type == Overlay::OverlayStatusUpdate) {
             // Bottom Left
-            overlayRect.x = 0;
-            overlayRect.y = 0;
+            overlayTop = newBatch->height;
         }
         else if (type == Overlay::OverlayDebug) {
             // Top left
-            overlayRect.x = 0;
-            overlayRect.y = viewportHeight - newSurface->h;
+            overlayTop = viewportHeight;
         } else {
             SDL_assert(false);
+            overlayTop = viewportHeight;
         }
 
-        overlayRect.w = newSurface->w;
-        overlayRect.h = newSurface->h;
-
-        SDL_FreeSurface(newSurface);
-
-        // Convert screen space to normalized device coordinates
-        StreamUtils::screenSpaceToNormalizedDeviceCoords(&overlayRect, viewportWidth, viewportHeight);
+        float atlasW = newBatch->atlas->w;
+        float atlasH = newBatch->atlas->h;
+
+        std::vector<VERTEX> verts;
+        verts.reserve(newBatch->quads.size() * 6);
+        for (const auto& quad : newBatch->quads) {
+            SDL_FRect glyphRect;
+            glyphRect.x = quad.dst.x;
+            glyphRect.y = overlayTop - quad.dst.y - quad.dst.h;
+            glyphRect.w = quad.dst.w;
+            glyphRect.h = quad.dst.h;
+
+            // Convert screen space to normalized device coordinates
+            StreamUtils::screenSpaceToNormalizedDeviceCoords(&glyphRect, viewportWidth, viewportHeight);
+
+            float u1 = quad.src.x / atlasW;
+            float v1 = quad.src.y / atlasH;
+            float u2 = (quad.src.x + quad.src.w) / atlasW;
+            float v2 = (quad.src.y + quad.src.h) / atlasH;
+
+            VERTEX quadVerts[] =
+            {
+                {glyphRect.x + glyphRect.w, glyphRect.y + glyphRect.h, u2, v1},
+                {glyphRect.x, glyphRect.y + glyphRect.h, u1, v1},
+                {glyphRect.x, glyphRect.y, u1, v2},
+                {glyphRect.x, glyphRect.y, u1, v2},
+                {glyphRect.x + glyphRect.w, glyphRect.y, u2, v2},
+                {glyphRect.x + glyphRect.w, glyphRect.y + glyphRect.h, u2, v1}
+            };
+            verts.insert(verts.end(), std::begin(quadVerts), std::end(quadVerts));
+        }
 
-        VERTEX verts[] =
-        {
-            {overlayRect.x + overlayRect.w, overlayRect.y + overlayRect.h, 1.0f, 0.0f},
-            {overlayRect.x, overlayRect.y + overlayRect.h, 0.0f, 0.0f},
-            {overlayRect.x, overlayRect.y, 0.0f, 1.0f},
-            {overlayRect.x, overlayRect.y, 0.0f, 1.0f},
-            {overlayRect.x + overlayRect.w, overlayRect.y, 1.0f, 1.0f},
-            {overlayRect.x + overlayRect.w, overlayRect.y + overlayRect.h, 1.0f, 0.0f}
-        };
+        Session::get()->getOverlayManager().releaseOverlayGlyphBatch(type, newBatch);
 
         // Update the VBO for this overlay (already bound to a VAO)
         glBindBuffer(GL_ARRAY_BUFFER, m_OverlayVBOs[type]);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(VERTEX), verts.data(), GL_DYNAMIC_DRAW);
+        m_OverlayVertexCounts[type] = (int)verts.size();
 
         SDL_AtomicSet(&m_OverlayHasValidData[type], 1);
     }
@@ -260,14 +367,15 @@ void EGLRenderer::renderOverlay(Overlay::OverlayType type, int viewportWidth, in
 
     // Draw the overlay
     m_glBindVertexArrayOES(m_OverlayVAOs[type]);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glDrawArrays(GL_TRIANGLES, 0, m_OverlayVertexCounts[type]);
     m_glBindVertexArrayOES(0);
 
     glDisable(GL_BLEND);
 }
 
 int EGLRenderer::loadAndBuildShader(int shaderType,
-                                    const char *file) {
+                                    const char *file,
+                                    const char *defines) {
     GLuint shader = glCreateShader(shaderType);
     if (!shader || shader == GL_INVALID_ENUM) {
         EGL_LOG(Error, "Can't create shader: %d", glGetError());
@@ -275,10 +383,11 @@ int EGLRenderer::loadAndBuildShader(int shaderType,
     }
 
     auto sourceData = Path::readDataFile(file);
-    GLint len = sourceData.size();
-    const char *buf = sourceData.data();
+    // The defines are prepended to the shader source
+    GLint lens[] = { (GLint)strlen(defines), (GLint)sourceData.size() };
+    const char *bufs[] = { defines, sourceData.data() };
 
-    glShaderSource(shader, 1, &buf, &len);
+    glShaderSource(shader, 2, bufs, lens);
     glCompileShader(shader);
     GLint status;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
@@ -292,14 +401,14 @@ int EGLRenderer::loadAndBuildShader(int shaderType,
     return shader;
 }
 
-unsigned EGLRenderer::compileShader(const char* vertexShaderSrc, const char* fragmentShaderSrc) {
+unsigned EGLRenderer::compileShader(const char* vertexShaderSrc, const char* fragmentShaderSrc, const char* defines) {
     unsigned shader = 0;
 
-    GLuint vertexShader = loadAndBuildShader(GL_VERTEX_SHADER, vertexShaderSrc);
+    GLuint vertexShader = loadAndBuildShader(GL_VERTEX_SHADER, vertexShaderSrc, defines);
     if (!vertexShader)
         return false;
 
-    GLuint fragmentShader = loadAndBuildShader(GL_FRAGMENT_SHADER, fragmentShaderSrc);
+    GLuint fragmentShader = loadAndBuildShader(GL_FRAGMENT_SHADER, fragmentShaderSrc, defines);
     if (!fragmentShader)
         goto fragError;
 
@@ -343,7 +452,9 @@ bool EGLRenderer::compileShaders() {
 
     // XXX: TODO: other formats
     if (m_EGLImagePixelFormat == AV_PIX_FMT_NV12 || m_EGLImagePixelFormat == AV_PIX_FMT_P010) {
-        m_ShaderProgram = compileShader("egl.vert", "egl_nv12.frag");
+        // Software frames are uploaded to regular 2D textures
+        m_ShaderProgram = compileShader("egl.vert", "egl_nv12.frag",
+                                        m_Backend != nullptr ? "#define EXTERNAL_PLANES\n" : "");
         if (!m_ShaderProgram) {
             return false;
         }
@@ -422,6 +533,11 @@ bool EGLRenderer::initialize(PDECODER_PARAMETERS params)
         return false;
     }
 
+    if (m_Backend == nullptr && (params->videoFormat & VIDEO_FORMAT_MASK_YUV444)) {
+        EGL_LOG(Info, "Software frame upload doesn't support YUV 4:4:4");
+        return false;
+    }
+
     int renderIndex;
     int maxRenderers = SDL_GetNumRenderDrivers();
     SDL_assert(maxRenderers >= 0);
@@ -513,23 +629,25 @@ bool EGLRenderer::initialize(PDECODER_PARAMETERS params)
     }
 
     const EGLExtensions eglExtensions(m_EGLDisplay);
-    if (!eglExtensions.isSupported("EGL_KHR_image_base") &&
-        !eglExtensions.isSupported("EGL_KHR_image")) {
-        EGL_LOG(Error, "EGL_KHR_image unsupported");
-        return false;
-    }
-    else if (!SDL_GL_ExtensionSupported("GL_OES_EGL_image")) {
-        EGL_LOG(Error, "GL_OES_EGL_image unsupported");
-        return false;
-    }
+    if (m_Backend != nullptr) {
+        if (!eglExtensions.isSupported("EGL_KHR_image_base") &&
+            !eglExtensions.isSupported("EGL_KHR_image")) {
+            EGL_LOG(Error, "EGL_KHR_image unsupported");
+            return false;
+        }
+        else if (!SDL_GL_ExtensionSupported("GL_OES_EGL_image")) {
+            EGL_LOG(Error, "GL_OES_EGL_image unsupported");
+            return false;
+        }
 
-    if (!m_Backend->initializeEGL(m_EGLDisplay, eglExtensions))
-        return false;
+        if (!m_Backend->initializeEGL(m_EGLDisplay, eglExtensions))
+            return false;
 
-    if (!(m_glEGLImageTargetTexture2DOES = (typeof(m_glEGLImageTargetTexture2DOES))eglGetProcAddress("glEGLImageTargetTexture2DOES"))) {
-        EGL_LOG(Error,
-                "EGL: cannot retrieve `glEGLImageTargetTexture2DOES` address");
-        return false;
+        if (!(m_glEGLImageTargetTexture2DOES = (typeof(m_glEGLImageTargetTexture2DOES))eglGetProcAddress("glEGLImageTargetTexture2DOES"))) {
+            EGL_LOG(Error,
+                    "EGL: cannot retrieve `glEGLImageTargetTexture2DOES` address");
+            return false;
+        }
     }
 
     // Vertex arrays are an extension on OpenGL ES 2.0
@@ -585,7 +703,17 @@ bool EGLRenderer::initialize(PDECODER_PARAMETERS params)
     // the Wayland viewport can be stale when using Super+Left/Right/Up
     // to resize the window. This seems to happen significantly more often
     // with vsync enabled, so this also mitigates that problem too.
-    if (params->enableVsync
+    if (params->enableVrr) {
+        // With VRR, the display refreshes when we swap and Pacer keeps us under
+        // its maximum refresh rate. Adaptive V-sync avoids tearing without ever
+        // blocking for a fixed refresh interval when we're running late.
+        if (SDL_GL_SetSwapInterval(-1) < 0) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Adaptive V-sync is not supported. Disabling V-sync for VRR.");
+            SDL_GL_SetSwapInterval(0);
+        }
+    }
+    else if (params->enableVsync
 #ifdef SDL_VIDEO_DRIVER_WAYLAND
             && info.subsystem != SDL_SYSWM_WAYLAND
 #endif
@@ -608,6 +736,10 @@ bool EGLRenderer::initialize(PDECODER_PARAMETERS params)
         SDL_GL_SetSwapInterval(0);
     }
 
+    if (m_Backend == nullptr && !initializeSoftwareUpload()) {
+        return false;
+    }
+
     if (!setupVideoRenderingState() || !setupOverlayRenderingState()) {
         return false;
     }
@@ -710,6 +842,233 @@ bool EGLRenderer::setupOverlayRenderingState() {
     return err == GL_NO_ERROR;
 }
 
+bool EGLRenderer::initializeSoftwareUpload()
+{
+    // SDL reports the GLES version it asked for rather than the one we got,
+    // so check the real version. Pixel buffer objects require GLES 3.0.
+    int glesMajorVersion = 0;
+    const char* glVersion = (const char*)glGetString(GL_VERSION);
+    if (glVersion == nullptr || SDL_sscanf(glVersion, "OpenGL ES %d", &glesMajorVersion) != 1 || glesMajorVersion < 3) {
+        EGL_LOG(Info, "Software frame upload requires OpenGL ES 3.0 (have: %s)",
+                glVersion != nullptr ? glVersion : "unknown");
+        return false;
+    }
+
+    m_glMapBufferRange = (typeof(m_glMapBufferRange))eglGetProcAddress("glMapBufferRange");
+    m_glUnmapBuffer = (typeof(m_glUnmapBuffer))eglGetProcAddress("glUnmapBuffer");
+    if (!m_glMapBufferRange || !m_glUnmapBuffer) {
+        EGL_LOG(Error, "Failed to find buffer mapping functions");
+        return false;
+    }
+
+    // Persistently mapped buffers need fences to tell us when the GPU is done
+    // reading them. Otherwise we map each buffer for every frame and let the
+    // driver handle synchronization.
+    if (SDL_GL_ExtensionSupported("GL_EXT_buffer_storage") && m_eglClientWaitSync != nullptr) {
+        m_glBufferStorageEXT = (typeof(m_glBufferStorageEXT))eglGetProcAddress("glBufferStorageEXT");
+    }
+    m_PersistentPbos = m_glBufferStorageEXT != nullptr;
+
+    glGenTextures(2, m_SwTextures);
+    for (size_t i = 0; i < 2; ++i) {
+        glBindTexture(GL_TEXTURE_2D, m_SwTextures[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    EGL_LOG(Info, "Uploading software frames with %s pixel buffer objects",
+            m_PersistentPbos ? "persistently mapped" : "per-frame mapped");
+    return true;
+}
+
+bool EGLRenderer::allocateSoftwareUploadBuffers(int width, int height)
+{
+    freeSoftwareUploadBuffers();
+
+    int chromaWidth = (width + 1) / 2;
+    int chromaHeight = (height + 1) / 2;
+    m_SwLumaPitch = (width + PBO_ROW_ALIGNMENT - 1) & ~(PBO_ROW_ALIGNMENT - 1);
+    m_SwChromaPitch = (chromaWidth * 2 + PBO_ROW_ALIGNMENT - 1) & ~(PBO_ROW_ALIGNMENT - 1);
+    m_PboSize = (size_t)m_SwLumaPitch * height + (size_t)m_SwChromaPitch * chromaHeight;
+
+    glGenBuffers(EGL_PBO_RING_SIZE, m_Pbos);
+    for (int i = 0; i < EGL_PBO_RING_SIZE; i++) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_Pbos[i]);
+        if (m_PersistentPbos) {
+            GLbitfield flags = GL_MAP_WRITE_BIT_EXT | GL_MAP_PERSISTENT_BIT_EXT | GL_MAP_COHERENT_BIT_EXT;
+            m_glBufferStorageEXT(GL_PIXEL_UNPACK_BUFFER, m_PboSize, nullptr, flags);
+            m_PboMappings[i] = m_glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m_PboSize, flags);
+            if (m_PboMappings[i] == nullptr) {
+                EGL_LOG(Error, "Failed to map pixel buffer object: %d", glGetError());
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                freeSoftwareUploadBuffers();
+                return false;
+            }
+        }
+        else {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, m_PboSize, nullptr, GL_STREAM_DRAW);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    glBindTexture(GL_TEXTURE_2D, m_SwTextures[0]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8_EXT, width, height, 0, GL_RED_EXT, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, m_SwTextures[1]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8_EXT, chromaWidth, chromaHeight, 0, GL_RG_EXT, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLenum err = glGetError();
+    if (err != GL_NO_ERROR) {
+        EGL_LOG(Error, "Failed to allocate software upload buffers: %d", err);
+        freeSoftwareUploadBuffers();
+        return false;
+    }
+
+    m_SwFrameWidth = width;
+    m_SwFrameHeight = height;
+    m_NextPbo = 0;
+    return true;
+}
+
+void EGLRenderer::freeSoftwareUploadBuffers()
+{
+    for (int i = 0; i < EGL_PBO_RING_SIZE; i++) {
+        if (m_PboFences[i] != EGL_NO_SYNC) {
+            SDL_assert(m_eglDestroySync != nullptr);
+            m_eglDestroySync(m_EGLDisplay, m_PboFences[i]);
+            m_PboFences[i] = EGL_NO_SYNC;
+        }
+    }
+
+    if (m_Pbos[0] != 0) {
+        for (int i = 0; i < EGL_PBO_RING_SIZE; i++) {
+            if (m_PboMappings[i] != nullptr) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_Pbos[i]);
+                m_glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                m_PboMappings[i] = nullptr;
+            }
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        glDeleteBuffers(EGL_PBO_RING_SIZE, m_Pbos);
+        SDL_zero(m_Pbos);
+    }
+
+    m_SwFrameWidth = m_SwFrameHeight = 0;
+}
+
+bool EGLRenderer::uploadSoftwareFrame(AVFrame* frame, GLint filter)
+{
+    if (frame->width != m_SwFrameWidth || frame->height != m_SwFrameHeight) {
+        if (!allocateSoftwareUploadBuffers(frame->width, frame->height)) {
+            return false;
+        }
+    }
+
+    int pbo = m_NextPbo;
+    m_NextPbo = (m_NextPbo + 1) % EGL_PBO_RING_SIZE;
+
+    // Wait until the GPU has finished uploading the last frame from this buffer.
+    // With a few buffers in the ring, this has almost always happened already.
+    if (m_PboFences[pbo] != EGL_NO_SYNC) {
+        m_eglClientWaitSync(m_EGLDisplay, m_PboFences[pbo], EGL_SYNC_FLUSH_COMMANDS_BIT, EGL_FOREVER);
+        m_eglDestroySync(m_EGLDisplay, m_PboFences[pbo]);
+        m_PboFences[pbo] = EGL_NO_SYNC;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_Pbos[pbo]);
+
+    uint8_t* lumaDst;
+    if (m_PersistentPbos) {
+        lumaDst = (uint8_t*)m_PboMappings[pbo];
+    }
+    else {
+        // Invalidating the buffer lets the driver give us new memory rather
+        // than stalling until the GPU is done with the old contents
+        lumaDst = (uint8_t*)m_glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m_PboSize,
+                                               GL_MAP_WRITE_BIT_EXT | GL_MAP_INVALIDATE_BUFFER_BIT_EXT);
+        if (lumaDst == nullptr) {
+            EGL_LOG(Error, "Failed to map pixel buffer object: %d", glGetError());
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return false;
+        }
+    }
+
+    int chromaWidth = (frame->width + 1) / 2;
+    int chromaHeight = (frame->height + 1) / 2;
+    size_t chromaOffset = (size_t)m_SwLumaPitch * frame->height;
+    uint8_t* chromaDst = lumaDst + chromaOffset;
+
+    for (int y = 0; y < frame->height; y++) {
+        memcpy(lumaDst + (size_t)m_SwLumaPitch * y,
+               frame->data[0] + (ptrdiff_t)frame->linesize[0] * y,
+               frame->width);
+    }
+
+    if (frame->format == AV_PIX_FMT_NV12) {
+        for (int y = 0; y < chromaHeight; y++) {
+            memcpy(chromaDst + (size_t)m_SwChromaPitch * y,
+                   frame->data[1] + (ptrdiff_t)frame->linesize[1] * y,
+                   chromaWidth * 2);
+        }
+    }
+    else {
+        // Interleave the U and V planes into NV12 while we're copying anyway
+        for (int y = 0; y < chromaHeight; y++) {
+            const uint8_t* srcU = frame->data[1] + (ptrdiff_t)frame->linesize[1] * y;
+            const uint8_t* srcV = frame->data[2] + (ptrdiff_t)frame->linesize[2] * y;
+            uint8_t* dstUV = chromaDst + (size_t)m_SwChromaPitch * y;
+
+            for (int x = 0; x < chromaWidth; x++) {
+                dstUV[x * 2] = srcU[x];
+                dstUV[x * 2 + 1] = srcV[x];
+            }
+        }
+    }
+
+    if (!m_PersistentPbos) {
+        m_glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    // These copy from the bound buffer, so they return without waiting for the GPU
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_SwTextures[0]);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, m_SwLumaPitch);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame->width, frame->height,
+                    GL_RED_EXT, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, m_SwTextures[1]);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, m_SwChromaPitch / 2);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, chromaWidth, chromaHeight,
+                    GL_RG_EXT, GL_UNSIGNED_BYTE, (const void*)chromaOffset);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (m_eglClientWaitSync != nullptr) {
+        m_PboFences[pbo] = createFence();
+    }
+
+    return true;
+}
+
+EGLSync EGLRenderer::createFence()
+{
+    if (m_eglCreateSync != nullptr) {
+        return m_eglCreateSync(m_EGLDisplay, EGL_SYNC_FENCE, nullptr);
+    }
+    else {
+        SDL_assert(m_eglCreateSyncKHR != nullptr);
+        return m_eglCreateSyncKHR(m_EGLDisplay, EGL_SYNC_FENCE, nullptr);
+    }
+}
+
 void EGLRenderer::cleanupRenderContext()
 {
     // Detach the context from the render thread so the destructor can attach it
@@ -760,7 +1119,8 @@ void EGLRenderer::renderFrame(AVFrame* frame)
 
     // Find the native read-back format and load the shaders
     if (m_EGLImagePixelFormat == AV_PIX_FMT_NONE) {
-        m_EGLImagePixelFormat = m_Backend->getEGLImagePixelFormat();
+        // Software frames are always uploaded as NV12
+        m_EGLImagePixelFormat = m_Backend != nullptr ? m_Backend->getEGLImagePixelFormat() : AV_PIX_FMT_NV12;
         EGL_LOG(Info, "EGLImage pixel format: %d", m_EGLImagePixelFormat);
 
         SDL_assert(m_EGLImagePixelFormat != AV_PIX_FMT_NONE);
@@ -794,24 +1154,27 @@ void EGLRenderer::renderFrame(AVFrame* frame)
     dst.h = drawableHeight;
     StreamUtils::scaleSourceToDestinationSurface(&src, &dst);
 
-    ssize_t plane_count = m_Backend->exportEGLImages(frame, m_EGLDisplay, imgs);
-    if (plane_count < 0)
-        return;
-    for (ssize_t i = 0; i < plane_count; ++i) {
-        glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_EXTERNAL_OES, m_Textures[i]);
-        m_glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, imgs[i]);
+    // Use GL_NEAREST to reduce sampling if the video region is a multiple of the frame size
+    GLint filter = (dst.w % frame->width == 0 && dst.h % frame->height == 0) ? GL_NEAREST : GL_LINEAR;
 
-        // Use GL_NEAREST to reduce sampling if the video region is a multiple of the frame size
-        if (dst.w % frame->width == 0 && dst.h % frame->height == 0) {
-            glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        }
-        else {
-            glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if (m_Backend != nullptr) {
+        ssize_t plane_count = m_Backend->exportEGLImages(frame, m_EGLDisplay, imgs);
+        if (plane_count < 0)
+            return;
+        if (!bindCachedTextures(frame, imgs, plane_count, filter)) {
+            // Rebind our shared textures if this surface isn't cached
+            for (ssize_t i = 0; i < plane_count; ++i) {
+                glActiveTexture(GL_TEXTURE0 + i);
+                glBindTexture(GL_TEXTURE_EXTERNAL_OES, m_Textures[i]);
+                m_glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, imgs[i]);
+                glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, filter);
+                glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, filter);
+            }
         }
     }
+    else if (!uploadSoftwareFrame(frame, filter)) {
+        return;
+    }
 
     // We already called glClear() after last frame's SDL_GL_SwapWindow()
     // to synchronize with our fence if swap buffers is blocking
@@ -851,13 +1214,7 @@ void EGLRenderer::renderFrame(AVFrame* frame)
         // video frame is safe for Pacer to free
         if (m_eglClientWaitSync != nullptr) {
             SDL_assert(m_LastRenderSync == EGL_NO_SYNC);
-            if (m_eglCreateSync != nullptr) {
-                m_LastRenderSync = m_eglCreateSync(m_EGLDisplay, EGL_SYNC_FENCE, nullptr);
-            }
-            else {
-                SDL_assert(m_eglCreateSyncKHR != nullptr);
-                m_LastRenderSync = m_eglCreateSyncKHR(m_EGLDisplay, EGL_SYNC_FENCE, nullptr);
-            }
+            m_LastRenderSync = createFence();
         }
     }
 
@@ -875,21 +1232,90 @@ void EGLRenderer::renderFrame(AVFrame* frame)
         glClear(GL_COLOR_BUFFER_BIT);
         if (m_eglClientWaitSync != nullptr) {
             SDL_assert(m_LastRenderSync == EGL_NO_SYNC);
-            if (m_eglCreateSync != nullptr) {
-                m_LastRenderSync = m_eglCreateSync(m_EGLDisplay, EGL_SYNC_FENCE, nullptr);
-            }
-            else {
-                SDL_assert(m_eglCreateSyncKHR != nullptr);
-                m_LastRenderSync = m_eglCreateSyncKHR(m_EGLDisplay, EGL_SYNC_FENCE, nullptr);
-            }
+            m_LastRenderSync = createFence();
+        }
+    }
+}
+
+bool EGLRenderer::bindCachedTextures(AVFrame* frame, EGLImage images[EGL_MAX_PLANES], ssize_t count, GLint filter)
+{
+    // Drop our textures whenever the backend flushes the EGLImages they're
+    // bound to. The backend just exported this frame on this thread, so
+    // any flush has already happened.
+    int generation = m_Backend->getEGLImageCacheGeneration();
+    if (generation != m_TextureCacheGeneration) {
+        flushTextureCache();
+        m_TextureCacheGeneration = generation;
+    }
+
+    CachedTextures* entry = nullptr;
+    for (int i = 0; i < m_TextureCacheCount; i++) {
+        if (m_TextureCache[i].count == count &&
+                memcmp(m_TextureCache[i].images, images, sizeof(EGLImage) * count) == 0) {
+            entry = &m_TextureCache[i];
+            break;
+        }
+    }
+
+    if (entry == nullptr) {
+        // We need a reference to the EGLImages to cache them
+        if (m_TextureCacheCount == EGL_TEXTURE_CACHE_SIZE || frame->opaque_ref == nullptr) {
+            return false;
+        }
+
+        entry = &m_TextureCache[m_TextureCacheCount];
+        entry->imageRef = av_buffer_ref(frame->opaque_ref);
+        if (entry->imageRef == nullptr) {
+            return false;
+        }
+
+        memcpy(entry->images, images, sizeof(EGLImage) * count);
+        entry->count = count;
+        entry->filter = 0;
+
+        glGenTextures(count, entry->textures);
+        for (ssize_t i = 0; i < count; ++i) {
+            glBindTexture(GL_TEXTURE_EXTERNAL_OES, entry->textures[i]);
+            glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            m_glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, images[i]);
+        }
+
+        m_TextureCacheCount++;
+    }
+
+    for (ssize_t i = 0; i < count; ++i) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_EXTERNAL_OES, entry->textures[i]);
+        if (entry->filter != filter) {
+            glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, filter);
+            glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, filter);
         }
     }
+    entry->filter = filter;
+
+    return true;
+}
+
+void EGLRenderer::flushTextureCache()
+{
+    for (int i = 0; i < m_TextureCacheCount; i++) {
+        glDeleteTextures(m_TextureCache[i].count, m_TextureCache[i].textures);
+        av_buffer_unref(&m_TextureCache[i].imageRef);
+    }
+
+    m_TextureCacheCount = 0;
 }
 
 bool EGLRenderer::testRenderFrame(AVFrame* frame)
 {
     EGLImage imgs[EGL_MAX_PLANES];
 
+    // Software frames don't depend on any driver import support
+    if (m_Backend == nullptr) {
+        return true;
+    }
+
     // Make sure we can get working EGLImages from the backend renderer.
     // Some devices (Raspberry Pi) will happily decode into DRM formats that
     // its own GL implementation won't accept in eglCreateImage().
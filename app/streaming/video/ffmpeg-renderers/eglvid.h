@@ -6,9 +6,16 @@
 #include <SDL_egl.h>
 #include <SDL_opengles2.h>
 
+// Number of pixel buffer objects used to upload software frames
+#define EGL_PBO_RING_SIZE 3
+
+// Number of decoder surfaces whose EGLImages stay bound to their own textures
+#define EGL_TEXTURE_CACHE_SIZE 32
+
 class EGLRenderer : public IFFmpegRenderer {
 public:
-    EGLRenderer(IFFmpegRenderer *backendRenderer);
+    // Without a backend renderer, we render software frames ourselves
+    EGLRenderer(IFFmpegRenderer *backendRenderer = nullptr);
     virtual ~EGLRenderer() override;
     virtual bool initialize(PDECODER_PARAMETERS params) override;
     virtual bool prepareDecoderContext(AVCodecContext* context, AVDictionary** options) override;
@@ -18,18 +25,27 @@ public:
     virtual void renderFrame(AVFrame* frame) override;
     virtual bool testRenderFrame(AVFrame* frame) override;
     virtual void notifyOverlayUpdated(Overlay::OverlayType) override;
+    virtual bool supportsOverlayGlyphBatches() override;
     virtual bool notifyWindowChanged(PWINDOW_STATE_CHANGE_INFO) override;
     virtual bool isPixelFormatSupported(int videoFormat, enum AVPixelFormat pixelFormat) override;
     virtual AVPixelFormat getPreferredPixelFormat(int videoFormat) override;
 
 private:
 
+    bool uploadOverlayAtlas(Overlay::OverlayType type, SDL_Surface* atlas);
     void renderOverlay(Overlay::OverlayType type, int viewportWidth, int viewportHeight);
-    unsigned compileShader(const char* vertexShaderSrc, const char* fragmentShaderSrc);
+    unsigned compileShader(const char* vertexShaderSrc, const char* fragmentShaderSrc, const char* defines = "");
     bool compileShaders();
     bool setupVideoRenderingState();
     bool setupOverlayRenderingState();
-    static int loadAndBuildShader(int shaderType, const char *filename);
+    bool initializeSoftwareUpload();
+    bool allocateSoftwareUploadBuffers(int width, int height);
+    void freeSoftwareUploadBuffers();
+    bool uploadSoftwareFrame(AVFrame* frame, GLint filter);
+    bool bindCachedTextures(AVFrame* frame, EGLImage images[EGL_MAX_PLANES], ssize_t count, GLint filter);
+    void flushTextureCache();
+    EGLSync createFence();
+    static int loadAndBuildShader(int shaderType, const char *filename, const char *defines);
 
     AVPixelFormat m_EGLImagePixelFormat;
     void *m_EGLDisplay;
@@ -37,6 +53,11 @@ private:
     unsigned m_OverlayTextures[Overlay::OverlayMax];
     unsigned m_OverlayVBOs[Overlay::OverlayMax];
     unsigned m_OverlayVAOs[Overlay::OverlayMax];
+
+    // Overlays are drawn as batches of quads from each overlay's glyph atlas
+    SDL_Surface* m_OverlayAtlases[Overlay::OverlayMax];
+    int m_OverlayVertexCounts[Overlay::OverlayMax];
+
     SDL_atomic_t m_OverlayHasValidData[Overlay::OverlayMax];
     unsigned m_ShaderProgram;
     unsigned m_OverlayShaderProgram;
@@ -58,6 +79,39 @@ private:
     int m_GlesMinorVersion;
     bool m_HasExtUnpackSubimage;
 
+    // Software frames are copied into a ring of pixel buffer objects, which are
+    // persistently mapped if possible, then uploaded to NV12 plane textures.
+    unsigned m_SwTextures[2];
+    unsigned m_Pbos[EGL_PBO_RING_SIZE];
+    void* m_PboMappings[EGL_PBO_RING_SIZE];
+    EGLSync m_PboFences[EGL_PBO_RING_SIZE];
+    int m_NextPbo;
+    int m_SwFrameWidth;
+    int m_SwFrameHeight;
+    int m_SwLumaPitch;
+    int m_SwChromaPitch;
+    size_t m_PboSize;
+    bool m_PersistentPbos;
+    PFNGLMAPBUFFERRANGEEXTPROC m_glMapBufferRange;
+    PFNGLUNMAPBUFFEROESPROC m_glUnmapBuffer;
+    PFNGLBUFFERSTORAGEEXTPROC m_glBufferStorageEXT;
+
+    // Backends reuse the same EGLImages for each decoder surface, so we keep
+    // a set of textures bound to each one instead of rebinding every frame.
+    // Each entry holds a reference to the frame's EGLImages, so their handles
+    // can't be recycled for a different surface while the entry exists.
+    // The cache is flushed whenever the backend flushes its EGLImage cache.
+    struct CachedTextures {
+        AVBufferRef* imageRef;
+        EGLImage images[EGL_MAX_PLANES];
+        ssize_t count;
+        unsigned textures[EGL_MAX_PLANES];
+        GLint filter;
+    };
+    CachedTextures m_TextureCache[EGL_TEXTURE_CACHE_SIZE];
+    int m_TextureCacheCount;
+    int m_TextureCacheGeneration;
+
 #define NV12_PARAM_YUVMAT 0
 #define NV12_PARAM_OFFSET 1
 #define NV12_PARAM_CHROMA_OFFSET 2
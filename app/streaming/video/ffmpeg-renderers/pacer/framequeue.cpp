@@ -0,0 +1,134 @@
+#include "framequeue.h"
+
+#include <thread>
+
+static_assert((FRAME_QUEUE_CAPACITY & (FRAME_QUEUE_CAPACITY - 1)) == 0,
+              "FRAME_QUEUE_CAPACITY must be a power of 2");
+
+FrameQueue::FrameQueue(PVIDEO_STATS videoStats)
+    : m_Head(0),
+      m_Tail(0),
+      m_ConsumerWaiting(false),
+      m_WakeTimeUs(0),
+      m_WakeSemaphore(SDL_CreateSemaphore(0)),
+      m_VideoStats(videoStats)
+{
+    for (std::atomic<AVFrame*>& frame : m_Frames) {
+        frame.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+FrameQueue::~FrameQueue()
+{
+    // The owner is responsible for draining frames first
+    SDL_assert(isEmpty());
+
+    SDL_DestroySemaphore(m_WakeSemaphore);
+}
+
+bool FrameQueue::enqueue(AVFrame* frame)
+{
+    uint32_t tail = m_Tail.load(std::memory_order_relaxed);
+    if (tail - m_Head.load(std::memory_order_acquire) >= FRAME_QUEUE_CAPACITY) {
+        return false;
+    }
+
+    m_Frames[tail & (FRAME_QUEUE_CAPACITY - 1)].store(frame, std::memory_order_relaxed);
+
+    // This must be sequentially consistent with the check of m_ConsumerWaiting
+    // to pair with the consumer setting it before re-checking the queue.
+    m_Tail.store(tail + 1, std::memory_order_seq_cst);
+
+    if (m_ConsumerWaiting.exchange(false, std::memory_order_seq_cst)) {
+        m_WakeTimeUs.store(LiGetMicroseconds(), std::memory_order_relaxed);
+        SDL_SemPost(m_WakeSemaphore);
+    }
+
+    return true;
+}
+
+AVFrame* FrameQueue::dequeue()
+{
+    uint32_t head = m_Head.load(std::memory_order_acquire);
+
+    for (;;) {
+        if (head == m_Tail.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+
+        AVFrame* frame = m_Frames[head & (FRAME_QUEUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (m_Head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            return frame;
+        }
+
+        // The other thread took this frame first. The failed CAS reloaded head.
+        m_VideoStats->pacerQueueContention++;
+    }
+}
+
+int FrameQueue::count() const
+{
+    uint32_t head = m_Head.load(std::memory_order_acquire);
+    return (int)(m_Tail.load(std::memory_order_acquire) - head);
+}
+
+bool FrameQueue::isEmpty() const
+{
+    return count() <= 0;
+}
+
+bool FrameQueue::waitForFrame(int timeoutMs)
+{
+    if (!isEmpty()) {
+        return true;
+    }
+
+    // Announce that we're going to sleep, then check again in case the
+    // producer enqueued a frame before it could have seen our flag. The
+    // re-check must load m_Tail seq_cst too. An acquire load could be
+    // reordered before our store, so we'd miss the frame while the producer
+    // misses our flag, and then sleep with a frame in the queue.
+    m_ConsumerWaiting.store(true, std::memory_order_seq_cst);
+    if (m_Tail.load(std::memory_order_seq_cst) != m_Head.load(std::memory_order_acquire)) {
+        if (!m_ConsumerWaiting.exchange(false, std::memory_order_seq_cst)) {
+            // The producer saw our flag and posted, so consume it
+            SDL_SemWait(m_WakeSemaphore);
+        }
+        return true;
+    }
+
+    int err = timeoutMs < 0 ? SDL_SemWait(m_WakeSemaphore) : SDL_SemWaitTimeout(m_WakeSemaphore, timeoutMs);
+    if (err == SDL_MUTEX_TIMEDOUT) {
+        if (!m_ConsumerWaiting.exchange(false, std::memory_order_seq_cst)) {
+            // We raced with a post, so consume it
+            SDL_SemWait(m_WakeSemaphore);
+        }
+    }
+    else if (!isEmpty()) {
+        m_VideoStats->pacerWakeups++;
+        m_VideoStats->totalPacerWakeLatencyUs += LiGetMicroseconds() - m_WakeTimeUs.load(std::memory_order_relaxed);
+    }
+
+    return !isEmpty();
+}
+
+bool FrameQueue::waitForFrameUntil(uint64_t deadlineUs)
+{
+    uint64_t nowUs = LiGetMicroseconds();
+    if (nowUs + 1000 <= deadlineUs && waitForFrame((int)((deadlineUs - nowUs) / 1000))) {
+        return true;
+    }
+
+    // SDL_SemWaitTimeout() only has millisecond granularity
+    while (isEmpty() && LiGetMicroseconds() < deadlineUs) {
+        std::this_thread::yield();
+    }
+
+    return !isEmpty();
+}
+
+void FrameQueue::wake()
+{
+    m_ConsumerWaiting.store(false, std::memory_order_seq_cst);
+    SDL_SemPost(m_WakeSemaphore);
+}
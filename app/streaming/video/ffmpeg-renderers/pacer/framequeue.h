@@ -0,0 +1,61 @@
+#pragma once
+
+#include "../../decoder.h"
+
+#include <atomic>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// Must be a power of 2 and larger than the deepest queue the Pacer allows
+#define FRAME_QUEUE_CAPACITY 8
+
+// Bounded lock-free queue of frames between one producer thread and one
+// consumer thread. The producer may also remove the oldest frame to make
+// room for a new one, so removal advances the head with a CAS. Whichever
+// thread wins owns the frame; the loser counts contention and retries.
+//
+// The consumer can block for a frame. Wakeups are futex-style: the producer
+// only posts the semaphore if the consumer announced that it's going to
+// sleep, so the common case of a non-empty queue never enters the kernel.
+class FrameQueue
+{
+public:
+    FrameQueue(PVIDEO_STATS videoStats);
+
+    ~FrameQueue();
+
+    // Producer only. Returns false if the queue is full.
+    bool enqueue(AVFrame* frame);
+
+    // Either thread. Returns nullptr if the queue is empty.
+    AVFrame* dequeue();
+
+    int count() const;
+
+    bool isEmpty() const;
+
+    // Consumer only. Waits up to timeoutMs (or forever if negative) for a
+    // frame, returning false if the queue is still empty when we wake up.
+    bool waitForFrame(int timeoutMs);
+
+    // Same as above, but waits until an absolute LiGetMicroseconds() deadline.
+    // We sleep on the semaphore for whole milliseconds, then poll the queue
+    // for the remainder, so we neither wake late nor give up early.
+    bool waitForFrameUntil(uint64_t deadlineUs);
+
+    // Wakes the consumer without a frame (used for shutdown)
+    void wake();
+
+private:
+    std::atomic<AVFrame*> m_Frames[FRAME_QUEUE_CAPACITY];
+    std::atomic<uint32_t> m_Head;
+    std::atomic<uint32_t> m_Tail;
+
+    std::atomic<bool> m_ConsumerWaiting;
+    std::atomic<uint64_t> m_WakeTimeUs;
+    SDL_sem* m_WakeSemaphore;
+
+    PVIDEO_STATS m_VideoStats;
+};
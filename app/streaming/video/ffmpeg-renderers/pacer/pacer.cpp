@@ -1,5 +1,6 @@
 #include "pacer.h"
 #include "streaming/streamutils.h"
+#include "utils.h"
 
 #ifdef Q_OS_WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -16,6 +17,12 @@
 #include "waylandvsyncsource.h"
 #endif
 
+#ifdef HAS_XCB_PRESENT
+#include "x11presentvsyncsource.h"
+#endif
+
+#include "softwarevsyncsource.h"
+
 #include <SDL_syswm.h>
 
 // Limit the number of queued frames to prevent excessive memory consumption
@@ -27,51 +34,129 @@
 // - Balanced: 3 frames (default)
 // - Low Latency: 2 frames
 // - Ultra Low Latency: 1 frame
+// - VRR: 1 frame, since we present as soon as it arrives
 #define MAX_QUEUED_FRAMES_BALANCED 3
 #define MAX_QUEUED_FRAMES_LOW_LATENCY 2
 #define MAX_QUEUED_FRAMES_ULTRA_LOW 1
 static_assert(PACER_MAX_OUTSTANDING_FRAMES == MAX_QUEUED_FRAMES_BALANCED + 2,
               "PACER_MAX_OUTSTANDING_FRAMES and MAX_QUEUED_FRAMES_BALANCED must agree");
+static_assert(MAX_QUEUED_FRAMES_BALANCED + 1 < PACER_MAX_OUTSTANDING_FRAMES,
+              "Adaptive pacing depth buckets must fit in m_RequiredDepthCounts");
 
 // Conservative guardrail: temporarily relax queue depth by +1 frame in
 // non-balanced modes when sustained enqueue overflows are detected.
 #define OVERLOAD_RELAX_OVERFLOW_THRESHOLD 24
 #define OVERLOAD_RELAX_DURATION_FRAMES 180
 #define OVERLOAD_HEALTHY_RESET_FRAMES 120
+
+// The adaptive mode picks the smallest queue depth that would have kept
+// late frames under this fraction of the recent window. It grows the queue
+// immediately, but only shrinks it one frame at a time after the smaller
+// depth has been sufficient for a while.
+#define ADAPTIVE_TARGET_LATE_RATE 0.01
+#define ADAPTIVE_DECREASE_HOLD_FRAMES 120
+
+// Allow our clock to run this much faster than the host's
+#define ADAPTIVE_CLOCK_DRIFT_ALLOWANCE 1.001
 #define DECODER_BACKLOG_RELAX_THRESHOLD 10
 #define DECODER_BACKLOG_RELAX_STREAK 8
 
-// We may be woken up slightly late so don't go all the way
-// up to the next V-sync since we may accidentally step into
-// the next V-sync period. It also takes some amount of time
-// to do the render itself, so we can't render right before
-// V-sync happens.
-#define TIMER_SLACK_MS 3
+// Frames are latched for rendering at a deadline before the next V-sync.
+// The lead time is our estimate of the render+present cost (mean plus two
+// deviations) plus a safety margin. The margin grows quickly when a frame
+// misses the V-sync it was latched for and shrinks slowly otherwise.
+#define RENDER_COST_INITIAL_US 1000
+#define RENDER_MARGIN_INITIAL_US 1000
+#define RENDER_MARGIN_MIN_US 500
+#define RENDER_MARGIN_MISS_PENALTY_US 1000
+#define RENDER_MARGIN_DECAY_US 1
+
+// A present that returns this close to V-sync probably blocked on it,
+// so it doesn't tell us how long rendering really took.
+#define PRESENT_BLOCKED_THRESHOLD_US 500
+
+uint64_t SystemPacerClock::getMicroseconds()
+{
+    return LiGetMicroseconds();
+}
+
+void SystemPacerClock::waitUntilUs(uint64_t deadlineUs)
+{
+    StreamUtils::waitUntilUs(deadlineUs);
+}
+
+bool SystemPacerClock::waitForFrame(FrameQueue& queue)
+{
+    return queue.waitForFrame(-1);
+}
+
+bool SystemPacerClock::waitForFrameUntil(FrameQueue& queue, uint64_t deadlineUs)
+{
+    return queue.waitForFrameUntil(deadlineUs);
+}
 
-Pacer::Pacer(IFFmpegRenderer* renderer, PVIDEO_STATS videoStats, StreamingPreferences::FramePacingMode pacingMode) :
+Pacer::Pacer(IFFmpegRenderer* renderer, PVIDEO_STATS videoStats, FrameTimeline* frameTimeline, FramePool* framePool,
+             StreamingPreferences::FramePacingMode pacingMode, IPacerClock* clock) :
+    m_RenderQueue(videoStats),
+    m_PacingQueue(videoStats),
     m_RenderThread(nullptr),
     m_VsyncThread(nullptr),
     m_DeferredFreeFrame(nullptr),
     m_Stopping(false),
+    m_Clock(clock != nullptr ? clock : &m_SystemClock),
     m_VsyncSource(nullptr),
     m_VsyncRenderer(renderer),
     m_MaxVideoFps(0),
     m_DisplayFps(0),
     m_VideoStats(videoStats),
+    m_FrameTimeline(frameTimeline),
+    m_FramePool(framePool),
+    m_LastVsyncTimeUs(0),
+    m_LastVsyncCount(0),
+    m_AvgVsyncIntervalUs(0),
+    m_RenderCostUs(RENDER_COST_INITIAL_US),
+    m_RenderCostDeviationUs(0),
+    m_RenderMarginUs(RENDER_MARGIN_INITIAL_US),
+    m_RenderLeadUs(RENDER_COST_INITIAL_US + RENDER_MARGIN_INITIAL_US),
     m_FramePacingMode(pacingMode),
+    m_VrrMinIntervalUs(0),
+    m_LastRenderStartUs(0),
+    m_VrrRenderTimer(0),
+    m_LastPresentUs(0),
+    m_LastPresentPts(AV_NOPTS_VALUE),
+    m_AdaptiveTargetQueueDepth(0),
     m_EnqueueOverflowStreak(0),
     m_EnqueueHealthyStreak(0),
     m_OverloadRelaxationActive(false),
     m_OverloadRelaxationFramesRemaining(0),
-    m_DecoderBacklogStreak(0)
+    m_DecoderBacklogStreak(0),
+    m_LastArrivalUs(0),
+    m_LastArrivalPts(0),
+    m_ArrivalScheduleUs(0),
+    m_RequiredDepthIndex(0),
+    m_RequiredDepthSamples(0),
+    m_AdaptiveDecreaseStreak(0)
 {
+    SDL_zero(m_RequiredDepthHistory);
+    SDL_zero(m_RequiredDepthCounts);
+
+    for (LatchRecord& record : m_LatchRecords) {
+        record.frameNumber.store(-1, std::memory_order_relaxed);
+        record.latchTimeUs.store(0, std::memory_order_relaxed);
+        record.targetVblankUs.store(0, std::memory_order_relaxed);
+        record.targetPeriodUs.store(0, std::memory_order_relaxed);
+    }
+
     switch (pacingMode) {
     case StreamingPreferences::FPM_LOW_LATENCY:
         m_MaxQueuedFrames = MAX_QUEUED_FRAMES_LOW_LATENCY;
         break;
     case StreamingPreferences::FPM_ULTRA_LOW:
+    case StreamingPreferences::FPM_VRR:
         m_MaxQueuedFrames = MAX_QUEUED_FRAMES_ULTRA_LOW;
         break;
+    case StreamingPreferences::FPM_ADAPTIVE:
+        // Start safe and shrink once we know the stream is stable
     case StreamingPreferences::FPM_BALANCED:
     default:
         m_MaxQueuedFrames = MAX_QUEUED_FRAMES_BALANCED;
@@ -81,7 +166,11 @@ Pacer::Pacer(IFFmpegRenderer* renderer, PVIDEO_STATS videoStats, StreamingPrefer
 
 void Pacer::notifyDecoderBacklog(int backlogFrames)
 {
-    if (m_FramePacingMode == StreamingPreferences::FPM_BALANCED) {
+    // The adaptive mode's controller already accounts for decoder backlog
+    // and VRR mode never queues frames behind a V-sync to begin with.
+    if (m_FramePacingMode == StreamingPreferences::FPM_BALANCED ||
+            m_FramePacingMode == StreamingPreferences::FPM_ADAPTIVE ||
+            m_FramePacingMode == StreamingPreferences::FPM_VRR) {
         return;
     }
 
@@ -100,8 +189,8 @@ void Pacer::notifyDecoderBacklog(int backlogFrames)
         ML_LOG_VIDEO_WARN("Pacer decode-backlog guard enabled: backlog=%d, mode=%d, maxQueue=%d->%d",
                           backlogFrames,
                           (int)m_FramePacingMode,
-                          m_MaxQueuedFrames,
-                          SDL_min(MAX_QUEUED_FRAMES_BALANCED, m_MaxQueuedFrames + 1));
+                          m_MaxQueuedFrames.load(),
+                          SDL_min(MAX_QUEUED_FRAMES_BALANCED, m_MaxQueuedFrames.load() + 1));
 #endif
         m_DecoderBacklogStreak = 0;
     }
@@ -113,36 +202,38 @@ Pacer::~Pacer()
 
     // Stop the V-sync thread
     if (m_VsyncThread != nullptr) {
-        m_PacingQueueNotEmpty.wakeAll();
+        m_PacingQueue.wake();
         m_VsyncSignalled.wakeAll();
         SDL_WaitThread(m_VsyncThread, nullptr);
     }
 
-    // Stop V-sync callbacks
-    delete m_VsyncSource;
-    m_VsyncSource = nullptr;
-
     // Stop the render thread
     if (m_RenderThread != nullptr) {
-        m_RenderQueueNotEmpty.wakeAll();
+        m_RenderQueue.wake();
         SDL_WaitThread(m_RenderThread, nullptr);
     }
     else {
+        SDL_RemoveTimer(m_VrrRenderTimer);
+
         // Notify the renderer that it is being destroyed soon
         // NB: This must happen on the same thread that calls renderFrame().
         m_VsyncRenderer->cleanupRenderContext();
     }
 
+    // Stop V-sync callbacks
+    // NB: This must happen after the render thread is gone since it reports presents to the source
+    delete m_VsyncSource;
+    m_VsyncSource = nullptr;
+
     // Delete any remaining unconsumed frames
-    while (!m_RenderQueue.isEmpty()) {
-        AVFrame* frame = m_RenderQueue.dequeue();
-        av_frame_free(&frame);
+    AVFrame* frame;
+    while ((frame = m_RenderQueue.dequeue()) != nullptr) {
+        m_FramePool->release(&frame);
     }
-    while (!m_PacingQueue.isEmpty()) {
-        AVFrame* frame = m_PacingQueue.dequeue();
-        av_frame_free(&frame);
+    while ((frame = m_PacingQueue.dequeue()) != nullptr) {
+        m_FramePool->release(&frame);
     }
-    av_frame_free(&m_DeferredFreeFrame);
+    m_FramePool->release(&m_DeferredFreeFrame);
 }
 
 void Pacer::renderOnMainThread()
@@ -152,17 +243,26 @@ void Pacer::renderOnMainThread()
         return;
     }
 
-    m_FrameQueueLock.lock();
+    if (m_VrrMinIntervalUs != 0) {
+        // We can't block the event loop until the VRR interval has passed,
+        // so leave the frame queued and check back when it has.
+        uint64_t nowUs = m_Clock->getMicroseconds();
+        uint64_t earliestRenderUs = getVrrEarliestRenderUs();
+        if (nowUs < earliestRenderUs) {
+            SDL_RemoveTimer(m_VrrRenderTimer);
+            m_VrrRenderTimer = SDL_AddTimer((Uint32)((earliestRenderUs - nowUs + 999) / 1000),
+                                            vrrRenderTimerCallback, nullptr);
 
-    if (!m_RenderQueue.isEmpty()) {
-        AVFrame* frame = m_RenderQueue.dequeue();
-        m_FrameQueueLock.unlock();
+            m_VideoStats->vrrDelayedFrames++;
+            m_VideoStats->totalVrrDelayUs += earliestRenderUs - nowUs;
+            return;
+        }
+    }
 
+    AVFrame* frame = m_RenderQueue.dequeue();
+    if (frame != nullptr) {
         renderFrame(frame);
     }
-    else {
-        m_FrameQueueLock.unlock();
-    }
 }
 
 int Pacer::vsyncThread(void *context)
@@ -184,9 +284,9 @@ int Pacer::vsyncThread(void *context)
     while (!me->m_Stopping) {
         if (async) {
             // Wait for the VSync source to invoke signalVsync() or 100ms to elapse
-            me->m_FrameQueueLock.lock();
-            me->m_VsyncSignalled.wait(&me->m_FrameQueueLock, 100);
-            me->m_FrameQueueLock.unlock();
+            me->m_VsyncLock.lock();
+            me->m_VsyncSignalled.wait(&me->m_VsyncLock, 100);
+            me->m_VsyncLock.unlock();
         }
         else {
             // Let the VSync source wait in the context of our thread
@@ -197,7 +297,16 @@ int Pacer::vsyncThread(void *context)
             break;
         }
 
-        me->handleVsync(1000 / me->m_DisplayFps);
+        // Schedule from the vblank itself if the source knows when it was,
+        // since our wakeup may have been delayed. Ignore timestamps that
+        // aren't from the last period, in case the source's clock differs.
+        uint64_t nowUs = me->m_Clock->getMicroseconds();
+        uint64_t vsyncTimeUs = async ? 0 : me->m_VsyncSource->getLastVsyncTimeUs();
+        if (vsyncTimeUs == 0 || vsyncTimeUs > nowUs || nowUs - vsyncTimeUs > 1000000U / me->m_DisplayFps) {
+            vsyncTimeUs = nowUs;
+        }
+
+        me->handleVsync(vsyncTimeUs);
     }
 
     return 0;
@@ -221,25 +330,21 @@ int Pacer::renderThread(void* context)
         // Wait for the renderer to be ready for the next frame
         me->m_VsyncRenderer->waitToRender();
 
-        // Acquire the frame queue lock to protect the queue and
-        // the not empty condition
-        me->m_FrameQueueLock.lock();
-
         // Wait for a frame to be ready to render
         while (!me->m_Stopping && me->m_RenderQueue.isEmpty()) {
-            me->m_RenderQueueNotEmpty.wait(&me->m_FrameQueueLock);
+            me->m_Clock->waitForFrame(me->m_RenderQueue);
         }
 
         if (me->m_Stopping) {
             // Exit this thread
-            me->m_FrameQueueLock.unlock();
             break;
         }
 
+        // This may fail if the V-sync thread dropped the frame to make room
         AVFrame* frame = me->m_RenderQueue.dequeue();
-        me->m_FrameQueueLock.unlock();
-
-        me->renderFrame(frame);
+        if (frame != nullptr) {
+            me->renderFrame(frame);
+        }
     }
 
     // Notify the renderer that it is being destroyed soon
@@ -249,17 +354,19 @@ int Pacer::renderThread(void* context)
     return 0;
 }
 
-void Pacer::enqueueFrameForRenderingAndUnlock(AVFrame *frame)
+void Pacer::enqueueFrameForRendering(AVFrame *frame)
 {
     dropFrameForEnqueue(m_RenderQueue);
-    m_RenderQueue.enqueue(frame);
-
-    m_FrameQueueLock.unlock();
-
-    if (m_RenderThread != nullptr) {
-        m_RenderQueueNotEmpty.wakeOne();
+    if (!m_RenderQueue.enqueue(frame)) {
+        // dropFrameForEnqueue() always leaves room, so this shouldn't happen
+        SDL_assert(false);
+        m_VideoStats->pacerDroppedFrames++;
+        m_FramePool->release(&frame);
+        return;
     }
-    else {
+
+    // The render thread is woken by the queue itself
+    if (m_RenderThread == nullptr) {
         SDL_Event event;
 
         // For main thread rendering, we'll push an event to trigger a callback
@@ -271,12 +378,16 @@ void Pacer::enqueueFrameForRenderingAndUnlock(AVFrame *frame)
 
 // Called in an arbitrary thread by the IVsyncSource on V-sync
 // or an event synchronized with V-sync
-void Pacer::handleVsync(int timeUntilNextVsyncMillis)
+void Pacer::handleVsync(uint64_t vsyncTimeUs)
 {
     // Make sure initialize() has been called
     SDL_assert(m_MaxVideoFps != 0);
 
-    m_FrameQueueLock.lock();
+    // Prefer the measured refresh interval if our V-sync source provides timestamps
+    double periodUs = m_AvgVsyncIntervalUs != 0 ? m_AvgVsyncIntervalUs : 1000000.0 / m_DisplayFps;
+    uint64_t nextVsyncUs = vsyncTimeUs + (uint64_t)periodUs;
+    uint64_t deadlineUs = nextVsyncUs - SDL_min((uint64_t)m_RenderLeadUs.load(std::memory_order_relaxed),
+                                                (uint64_t)periodUs);
 
     // If the queue length history entries are large, be strict
     // about dropping excess frames.
@@ -303,62 +414,102 @@ void Pacer::handleVsync(int timeUntilNextVsyncMillis)
         m_PacingQueueHistory.enqueue(m_PacingQueue.count());
     }
 
+    if (m_PacingQueue.isEmpty()) {
+        // Wait for a frame to arrive or our deadline to pass
+        if (!m_Clock->waitForFrameUntil(m_PacingQueue, deadlineUs)) {
+            // Wait timed out - bail
+            return;
+        }
+    }
+    else {
+        // Latch as late as we safely can, so the catch-up below can
+        // pick a newer frame if one arrives in the meantime.
+        m_Clock->waitUntilUs(deadlineUs);
+    }
+
+    if (m_Stopping) {
+        return;
+    }
+
     // Catch up if we're several frames ahead
     while (m_PacingQueue.count() > frameDropTarget) {
         AVFrame* frame = m_PacingQueue.dequeue();
+        if (frame == nullptr) {
+            // The decoder thread dropped it first
+            break;
+        }
 
-        // Drop the lock while we call av_frame_free()
-        m_FrameQueueLock.unlock();
         m_VideoStats->pacerDroppedFrames++;
 #ifdef Q_OS_DARWIN
         ML_LOG_VIDEO_WARN("Pacer dropped frame: queue=%d, target=%d, total_dropped=%u",
                          (int)(m_PacingQueue.count() + 1), frameDropTarget, m_VideoStats->pacerDroppedFrames);
 #endif
-        av_frame_free(&frame);
-        m_FrameQueueLock.lock();
+        m_FramePool->release(&frame);
     }
 
-    if (m_PacingQueue.isEmpty()) {
-        // Wait for a frame to arrive or our V-sync timeout to expire
-        if (!m_PacingQueueNotEmpty.wait(&m_FrameQueueLock, SDL_max(timeUntilNextVsyncMillis, TIMER_SLACK_MS) - TIMER_SLACK_MS)) {
-            // Wait timed out - unlock and bail
-            m_FrameQueueLock.unlock();
-            return;
-        }
+    // Place the first frame on the render queue
+    AVFrame* frame = m_PacingQueue.dequeue();
+    if (frame != nullptr) {
+        uint64_t latchTimeUs = m_Clock->getMicroseconds();
 
-        if (m_Stopping) {
-            m_FrameQueueLock.unlock();
-            return;
-        }
-    }
+        m_VideoStats->totalRenderLeadUs += nextVsyncUs > latchTimeUs ? nextVsyncUs - latchTimeUs : 0;
+        m_VideoStats->latchedFrames++;
 
-    // Place the first frame on the render queue
-    enqueueFrameForRenderingAndUnlock(m_PacingQueue.dequeue());
+        // Let the render thread know which V-sync this frame is aiming for
+        int frameNumber = (int)(intptr_t)frame->opaque;
+        LatchRecord& record = m_LatchRecords[frameNumber & (PACER_LATCH_RECORDS - 1)];
+        record.latchTimeUs.store(latchTimeUs, std::memory_order_relaxed);
+        record.targetPeriodUs.store((uint32_t)periodUs, std::memory_order_relaxed);
+        record.targetVblankUs.store(nextVsyncUs, std::memory_order_relaxed);
+        record.frameNumber.store(frameNumber, std::memory_order_release);
+
+        enqueueFrameForRendering(frame);
+    }
 }
 
-bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing)
+// Called on the render thread after presenting a frame latched by handleVsync()
+void Pacer::updateRenderDeadline(int frameNumber, uint64_t afterRenderUs)
 {
-    m_MaxVideoFps = maxVideoFps;
-    m_DisplayFps = StreamUtils::getDisplayRefreshRate(window);
-    m_RendererAttributes = m_VsyncRenderer->getRendererAttributes();
+    LatchRecord& record = m_LatchRecords[frameNumber & (PACER_LATCH_RECORDS - 1)];
+    if (record.frameNumber.load(std::memory_order_acquire) != frameNumber) {
+        // This frame wasn't latched on V-sync (or its record was reused)
+        return;
+    }
 
-#ifdef Q_OS_DARWIN
-    const char* pacingModeStr = "unknown";
-    switch (m_FramePacingMode) {
-        case StreamingPreferences::FPM_LOW_LATENCY: pacingModeStr = "low_latency"; break;
-        case StreamingPreferences::FPM_ULTRA_LOW: pacingModeStr = "ultra_low"; break;
-        case StreamingPreferences::FPM_BALANCED: pacingModeStr = "balanced"; break;
+    uint64_t targetVblankUs = record.targetVblankUs.load(std::memory_order_relaxed);
+    uint64_t latchTimeUs = record.latchTimeUs.load(std::memory_order_relaxed);
+    uint32_t periodUs = record.targetPeriodUs.load(std::memory_order_relaxed);
+
+    // Don't count this frame again if it's presented twice
+    record.frameNumber.store(-1, std::memory_order_relaxed);
+
+    if (afterRenderUs > targetVblankUs + periodUs / 4) {
+        // We missed the V-sync we latched this frame for
+        m_RenderMarginUs = SDL_min(m_RenderMarginUs + RENDER_MARGIN_MISS_PENALTY_US, periodUs / 2.0);
+        m_VideoStats->missedRenderDeadlines++;
     }
-    ML_LOG_VIDEO("Pacer init: display=%d Hz, video=%d fps, pacing=%s, mode=%s, maxQueue=%d",
-                m_DisplayFps, m_MaxVideoFps, enablePacing ? "enabled" : "disabled",
-                pacingModeStr, m_MaxQueuedFrames);
-#endif
+    else {
+        m_RenderMarginUs = SDL_max(m_RenderMarginUs - RENDER_MARGIN_DECAY_US, (double)RENDER_MARGIN_MIN_US);
 
-    if (enablePacing) {
-        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
-                    "Frame pacing: target %d Hz with %d FPS stream",
-                    m_DisplayFps, m_MaxVideoFps);
+        if (afterRenderUs + PRESENT_BLOCKED_THRESHOLD_US < targetVblankUs) {
+            // Include the handoff to this thread in the cost
+            double costUs = (double)(afterRenderUs - latchTimeUs);
+            m_RenderCostDeviationUs += (qAbs(costUs - m_RenderCostUs) - m_RenderCostDeviationUs) / 16;
+            m_RenderCostUs += (costUs - m_RenderCostUs) / 16;
+        }
+    }
+
+    m_RenderLeadUs.store((uint32_t)(m_RenderCostUs + 2 * m_RenderCostDeviationUs + m_RenderMarginUs),
+                         std::memory_order_relaxed);
+}
+
+bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing)
+{
+    int displayFps = StreamUtils::getDisplayRefreshRate(window);
+    IVsyncSource* vsyncSource = nullptr;
 
+    // VRR pacing doesn't wait for V-sync
+    if (enablePacing && m_FramePacingMode != StreamingPreferences::FPM_VRR) {
         SDL_SysWMinfo info;
         SDL_VERSION(&info.version);
         if (!SDL_GetWindowWMInfo(window, &info)) {
@@ -371,30 +522,103 @@ bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing)
         switch (info.subsystem) {
     #ifdef Q_OS_WIN32
         case SDL_SYSWM_WINDOWS:
-            m_VsyncSource = new DxVsyncSource(this);
+            vsyncSource = new DxVsyncSource(this);
             break;
     #endif
 
     #if defined(SDL_VIDEO_DRIVER_WAYLAND) && defined(HAS_WAYLAND)
         case SDL_SYSWM_WAYLAND:
-            m_VsyncSource = new WaylandVsyncSource(this);
+            vsyncSource = new WaylandVsyncSource(this);
+            break;
+    #endif
+
+    #if defined(SDL_VIDEO_DRIVER_X11) && defined(HAS_XCB_PRESENT)
+        case SDL_SYSWM_X11:
+            vsyncSource = new X11PresentVsyncSource(this);
             break;
     #endif
 
         default:
-            // Platforms without a VsyncSource will just render frames
-            // immediately like they used to.
             break;
         }
 
-        SDL_assert(m_VsyncSource != nullptr || !(m_RendererAttributes & RENDERER_ATTRIBUTE_FORCE_PACING));
+        if (vsyncSource != nullptr && !vsyncSource->initialize(window, displayFps)) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Vsync source failed to initialize");
+            delete vsyncSource;
+            vsyncSource = nullptr;
+        }
 
-        if (m_VsyncSource != nullptr && !m_VsyncSource->initialize(window, m_DisplayFps)) {
+    #ifndef Q_OS_DARWIN
+        // Platforms without a real VsyncSource predict it from the refresh rate
+        // and the time each V-synced present returns, unless the renderer's
+        // presents don't block or the user opted out.
+        bool softwareVsync;
+        if (!Utils::getEnvironmentVariableOverride("SOFTWARE_VSYNC", &softwareVsync)) {
+            softwareVsync = !(m_VsyncRenderer->getRendererAttributes() & RENDERER_ATTRIBUTE_NONBLOCKING_PRESENT);
+        }
+        if (vsyncSource == nullptr && softwareVsync) {
+            vsyncSource = new SoftwareVsyncSource();
+            if (!vsyncSource->initialize(window, displayFps)) {
+                delete vsyncSource;
+                vsyncSource = nullptr;
+            }
+        }
+    #endif
+
+        // Otherwise we will just render frames immediately like we used to.
+        if (vsyncSource == nullptr) {
             SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
-                        "Vsync source failed to initialize. Frame pacing will not be available!");
-            delete m_VsyncSource;
-            m_VsyncSource = nullptr;
+                        "No V-sync source available. Frame pacing will not be available!");
+        }
+
+        SDL_assert(vsyncSource != nullptr || !(m_VsyncRenderer->getRendererAttributes() & RENDERER_ATTRIBUTE_FORCE_PACING));
+    }
+
+    return initialize(vsyncSource, displayFps, maxVideoFps, enablePacing);
+}
+
+bool Pacer::initialize(IVsyncSource* vsyncSource, int displayFps, int maxVideoFps, bool enablePacing)
+{
+    m_MaxVideoFps = maxVideoFps;
+    m_DisplayFps = displayFps;
+    m_VsyncSource = vsyncSource;
+    m_RendererAttributes = m_VsyncRenderer->getRendererAttributes();
+
+#ifdef Q_OS_DARWIN
+    const char* pacingModeStr = "unknown";
+    switch (m_FramePacingMode) {
+        case StreamingPreferences::FPM_LOW_LATENCY: pacingModeStr = "low_latency"; break;
+        case StreamingPreferences::FPM_ULTRA_LOW: pacingModeStr = "ultra_low"; break;
+        case StreamingPreferences::FPM_BALANCED: pacingModeStr = "balanced"; break;
+        case StreamingPreferences::FPM_ADAPTIVE: pacingModeStr = "adaptive"; break;
+        case StreamingPreferences::FPM_VRR: pacingModeStr = "vrr"; break;
+    }
+    ML_LOG_VIDEO("Pacer init: display=%d Hz, video=%d fps, pacing=%s, mode=%s, maxQueue=%d",
+                m_DisplayFps, m_MaxVideoFps, enablePacing ? "enabled" : "disabled",
+                pacingModeStr, m_MaxQueuedFrames.load());
+#endif
+
+    if (enablePacing && m_FramePacingMode == StreamingPreferences::FPM_VRR) {
+        // A VRR display refreshes when we present, so there's no V-sync to wait for.
+        // We just need to avoid presenting faster than its maximum refresh rate,
+        // which would take it out of its VRR range. SDL reports the current mode's
+        // refresh rate, which is normally the maximum for VRR-capable modes.
+        int maxRefreshRate;
+        if (!Utils::getEnvironmentVariableOverride("VRR_MAX_REFRESH_RATE", &maxRefreshRate) || maxRefreshRate <= 0) {
+            maxRefreshRate = m_DisplayFps;
         }
+
+        m_VrrMinIntervalUs = 1000000 / maxRefreshRate;
+
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Frame pacing: VRR up to %d Hz with %d FPS stream",
+                    maxRefreshRate, m_MaxVideoFps);
+    }
+    else if (enablePacing) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Frame pacing: target %d Hz with %d FPS stream",
+                    m_DisplayFps, m_MaxVideoFps);
     }
     else {
         SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
@@ -418,15 +642,125 @@ void Pacer::signalVsync()
     m_VsyncSignalled.wakeOne();
 }
 
+// Called on the V-sync thread by sources that know when V-sync actually happened
+void Pacer::recordVsyncTime(uint64_t vsyncTimeUs, uint64_t vsyncCount)
+{
+    if (m_LastVsyncCount != 0 && vsyncCount > m_LastVsyncCount && vsyncTimeUs > m_LastVsyncTimeUs) {
+        // Normalize to a single refresh interval in case we missed some
+        double intervalUs = (double)(vsyncTimeUs - m_LastVsyncTimeUs) / (vsyncCount - m_LastVsyncCount);
+
+        if (m_AvgVsyncIntervalUs == 0) {
+            m_AvgVsyncIntervalUs = intervalUs;
+        }
+
+        // Jitter is the deviation from the recent average interval, since
+        // the real refresh rate usually isn't exactly what SDL reports.
+        uint64_t jitterUs = (uint64_t)qAbs(intervalUs - m_AvgVsyncIntervalUs);
+        m_VideoStats->totalVsyncJitterUs += jitterUs;
+        m_VideoStats->maxVsyncJitterUs = qMax(m_VideoStats->maxVsyncJitterUs, (uint32_t)jitterUs);
+        m_VideoStats->vsyncIntervals++;
+
+        m_AvgVsyncIntervalUs = (m_AvgVsyncIntervalUs * 31 + intervalUs) / 32;
+    }
+
+    m_LastVsyncTimeUs = vsyncTimeUs;
+    m_LastVsyncCount = vsyncCount;
+}
+
+// Returns the earliest time the next frame may start rendering in VRR mode.
+// We measure between render starts rather than presents, since the time it
+// takes the renderer to return from presenting varies from frame to frame.
+uint64_t Pacer::getVrrEarliestRenderUs()
+{
+    if (m_LastRenderStartUs == 0) {
+        return 0;
+    }
+
+    return m_LastRenderStartUs + m_VrrMinIntervalUs;
+}
+
+// Called on the render thread before presenting in VRR mode
+void Pacer::waitForVrrRefreshInterval()
+{
+    uint64_t nowUs = m_Clock->getMicroseconds();
+    uint64_t earliestRenderUs = getVrrEarliestRenderUs();
+    if (nowUs >= earliestRenderUs) {
+        return;
+    }
+
+    m_Clock->waitUntilUs(earliestRenderUs);
+
+    m_VideoStats->vrrDelayedFrames++;
+    m_VideoStats->totalVrrDelayUs += m_Clock->getMicroseconds() - nowUs;
+}
+
+Uint32 Pacer::vrrRenderTimerCallback(Uint32, void*)
+{
+    SDL_Event event;
+
+    // Retry rendering on the main thread now that the VRR interval has passed
+    event.type = SDL_USEREVENT;
+    event.user.code = SDL_CODE_FRAME_READY;
+    SDL_PushEvent(&event);
+
+    // One-shot
+    return 0;
+}
+
 void Pacer::renderFrame(AVFrame* frame)
 {
+    if (m_VrrMinIntervalUs != 0) {
+        // Main thread rendering waits in renderOnMainThread() instead
+        if (m_RenderThread != nullptr) {
+            waitForVrrRefreshInterval();
+        }
+
+        // Present the newest frame if another one arrived while we waited
+        AVFrame* newerFrame;
+        while ((newerFrame = m_RenderQueue.dequeue()) != nullptr) {
+            m_VideoStats->pacerDroppedFrames++;
+            m_FramePool->release(&frame);
+            frame = newerFrame;
+        }
+    }
+
     // Count time spent in Pacer's queues
-    uint64_t beforeRender = LiGetMicroseconds();
-    m_VideoStats->totalPacerTimeUs += (beforeRender - (uint64_t)frame->pkt_dts);
+    uint64_t beforeRender = m_Clock->getMicroseconds();
+    m_LastRenderStartUs = beforeRender;
+    uint64_t pacerTimeUs = beforeRender - (uint64_t)frame->pkt_dts;
+    m_VideoStats->totalPacerTimeUs += pacerTimeUs;
+    m_VideoStats->pacerLatencyHistogram[SDL_min(pacerTimeUs / PACER_LATENCY_HISTOGRAM_BUCKET_US,
+                                                (uint64_t)PACER_LATENCY_HISTOGRAM_BUCKETS - 1)]++;
+    int64_t pts = frame->pts;
 
     // Render it
+    int frameNumber = (int)(intptr_t)frame->opaque;
+    m_FrameTimeline->recordStage(frameNumber, FrameTimeline::StageRenderStart, beforeRender);
     m_VsyncRenderer->renderFrame(frame);
-    uint64_t afterRender = LiGetMicroseconds();
+    uint64_t afterRender = m_Clock->getMicroseconds();
+    m_VsyncRenderer->updateRenderStats(m_VideoStats);
+    m_FrameTimeline->recordStage(frameNumber, FrameTimeline::StagePresent, afterRender);
+
+    if (m_VsyncSource != nullptr) {
+        m_VsyncSource->notifyPresent(afterRender);
+        updateRenderDeadline(frameNumber, afterRender);
+    }
+
+    // Judder is how far the time between presents strays from the time between
+    // the frames' capture on the host, regardless of any frames dropped between.
+    if (m_LastPresentUs != 0 && pts != AV_NOPTS_VALUE && m_LastPresentPts != AV_NOPTS_VALUE) {
+        // RTP timestamps use a 90 kHz clock and wrap at 32 bits
+        double contentIntervalUs = (uint32_t)(pts - m_LastPresentPts) / 90.0;
+        if (contentIntervalUs < 1000000.0) {
+            uint64_t judderUs = (uint64_t)qAbs((double)(afterRender - m_LastPresentUs) - contentIntervalUs);
+            m_VideoStats->totalJudderUs += judderUs;
+            m_VideoStats->maxJudderUs = qMax(m_VideoStats->maxJudderUs, (uint32_t)judderUs);
+            m_VideoStats->judderSamples++;
+        }
+    }
+
+    m_LastPresentUs = afterRender;
+    m_LastPresentPts = pts;
 
     m_VideoStats->totalRenderTimeUs += (afterRender - beforeRender);
     m_VideoStats->renderedFrames++;
@@ -435,11 +769,9 @@ void Pacer::renderFrame(AVFrame* frame)
     // doesn't stall or read garbage if the backing buffer gets returned
     // to the pool and the decoder tries to write a new frame into it
     std::swap(frame, m_DeferredFreeFrame);
-    av_frame_free(&frame);
+    m_FramePool->release(&frame);
 
     // Drop frames if we have too many queued up for a while
-    m_FrameQueueLock.lock();
-
     int frameDropTarget;
 
     if (m_RendererAttributes & RENDERER_ATTRIBUTE_NO_BUFFERING) {
@@ -469,51 +801,60 @@ void Pacer::renderFrame(AVFrame* frame)
     // Catch up if we're several frames ahead
     while (m_RenderQueue.count() > frameDropTarget) {
         AVFrame* frame = m_RenderQueue.dequeue();
+        if (frame == nullptr) {
+            break;
+        }
 
-        // Drop the lock while we call av_frame_free()
-        m_FrameQueueLock.unlock();
         m_VideoStats->pacerDroppedFrames++;
-        av_frame_free(&frame);
-        m_FrameQueueLock.lock();
+        m_FramePool->release(&frame);
     }
-
-    m_FrameQueueLock.unlock();
 }
 
-void Pacer::dropFrameForEnqueue(QQueue<AVFrame*>& queue)
+void Pacer::dropFrameForEnqueue(FrameQueue& queue)
 {
-    int effectiveMaxQueuedFrames = m_MaxQueuedFrames;
+    int maxQueuedFrames = m_MaxQueuedFrames;
+    int effectiveMaxQueuedFrames = maxQueuedFrames;
 
     // In non-balanced modes, temporarily allow one extra queued frame when
     // sustained enqueue overflow indicates persistent overload.
-    if (m_OverloadRelaxationActive && m_FramePacingMode != StreamingPreferences::FPM_BALANCED) {
-        effectiveMaxQueuedFrames = SDL_min(MAX_QUEUED_FRAMES_BALANCED, m_MaxQueuedFrames + 1);
+    if (m_OverloadRelaxationActive &&
+            m_FramePacingMode != StreamingPreferences::FPM_BALANCED &&
+            m_FramePacingMode != StreamingPreferences::FPM_ADAPTIVE &&
+            m_FramePacingMode != StreamingPreferences::FPM_VRR) {
+        effectiveMaxQueuedFrames = SDL_min(MAX_QUEUED_FRAMES_BALANCED, maxQueuedFrames + 1);
     }
 
-    if (queue.size() >= effectiveMaxQueuedFrames) {
+    if (queue.count() >= effectiveMaxQueuedFrames) {
         m_EnqueueOverflowStreak++;
         m_EnqueueHealthyStreak = 0;
 
         if (!m_OverloadRelaxationActive &&
             m_FramePacingMode != StreamingPreferences::FPM_BALANCED &&
+            m_FramePacingMode != StreamingPreferences::FPM_ADAPTIVE &&
+            m_FramePacingMode != StreamingPreferences::FPM_VRR &&
             m_EnqueueOverflowStreak >= OVERLOAD_RELAX_OVERFLOW_THRESHOLD) {
             m_OverloadRelaxationActive = true;
             m_OverloadRelaxationFramesRemaining = OVERLOAD_RELAX_DURATION_FRAMES;
 #ifdef Q_OS_DARWIN
             ML_LOG_VIDEO_WARN("Pacer overload guard enabled: mode=%d, maxQueue=%d->%d",
-                              (int)m_FramePacingMode, m_MaxQueuedFrames,
-                              SDL_min(MAX_QUEUED_FRAMES_BALANCED, m_MaxQueuedFrames + 1));
+                              (int)m_FramePacingMode, effectiveMaxQueuedFrames - 1,
+                              effectiveMaxQueuedFrames);
 #endif
         }
 
-        while (queue.size() >= effectiveMaxQueuedFrames) {
+        while (queue.count() >= effectiveMaxQueuedFrames) {
+            // The consumer may take the oldest frame before we can
+            AVFrame* frame = queue.dequeue();
+            if (frame == nullptr) {
+                break;
+            }
+
             m_VideoStats->pacerDroppedFrames++;
 #ifdef Q_OS_DARWIN
             ML_LOG_VIDEO_WARN("Pacer queue overflow drop: queueSize=%d, maxQueue=%d, mode=%d, total_dropped=%u",
-                             (int)queue.size(), effectiveMaxQueuedFrames, (int)m_FramePacingMode, m_VideoStats->pacerDroppedFrames);
+                             (int)queue.count() + 1, effectiveMaxQueuedFrames, (int)m_FramePacingMode, m_VideoStats->pacerDroppedFrames);
 #endif
-            AVFrame* frame = queue.dequeue();
-            av_frame_free(&frame);
+            m_FramePool->release(&frame);
         }
     }
     else {
@@ -524,13 +865,114 @@ void Pacer::dropFrameForEnqueue(QQueue<AVFrame*>& queue)
     }
 }
 
+// Estimates how late each frame arrives relative to the host's frame timing,
+// like the playout delay estimate of a VoIP jitter buffer. Since we measure
+// arrival after decoding, this covers both network jitter and variance in
+// decode time. A frame that arrives N frame intervals late needs N extra
+// frames queued ahead of it to avoid a stall.
+void Pacer::updateAdaptiveQueueDepth(AVFrame* frame)
+{
+    if (frame->pts == AV_NOPTS_VALUE) {
+        return;
+    }
+
+    uint64_t arrivalUs = (uint64_t)frame->pkt_dts;
+    double frameIntervalUs = 1000000.0 / m_MaxVideoFps;
+
+    // RTP timestamps use a 90 kHz clock and wrap at 32 bits
+    double expectedDeltaUs = (uint32_t)(frame->pts - m_LastArrivalPts) / 90.0;
+    if (m_LastArrivalUs == 0 || expectedDeltaUs > 1000000.0) {
+        // First frame or a discontinuity, so start a new schedule
+        m_ArrivalScheduleUs = arrivalUs;
+    }
+    else {
+        // The schedule is the earliest we could have expected this frame
+        m_ArrivalScheduleUs = SDL_min((double)arrivalUs,
+                                      m_ArrivalScheduleUs + expectedDeltaUs * ADAPTIVE_CLOCK_DRIFT_ALLOWANCE);
+    }
+
+    m_LastArrivalUs = arrivalUs;
+    m_LastArrivalPts = frame->pts;
+
+    // Depths beyond what we can hold all count as one bucket
+    int requiredDepth = 1 + (int)((arrivalUs - m_ArrivalScheduleUs) / frameIntervalUs);
+    requiredDepth = SDL_min(requiredDepth, MAX_QUEUED_FRAMES_BALANCED + 1);
+
+    // Replace the oldest sample in the window
+    if (m_RequiredDepthSamples == PACER_ADAPTIVE_WINDOW_FRAMES) {
+        m_RequiredDepthCounts[m_RequiredDepthHistory[m_RequiredDepthIndex]]--;
+    }
+    else {
+        m_RequiredDepthSamples++;
+    }
+    m_RequiredDepthHistory[m_RequiredDepthIndex] = (uint8_t)requiredDepth;
+    m_RequiredDepthCounts[requiredDepth]++;
+    m_RequiredDepthIndex = (m_RequiredDepthIndex + 1) % PACER_ADAPTIVE_WINDOW_FRAMES;
+
+    // Find the smallest depth where the frames needing more stay under our target
+    int allowedLateFrames = (int)(m_RequiredDepthSamples * ADAPTIVE_TARGET_LATE_RATE);
+    int lateFrames = m_RequiredDepthSamples;
+    int targetDepth = MAX_QUEUED_FRAMES_BALANCED;
+    for (int depth = 1; depth < MAX_QUEUED_FRAMES_BALANCED; depth++) {
+        lateFrames -= m_RequiredDepthCounts[depth];
+        if (lateFrames <= allowedLateFrames) {
+            targetDepth = depth;
+            break;
+        }
+    }
+
+    int maxQueuedFrames = m_MaxQueuedFrames;
+    if (targetDepth > maxQueuedFrames) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Adaptive pacing: increasing queue depth from %d to %d",
+                    maxQueuedFrames,
+                    targetDepth);
+        m_MaxQueuedFrames = targetDepth;
+        m_AdaptiveDecreaseStreak = 0;
+    }
+    else if (targetDepth < maxQueuedFrames) {
+        if (++m_AdaptiveDecreaseStreak >= ADAPTIVE_DECREASE_HOLD_FRAMES) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Adaptive pacing: decreasing queue depth from %d to %d",
+                        maxQueuedFrames,
+                        maxQueuedFrames - 1);
+            m_MaxQueuedFrames = maxQueuedFrames - 1;
+            m_AdaptiveDecreaseStreak = 0;
+        }
+    }
+    else {
+        m_AdaptiveDecreaseStreak = 0;
+    }
+
+    // The decoder samples this into its stats when it flips stats windows
+    m_AdaptiveTargetQueueDepth = targetDepth;
+}
+
+int Pacer::getQueueDepthLimit()
+{
+    return m_MaxQueuedFrames;
+}
+
+int Pacer::getAdaptiveTargetQueueDepth()
+{
+    return m_AdaptiveTargetQueueDepth;
+}
+
 void Pacer::submitFrame(AVFrame* frame)
 {
     // Make sure initialize() has been called
     SDL_assert(m_MaxVideoFps != 0);
 
-    // Queue the frame and possibly wake up the render thread
-    m_FrameQueueLock.lock();
+    m_FrameTimeline->recordStage((int)(intptr_t)frame->opaque, FrameTimeline::StagePacerEnqueue, m_Clock->getMicroseconds());
+
+    // Let the renderer get a head start on this frame
+    m_VsyncRenderer->notifyFrameQueued(frame);
+
+    if (m_FramePacingMode == StreamingPreferences::FPM_ADAPTIVE) {
+        updateAdaptiveQueueDepth(frame);
+    }
+
+    // Queue the frame and possibly wake up the V-sync or render thread
     if (m_VsyncSource != nullptr) {
         if (m_OverloadRelaxationActive) {
             if (m_OverloadRelaxationFramesRemaining > 0) {
@@ -542,17 +984,20 @@ void Pacer::submitFrame(AVFrame* frame)
                 m_EnqueueHealthyStreak = 0;
 #ifdef Q_OS_DARWIN
                 ML_LOG_VIDEO("Pacer overload guard disabled: mode=%d, maxQueue=%d",
-                             (int)m_FramePacingMode, m_MaxQueuedFrames);
+                             (int)m_FramePacingMode, m_MaxQueuedFrames.load());
 #endif
             }
         }
 
         dropFrameForEnqueue(m_PacingQueue);
-        m_PacingQueue.enqueue(frame);
-        m_FrameQueueLock.unlock();
-        m_PacingQueueNotEmpty.wakeOne();
+        if (!m_PacingQueue.enqueue(frame)) {
+            // dropFrameForEnqueue() always leaves room, so this shouldn't happen
+            SDL_assert(false);
+            m_VideoStats->pacerDroppedFrames++;
+            m_FramePool->release(&frame);
+        }
     }
     else {
-        enqueueFrameForRenderingAndUnlock(frame);
+        enqueueFrameForRendering(frame);
     }
 }
@@ -2,18 +2,30 @@
 
 #include "../../decoder.h"
 #include "../renderer.h"
+#include "../../frametimeline.h"
+#include "../../framepool.h"
+#include "framequeue.h"
 #include "settings/streamingpreferences.h"
 
 #include <QQueue>
 #include <QMutex>
 #include <QWaitCondition>
 
+#include <atomic>
+
 // The maximum number of frames pacer will ever hold is:
 // - 3 frames in the pacing queue
 // - 1 frame removed from the render queue in the process of rendering
 // - 1 frame for deferred free
 #define PACER_MAX_OUTSTANDING_FRAMES (3 + 1 + 1)
 
+// Number of recent frames the adaptive pacing mode looks at
+#define PACER_ADAPTIVE_WINDOW_FRAMES 256
+
+// Number of latch records kept for frames between the V-sync and render
+// threads. This must be a power of 2 larger than PACER_MAX_OUTSTANDING_FRAMES.
+#define PACER_LATCH_RECORDS 8
+
 class IVsyncSource {
 public:
     virtual ~IVsyncSource() {}
@@ -27,12 +39,52 @@ public:
         // Synchronous sources must implement waitForVsync()!
         SDL_assert(false);
     }
+
+    // Called on the render thread after the renderer returns from presenting
+    // a frame. Sources that predict V-sync can use this to correct drift.
+    virtual void notifyPresent(uint64_t) {}
+
+    // Synchronous sources may return the LiGetMicroseconds() time of the
+    // vblank that the last waitForVsync() call woke up for, or 0 if unknown.
+    virtual uint64_t getLastVsyncTimeUs() { return 0; }
+};
+
+// Source of time for the Pacer and its threads. Every wait that depends on
+// time goes through the clock, so a simulation can run the Pacer on virtual
+// time with mock V-sync sources and renderers.
+class IPacerClock {
+public:
+    virtual ~IPacerClock() {}
+
+    // Microseconds on the same timeline as LiGetMicroseconds()
+    virtual uint64_t getMicroseconds() = 0;
+
+    virtual void waitUntilUs(uint64_t deadlineUs) = 0;
+
+    // Waits until the queue has a frame (or the consumer is woken)
+    virtual bool waitForFrame(FrameQueue& queue) = 0;
+
+    // Returns false if the queue is still empty at the deadline
+    virtual bool waitForFrameUntil(FrameQueue& queue, uint64_t deadlineUs) = 0;
+};
+
+class SystemPacerClock : public IPacerClock {
+public:
+    virtual uint64_t getMicroseconds() override;
+
+    virtual void waitUntilUs(uint64_t deadlineUs) override;
+
+    virtual bool waitForFrame(FrameQueue& queue) override;
+
+    virtual bool waitForFrameUntil(FrameQueue& queue, uint64_t deadlineUs) override;
 };
 
 class Pacer
 {
 public:
-    Pacer(IFFmpegRenderer* renderer, PVIDEO_STATS videoStats, StreamingPreferences::FramePacingMode pacingMode);
+    // If clock is null, the Pacer runs on the system clock
+    Pacer(IFFmpegRenderer* renderer, PVIDEO_STATS videoStats, FrameTimeline* frameTimeline, FramePool* framePool,
+          StreamingPreferences::FramePacingMode pacingMode, IPacerClock* clock = nullptr);
 
     ~Pacer();
 
@@ -42,48 +94,119 @@ public:
 
     bool initialize(SDL_Window* window, int maxVideoFps, bool enablePacing);
 
+    // Starts pacing with a V-sync source that's already initialized (or none)
+    // rather than one for a window. The Pacer takes ownership of the source.
+    bool initialize(IVsyncSource* vsyncSource, int displayFps, int maxVideoFps, bool enablePacing);
+
     void signalVsync();
 
+    void recordVsyncTime(uint64_t vsyncTimeUs, uint64_t vsyncCount);
+
     void renderOnMainThread();
 
+    // Current limit on queued frames and the adaptive controller's target.
+    // These may change on the decoder thread, so they're safe to read anywhere.
+    int getQueueDepthLimit();
+
+    int getAdaptiveTargetQueueDepth();
+
 private:
     static int vsyncThread(void* context);
 
     static int renderThread(void* context);
 
-    void handleVsync(int timeUntilNextVsyncMillis);
+    void handleVsync(uint64_t vsyncTimeUs);
+
+    void updateRenderDeadline(int frameNumber, uint64_t afterRenderUs);
 
-    void enqueueFrameForRenderingAndUnlock(AVFrame* frame);
+    void enqueueFrameForRendering(AVFrame* frame);
 
     void renderFrame(AVFrame* frame);
 
-    void dropFrameForEnqueue(QQueue<AVFrame*>& queue);
+    void dropFrameForEnqueue(FrameQueue& queue);
+
+    void updateAdaptiveQueueDepth(AVFrame* frame);
+
+    uint64_t getVrrEarliestRenderUs();
+
+    void waitForVrrRefreshInterval();
+
+    static Uint32 vrrRenderTimerCallback(Uint32 interval, void* param);
+
+    // Decoder (or V-sync thread) -> render thread
+    FrameQueue m_RenderQueue;
+
+    // Decoder -> V-sync thread
+    FrameQueue m_PacingQueue;
 
-    QQueue<AVFrame*> m_RenderQueue;
-    QQueue<AVFrame*> m_PacingQueue;
     QQueue<int> m_PacingQueueHistory;
     QQueue<int> m_RenderQueueHistory;
-    QMutex m_FrameQueueLock;
-    QWaitCondition m_RenderQueueNotEmpty;
-    QWaitCondition m_PacingQueueNotEmpty;
+    QMutex m_VsyncLock;
     QWaitCondition m_VsyncSignalled;
     SDL_Thread* m_RenderThread;
     SDL_Thread* m_VsyncThread;
     AVFrame* m_DeferredFreeFrame;
     bool m_Stopping;
 
+    SystemPacerClock m_SystemClock;
+    IPacerClock* m_Clock;
     IVsyncSource* m_VsyncSource;
     IFFmpegRenderer* m_VsyncRenderer;
     int m_MaxVideoFps;
     int m_DisplayFps;
     PVIDEO_STATS m_VideoStats;
+    FrameTimeline* m_FrameTimeline;
+    FramePool* m_FramePool;
+    uint64_t m_LastVsyncTimeUs;
+    uint64_t m_LastVsyncCount;
+    double m_AvgVsyncIntervalUs;
+
+    // Render deadline estimation (render thread only)
+    double m_RenderCostUs;
+    double m_RenderCostDeviationUs;
+    double m_RenderMarginUs;
+
+    // Render thread -> V-sync thread
+    std::atomic<uint32_t> m_RenderLeadUs;
+
+    // V-sync thread -> render thread, indexed by frame number. Frames may be
+    // dropped after they're latched, so each frame carries its own target.
+    struct LatchRecord {
+        std::atomic<int> frameNumber;
+        std::atomic<uint64_t> latchTimeUs;
+        std::atomic<uint64_t> targetVblankUs;
+        std::atomic<uint32_t> targetPeriodUs;
+    };
+    LatchRecord m_LatchRecords[PACER_LATCH_RECORDS];
     int m_RendererAttributes;
     StreamingPreferences::FramePacingMode m_FramePacingMode;
-    int m_MaxQueuedFrames;
+
+    // VRR pacing mode state (render thread only)
+    uint32_t m_VrrMinIntervalUs;
+    uint64_t m_LastRenderStartUs;
+    SDL_TimerID m_VrrRenderTimer;
+
+    // Last presented frame for VRR pacing and judder (render thread only)
+    uint64_t m_LastPresentUs;
+    int64_t m_LastPresentPts;
+
+    // Only changed by the decoder thread
+    std::atomic<int> m_MaxQueuedFrames;
+    std::atomic<int> m_AdaptiveTargetQueueDepth;
 
     int m_EnqueueOverflowStreak;
     int m_EnqueueHealthyStreak;
     bool m_OverloadRelaxationActive;
     int m_OverloadRelaxationFramesRemaining;
     int m_DecoderBacklogStreak;
+
+    // Adaptive pacing mode state (decoder thread only)
+    uint64_t m_LastArrivalUs;
+    int64_t m_LastArrivalPts;
+    double m_ArrivalScheduleUs;
+    uint8_t m_RequiredDepthHistory[PACER_ADAPTIVE_WINDOW_FRAMES];
+    int m_RequiredDepthCounts[PACER_MAX_OUTSTANDING_FRAMES];
+    int m_RequiredDepthIndex;
+    int m_RequiredDepthSamples;
+    int m_AdaptiveDecreaseStreak;
 };
@@ -0,0 +1,143 @@
+#include "softwarevsyncsource.h"
+#include "streaming/streamutils.h"
+
+#include <Limelight.h>
+
+#include <cmath>
+
+// Loop gains for phase and period correction. These are small because
+// present timestamps include scheduling noise from the render thread.
+#define PLL_PHASE_GAIN 0.1
+#define PLL_PERIOD_GAIN 0.0025
+
+// The real refresh rate can't be that far from the nominal one
+#define PLL_MAX_PERIOD_DEVIATION 0.01
+
+// Samples further than this fraction of a period from the predicted vblank
+// are probably from a missed V-sync or a non-blocking present, so ignore them.
+#define PLL_MAX_PHASE_ERROR 0.25
+
+// If this many samples in a row are rejected, we've lost lock (or the
+// initial seed was bad), so start over from the next present.
+#define PLL_MAX_CONSECUTIVE_REJECTED_SAMPLES 8
+
+SoftwareVsyncSource::SoftwareVsyncSource()
+    : m_Lock(0),
+      m_PhaseSeeded(false),
+      m_NominalPeriodUs(0),
+      m_PeriodUs(0),
+      m_PhaseUs(0),
+      m_LastVsyncUs(0),
+      m_LockedSamples(0),
+      m_RejectedSamples(0),
+      m_ConsecutiveRejectedSamples(0)
+{
+
+}
+
+SoftwareVsyncSource::~SoftwareVsyncSource()
+{
+    if (m_PeriodUs != 0) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Software V-sync estimated refresh rate: %.3f Hz (%u samples used, %u rejected)",
+                    1000000.0 / m_PeriodUs,
+                    m_LockedSamples,
+                    m_RejectedSamples);
+    }
+}
+
+bool SoftwareVsyncSource::initialize(SDL_Window*, int displayFps)
+{
+    if (displayFps <= 0) {
+        return false;
+    }
+
+    m_NominalPeriodUs = m_PeriodUs = 1000000.0 / displayFps;
+
+    // We don't know the phase until the first frame is presented,
+    // so use an arbitrary one until then.
+    m_PhaseUs = (double)LiGetMicroseconds();
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Using software V-sync source at %d Hz",
+                displayFps);
+    return true;
+}
+
+bool SoftwareVsyncSource::isAsync()
+{
+    // We sleep in the context of the Pacer's V-sync thread
+    return false;
+}
+
+void SoftwareVsyncSource::waitForVsync()
+{
+    uint64_t nextVsyncUs = predictNextVsyncUs(LiGetMicroseconds());
+
+    StreamUtils::waitUntilUs(nextVsyncUs);
+
+    m_LastVsyncUs = nextVsyncUs;
+}
+
+uint64_t SoftwareVsyncSource::predictNextVsyncUs(uint64_t nowUs)
+{
+    uint64_t nextVsyncUs;
+
+    SDL_AtomicLock(&m_Lock);
+    {
+        // Find the first predicted vblank that's at least half a period after
+        // the last one we signalled, so an early wakeup can't signal twice.
+        double earliestUs = SDL_max((double)nowUs, m_LastVsyncUs + m_PeriodUs / 2);
+        double periods = std::ceil((earliestUs - m_PhaseUs) / m_PeriodUs);
+        nextVsyncUs = (uint64_t)(m_PhaseUs + periods * m_PeriodUs);
+    }
+    SDL_AtomicUnlock(&m_Lock);
+
+    return nextVsyncUs;
+}
+
+uint64_t SoftwareVsyncSource::getLastVsyncTimeUs()
+{
+    // The predicted vblank rather than when our wait happened to return
+    return m_LastVsyncUs;
+}
+
+void SoftwareVsyncSource::notifyPresent(uint64_t presentTimeUs)
+{
+    SDL_AtomicLock(&m_Lock);
+
+    // Seed the phase directly from a present rather than waiting for
+    // the PLL to slowly pull in an arbitrary starting phase.
+    if (!m_PhaseSeeded) {
+        m_PhaseUs = (double)presentTimeUs;
+        m_PhaseSeeded = true;
+        SDL_AtomicUnlock(&m_Lock);
+        return;
+    }
+
+    // Phase error against the nearest predicted vblank
+    double errorUs = std::remainder((double)presentTimeUs - m_PhaseUs, m_PeriodUs);
+    if (std::fabs(errorUs) > m_PeriodUs * PLL_MAX_PHASE_ERROR) {
+        m_RejectedSamples++;
+        if (++m_ConsecutiveRejectedSamples >= PLL_MAX_CONSECUTIVE_REJECTED_SAMPLES) {
+            m_PhaseSeeded = false;
+            m_ConsecutiveRejectedSamples = 0;
+        }
+        SDL_AtomicUnlock(&m_Lock);
+        return;
+    }
+
+    m_ConsecutiveRejectedSamples = 0;
+
+    // Re-anchor the phase at this vblank to keep the numbers small
+    m_PhaseUs = (double)presentTimeUs - errorUs + errorUs * PLL_PHASE_GAIN;
+
+    m_PeriodUs += errorUs * PLL_PERIOD_GAIN;
+    m_PeriodUs = SDL_clamp(m_PeriodUs,
+                           m_NominalPeriodUs * (1 - PLL_MAX_PERIOD_DEVIATION),
+                           m_NominalPeriodUs * (1 + PLL_MAX_PERIOD_DEVIATION));
+
+    m_LockedSamples++;
+
+    SDL_AtomicUnlock(&m_Lock);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "pacer.h"
+
+// Predicts V-sync from the display's nominal refresh rate for platforms that
+// have no way to wait for the real thing. Since pacing is only enabled with
+// V-sync, the time the renderer returns from presenting is a (noisy) sample
+// of a real vblank. Those samples drive a second-order PLL that corrects
+// both the phase of our vblank grid and the period, which may differ
+// slightly from the integer refresh rate that SDL reports.
+//
+// This is the fallback wherever there's no real V-sync source, unless the
+// renderer reports non-blocking presents. The predictions are only as good
+// as the present timestamps, so set SOFTWARE_VSYNC=0 to render frames
+// immediately instead (or SOFTWARE_VSYNC=1 to force it on).
+class SoftwareVsyncSource : public IVsyncSource
+{
+public:
+    SoftwareVsyncSource();
+
+    virtual ~SoftwareVsyncSource();
+
+    virtual bool initialize(SDL_Window* window, int displayFps) override;
+
+    virtual bool isAsync() override;
+
+    virtual void waitForVsync() override;
+
+    virtual void notifyPresent(uint64_t presentTimeUs) override;
+
+    virtual uint64_t getLastVsyncTimeUs() override;
+
+    // Returns the first predicted vblank after nowUs that's at least half a
+    // period after the last one we signalled. This is what waitForVsync()
+    // waits for.
+    uint64_t predictNextVsyncUs(uint64_t nowUs);
+
+private:
+    SDL_SpinLock m_Lock;
+    bool m_PhaseSeeded;
+    double m_NominalPeriodUs;
+    double m_PeriodUs;
+    double m_PhaseUs;
+    uint64_t m_LastVsyncUs;
+    uint32_t m_LockedSamples;
+    uint32_t m_RejectedSamples;
+    uint32_t m_ConsecutiveRejectedSamples;
+};
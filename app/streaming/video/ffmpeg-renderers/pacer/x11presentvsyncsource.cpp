@@ -0,0 +1,172 @@
+#include "x11presentvsyncsource.h"
+
+#include <SDL_syswm.h>
+
+#include <cstdlib>
+#include <poll.h>
+
+#ifndef SDL_VIDEO_DRIVER_X11
+#warning Unable to use X11PresentVsyncSource without SDL support
+#else
+
+// Don't wait longer than this for a vblank, so the Pacer can
+// still shut down if the window is never shown on a CRTC.
+#define VSYNC_TIMEOUT_MS 100
+
+X11PresentVsyncSource::X11PresentVsyncSource(Pacer* pacer)
+    : m_Pacer(pacer),
+      m_Connection(nullptr),
+      m_Window(XCB_NONE),
+      m_SpecialEvent(nullptr),
+      m_Serial(0),
+      m_LastMsc(0),
+      m_LastUst(0)
+{
+
+}
+
+X11PresentVsyncSource::~X11PresentVsyncSource()
+{
+    if (m_SpecialEvent != nullptr) {
+        xcb_unregister_for_special_event(m_Connection, m_SpecialEvent);
+    }
+
+    if (m_Connection != nullptr) {
+        xcb_disconnect(m_Connection);
+    }
+}
+
+bool X11PresentVsyncSource::initialize(SDL_Window* window, int)
+{
+    SDL_SysWMinfo info;
+
+    SDL_VERSION(&info.version);
+
+    if (!SDL_GetWindowWMInfo(window, &info)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_GetWindowWMInfo() failed: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    // Pacer should not create us for non-X11 windows
+    SDL_assert(info.subsystem == SDL_SYSWM_X11);
+
+    m_Window = (xcb_window_t)info.info.x11.window;
+
+    m_Connection = xcb_connect(DisplayString(info.info.x11.display), nullptr);
+    if (xcb_connection_has_error(m_Connection)) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Unable to open XCB connection for V-sync");
+        return false;
+    }
+
+    const xcb_query_extension_reply_t* presentExt = xcb_get_extension_data(m_Connection, &xcb_present_id);
+    if (presentExt == nullptr || !presentExt->present) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "X server doesn't support the Present extension");
+        return false;
+    }
+
+    xcb_present_query_version_reply_t* versionReply =
+            xcb_present_query_version_reply(m_Connection,
+                                            xcb_present_query_version(m_Connection,
+                                                                      XCB_PRESENT_MAJOR_VERSION,
+                                                                      XCB_PRESENT_MINOR_VERSION),
+                                            nullptr);
+    if (versionReply == nullptr) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Present version query failed");
+        return false;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Using X11 Present V-sync source (Present %u.%u)",
+                versionReply->major_version,
+                versionReply->minor_version);
+    free(versionReply);
+
+    // Only ask for completion events. We'll also get them for the renderer's
+    // own PresentPixmap requests on this window, so we filter by serial.
+    xcb_present_event_t eventId = xcb_generate_id(m_Connection);
+    xcb_generic_error_t* error = xcb_request_check(m_Connection,
+                                                   xcb_present_select_input_checked(m_Connection, eventId, m_Window,
+                                                                                    XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY));
+    if (error != nullptr) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "PresentSelectInput() failed: %d",
+                    error->error_code);
+        free(error);
+        return false;
+    }
+
+    m_SpecialEvent = xcb_register_for_special_xge(m_Connection, &xcb_present_id, eventId, nullptr);
+    if (m_SpecialEvent == nullptr) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Unable to register for Present events");
+        return false;
+    }
+
+    return true;
+}
+
+bool X11PresentVsyncSource::isAsync()
+{
+    // We block in the context of the Pacer's V-sync thread
+    return false;
+}
+
+void X11PresentVsyncSource::waitForVsync()
+{
+    // Ask for a notification at the next MSC after the last one we saw.
+    // If we've fallen behind, the divisor makes this the next MSC rather
+    // than completing immediately.
+    m_Serial++;
+    xcb_present_notify_msc(m_Connection, m_Window, m_Serial, m_LastMsc + 1, 1, 0);
+    xcb_flush(m_Connection);
+
+    uint64_t deadlineUs = LiGetMicroseconds() + VSYNC_TIMEOUT_MS * 1000;
+
+    // Don't report a stale vblank time if we time out
+    m_LastUst = 0;
+
+    for (;;) {
+        xcb_generic_event_t* event = xcb_poll_for_special_event(m_Connection, m_SpecialEvent);
+        if (event == nullptr) {
+            uint64_t nowUs = LiGetMicroseconds();
+            if (xcb_connection_has_error(m_Connection) || nowUs >= deadlineUs) {
+                // Let the Pacer run as if we got V-sync
+                return;
+            }
+
+            pollfd pfd = {};
+            pfd.fd = xcb_get_file_descriptor(m_Connection);
+            pfd.events = POLLIN;
+            poll(&pfd, 1, (int)((deadlineUs - nowUs + 999) / 1000));
+            continue;
+        }
+
+        auto presentEvent = (xcb_present_generic_event_t*)event;
+        if (presentEvent->evtype == XCB_PRESENT_EVENT_COMPLETE_NOTIFY) {
+            auto completeEvent = (xcb_present_complete_notify_event_t*)event;
+            if (completeEvent->kind == XCB_PRESENT_COMPLETE_KIND_NOTIFY_MSC && completeEvent->serial == m_Serial) {
+                m_LastMsc = completeEvent->msc;
+                m_LastUst = completeEvent->ust;
+                m_Pacer->recordVsyncTime(completeEvent->ust, completeEvent->msc);
+                free(event);
+                return;
+            }
+        }
+
+        free(event);
+    }
+}
+
+uint64_t X11PresentVsyncSource::getLastVsyncTimeUs()
+{
+    // The UST is normally CLOCK_MONOTONIC microseconds. The Pacer ignores
+    // it if that doesn't match LiGetMicroseconds().
+    return m_LastUst;
+}
+
+#endif
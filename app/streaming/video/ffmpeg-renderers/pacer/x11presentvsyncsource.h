@@ -0,0 +1,39 @@
+#pragma once
+
+#include "pacer.h"
+
+#include <xcb/xcb.h>
+#include <xcb/present.h>
+
+// Waits for real vblanks on X11 using PresentNotifyMSC on our window.
+// The X server completes each request at the next MSC of the CRTC showing
+// the window and tells us the UST it happened at, which we report to the
+// Pacer to measure V-sync jitter. Windows that aren't on a real CRTC (like
+// under Xvfb) get ticks from the X server's fake CRTC instead.
+//
+// We use a private XCB connection so our blocking waits never contend
+// with SDL's Xlib connection.
+class X11PresentVsyncSource : public IVsyncSource
+{
+public:
+    X11PresentVsyncSource(Pacer* pacer);
+
+    virtual ~X11PresentVsyncSource();
+
+    virtual bool initialize(SDL_Window* window, int displayFps) override;
+
+    virtual bool isAsync() override;
+
+    virtual void waitForVsync() override;
+
+    virtual uint64_t getLastVsyncTimeUs() override;
+
+private:
+    Pacer* m_Pacer;
+    xcb_connection_t* m_Connection;
+    xcb_window_t m_Window;
+    xcb_special_event_t* m_SpecialEvent;
+    uint32_t m_Serial;
+    uint64_t m_LastMsc;
+    uint64_t m_LastUst;
+};
@@ -93,11 +93,6 @@ void PlVkRenderer::unlockQueue(struct AVHWDeviceContext *dev_ctx, uint32_t queue
     me->m_Vulkan->unlock_queue(me->m_Vulkan, queue_family, index);
 }
 
-void PlVkRenderer::overlayUploadComplete(void* opaque)
-{
-    SDL_FreeSurface((SDL_Surface*)opaque);
-}
-
 PlVkRenderer::PlVkRenderer(bool hwaccel, IFFmpegRenderer *backendRenderer) :
     IFFmpegRenderer(RendererType::Vulkan),
     m_Backend(backendRenderer),
@@ -125,9 +120,12 @@ PlVkRenderer::~PlVkRenderer()
     SDL_assert(!m_HasPendingSwapchainFrame);
 
     if (m_Vulkan != nullptr) {
+        // The overlays only reference their atlas textures
         for (int i = 0; i < (int)SDL_arraysize(m_Overlays); i++) {
-            pl_tex_destroy(m_Vulkan->gpu, &m_Overlays[i].overlay.tex);
-            pl_tex_destroy(m_Vulkan->gpu, &m_Overlays[i].stagingOverlay.tex);
+            pl_tex_destroy(m_Vulkan->gpu, &m_Overlays[i].atlasTex);
+        }
+        for (pl_tex& tex : m_RetiredOverlayAtlasTextures) {
+            pl_tex_destroy(m_Vulkan->gpu, &tex);
         }
 
         for (int i = 0; i < (int)SDL_arraysize(m_Textures); i++) {
@@ -425,7 +423,27 @@ bool PlVkRenderer::initialize(PDECODER_PARAMETERS params)
     }
 
     VkPresentModeKHR presentMode;
-    if (params->enableVsync) {
+    if (params->enableVrr) {
+        // Pacer presents each frame as it arrives and the display refreshes when we
+        // do, so we don't want a fixed refresh interval. FIFO Relaxed still syncs
+        // to the VRR display's refresh, while Immediate may tear outside its range.
+        if (isPresentModeSupportedByPhysicalDevice(m_Vulkan->phys_device, VK_PRESENT_MODE_FIFO_RELAXED_KHR)) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Using FIFO Relaxed present mode for VRR");
+            presentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+        }
+        else if (isPresentModeSupportedByPhysicalDevice(m_Vulkan->phys_device, VK_PRESENT_MODE_IMMEDIATE_KHR)) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Using Immediate present mode for VRR");
+            presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+        }
+        else {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Using FIFO present mode for VRR");
+            presentMode = VK_PRESENT_MODE_FIFO_KHR;
+        }
+    }
+    else if (params->enableVsync) {
         // FIFO mode improves frame pacing compared with Mailbox, especially for
         // platforms like X11 that lack a VSyncSource implementation for Pacer.
         presentMode = VK_PRESENT_MODE_FIFO_KHR;
@@ -776,11 +794,7 @@ void PlVkRenderer::renderFrame(AVFrame *frame)
         pl_swapchain_colorspace_hint(m_Swapchain, &mappedFrame.color);
     }
 
-    // Reserve enough space to avoid allocating under the overlay lock
-    pl_overlay_part overlayParts[Overlay::OverlayMax] = {};
-    std::vector<pl_tex> texturesToDestroy;
     std::vector<pl_overlay> overlays;
-    texturesToDestroy.reserve(Overlay::OverlayMax);
     overlays.reserve(Overlay::OverlayMax);
 
     pl_frame_from_swapchain(&targetFrame, &m_SwapchainFrame);
@@ -788,51 +802,51 @@ void PlVkRenderer::renderFrame(AVFrame *frame)
     // We perform minimal processing under the overlay lock to avoid blocking threads updating the overlay
     SDL_AtomicLock(&m_OverlayLock);
     for (int i = 0; i < Overlay::OverlayMax; i++) {
-        // If we have a staging overlay, we need to transfer ownership to us
+        // If we have a staging overlay, take it from the staging area. Swapping the
+        // glyph parts hands our old vector back to the overlay update thread to fill
+        // next time, so neither side has to allocate under the lock.
         if (m_Overlays[i].hasStagingOverlay) {
-            if (m_Overlays[i].hasOverlay) {
-                texturesToDestroy.push_back(m_Overlays[i].overlay.tex);
-            }
-
-            // Copy the overlay fields from the staging area
             m_Overlays[i].overlay = m_Overlays[i].stagingOverlay;
+            std::swap(m_Overlays[i].parts, m_Overlays[i].stagingParts);
+            m_Overlays[i].height = m_Overlays[i].stagingHeight;
 
-            // We now own the staging overlay
             m_Overlays[i].hasStagingOverlay = false;
-            SDL_zero(m_Overlays[i].stagingOverlay);
             m_Overlays[i].hasOverlay = true;
         }
 
-        // If we have an overlay but it's been disabled, free the overlay texture
+        // If we have an overlay but it's been disabled, stop drawing it
         if (m_Overlays[i].hasOverlay && !Session::get()->getOverlayManager().isOverlayEnabled((Overlay::OverlayType)i)) {
-            texturesToDestroy.push_back(m_Overlays[i].overlay.tex);
             m_Overlays[i].hasOverlay = false;
         }
+    }
+    SDL_AtomicUnlock(&m_OverlayLock);
 
+    for (int i = 0; i < Overlay::OverlayMax; i++) {
         // We have an overlay to draw
-        if (m_Overlays[i].hasOverlay) {
-            // Position the overlay
-            overlayParts[i].src = { 0, 0, (float)m_Overlays[i].overlay.tex->params.w, (float)m_Overlays[i].overlay.tex->params.h };
+        if (m_Overlays[i].hasOverlay && !m_Overlays[i].parts.empty()) {
+            // Position the overlay. The debug overlay stays at the top left.
+            float overlayY = 0;
             if (i == Overlay::OverlayStatusUpdate) {
                 // Bottom Left
-                overlayParts[i].dst.x0 = 0;
-                overlayParts[i].dst.y0 = SDL_max(0, targetFrame.crop.y1 - overlayParts[i].src.y1);
+                overlayY = SDL_max(0, targetFrame.crop.y1 - m_Overlays[i].height);
             }
-            else if (i == Overlay::OverlayDebug) {
-                // Top left
-                overlayParts[i].dst.x0 = 0;
-                overlayParts[i].dst.y0 = 0;
+
+            // Offset each glyph by the overlay position
+            m_Overlays[i].drawParts.resize(m_Overlays[i].parts.size());
+            for (size_t j = 0; j < m_Overlays[i].parts.size(); j++) {
+                pl_overlay_part& part = m_Overlays[i].drawParts[j];
+
+                part = m_Overlays[i].parts[j];
+                part.dst.y0 += overlayY;
+                part.dst.y1 += overlayY;
             }
-            overlayParts[i].dst.x1 = overlayParts[i].dst.x0 + overlayParts[i].src.x1;
-            overlayParts[i].dst.y1 = overlayParts[i].dst.y0 + overlayParts[i].src.y1;
 
-            m_Overlays[i].overlay.parts = &overlayParts[i];
-            m_Overlays[i].overlay.num_parts = 1;
+            m_Overlays[i].overlay.parts = m_Overlays[i].drawParts.data();
+            m_Overlays[i].overlay.num_parts = (int)m_Overlays[i].drawParts.size();
 
             overlays.push_back(m_Overlays[i].overlay);
         }
     }
-    SDL_AtomicUnlock(&m_OverlayLock);
 
     SDL_Rect src;
     src.x = mappedFrame.crop.x0;
@@ -883,11 +897,6 @@ void PlVkRenderer::renderFrame(AVFrame *frame)
 #endif
 
 UnmapExit:
-    // Delete any textures that need to be destroyed
-    for (pl_tex texture : texturesToDestroy) {
-        pl_tex_destroy(m_Vulkan->gpu, &texture);
-    }
-
     pl_unmap_avframe(m_Vulkan->gpu, &mappedFrame);
 }
 
@@ -903,81 +912,105 @@ bool PlVkRenderer::testRenderFrame(AVFrame *frame)
     return true;
 }
 
-void PlVkRenderer::notifyOverlayUpdated(Overlay::OverlayType type)
+bool PlVkRenderer::uploadOverlayAtlas(Overlay::OverlayType type, SDL_Surface* atlas)
 {
-    SDL_Surface* newSurface = Session::get()->getOverlayManager().getUpdatedOverlaySurface(type);
-    if (newSurface == nullptr && Session::get()->getOverlayManager().isOverlayEnabled(type)) {
-        // The overlay is enabled and there is no new surface. Leave the old texture alone.
-        return;
-    }
-
-    SDL_AtomicLock(&m_OverlayLock);
-    // We want to clear the staging overlay flag even if a staging overlay is still present,
-    // since this ensures the render thread will not read from a partially initialized pl_tex
-    // as we modify or recreate the staging overlay texture outside the overlay lock.
-    m_Overlays[type].hasStagingOverlay = false;
-    SDL_AtomicUnlock(&m_OverlayLock);
-
-    // If there's no new staging overlay, free the old staging overlay texture.
-    // NB: This is safe to do outside the overlay lock because we're guaranteed
-    // to not have racing readers/writers if hasStagingOverlay is false.
-    if (newSurface == nullptr) {
-        pl_tex_destroy(m_Vulkan->gpu, &m_Overlays[type].stagingOverlay.tex);
-        SDL_zero(m_Overlays[type].stagingOverlay);
-        return;
-    }
-
     // Find a compatible texture format
-    SDL_assert(newSurface->format->format == SDL_PIXELFORMAT_ARGB8888);
+    SDL_assert(atlas->format->format == SDL_PIXELFORMAT_ARGB8888);
     pl_fmt texFormat = pl_find_named_fmt(m_Vulkan->gpu, "bgra8");
     if (!texFormat) {
-        SDL_FreeSurface(newSurface);
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                      "pl_find_named_fmt(bgra8) failed");
-        return;
+        return false;
     }
 
-    // Create a new texture for this overlay if necessary, otherwise reuse the existing texture.
-    // NB: We're guaranteed that the render thread won't be reading this concurrently because
-    // we set hasStagingOverlay to false above.
     pl_tex_params texParams = {};
-    texParams.w = newSurface->w;
-    texParams.h = newSurface->h;
+    texParams.w = atlas->w;
+    texParams.h = atlas->h;
     texParams.format = texFormat;
     texParams.sampleable = true;
     texParams.host_writable = true;
     texParams.blit_src = !!(texFormat->caps & PL_FMT_CAP_BLITTABLE);
     texParams.debug_tag = PL_DEBUG_TAG;
-    if (!pl_tex_recreate(m_Vulkan->gpu, &m_Overlays[type].stagingOverlay.tex, &texParams)) {
-        pl_tex_destroy(m_Vulkan->gpu, &m_Overlays[type].stagingOverlay.tex);
-        SDL_zero(m_Overlays[type].stagingOverlay);
-        SDL_FreeSurface(newSurface);
+    pl_tex atlasTex = pl_tex_create(m_Vulkan->gpu, &texParams);
+    if (!atlasTex) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                     "pl_tex_recreate() failed");
-        return;
+                     "pl_tex_create() failed");
+        return false;
     }
 
-    // Upload the surface data to the new texture
-    SDL_assert(!SDL_MUSTLOCK(newSurface));
+    // Upload the atlas to the new texture. The OverlayManager owns the
+    // atlas and keeps it alive longer than us, so we don't copy it.
+    SDL_assert(!SDL_MUSTLOCK(atlas));
     pl_tex_transfer_params xferParams = {};
-    xferParams.tex = m_Overlays[type].stagingOverlay.tex;
-    xferParams.row_pitch = (size_t)newSurface->pitch;
-    xferParams.ptr = newSurface->pixels;
-    xferParams.callback = overlayUploadComplete;
-    xferParams.priv = newSurface;
+    xferParams.tex = atlasTex;
+    xferParams.row_pitch = (size_t)atlas->pitch;
+    xferParams.ptr = atlas->pixels;
     if (!pl_tex_upload(m_Vulkan->gpu, &xferParams)) {
-        pl_tex_destroy(m_Vulkan->gpu, &m_Overlays[type].stagingOverlay.tex);
-        SDL_zero(m_Overlays[type].stagingOverlay);
-        SDL_FreeSurface(newSurface);
+        pl_tex_destroy(m_Vulkan->gpu, &atlasTex);
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                      "pl_tex_upload() failed");
+        return false;
+    }
+
+    // The render thread may still be drawing from the old atlas texture,
+    // so it can't be destroyed until we are.
+    if (m_Overlays[type].atlasTex != nullptr) {
+        m_RetiredOverlayAtlasTextures.push_back(m_Overlays[type].atlasTex);
+    }
+
+    m_Overlays[type].atlas = atlas;
+    m_Overlays[type].atlasTex = atlasTex;
+    return true;
+}
+
+void PlVkRenderer::notifyOverlayUpdated(Overlay::OverlayType type)
+{
+    Overlay::GlyphBatch* newBatch = Session::get()->getOverlayManager().getUpdatedOverlayGlyphBatch(type);
+    if (newBatch == nullptr && Session::get()->getOverlayManager().isOverlayEnabled(type)) {
+        // The overlay is enabled and there is no new batch. Leave the old overlay alone.
         return;
     }
 
-    // newSurface is now owned by the texture upload process. It will be freed in overlayUploadComplete()
-    newSurface = nullptr;
+    SDL_AtomicLock(&m_OverlayLock);
+    // We want to clear the staging overlay flag even if a staging overlay is still present,
+    // since this ensures the render thread will not read a partially written staging overlay
+    // as we modify it outside the overlay lock.
+    m_Overlays[type].hasStagingOverlay = false;
+    SDL_AtomicUnlock(&m_OverlayLock);
+
+    // If the overlay was disabled, the render thread stops drawing it by itself.
+    // We keep the atlas texture around in case it's enabled again.
+    if (newBatch == nullptr) {
+        return;
+    }
+
+    // The atlas only changes if the overlay's font does, so
+    // it's normally uploaded just once per overlay
+    if (newBatch->atlas != m_Overlays[type].atlas && !uploadOverlayAtlas(type, newBatch->atlas)) {
+        Session::get()->getOverlayManager().releaseOverlayGlyphBatch(type, newBatch);
+        return;
+    }
+
+    // Copy each glyph from the atlas, relative to the top left of the overlay.
+    // NB: We're guaranteed that the render thread won't be reading this concurrently
+    // because we set hasStagingOverlay to false above.
+    std::vector<pl_overlay_part>& parts = m_Overlays[type].stagingParts;
+    parts.clear();
+    for (const auto& quad : newBatch->quads) {
+        pl_overlay_part part = {};
+        part.src = { (float)quad.src.x, (float)quad.src.y,
+                     (float)(quad.src.x + quad.src.w), (float)(quad.src.y + quad.src.h) };
+        part.dst = { (float)quad.dst.x, (float)quad.dst.y,
+                     (float)(quad.dst.x + quad.dst.w), (float)(quad.dst.y + quad.dst.h) };
+        parts.push_back(part);
+    }
+    m_Overlays[type].stagingHeight = newBatch->height;
+
+    Session::get()->getOverlayManager().releaseOverlayGlyphBatch(type, newBatch);
 
     // Initialize the rest of the overlay params
+    m_Overlays[type].stagingOverlay = {};
+    m_Overlays[type].stagingOverlay.tex = m_Overlays[type].atlasTex;
     m_Overlays[type].stagingOverlay.mode = PL_OVERLAY_NORMAL;
     m_Overlays[type].stagingOverlay.coords = PL_OVERLAY_COORDS_DST_FRAME;
     m_Overlays[type].stagingOverlay.repr = pl_color_repr_rgb;
@@ -990,6 +1023,12 @@ void PlVkRenderer::notifyOverlayUpdated(Overlay::OverlayType type)
     SDL_AtomicUnlock(&m_OverlayLock);
 }
 
+bool PlVkRenderer::supportsOverlayGlyphBatches()
+{
+    // Each glyph becomes a part of the overlay drawn from the atlas texture
+    return true;
+}
+
 bool PlVkRenderer::notifyWindowChanged(PWINDOW_STATE_CHANGE_INFO info)
 {
     // We can transparently handle size and display changes
@@ -21,6 +21,7 @@ public:
     virtual void waitToRender() override;
     virtual void cleanupRenderContext() override;
     virtual void notifyOverlayUpdated(Overlay::OverlayType) override;
+    virtual bool supportsOverlayGlyphBatches() override;
     virtual bool notifyWindowChanged(PWINDOW_STATE_CHANGE_INFO) override;
     virtual int getRendererAttributes() override;
     virtual int getDecoderColorspace() override;
@@ -32,8 +33,8 @@ public:
 private:
     static void lockQueue(AVHWDeviceContext *dev_ctx, uint32_t queue_family, uint32_t index);
     static void unlockQueue(AVHWDeviceContext *dev_ctx, uint32_t queue_family, uint32_t index);
-    static void overlayUploadComplete(void* opaque);
 
+    bool uploadOverlayAtlas(Overlay::OverlayType type, SDL_Surface* atlas);
     bool mapAvFrameToPlacebo(const AVFrame *frame, pl_frame* mappedFrame);
     bool populateQueues(int videoFormat);
     bool chooseVulkanDevice(PDECODER_PARAMETERS params, bool hdrOutputRequired);
@@ -75,10 +76,12 @@ private:
         // lock when hasStagingOverlay is true.
         bool hasOverlay;
         pl_overlay overlay;
+        std::vector<pl_overlay_part> parts;
+        int height;
 
         // This state is written by the overlay update thread
         //
-        // NB: hasStagingOverlay may be false even if there is a staging overlay texture present,
+        // NB: hasStagingOverlay may be false even if there is a staging overlay present,
         // because this is how the overlay update path indicates that the overlay is not currently
         // safe for the render thread to read.
         //
@@ -86,8 +89,22 @@ private:
         // as long as hasStagingOverlay is false.
         bool hasStagingOverlay;
         pl_overlay stagingOverlay;
+        std::vector<pl_overlay_part> stagingParts;
+        int stagingHeight;
+
+        // The glyph atlas texture referenced by the overlays, which is only
+        // written by the overlay update thread
+        SDL_Surface* atlas;
+        pl_tex atlasTex;
+
+        // The glyph parts offset by the overlay position, only used by the render thread
+        std::vector<pl_overlay_part> drawParts;
     } m_Overlays[Overlay::OverlayMax] = {};
 
+    // Atlas textures that were replaced while the render thread could still be
+    // drawing them. Only used by the overlay update thread and the destructor.
+    std::vector<pl_tex> m_RetiredOverlayAtlasTextures;
+
     // Device context used for hwaccel decoders
     AVBufferRef* m_HwDeviceCtx = nullptr;
 
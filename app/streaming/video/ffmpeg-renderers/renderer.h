@@ -137,6 +137,10 @@ private:
 #define RENDERER_ATTRIBUTE_NO_BUFFERING 0x08
 #define RENDERER_ATTRIBUTE_FORCE_PACING 0x10
 
+// Presents return without waiting for a vblank, so they can't be used to
+// predict V-sync on platforms without a real V-sync source
+#define RENDERER_ATTRIBUTE_NONBLOCKING_PRESENT 0x20
+
 class IFFmpegRenderer : public Overlay::IOverlayRenderer {
 public:
     enum class RendererType {
@@ -302,6 +306,23 @@ public:
         // preparations might include clearing the window.
     }
 
+    virtual void notifyFrameQueued(AVFrame*) {
+        // Called on the decoder thread when a frame is queued for
+        // rendering. Renderers can start work on the frame here that
+        // doesn't require the render context.
+    }
+
+    virtual int getDecoderBuffer(AVCodecContext* context, AVFrame* frame, int flags) {
+        // Called by non-hwaccel decoders to allocate frame buffers.
+        // Renderers may provide buffers they can display without a copy.
+        return avcodec_default_get_buffer2(context, frame, flags);
+    }
+
+    virtual void updateRenderStats(VIDEO_STATS*) {
+        // Called on the render thread after each rendered frame, so
+        // renderers can add statistics only they can measure.
+    }
+
     RendererType getRendererType() {
         return m_Type;
     }
@@ -515,6 +536,12 @@ public:
                                     EGLImage[EGL_MAX_PLANES]) {
         return -1;
     }
+
+    // Changes whenever the backend destroys the EGLImages it reuses across
+    // frames, so callers know to drop state derived from them.
+    virtual int getEGLImageCacheGeneration() {
+        return 0;
+    }
 #endif
 
 #ifdef HAVE_DRM
@@ -9,7 +9,6 @@
 
 extern "C" {
 #include <libavutil/pixdesc.h>
-#include <libavutil/opt.h>
 }
 
 SdlRenderer::SdlRenderer()
@@ -18,11 +17,13 @@ SdlRenderer::SdlRenderer()
       m_Renderer(nullptr),
       m_Texture(nullptr),
       m_NeedsYuvToRgbConversion(false),
-      m_SwsContext(nullptr),
-      m_RgbFrame(av_frame_alloc()),
+      m_NeedsDownConversion(false),
       m_SwFrameMapper(this)
 {
-    SDL_zero(m_OverlayTextures);
+    SDL_zero(m_OverlayRects);
+    SDL_zero(m_OverlayAtlases);
+    SDL_zero(m_OverlayAtlasTextures);
+    SDL_zero(m_OverlayBatches);
 
 #ifdef HAVE_CUDA
     m_CudaGLHelper = nullptr;
@@ -38,14 +39,12 @@ SdlRenderer::~SdlRenderer()
 #endif
 
     for (int i = 0; i < Overlay::OverlayMax; i++) {
-        if (m_OverlayTextures[i] != nullptr) {
-            SDL_DestroyTexture(m_OverlayTextures[i]);
+        if (m_OverlayAtlasTextures[i] != nullptr) {
+            SDL_DestroyTexture(m_OverlayAtlasTextures[i]);
         }
+        delete m_OverlayBatches[i];
     }
 
-    av_frame_free(&m_RgbFrame);
-    sws_freeContext(m_SwsContext);
-
     if (m_Texture != nullptr) {
         SDL_DestroyTexture(m_Texture);
     }
@@ -97,7 +96,7 @@ bool SdlRenderer::isPixelFormatSupported(int videoFormat, AVPixelFormat pixelFor
 {
     if (videoFormat & (VIDEO_FORMAT_MASK_10BIT | VIDEO_FORMAT_MASK_YUV444)) {
         // SDL2 can't natively handle textures with these formats, but we can perform
-        // conversion on the CPU using swscale then upload them as an RGB texture.
+        // conversion on the CPU then upload them as an NV12 or RGB texture.
         const AVPixFmtDescriptor* formatDesc = av_pix_fmt_desc_get(pixelFormat);
         if (!formatDesc) {
             SDL_assert(formatDesc);
@@ -137,11 +136,6 @@ bool SdlRenderer::initialize(PDECODER_PARAMETERS params)
     m_VideoFormat = params->videoFormat;
     m_SwFrameMapper.setVideoFormat(m_VideoFormat);
 
-    if (params->videoFormat & VIDEO_FORMAT_MASK_10BIT) {
-        // SDL doesn't support rendering HDR yet
-        return false;
-    }
-
     // Don't create a renderer or pump events for test-only
     // renderers. Test-only renderers might be created on
     // a non-main thread where interaction with the SDL
@@ -222,16 +216,34 @@ bool SdlRenderer::initialize(PDECODER_PARAMETERS params)
     return true;
 }
 
+bool SdlRenderer::supportsOverlayGlyphBatches()
+{
+    return true;
+}
+
 void SdlRenderer::renderOverlay(Overlay::OverlayType type)
 {
     if (Session::get()->getOverlayManager().isOverlayEnabled(type)) {
-        // If a new surface has been created for updated overlay data, convert it into a texture.
-        // NB: We have to do this conversion at render-time because we can only interact
+        // If the overlay text has changed, pick up the new glyph layout.
+        // NB: We have to do this at render-time because we can only interact
         // with the renderer on a single thread.
-        SDL_Surface* newSurface = Session::get()->getOverlayManager().getUpdatedOverlaySurface(type);
-        if (newSurface != nullptr) {
-            if (m_OverlayTextures[type] != nullptr) {
-                SDL_DestroyTexture(m_OverlayTextures[type]);
+        Overlay::GlyphBatch* newBatch = Session::get()->getOverlayManager().getUpdatedOverlayGlyphBatch(type);
+        if (newBatch != nullptr) {
+            // The atlas only changes if the overlay's font does, so
+            // we normally upload it just once per overlay
+            if (newBatch->atlas != m_OverlayAtlases[type]) {
+                if (m_OverlayAtlasTextures[type] != nullptr) {
+                    SDL_DestroyTexture(m_OverlayAtlasTextures[type]);
+                }
+
+                m_OverlayAtlasTextures[type] = SDL_CreateTextureFromSurface(m_Renderer, newBatch->atlas);
+                if (m_OverlayAtlasTextures[type]) {
+                    // Overlays are always drawn at exact size
+                    SDL_SetTextureScaleMode(m_OverlayAtlasTextures[type], SDL_ScaleModeNearest);
+                    SDL_SetTextureBlendMode(m_OverlayAtlasTextures[type], SDL_BLENDMODE_BLEND);
+                }
+
+                m_OverlayAtlases[type] = newBatch->atlas;
             }
 
             if (type == Overlay::OverlayStatusUpdate) {
@@ -239,7 +251,7 @@ void SdlRenderer::renderOverlay(Overlay::OverlayType type)
                 SDL_Rect viewportRect;
                 SDL_RenderGetViewport(m_Renderer, &viewportRect);
                 m_OverlayRects[type].x = 0;
-                m_OverlayRects[type].y = viewportRect.h - newSurface->h;
+                m_OverlayRects[type].y = viewportRect.h - newBatch->height;
             }
             else if (type == Overlay::OverlayDebug) {
                 // Top left
@@ -247,30 +259,65 @@ void SdlRenderer::renderOverlay(Overlay::OverlayType type)
                 m_OverlayRects[type].y = 0;
             }
 
-            m_OverlayRects[type].w = newSurface->w;
-            m_OverlayRects[type].h = newSurface->h;
-
-            m_OverlayTextures[type] = SDL_CreateTextureFromSurface(m_Renderer, newSurface);
-            SDL_FreeSurface(newSurface);
-
-            if (m_OverlayTextures[type]) {
-                // Overlays are always drawn at exact size
-                SDL_SetTextureScaleMode(m_OverlayTextures[type], SDL_ScaleModeNearest);
+            m_OverlayRects[type].w = newBatch->width;
+            m_OverlayRects[type].h = newBatch->height;
+
+            Session::get()->getOverlayManager().releaseOverlayGlyphBatch(type, m_OverlayBatches[type]);
+            m_OverlayBatches[type] = newBatch;
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+            // Build the vertices now, so each frame draws the overlay in a single call
+            auto& vertices = m_OverlayVertices[type];
+            auto& indices = m_OverlayIndices[type];
+            vertices.clear();
+            indices.clear();
+
+            float atlasW = newBatch->atlas->w;
+            float atlasH = newBatch->atlas->h;
+            for (const auto& quad : newBatch->quads) {
+                float x1 = m_OverlayRects[type].x + quad.dst.x;
+                float y1 = m_OverlayRects[type].y + quad.dst.y;
+                float x2 = x1 + quad.dst.w;
+                float y2 = y1 + quad.dst.h;
+                float u1 = quad.src.x / atlasW;
+                float v1 = quad.src.y / atlasH;
+                float u2 = (quad.src.x + quad.src.w) / atlasW;
+                float v2 = (quad.src.y + quad.src.h) / atlasH;
+                int base = (int)vertices.size();
+
+                vertices.push_back({ { x1, y1 }, { 0xFF, 0xFF, 0xFF, 0xFF }, { u1, v1 } });
+                vertices.push_back({ { x2, y1 }, { 0xFF, 0xFF, 0xFF, 0xFF }, { u2, v1 } });
+                vertices.push_back({ { x2, y2 }, { 0xFF, 0xFF, 0xFF, 0xFF }, { u2, v2 } });
+                vertices.push_back({ { x1, y2 }, { 0xFF, 0xFF, 0xFF, 0xFF }, { u1, v2 } });
+
+                for (int index : { 0, 1, 2, 0, 2, 3 }) {
+                    indices.push_back(base + index);
+                }
             }
+#endif
         }
 
-        // If we have an overlay texture, render it too
-        if (m_OverlayTextures[type] != nullptr) {
-            SDL_RenderCopy(m_Renderer, m_OverlayTextures[type], nullptr, &m_OverlayRects[type]);
+        // If we have glyphs to draw, render them too
+        if (m_OverlayAtlasTextures[type] != nullptr && m_OverlayBatches[type] != nullptr) {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+            if (!m_OverlayIndices[type].empty()) {
+                SDL_RenderGeometry(m_Renderer, m_OverlayAtlasTextures[type],
+                                   m_OverlayVertices[type].data(), (int)m_OverlayVertices[type].size(),
+                                   m_OverlayIndices[type].data(), (int)m_OverlayIndices[type].size());
+            }
+#else
+            // SDL batches these copies into a single draw call
+            for (const auto& quad : m_OverlayBatches[type]->quads) {
+                SDL_Rect dstRect = quad.dst;
+                dstRect.x += m_OverlayRects[type].x;
+                dstRect.y += m_OverlayRects[type].y;
+                SDL_RenderCopy(m_Renderer, m_OverlayAtlasTextures[type], &quad.src, &dstRect);
+            }
+#endif
         }
     }
 }
 
-void SdlRenderer::ffNoopFree(void*, uint8_t*)
-{
-    // Nothing
-}
-
 void SdlRenderer::renderFrame(AVFrame* frame)
 {
     int err;
@@ -311,6 +358,7 @@ ReadbackRetry:
 
         // Remember to keep this in sync with SdlRenderer::isPixelFormatSupported()!
         m_NeedsYuvToRgbConversion = false;
+        m_NeedsDownConversion = false;
         switch (frame->format)
         {
         case AV_PIX_FMT_YUV420P:
@@ -324,6 +372,13 @@ ReadbackRetry:
         case AV_PIX_FMT_NV21:
             sdlFormat = SDL_PIXELFORMAT_NV21;
             break;
+        case AV_PIX_FMT_P010:
+        case AV_PIX_FMT_YUV420P10:
+            // SDL doesn't support rendering HDR yet, so we drop to 8-bit on
+            // the CPU and let SDL handle the YUV conversion on the GPU.
+            sdlFormat = SDL_PIXELFORMAT_NV12;
+            m_NeedsDownConversion = true;
+            break;
         default:
             SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
                         "Performing color conversion on CPU due to lack of SDL support for format: %s",
@@ -334,65 +389,30 @@ ReadbackRetry:
         }
 
         if (m_NeedsYuvToRgbConversion) {
-            m_RgbFrame->width = frame->width;
-            m_RgbFrame->height = frame->height;
-            m_RgbFrame->format = AV_PIX_FMT_BGR0;
-
-            sws_freeContext(m_SwsContext);
-
-#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
-            m_SwsContext = sws_alloc_context();
-            if (!m_SwsContext) {
-                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                             "sws_alloc_context() failed");
-                goto Exit;
-            }
-
-            AVDictionary *options { nullptr };
-            av_dict_set_int(&options, "srcw", frame->width, 0);
-            av_dict_set_int(&options, "srch", frame->height, 0);
-            av_dict_set_int(&options, "src_format", frame->format, 0);
-            av_dict_set_int(&options, "dstw", m_RgbFrame->width, 0);
-            av_dict_set_int(&options, "dsth", m_RgbFrame->height, 0);
-            av_dict_set_int(&options, "dst_format", m_RgbFrame->format, 0);
-            av_dict_set_int(&options, "threads", std::min(SDL_GetCPUCount(), 4), 0); // Up to 4 threads
-
-            err = av_opt_set_dict(m_SwsContext, &options);
-            av_dict_free(&options);
-            if (err < 0) {
-                char string[AV_ERROR_MAX_STRING_SIZE];
-                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                             "av_opt_set_dict() failed: %s",
-                             av_make_error_string(string, sizeof(string), err));
+            if (!m_ColorConverter.initialize(frame, AV_PIX_FMT_BGR0)) {
                 goto Exit;
             }
-
-            err = sws_init_context(m_SwsContext, nullptr, nullptr);
-            if (err < 0) {
-                char string[AV_ERROR_MAX_STRING_SIZE];
-                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                             "sws_init_context() failed: %s",
-                             av_make_error_string(string, sizeof(string), err));
+        }
+        else {
+            if (m_NeedsDownConversion && !m_ColorConverter.initialize(frame, AV_PIX_FMT_NV12)) {
                 goto Exit;
             }
-#else
-            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
-                        "CPU color conversion is slow on FFmpeg 4.x. Update FFmpeg for better performance.");
 
-            m_SwsContext = sws_getContext(frame->width, frame->height, (AVPixelFormat)frame->format,
-                                          m_RgbFrame->width, m_RgbFrame->height, (AVPixelFormat)m_RgbFrame->format,
-                                          0, nullptr, nullptr, nullptr);
-            if (!m_SwsContext) {
-                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                             "sws_getContext() failed");
-                goto Exit;
-            }
-#endif
-        }
-        else {
             // SDL will perform YUV conversion on the GPU
             switch (getFrameColorspace(frame))
             {
+            case COLORSPACE_REC_2020:
+                // SDL has no Rec 2020 matrix, so use the closest one that
+                // matches the range. Its only full range mode is JPEG, and
+                // a range mismatch (crushed blacks and clipped whites) is
+                // much more visible than the difference in the matrix.
+                if (isFrameFullRange(frame)) {
+                    SDL_SetYUVConversionMode(SDL_YUV_CONVERSION_JPEG);
+                }
+                else {
+                    SDL_SetYUVConversionMode(SDL_YUV_CONVERSION_BT709);
+                }
+                break;
             case COLORSPACE_REC_709:
                 SDL_assert(!isFrameFullRange(frame));
                 SDL_SetYUVConversionMode(SDL_YUV_CONVERSION_BT709);
@@ -462,6 +482,34 @@ ReadbackRetry:
                              frame->data[2],
                              frame->linesize[2]);
     }
+    else if (m_NeedsDownConversion) {
+        char* pixels;
+        int texturePitch;
+
+        err = SDL_LockTexture(m_Texture, nullptr, (void**)&pixels, &texturePitch);
+        if (err < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "SDL_LockTexture() failed: %s",
+                         SDL_GetError());
+            goto Exit;
+        }
+
+        // Convert directly into the locked texture, so the down-conversion
+        // and the upload are a single pass over the frame
+        uint8_t* dstData[4] = { (uint8_t*)pixels, (uint8_t*)pixels + (texturePitch * frame->height) };
+        int dstLinesize[4] = { texturePitch, texturePitch };
+
+        m_ColorConverter.submitFrame(frame, dstData, dstLinesize);
+        bool converted = m_ColorConverter.finishFrame();
+
+        SDL_UnlockTexture(m_Texture);
+
+        if (!converted) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "CPU down-conversion failed");
+            goto Exit;
+        }
+    }
     else if (!m_NeedsYuvToRgbConversion) {
 #if SDL_VERSION_ATLEAST(2, 0, 15)
         // SDL_UpdateNVTexture is not supported on all renderer backends,
@@ -524,39 +572,31 @@ ReadbackRetry:
     else {
         // We have a pixel format that SDL doesn't natively support, so we must use
         // swscale to convert the YUV frame into an RGB frame to upload to the GPU.
-        uint8_t* pixels;
-        int texturePitch;
+        // The conversion runs in slices on worker threads, and we upload each
+        // slice as soon as it's ready while the rest are still converting.
+        SDL_Rect sliceRect;
+        uint8_t* slicePixels;
+        int slicePitch;
+
+        err = 0;
+        m_ColorConverter.submitFrame(frame);
+        while (m_ColorConverter.waitForNextSlice(&sliceRect, &slicePixels, &slicePitch)) {
+            err = SDL_UpdateTexture(m_Texture, &sliceRect, slicePixels, slicePitch);
+            if (err < 0) {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                             "SDL_UpdateTexture() failed: %s",
+                             SDL_GetError());
+                break;
+            }
+        }
 
-        err = SDL_LockTexture(m_Texture, nullptr, (void**)&pixels, &texturePitch);
-        if (err < 0) {
+        // Wait for the workers to be done with this frame before it can be freed
+        if (!m_ColorConverter.finishFrame()) {
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "SDL_LockTexture() failed: %s",
-                         SDL_GetError());
+                         "CPU color conversion failed");
             goto Exit;
         }
-
-        // Create a buffer to wrap our locked texture buffer
-        m_RgbFrame->buf[0] = av_buffer_create(pixels, m_RgbFrame->height * texturePitch, ffNoopFree, nullptr, 0);
-        m_RgbFrame->data[0] = pixels;
-        m_RgbFrame->linesize[0] = texturePitch;
-
-#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
-        // Perform multi-threaded color conversion into the locked texture buffer
-        err = sws_scale_frame(m_SwsContext, m_RgbFrame, frame);
-#else
-        // Perform a single-threaded color conversion using the legacy swscale API
-        err = sws_scale(m_SwsContext, frame->data, frame->linesize, 0, frame->height,
-                        m_RgbFrame->data, m_RgbFrame->linesize);
-#endif
-
-        av_buffer_unref(&m_RgbFrame->buf[0]);
-        SDL_UnlockTexture(m_Texture);
-
-        if (err < 0) {
-            char string[AV_ERROR_MAX_STRING_SIZE];
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "sws_scale_frame() failed: %s",
-                         av_make_error_string(string, AV_ERROR_MAX_STRING_SIZE, err));
+        else if (err < 0) {
             goto Exit;
         }
     }
@@ -596,7 +636,15 @@ ReadbackRetry:
 
 Exit:
     if (swFrame != nullptr) {
-        av_frame_free(&swFrame);
+        m_SwFrameMapper.releaseSwFrame(&swFrame);
+    }
+}
+
+void SdlRenderer::notifyFrameQueued(AVFrame* frame)
+{
+    // Start reading back hwframes that we can't render directly
+    if (frame->hw_frames_ctx != nullptr && frame->format != AV_PIX_FMT_CUDA) {
+        m_SwFrameMapper.prefetchSwFrame(frame);
     }
 }
 
@@ -626,7 +674,7 @@ bool SdlRenderer::testRenderFrame(AVFrame* frame)
             return false;
         }
 
-        av_frame_free(&swFrame);
+        m_SwFrameMapper.releaseSwFrame(&swFrame);
     }
     else if (!isPixelFormatSupported(m_VideoFormat, (AVPixelFormat)frame->format)) {
         SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
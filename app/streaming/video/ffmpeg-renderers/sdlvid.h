@@ -2,15 +2,12 @@
 
 #include "renderer.h"
 #include "swframemapper.h"
+#include "cpucolorconverter.h"
 
 #ifdef HAVE_CUDA
 #include "cuda.h"
 #endif
 
-extern "C" {
-#include <libswscale/swscale.h>
-}
-
 class SdlRenderer : public IFFmpegRenderer {
 public:
     SdlRenderer();
@@ -23,22 +20,30 @@ public:
     virtual bool isPixelFormatSupported(int videoFormat, enum AVPixelFormat pixelFormat) override;
     virtual bool testRenderFrame(AVFrame* frame) override;
     virtual bool notifyWindowChanged(PWINDOW_STATE_CHANGE_INFO) override;
+    virtual void notifyFrameQueued(AVFrame* frame) override;
+    virtual bool supportsOverlayGlyphBatches() override;
 
 private:
     void renderOverlay(Overlay::OverlayType type);
 
-    static void ffNoopFree(void *opaque, uint8_t *data);
-
     int m_VideoFormat;
     SDL_Renderer* m_Renderer;
     SDL_Texture* m_Texture;
-    SDL_Texture* m_OverlayTextures[Overlay::OverlayMax];
     SDL_Rect m_OverlayRects[Overlay::OverlayMax];
 
-    // Used for CPU conversion of YUV to RGB if needed
+    // Overlays are drawn as batches of quads from each overlay's glyph atlas
+    SDL_Surface* m_OverlayAtlases[Overlay::OverlayMax];
+    SDL_Texture* m_OverlayAtlasTextures[Overlay::OverlayMax];
+    Overlay::GlyphBatch* m_OverlayBatches[Overlay::OverlayMax];
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    std::vector<SDL_Vertex> m_OverlayVertices[Overlay::OverlayMax];
+    std::vector<int> m_OverlayIndices[Overlay::OverlayMax];
+#endif
+
+    // Used for CPU conversion of YUV to RGB or 10-bit to 8-bit if needed
     bool m_NeedsYuvToRgbConversion;
-    SwsContext* m_SwsContext;
-    AVFrame* m_RgbFrame;
+    bool m_NeedsDownConversion;
+    CpuColorConverter m_ColorConverter;
 
     SwFrameMapper m_SwFrameMapper;
 
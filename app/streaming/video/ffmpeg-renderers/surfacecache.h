@@ -0,0 +1,134 @@
+#pragma once
+
+#include "SDL_compat.h"
+
+#include <functional>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// Fixed-size cache of objects that renderers derive from decoder surfaces,
+// like imported EGLImages or KMS framebuffers. A decoder's surfaces are only
+// reused within the same frames context, so the whole cache is flushed when
+// frames from a new one arrive or when the decoder resets its surface pool.
+// We hold a reference to the cached frames context, so its address can't be
+// reused by a new one while we're comparing against it.
+//
+// Frames without a frames context (like those from a renderer's own buffer
+// pool) share one generation of the cache until reset() is called.
+//
+// Only the thread importing surfaces may use the cache, except for reset().
+template <typename Key, typename Value, int Capacity>
+class SurfaceCache
+{
+public:
+    // Called for each value when it is flushed from the cache
+    typedef std::function<void(Value& value)> ReleaseCallback;
+
+    explicit SurfaceCache(ReleaseCallback releaseCallback)
+        : m_ReleaseCallback(releaseCallback),
+          m_Count(0),
+          m_FramesCtx(nullptr),
+          m_Generation(0)
+    {
+        SDL_AtomicSet(&m_ResetPending, 0);
+    }
+
+    ~SurfaceCache()
+    {
+        flush();
+    }
+
+    SurfaceCache(const SurfaceCache&) = delete;
+    SurfaceCache& operator=(const SurfaceCache&) = delete;
+
+    // Flushes the cache the next time a frame is validated. This may be
+    // called from any thread, like the decoder thread when it resets its
+    // surface pool.
+    void reset()
+    {
+        SDL_AtomicSet(&m_ResetPending, 1);
+    }
+
+    // Flushes the cache if the frame is from a different frames context than
+    // the cached entries or reset() has been called. Returns true if the cache
+    // was flushed.
+    bool validate(AVFrame* frame)
+    {
+        void* framesCtx = frame->hw_frames_ctx ? frame->hw_frames_ctx->data : nullptr;
+        void* cachedFramesCtx = m_FramesCtx ? m_FramesCtx->data : nullptr;
+        if (!SDL_AtomicSet(&m_ResetPending, 0) && framesCtx == cachedFramesCtx) {
+            return false;
+        }
+
+        flush();
+        if (frame->hw_frames_ctx != nullptr) {
+            m_FramesCtx = av_buffer_ref(frame->hw_frames_ctx);
+        }
+        return true;
+    }
+
+    bool lookup(const Key& key, Value* value) const
+    {
+        for (int i = 0; i < m_Count; i++) {
+            if (m_Entries[i].key == key) {
+                *value = m_Entries[i].value;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Returns false if the cache is full. The caller still owns the value then.
+    bool insert(const Key& key, const Value& value)
+    {
+        if (m_Count == Capacity) {
+            return false;
+        }
+
+        m_Entries[m_Count].key = key;
+        m_Entries[m_Count].value = value;
+        m_Count++;
+        return true;
+    }
+
+    // Releases every cached value and forgets the frames context
+    void flush()
+    {
+        for (int i = 0; i < m_Count; i++) {
+            m_ReleaseCallback(m_Entries[i].value);
+        }
+
+        m_Count = 0;
+        av_buffer_unref(&m_FramesCtx);
+
+        // Tell the owner to drop anything it derived from these values
+        m_Generation++;
+    }
+
+    int getCount() const
+    {
+        return m_Count;
+    }
+
+    // Changes each time the cache is flushed
+    int getGeneration() const
+    {
+        return m_Generation;
+    }
+
+private:
+    struct Entry {
+        Key key;
+        Value value;
+    };
+
+    ReleaseCallback m_ReleaseCallback;
+    Entry m_Entries[Capacity];
+    int m_Count;
+    AVBufferRef* m_FramesCtx;
+    int m_Generation;
+    SDL_atomic_t m_ResetPending;
+};
@@ -1,11 +1,85 @@
 #include "swframemapper.h"
+#include "pacer/pacer.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+// Alignment of the planes in our pooled readback buffers
+#define SW_FRAME_ALIGNMENT 64
 
 SwFrameMapper::SwFrameMapper(IFFmpegRenderer* renderer)
     : m_Renderer(renderer),
       m_VideoFormat(0),
       m_SwPixelFormat(AV_PIX_FMT_NONE),
-      m_MapFrame(false)
+      m_MapFrame(false),
+      m_BufferPool(nullptr),
+      m_BufferSize(0),
+      m_Lock(SDL_CreateMutex()),
+      m_Cond(SDL_CreateCond()),
+      m_ReadbackThread(nullptr),
+      m_ReadbackReady(false),
+      m_StopReadback(false),
+      m_PendingHwFrame(nullptr),
+      m_ActiveHwFrame(nullptr),
+      m_ReadyHwFrame(nullptr),
+      m_ReadySwFrame(nullptr),
+      m_PrefetchedFrames(0),
+      m_TotalFrames(0)
+{
+}
+
+SwFrameMapper::~SwFrameMapper()
+{
+    stopReadbackThread();
+
+    if (m_TotalFrames > 0 && isAsyncReadbackEnabled()) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Asynchronous readback finished %d of %d frames ahead of rendering",
+                    m_PrefetchedFrames,
+                    m_TotalFrames);
+    }
+
+    // Outstanding buffers keep the pool alive until they are released
+    av_buffer_pool_uninit(&m_BufferPool);
+
+    SDL_DestroyCond(m_Cond);
+    SDL_DestroyMutex(m_Lock);
+}
+
+bool SwFrameMapper::isAsyncReadbackEnabled()
+{
+    return qEnvironmentVariableIntValue("SW_FRAME_ASYNC_READBACK") != 0;
+}
+
+void SwFrameMapper::stopReadbackThread()
+{
+    if (m_ReadbackThread != nullptr) {
+        SDL_LockMutex(m_Lock);
+        m_StopReadback = true;
+        SDL_CondBroadcast(m_Cond);
+        SDL_UnlockMutex(m_Lock);
+
+        SDL_WaitThread(m_ReadbackThread, nullptr);
+        m_ReadbackThread = nullptr;
+    }
+
+    m_FramePool.release(&m_PendingHwFrame);
+    m_FramePool.release(&m_ReadyHwFrame);
+    m_FramePool.release(&m_ReadySwFrame);
+}
+
+bool SwFrameMapper::isSameFrame(const AVFrame* a, const AVFrame* b)
+{
+    // Hardware frames identify their surface in the data pointers
+    return a->data[0] == b->data[0] && a->data[3] == b->data[3] &&
+           a->pts == b->pts && a->opaque == b->opaque;
+}
+
+void SwFrameMapper::releaseSwFrame(AVFrame** swFrame)
 {
+    // This returns the data buffers to our buffer pool (or unmaps them)
+    m_FramePool.release(swFrame);
 }
 
 void SwFrameMapper::setVideoFormat(int videoFormat)
@@ -99,10 +173,125 @@ Exit:
     return true;
 }
 
-AVFrame* SwFrameMapper::getSwFrameFromHwFrame(AVFrame* hwFrame)
+bool SwFrameMapper::allocateTransferBuffer(AVFrame* swFrame, AVFrame* hwFrame)
 {
-    int err;
+    // Like av_hwframe_transfer_data(), we allocate at the size of the hwframe
+    // context and crop to the frame size after the transfer.
+    auto hwFrameCtx = (AVHWFramesContext*)hwFrame->hw_frames_ctx->data;
+    swFrame->width = hwFrameCtx->width;
+    swFrame->height = hwFrameCtx->height;
+
+    int size = av_image_get_buffer_size(m_SwPixelFormat, swFrame->width, swFrame->height, SW_FRAME_ALIGNMENT);
+    if (size < 0) {
+        return false;
+    }
+
+    SDL_LockMutex(m_Lock);
+    if (size != m_BufferSize) {
+        // Buffers from the old pool are freed as their frames are released
+        av_buffer_pool_uninit(&m_BufferPool);
+        m_BufferPool = av_buffer_pool_init(size, nullptr);
+        m_BufferSize = m_BufferPool != nullptr ? size : 0;
+
+        // Preallocate enough buffers for every frame in flight
+        AVBufferRef* buffers[PACER_MAX_OUTSTANDING_FRAMES] = {};
+        for (int i = 0; m_BufferPool != nullptr && i < PACER_MAX_OUTSTANDING_FRAMES; i++) {
+            buffers[i] = av_buffer_pool_get(m_BufferPool);
+        }
+        for (int i = 0; i < PACER_MAX_OUTSTANDING_FRAMES; i++) {
+            av_buffer_unref(&buffers[i]);
+        }
+    }
+    swFrame->buf[0] = m_BufferPool != nullptr ? av_buffer_pool_get(m_BufferPool) : nullptr;
+    SDL_UnlockMutex(m_Lock);
+
+    if (swFrame->buf[0] == nullptr) {
+        return false;
+    }
 
+    return av_image_fill_arrays(swFrame->data, swFrame->linesize, swFrame->buf[0]->data,
+                                m_SwPixelFormat, swFrame->width, swFrame->height,
+                                SW_FRAME_ALIGNMENT) >= 0;
+}
+
+int SwFrameMapper::readbackThreadProc(void* context)
+{
+    SwFrameMapper* me = reinterpret_cast<SwFrameMapper*>(context);
+
+    SDL_LockMutex(me->m_Lock);
+    for (;;) {
+        while (!me->m_StopReadback && me->m_PendingHwFrame == nullptr) {
+            SDL_CondWait(me->m_Cond, me->m_Lock);
+        }
+        if (me->m_StopReadback) {
+            break;
+        }
+
+        me->m_ActiveHwFrame = me->m_PendingHwFrame;
+        me->m_PendingHwFrame = nullptr;
+        SDL_UnlockMutex(me->m_Lock);
+
+        AVFrame* swFrame = me->readBackFrame(me->m_ActiveHwFrame);
+
+        SDL_LockMutex(me->m_Lock);
+
+        // Replace any frame that was never rendered (Pacer dropped it)
+        me->m_FramePool.release(&me->m_ReadyHwFrame);
+        me->m_FramePool.release(&me->m_ReadySwFrame);
+
+        me->m_ReadyHwFrame = me->m_ActiveHwFrame;
+        me->m_ReadySwFrame = swFrame;
+        me->m_ActiveHwFrame = nullptr;
+        SDL_CondBroadcast(me->m_Cond);
+    }
+    SDL_UnlockMutex(me->m_Lock);
+
+    return 0;
+}
+
+void SwFrameMapper::prefetchSwFrame(AVFrame* hwFrame)
+{
+    if (hwFrame->hw_frames_ctx == nullptr) {
+        return;
+    }
+
+    // The readback thread is started on the render thread
+    SDL_LockMutex(m_Lock);
+    bool readbackReady = m_ReadbackReady && m_ReadbackThread != nullptr;
+    SDL_UnlockMutex(m_Lock);
+    if (!readbackReady) {
+        return;
+    }
+
+    AVFrame* hwFrameRef = m_FramePool.take();
+    if (hwFrameRef == nullptr) {
+        hwFrameRef = av_frame_alloc();
+        if (hwFrameRef == nullptr) {
+            return;
+        }
+    }
+
+    if (av_frame_ref(hwFrameRef, hwFrame) < 0) {
+        m_FramePool.release(&hwFrameRef);
+        return;
+    }
+
+    SDL_LockMutex(m_Lock);
+    if (!m_StopReadback) {
+        // Only the newest frame is worth reading back. If the renderer gets to
+        // an older one first, it will do the readback itself.
+        m_FramePool.release(&m_PendingHwFrame);
+        m_PendingHwFrame = hwFrameRef;
+        hwFrameRef = nullptr;
+        SDL_CondBroadcast(m_Cond);
+    }
+    SDL_UnlockMutex(m_Lock);
+
+    m_FramePool.release(&hwFrameRef);
+}
+
+AVFrame* SwFrameMapper::getSwFrameFromHwFrame(AVFrame* hwFrame)
+{
     // setVideoFormat() must have been called before our first frame
     SDL_assert(m_VideoFormat != 0);
 
@@ -111,11 +300,65 @@ AVFrame* SwFrameMapper::getSwFrameFromHwFrame(AVFrame* hwFrame)
         if (!initializeReadBackFormat(hwFrame->hw_frames_ctx, hwFrame)) {
             return nullptr;
         }
+
+        if (isAsyncReadbackEnabled()) {
+            m_ReadbackThread = SDL_CreateThread(SwFrameMapper::readbackThreadProc, "SwFrameReadback", this);
+            if (m_ReadbackThread == nullptr) {
+                SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                            "SDL_CreateThread() failed: %s",
+                            SDL_GetError());
+            }
+        }
+
+        // The readback thread can start once our format is known
+        SDL_LockMutex(m_Lock);
+        m_ReadbackReady = true;
+        SDL_UnlockMutex(m_Lock);
     }
 
-    AVFrame* swFrame = av_frame_alloc();
+    m_TotalFrames++;
+
+    if (m_ReadbackThread != nullptr) {
+        AVFrame* swFrame = nullptr;
+
+        SDL_LockMutex(m_Lock);
+
+        // Wait if the worker is in the middle of reading back this frame
+        while (m_ActiveHwFrame != nullptr && isSameFrame(m_ActiveHwFrame, hwFrame)) {
+            SDL_CondWait(m_Cond, m_Lock);
+        }
+
+        if (m_ReadyHwFrame != nullptr && isSameFrame(m_ReadyHwFrame, hwFrame)) {
+            swFrame = m_ReadySwFrame;
+            m_ReadySwFrame = nullptr;
+            m_FramePool.release(&m_ReadyHwFrame);
+        }
+        else if (m_PendingHwFrame != nullptr && isSameFrame(m_PendingHwFrame, hwFrame)) {
+            // The worker hasn't started, so we'll just do it ourselves
+            m_FramePool.release(&m_PendingHwFrame);
+        }
+
+        SDL_UnlockMutex(m_Lock);
+
+        if (swFrame != nullptr) {
+            m_PrefetchedFrames++;
+            return swFrame;
+        }
+    }
+
+    return readBackFrame(hwFrame);
+}
+
+AVFrame* SwFrameMapper::readBackFrame(AVFrame* hwFrame)
+{
+    int err;
+
+    AVFrame* swFrame = m_FramePool.take();
     if (swFrame == nullptr) {
-        return nullptr;
+        swFrame = av_frame_alloc();
+        if (swFrame == nullptr) {
+            return nullptr;
+        }
     }
 
     swFrame->format = m_SwPixelFormat;
@@ -129,20 +372,32 @@ AVFrame* SwFrameMapper::getSwFrameFromHwFrame(AVFrame* hwFrame)
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                          "av_hwframe_map() failed: %d",
                          err);
-            av_frame_free(&swFrame);
+            m_FramePool.release(&swFrame);
             return nullptr;
         }
     }
     else {
+        // Transfer into a pooled buffer rather than letting
+        // av_hwframe_transfer_data() allocate a new one
+        if (!allocateTransferBuffer(swFrame, hwFrame)) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Failed to allocate readback buffer");
+            m_FramePool.release(&swFrame);
+            return nullptr;
+        }
+
         err = av_hwframe_transfer_data(swFrame, hwFrame, 0);
         if (err < 0) {
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                          "av_hwframe_transfer_data() failed: %d",
                          err);
-            av_frame_free(&swFrame);
+            m_FramePool.release(&swFrame);
             return nullptr;
         }
 
+        swFrame->width = hwFrame->width;
+        swFrame->height = hwFrame->height;
+
         // av_hwframe_transfer_data() doesn't transfer metadata
         // (and can even nuke existing metadata in dst), so we
         // will propagate metadata manually afterwards.
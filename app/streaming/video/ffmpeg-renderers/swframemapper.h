@@ -1,19 +1,63 @@
 #pragma once
 
 #include "renderer.h"
+#include "streaming/video/framepool.h"
 
+// Frames the asynchronous readback thread may keep references to after
+// Pacer has dropped them (one being read back and one finished)
+#define SW_FRAME_MAPPER_MAX_HELD_FRAMES 2
+
+// Maps or copies hardware frames into software frames. Copied frames use
+// pooled buffers, so steady-state readback doesn't allocate. Set
+// SW_FRAME_ASYNC_READBACK=1 to read back queued frames on a worker thread
+// while the renderer is still busy with the previous frame.
 class SwFrameMapper
 {
 public:
     explicit SwFrameMapper(IFFmpegRenderer* renderer);
+    ~SwFrameMapper();
     void setVideoFormat(int videoFormat);
     AVFrame* getSwFrameFromHwFrame(AVFrame* hwFrame);
 
+    // Returns a frame from getSwFrameFromHwFrame() to the pool
+    void releaseSwFrame(AVFrame** swFrame);
+
+    // Starts reading back a frame that will be rendered soon. This may
+    // be called on any thread and does nothing in synchronous mode.
+    void prefetchSwFrame(AVFrame* hwFrame);
+
+    static bool isAsyncReadbackEnabled();
+
 private:
     bool initializeReadBackFormat(AVBufferRef* hwFrameCtxRef, AVFrame* testFrame);
+    AVFrame* readBackFrame(AVFrame* hwFrame);
+    bool allocateTransferBuffer(AVFrame* swFrame, AVFrame* hwFrame);
+    void stopReadbackThread();
+    static bool isSameFrame(const AVFrame* a, const AVFrame* b);
+    static int readbackThreadProc(void* context);
 
     IFFmpegRenderer* m_Renderer;
     int m_VideoFormat;
     enum AVPixelFormat m_SwPixelFormat;
     bool m_MapFrame;
+
+    // Frame shells for both software frames and our hwframe references
+    FramePool m_FramePool;
+
+    // Data buffers for copied frames
+    AVBufferPool* m_BufferPool;
+    int m_BufferSize;
+
+    // Asynchronous readback state, protected by m_Lock
+    SDL_mutex* m_Lock;
+    SDL_cond* m_Cond;
+    SDL_Thread* m_ReadbackThread;
+    bool m_ReadbackReady;
+    bool m_StopReadback;
+    AVFrame* m_PendingHwFrame;
+    AVFrame* m_ActiveHwFrame;
+    AVFrame* m_ReadyHwFrame;
+    AVFrame* m_ReadySwFrame;
+    int m_PrefetchedFrames;
+    int m_TotalFrames;
 };
@@ -1162,6 +1162,12 @@ VAAPIRenderer::exportEGLImages(AVFrame *frame, EGLDisplay dpy,
     return m_EglImageFactory.exportVAImages(frame, exportFlags, dpy, images);
 }
 
+int
+VAAPIRenderer::getEGLImageCacheGeneration()
+{
+    return m_EglImageFactory.getCacheGeneration();
+}
+
 #endif
 
 #ifdef HAVE_DRM
@@ -64,6 +64,14 @@ extern "C" {
 
 #define FAILED_DECODES_RESET_THRESHOLD 20
 
+// Number of frames that must decode successfully after a soft recovery
+// before a later failure starts over at the cheapest recovery tier
+#define RECOVERY_STABLE_FRAMES 60
+
+// Set when a decoder escalates to a full reset, so the replacement
+// decoder can report how long the reset took once it outputs a frame.
+static uint64_t s_FullResetStartUs;
+
 #ifdef Q_OS_DARWIN
 static MoonlightStatTracker s_DecodeQueueDepthStats;
 static MoonlightStatTracker s_ReceiveFrameStats;
@@ -228,11 +236,19 @@ enum AVPixelFormat FFmpegVideoDecoder::ffGetFormat(AVCodecContext* context,
     return AV_PIX_FMT_NONE;
 }
 
+int FFmpegVideoDecoder::ffGetBuffer2(AVCodecContext* context, AVFrame* frame, int flags)
+{
+    FFmpegVideoDecoder* decoder = (FFmpegVideoDecoder*)context->opaque;
+
+    return decoder->m_BackendRenderer->getDecoderBuffer(context, frame, flags);
+}
+
 FFmpegVideoDecoder::FFmpegVideoDecoder(bool testOnly)
     : m_Pkt(av_packet_alloc()),
       m_VideoDecoderCtx(nullptr),
       m_RequiredPixelFormat(AV_PIX_FMT_NONE),
-      m_DecodeBuffer(1024 * 1024, 0),
+      m_PacketBufferPool(nullptr),
+      m_PacketBufferPoolSize(0),
       m_HwDecodeCfg(nullptr),
       m_BackendRenderer(nullptr),
       m_FrontendRenderer(nullptr),
@@ -248,11 +264,27 @@ FFmpegVideoDecoder::FFmpegVideoDecoder(bool testOnly)
       m_TestOnly(testOnly),
       m_CurrentTestMode(TestMode::TestFrameOnly),
       m_DecoderThread(nullptr),
-      m_VideoEnhancement(&VideoEnhancement::getInstance())
+      m_VideoEnhancement(&VideoEnhancement::getInstance()),
+      m_TotalWaitTimeUs(0),
+      m_TotalDecodeTimeUs(0),
+      m_FrameInfoHead(0),
+      m_FrameInfoCount(0),
+      m_MasteringDisplayBuf(nullptr),
+      m_ContentLightBuf(nullptr),
+      m_Decoder(nullptr),
+      m_RecoveryTier(RecoveryTier::None),
+      m_RecoveryStartUs(0),
+      m_FramesSinceRecovery(0),
+      m_LastRecoveryTier(RecoveryTier::None),
+      m_LastRecoveryTimeUs(0)
 {
     SDL_zero(m_ActiveWndVideoStats);
     SDL_zero(m_LastWndVideoStats);
     SDL_zero(m_GlobalVideoStats);
+    SDL_zero(m_WaitTimeHistogram);
+    SDL_zero(m_DecodeTimeHistogram);
+    SDL_zero(m_DecoderParams);
+    SDL_zero(m_HdrMetadata);
 
     SDL_AtomicSet(&m_DecoderThreadShouldQuit, 0);
 }
@@ -268,6 +300,14 @@ FFmpegVideoDecoder::~FFmpegVideoDecoder()
     av_log_set_level(AV_LOG_INFO);
 
     av_packet_free(&m_Pkt);
+
+    // Any packet buffers still referenced by FFmpeg will
+    // be freed when their last reference is dropped.
+    av_buffer_pool_uninit(&m_PacketBufferPool);
+
+    // Frames still holding references to these will keep them alive
+    av_buffer_unref(&m_MasteringDisplayBuf);
+    av_buffer_unref(&m_ContentLightBuf);
 }
 
 IFFmpegRenderer* FFmpegVideoDecoder::getBackendRenderer()
@@ -281,14 +321,19 @@ void FFmpegVideoDecoder::reset()
     // It might be touching things we're about to free.
     if (m_DecoderThread != nullptr) {
         SDL_AtomicSet(&m_DecoderThreadShouldQuit, 1);
-        LiWakeWaitForVideoFrame();
+        if (Session::get()->getDecodeUnitPlayer() != nullptr) {
+            Session::get()->getDecodeUnitPlayer()->wake();
+        }
+        else {
+            LiWakeWaitForVideoFrame();
+        }
         SDL_WaitThread(m_DecoderThread, NULL);
         SDL_AtomicSet(&m_DecoderThreadShouldQuit, 0);
         m_DecoderThread = nullptr;
     }
 
     m_FramesIn = m_FramesOut = 0;
-    m_FrameInfoQueue.clear();
+    m_FrameInfoHead = m_FrameInfoCount = 0;
 
     delete m_Pacer;
     m_Pacer = nullptr;
@@ -315,6 +360,7 @@ void FFmpegVideoDecoder::reset()
 
     if (m_CurrentTestMode != TestMode::TestFrameOnly) {
         logVideoStats(m_GlobalVideoStats, "Global video stats");
+        logDecoderThreadHistograms();
     }
     else {
         // Test-only decoders can't have any frames submitted
@@ -489,42 +535,8 @@ bool FFmpegVideoDecoder::createFrontendRenderer(PDECODER_PARAMETERS params, bool
     return true;
 }
 
-bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, enum AVPixelFormat requiredFormat, PDECODER_PARAMETERS params, TestMode testMode, bool useAlternateFrontend)
+bool FFmpegVideoDecoder::openDecoderContext(const AVCodec* decoder, enum AVPixelFormat requiredFormat, PDECODER_PARAMETERS params)
 {
-#ifdef Q_OS_DARWIN
-    ml_stat_init(&s_DecodeQueueDepthStats);
-    ml_stat_init(&s_ReceiveFrameStats);
-    ml_stat_init(&s_SendPacketStats);
-#endif
-
-    // In test-only mode, we should only see test frames
-    SDL_assert(!m_TestOnly || testMode != TestMode::NoTesting);
-
-    // Create the frontend renderer based on the capabilities of the backend renderer
-    if (!createFrontendRenderer(params, useAlternateFrontend)) {
-        return false;
-    }
-
-    // Reset frame number
-    m_VideoEnhancement->resetNumFrame();
-
-    m_RequiredPixelFormat = requiredFormat;
-    m_OriginalVideoWidth = params->width;
-    m_OriginalVideoHeight = params->height;
-    m_StreamFps = params->frameRate;
-    m_VideoFormat = params->videoFormat;
-    m_CurrentTestMode = testMode;
-
-    // Don't bother initializing Pacer if we're not actually going to render
-    if (testMode != TestMode::TestFrameOnly) {
-        StreamingPreferences* prefs = Session::get()->getPreferences();
-        m_Pacer = new Pacer(m_FrontendRenderer, &m_ActiveWndVideoStats, prefs->framePacingMode);
-        if (!m_Pacer->initialize(params->window, params->frameRate,
-                                 params->enableFramePacing || (params->enableVsync && (m_FrontendRenderer->getRendererAttributes() & RENDERER_ATTRIBUTE_FORCE_PACING)))) {
-            return false;
-        }
-    }
-
     m_VideoDecoderCtx = avcodec_alloc_context3(decoder);
     if (!m_VideoDecoderCtx) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
@@ -567,6 +579,9 @@ bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, enum AVP
 
     // Allocate enough extra frames for Pacer to avoid stalling the decoder
     m_VideoDecoderCtx->extra_hw_frames = PACER_MAX_OUTSTANDING_FRAMES;
+    if (SwFrameMapper::isAsyncReadbackEnabled()) {
+        m_VideoDecoderCtx->extra_hw_frames += SW_FRAME_MAPPER_MAX_HELD_FRAMES;
+    }
 
     // For non-hwaccel decoders, set the pix_fmt to hint to the decoder which
     // format should be used. This is necessary for certain decoders like the
@@ -577,6 +592,11 @@ bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, enum AVP
     if (m_HwDecodeCfg == nullptr) {
         m_VideoDecoderCtx->pix_fmt = (requiredFormat != AV_PIX_FMT_NONE) ?
             requiredFormat : m_FrontendRenderer->getPreferredPixelFormat(params->videoFormat);
+
+        // Let the renderer provide buffers for decoders that support custom allocators
+        if (decoder->capabilities & AV_CODEC_CAP_DR1) {
+            m_VideoDecoderCtx->get_buffer2 = ffGetBuffer2;
+        }
     }
 
     AVDictionary* options = nullptr;
@@ -629,12 +649,61 @@ bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, enum AVP
         return false;
     }
 
+    return true;
+}
+
+bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, enum AVPixelFormat requiredFormat, PDECODER_PARAMETERS params, TestMode testMode, bool useAlternateFrontend)
+{
+#ifdef Q_OS_DARWIN
+    ml_stat_init(&s_DecodeQueueDepthStats);
+    ml_stat_init(&s_ReceiveFrameStats);
+    ml_stat_init(&s_SendPacketStats);
+#endif
+
+    // In test-only mode, we should only see test frames
+    SDL_assert(!m_TestOnly || testMode != TestMode::NoTesting);
+
+    // Create the frontend renderer based on the capabilities of the backend renderer
+    if (!createFrontendRenderer(params, useAlternateFrontend)) {
+        return false;
+    }
+
+    // Reset frame number
+    m_VideoEnhancement->resetNumFrame();
+
+    m_RequiredPixelFormat = requiredFormat;
+    m_OriginalVideoWidth = params->width;
+    m_OriginalVideoHeight = params->height;
+    m_StreamFps = params->frameRate;
+    m_VideoFormat = params->videoFormat;
+    m_CurrentTestMode = testMode;
+
+    // Don't bother initializing Pacer if we're not actually going to render
+    if (testMode != TestMode::TestFrameOnly) {
+        StreamingPreferences* prefs = Session::get()->getPreferences();
+        m_Pacer = new Pacer(m_FrontendRenderer, &m_ActiveWndVideoStats,
+                            &Session::get()->getFrameTimeline(), &m_FramePool,
+                            prefs->framePacingMode);
+        if (!m_Pacer->initialize(params->window, params->frameRate,
+                                 params->enableFramePacing || (params->enableVsync && (m_FrontendRenderer->getRendererAttributes() & RENDERER_ATTRIBUTE_FORCE_PACING)))) {
+            return false;
+        }
+    }
+
+    m_Decoder = decoder;
+    m_DecoderParams = *params;
+    if (!openDecoderContext(decoder, requiredFormat, params)) {
+        return false;
+    }
+
     // FFMpeg doesn't completely initialize the codec until the codec
     // config data comes in. This would be too late for us to change
     // our minds on the selected video codec, so we'll do a trial run
     // now to see if things will actually work when the video stream
     // comes in.
     if (testMode != TestMode::NoTesting) {
+        int err;
+
         switch (params->videoFormat) {
         case VIDEO_FORMAT_H264:
             m_Pkt->data = (uint8_t*)k_H264TestFrame;
@@ -760,10 +829,11 @@ bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, enum AVP
 
         // Only create the decoder thread when instantiating the decoder for real. It will use APIs from
         // moonlight-common-c that can only be legally called with an established connection.
-        m_DecoderThread = SDL_CreateThread(FFmpegVideoDecoder::decoderThreadProcThunk, "FFDecoder", (void*)this);
-        if (m_DecoderThread == nullptr) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "Failed to create decoder thread: %s", SDL_GetError());
+        if (params->prewarm) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Deferring decoder thread start until the connection is established");
+        }
+        else if (!startDecoding()) {
             return false;
         }
 
@@ -783,6 +853,25 @@ bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, enum AVP
     return true;
 }
 
+bool FFmpegVideoDecoder::startDecoding()
+{
+    if (m_TestOnly || m_DecoderThread != nullptr) {
+        return true;
+    }
+
+    // Don't defer again if this decoder reinitializes itself later
+    m_DecoderParams.prewarm = false;
+
+    m_DecoderThread = SDL_CreateThread(FFmpegVideoDecoder::decoderThreadProcThunk, "FFDecoder", (void*)this);
+    if (m_DecoderThread == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to create decoder thread: %s", SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
 void FFmpegVideoDecoder::addVideoStats(VIDEO_STATS& src, VIDEO_STATS& dst)
 {
     dst.receivedFrames += src.receivedFrames;
@@ -795,6 +884,40 @@ void FFmpegVideoDecoder::addVideoStats(VIDEO_STATS& src, VIDEO_STATS& dst)
     dst.totalDecodeTimeUs += src.totalDecodeTimeUs;
     dst.totalPacerTimeUs += src.totalPacerTimeUs;
     dst.totalRenderTimeUs += src.totalRenderTimeUs;
+    dst.packetBufferAllocations += src.packetBufferAllocations;
+    dst.packetBytesCopied += src.packetBytesCopied;
+    dst.frameAllocations += src.frameAllocations;
+    dst.totalVsyncJitterUs += src.totalVsyncJitterUs;
+    dst.maxVsyncJitterUs = qMax(dst.maxVsyncJitterUs, src.maxVsyncJitterUs);
+    dst.vsyncIntervals += src.vsyncIntervals;
+
+    dst.pacerWakeups += src.pacerWakeups;
+    dst.totalPacerWakeLatencyUs += src.totalPacerWakeLatencyUs;
+    dst.pacerQueueContention += src.pacerQueueContention;
+    dst.totalRenderLeadUs += src.totalRenderLeadUs;
+    dst.latchedFrames += src.latchedFrames;
+    dst.missedRenderDeadlines += src.missedRenderDeadlines;
+    dst.vrrDelayedFrames += src.vrrDelayedFrames;
+    dst.totalVrrDelayUs += src.totalVrrDelayUs;
+    dst.totalJudderUs += src.totalJudderUs;
+    dst.maxJudderUs = qMax(dst.maxJudderUs, src.maxJudderUs);
+    dst.judderSamples += src.judderSamples;
+    dst.totalKmsCommitTimeUs += src.totalKmsCommitTimeUs;
+    dst.maxKmsCommitTimeUs = qMax(dst.maxKmsCommitTimeUs, src.maxKmsCommitTimeUs);
+    dst.kmsCommits += src.kmsCommits;
+    dst.totalFbLookupTimeUs += src.totalFbLookupTimeUs;
+    dst.maxFbLookupTimeUs = qMax(dst.maxFbLookupTimeUs, src.maxFbLookupTimeUs);
+    dst.fbLookups += src.fbLookups;
+    dst.framebufferImports += src.framebufferImports;
+    for (int i = 0; i < PACER_LATENCY_HISTOGRAM_BUCKETS; i++) {
+        dst.pacerLatencyHistogram[i] += src.pacerLatencyHistogram[i];
+    }
+
+    // Use the most recent queue depths
+    if (src.pacerTargetQueueDepth != 0) {
+        dst.pacerQueueDepth = src.pacerQueueDepth;
+        dst.pacerTargetQueueDepth = src.pacerTargetQueueDepth;
+    }
 
     if (dst.minHostProcessingLatency == 0) {
         dst.minHostProcessingLatency = src.minHostProcessingLatency;
@@ -1003,13 +1126,14 @@ void FFmpegVideoDecoder::stringifyVideoStats(VIDEO_STATS& stats, char* output, i
                        "Frames dropped due to network jitter: %.2f%%\n"
                        "Average network latency: %s\n"
                        "Average decoding time: %.2f ms\n"
-                       "Average frame queue delay: %.2f ms\n"
+                       "Average frame queue delay: %.2f ms (p99: %.2f ms)\n"
                        "Average rendering time (including monitor V-sync latency): %.2f ms\n",
                        (float)stats.networkDroppedFrames / stats.totalFrames * 100,
                        (float)stats.pacerDroppedFrames / stats.decodedFrames * 100,
                        rttString,
                        (double)(stats.totalDecodeTimeUs / 1000.0) / stats.decodedFrames,
                        (double)(stats.totalPacerTimeUs / 1000.0) / stats.renderedFrames,
+                       getPacerLatencyPercentileUs(stats, 0.99) / 1000.0,
                        (double)(stats.totalRenderTimeUs / 1000.0) / stats.renderedFrames);
         if (ret < 0 || ret >= length - offset) {
             SDL_assert(false);
@@ -1018,12 +1142,167 @@ void FFmpegVideoDecoder::stringifyVideoStats(VIDEO_STATS& stats, char* output, i
 
         offset += ret;
     }
+
+    if (m_LastRecoveryTier != RecoveryTier::None) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "Last decoder recovery: %s (%.1f ms)\n",
+                       getRecoveryTierName(m_LastRecoveryTier),
+                       m_LastRecoveryTimeUs / 1000.0);
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
+        }
+
+        offset += ret;
+    }
+
+    if (stats.receivedFrames != 0) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "Packet buffer allocations: %u (%.1f KB copied per frame)\n",
+                       stats.packetBufferAllocations,
+                       (double)(stats.packetBytesCopied / 1024.0) / stats.receivedFrames);
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
+        }
+
+        offset += ret;
+    }
+
+    if (stats.decodedFrames != 0) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "Frame allocations: %u\n",
+                       stats.frameAllocations);
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
+        }
+
+        offset += ret;
+    }
+
+    if (stats.vsyncIntervals != 0) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "V-sync jitter: %.2f ms average, %.2f ms max\n",
+                       (double)(stats.totalVsyncJitterUs / 1000.0) / stats.vsyncIntervals,
+                       stats.maxVsyncJitterUs / 1000.0);
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
+        }
+
+        offset += ret;
+    }
+
+    if (stats.pacerTargetQueueDepth != 0) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "Pacer queue depth: %u frames (target %u)\n",
+                       stats.pacerQueueDepth,
+                       stats.pacerTargetQueueDepth);
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
+        }
+
+        offset += ret;
+    }
+
+    if (stats.pacerWakeups != 0) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "Pacer handoff latency: %.1f us (%u wakeups, %u contended)\n",
+                       (double)stats.totalPacerWakeLatencyUs / stats.pacerWakeups,
+                       stats.pacerWakeups,
+                       stats.pacerQueueContention);
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
+        }
+
+        offset += ret;
+    }
+
+    if (stats.latchedFrames != 0) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "Render deadline: %.2f ms before V-sync (%u missed)\n",
+                       (double)(stats.totalRenderLeadUs / 1000.0) / stats.latchedFrames,
+                       stats.missedRenderDeadlines);
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
+        }
+
+        offset += ret;
+    }
+
+    if (stats.judderSamples != 0) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "Presentation judder: %.2f ms average, %.2f ms max\n",
+                       (double)(stats.totalJudderUs / 1000.0) / stats.judderSamples,
+                       stats.maxJudderUs / 1000.0);
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
+        }
+
+        offset += ret;
+    }
+
+    if (stats.fbLookups != 0) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "KMS framebuffer lookup time: %.2f ms average, %.2f ms max (%u imports)\n",
+                       (double)(stats.totalFbLookupTimeUs / 1000.0) / stats.fbLookups,
+                       stats.maxFbLookupTimeUs / 1000.0,
+                       stats.framebufferImports);
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
+        }
+
+        offset += ret;
+    }
+
+    if (stats.kmsCommits != 0) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "KMS commit time: %.2f ms average, %.2f ms max\n",
+                       (double)(stats.totalKmsCommitTimeUs / 1000.0) / stats.kmsCommits,
+                       stats.maxKmsCommitTimeUs / 1000.0);
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
+        }
+
+        offset += ret;
+    }
+
+    if (stats.vrrDelayedFrames != 0) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "VRR refresh limit: %u frames held %.2f ms on average\n",
+                       stats.vrrDelayedFrames,
+                       (double)(stats.totalVrrDelayUs / 1000.0) / stats.vrrDelayedFrames);
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
+        }
+
+        offset += ret;
+    }
 }
 
 void FFmpegVideoDecoder::logVideoStats(VIDEO_STATS& stats, const char* title)
 {
     if (stats.renderedFps > 0 || stats.renderedFrames != 0) {
-        char videoStatsStr[800];
+        char videoStatsStr[2048];
         stringifyVideoStats(stats, videoStatsStr, sizeof(videoStatsStr));
 
         SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
@@ -1428,6 +1707,13 @@ bool FFmpegVideoDecoder::tryInitializeRendererForUnknownDecoder(const AVCodec* d
         }
 #endif
 
+#ifdef HAVE_EGL
+        if (!glIsSlow && tryInitializeRenderer(decoder, AV_PIX_FMT_NONE, params, nullptr, nullptr,
+                                               []() -> IFFmpegRenderer* { return new EGLRenderer(); })) {
+            return true;
+        }
+#endif
+
         if (tryInitializeRenderer(decoder, AV_PIX_FMT_NONE, params, nullptr, nullptr,
                                   []() -> IFFmpegRenderer* { return new SdlRenderer(); })) {
             return true;
@@ -1464,6 +1750,9 @@ bool FFmpegVideoDecoder::tryInitializeRendererForUnknownDecoder(const AVCodec* d
         }
 #endif
         if (!glIsSlow) {
+#ifdef HAVE_EGL
+            TRY_PREFERRED_PIXEL_FORMAT(EGLRenderer);
+#endif
             TRY_PREFERRED_PIXEL_FORMAT(SdlRenderer);
         }
     }
@@ -1479,6 +1768,9 @@ bool FFmpegVideoDecoder::tryInitializeRendererForUnknownDecoder(const AVCodec* d
         }
 #endif
         if (!glIsSlow) {
+#ifdef HAVE_EGL
+            TRY_SUPPORTED_NON_PREFERRED_PIXEL_FORMAT(EGLRenderer);
+#endif
             TRY_SUPPORTED_NON_PREFERRED_PIXEL_FORMAT(SdlRenderer);
         }
     }
@@ -1808,7 +2100,75 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
     return false;
 }
 
-void FFmpegVideoDecoder::writeBuffer(PLENTRY entry, int& offset)
+void FFmpegVideoDecoder::attachHdrMetadata(AVFrame* frame)
+{
+    SS_HDR_METADATA hdrMetadata;
+    if (!LiGetHdrMetadata(&hdrMetadata)) {
+        return;
+    }
+
+    // Rebuild our side data buffers only when the host sends new metadata.
+    // Otherwise every frame just takes another reference to the same buffers.
+    if (m_MasteringDisplayBuf == nullptr || memcmp(&hdrMetadata, &m_HdrMetadata, sizeof(hdrMetadata)) != 0) {
+        av_buffer_unref(&m_MasteringDisplayBuf);
+        av_buffer_unref(&m_ContentLightBuf);
+
+        m_MasteringDisplayBuf = av_buffer_allocz(sizeof(AVMasteringDisplayMetadata));
+        if (m_MasteringDisplayBuf == nullptr) {
+            return;
+        }
+        m_ActiveWndVideoStats.frameAllocations++;
+
+        auto mdm = (AVMasteringDisplayMetadata*)m_MasteringDisplayBuf->data;
+
+        mdm->display_primaries[0][0] = av_make_q(hdrMetadata.displayPrimaries[0].x, 50000);
+        mdm->display_primaries[0][1] = av_make_q(hdrMetadata.displayPrimaries[0].y, 50000);
+        mdm->display_primaries[1][0] = av_make_q(hdrMetadata.displayPrimaries[1].x, 50000);
+        mdm->display_primaries[1][1] = av_make_q(hdrMetadata.displayPrimaries[1].y, 50000);
+        mdm->display_primaries[2][0] = av_make_q(hdrMetadata.displayPrimaries[2].x, 50000);
+        mdm->display_primaries[2][1] = av_make_q(hdrMetadata.displayPrimaries[2].y, 50000);
+
+        mdm->white_point[0] = av_make_q(hdrMetadata.whitePoint.x, 50000);
+        mdm->white_point[1] = av_make_q(hdrMetadata.whitePoint.y, 50000);
+
+        mdm->min_luminance = av_make_q(hdrMetadata.minDisplayLuminance, 10000);
+        mdm->max_luminance = av_make_q(hdrMetadata.maxDisplayLuminance, 1);
+
+        mdm->has_luminance = hdrMetadata.maxDisplayLuminance != 0 ? 1 : 0;
+        mdm->has_primaries = hdrMetadata.displayPrimaries[0].x != 0 ? 1 : 0;
+
+        if (hdrMetadata.maxContentLightLevel != 0 || hdrMetadata.maxFrameAverageLightLevel != 0) {
+            m_ContentLightBuf = av_buffer_allocz(sizeof(AVContentLightMetadata));
+            if (m_ContentLightBuf != nullptr) {
+                m_ActiveWndVideoStats.frameAllocations++;
+
+                auto clm = (AVContentLightMetadata*)m_ContentLightBuf->data;
+
+                clm->MaxCLL = hdrMetadata.maxContentLightLevel;
+                clm->MaxFALL = hdrMetadata.maxFrameAverageLightLevel;
+            }
+        }
+
+        m_HdrMetadata = hdrMetadata;
+    }
+
+    if (av_frame_get_side_data(frame, AV_FRAME_DATA_MASTERING_DISPLAY_METADATA) == nullptr) {
+        AVBufferRef* ref = av_buffer_ref(m_MasteringDisplayBuf);
+        if (ref != nullptr && av_frame_new_side_data_from_buf(frame, AV_FRAME_DATA_MASTERING_DISPLAY_METADATA, ref) == nullptr) {
+            av_buffer_unref(&ref);
+        }
+    }
+
+    if (m_ContentLightBuf != nullptr &&
+            av_frame_get_side_data(frame, AV_FRAME_DATA_CONTENT_LIGHT_LEVEL) == nullptr) {
+        AVBufferRef* ref = av_buffer_ref(m_ContentLightBuf);
+        if (ref != nullptr && av_frame_new_side_data_from_buf(frame, AV_FRAME_DATA_CONTENT_LIGHT_LEVEL, ref) == nullptr) {
+            av_buffer_unref(&ref);
+        }
+    }
+}
+
+void FFmpegVideoDecoder::writeBuffer(PLENTRY entry, uint8_t* buffer, int& offset)
 {
     if (m_NeedsSpsFixup && entry->bufferType == BUFFER_TYPE_SPS) {
         h264_stream_t* stream = h264_new();
@@ -1846,22 +2206,60 @@ void FFmpegVideoDecoder::writeBuffer(PLENTRY entry, int& offset)
 
         // Copy the modified NALU data. This clobbers byte 0 and starts NALU data at byte 1.
         // Since it prepended one extra byte, subtract one from the returned length.
-        offset += write_nal_unit(stream, (uint8_t*)&m_DecodeBuffer.data()[initialOffset + nalStart - 1],
+        offset += write_nal_unit(stream, &buffer[initialOffset + nalStart - 1],
                                  MAX_SPS_EXTRA_SIZE + entry->length - nalStart) - 1;
 
         // Copy the NALU prefix over from the original SPS
-        memcpy(&m_DecodeBuffer.data()[initialOffset], entry->data, nalStart);
+        memcpy(&buffer[initialOffset], entry->data, nalStart);
         offset += nalStart;
 
         h264_free(stream);
     }
     else {
         // Write the buffer as-is
-        memcpy(&m_DecodeBuffer.data()[offset],
+        memcpy(&buffer[offset],
                entry->data,
                entry->length);
         offset += entry->length;
     }
+
+    m_ActiveWndVideoStats.packetBytesCopied += entry->length;
+}
+
+#if FF_API_BUFFER_SIZE_T
+AVBufferRef* FFmpegVideoDecoder::allocPacketBuffer(void* opaque, int size)
+#else
+AVBufferRef* FFmpegVideoDecoder::allocPacketBuffer(void* opaque, size_t size)
+#endif
+{
+    auto me = (FFmpegVideoDecoder*)opaque;
+
+    // This only happens while the pool is warming up or after it has
+    // been resized, so it should stay at zero in steady state.
+    me->m_ActiveWndVideoStats.packetBufferAllocations++;
+
+    return av_buffer_alloc(size);
+}
+
+AVBufferRef* FFmpegVideoDecoder::getPacketBuffer(int requiredSize)
+{
+    // Grow the pool if this packet won't fit in its buffers. The old pool
+    // is freed once FFmpeg drops its last reference to any of its buffers.
+    if (m_PacketBufferPool == nullptr || requiredSize > m_PacketBufferPoolSize) {
+        int newSize = qMax(1024 * 1024, requiredSize + requiredSize / 2);
+
+        av_buffer_pool_uninit(&m_PacketBufferPool);
+        m_PacketBufferPool = av_buffer_pool_init2(newSize + AV_INPUT_BUFFER_PADDING_SIZE,
+                                                  this, allocPacketBuffer, nullptr);
+        if (m_PacketBufferPool == nullptr) {
+            m_PacketBufferPoolSize = 0;
+            return nullptr;
+        }
+
+        m_PacketBufferPoolSize = newSize;
+    }
+
+    return av_buffer_pool_get(m_PacketBufferPool);
 }
 
 int FFmpegVideoDecoder::decoderThreadProcThunk(void *context)
@@ -1880,19 +2278,17 @@ void FFmpegVideoDecoder::decoderThreadProc()
     }
 #endif
 
+    // If we're replaying a capture, DUs come from the player rather than the host
+    DecodeUnitPlayer* player = Session::get()->getDecodeUnitPlayer();
+
     while (!SDL_AtomicGet(&m_DecoderThreadShouldQuit)) {
         if (m_FramesIn == m_FramesOut) {
-            VIDEO_FRAME_HANDLE handle;
-            PDECODE_UNIT du;
-
             // Waiting for input. All output frames have been received.
             // Block until we receive a new frame from the host.
-            if (!LiWaitForNextVideoFrame(&handle, &du)) {
+            if (!waitAndSubmitNextDecodeUnit(player, false)) {
                 // This might be a signal from the main thread to exit
                 continue;
             }
-
-            LiCompleteVideoFrame(handle, submitDecodeUnit(du));
         }
 
         if (m_FramesIn != m_FramesOut) {
@@ -1900,59 +2296,37 @@ void FFmpegVideoDecoder::decoderThreadProc()
 
             // We have output frames to receive. Let's poll until we get one,
             // and submit new input data if/when we get it.
-            AVFrame* frame = av_frame_alloc();
+            AVFrame* frame = m_FramePool.take();
             if (!frame) {
-                // Failed to allocate a frame but we did submit,
-                // so we can return DR_OK
-                SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
-                            "Failed to allocate frame");
-                continue;
+                frame = av_frame_alloc();
+                if (!frame) {
+                    // Failed to allocate a frame but we did submit,
+                    // so we can return DR_OK
+                    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                                "Failed to allocate frame");
+                    continue;
+                }
+
+                m_ActiveWndVideoStats.frameAllocations++;
             }
 
             int err;
             do {
                 uint64_t receiveStartUs = LiGetMicroseconds();
                 err = avcodec_receive_frame(m_VideoDecoderCtx, frame);
+                addToHistogram(m_DecodeTimeHistogram, LiGetMicroseconds() - receiveStartUs);
+                m_TotalDecodeTimeUs += LiGetMicroseconds() - receiveStartUs;
 #ifdef Q_OS_DARWIN
                 ml_stat_add(&s_ReceiveFrameStats, (double)(LiGetMicroseconds() - receiveStartUs));
 #endif
                 if (err == 0) {
-                    SDL_assert(m_FrameInfoQueue.size() == m_FramesIn - m_FramesOut);
+                    SDL_assert(m_FrameInfoCount == m_FramesIn - m_FramesOut);
                     m_FramesOut++;
 
                     // Attach HDR metadata to the frame if it's not already present. We will defer to
                     // any metadata contained in the bitstream itself since that is guaranteed to be
                     // correctly synchronized to each frame, unlike our async HDR metadata message.
-                    SS_HDR_METADATA hdrMetadata;
-                    if (LiGetHdrMetadata(&hdrMetadata)) {
-                        if (av_frame_get_side_data(frame, AV_FRAME_DATA_MASTERING_DISPLAY_METADATA) == nullptr) {
-                            auto mdm = av_mastering_display_metadata_create_side_data(frame);
-
-                            mdm->display_primaries[0][0] = av_make_q(hdrMetadata.displayPrimaries[0].x, 50000);
-                            mdm->display_primaries[0][1] = av_make_q(hdrMetadata.displayPrimaries[0].y, 50000);
-                            mdm->display_primaries[1][0] = av_make_q(hdrMetadata.displayPrimaries[1].x, 50000);
-                            mdm->display_primaries[1][1] = av_make_q(hdrMetadata.displayPrimaries[1].y, 50000);
-                            mdm->display_primaries[2][0] = av_make_q(hdrMetadata.displayPrimaries[2].x, 50000);
-                            mdm->display_primaries[2][1] = av_make_q(hdrMetadata.displayPrimaries[2].y, 50000);
-
-                            mdm->white_point[0] = av_make_q(hdrMetadata.whitePoint.x, 50000);
-                            mdm->white_point[1] = av_make_q(hdrMetadata.whitePoint.y, 50000);
-
-                            mdm->min_luminance = av_make_q(hdrMetadata.minDisplayLuminance, 10000);
-                            mdm->max_luminance = av_make_q(hdrMetadata.maxDisplayLuminance, 1);
-
-                            mdm->has_luminance = hdrMetadata.maxDisplayLuminance != 0 ? 1 : 0;
-                            mdm->has_primaries = hdrMetadata.displayPrimaries[0].x != 0 ? 1 : 0;
-                        }
-
-                        if ((hdrMetadata.maxContentLightLevel != 0 || hdrMetadata.maxFrameAverageLightLevel != 0) &&
-                                av_frame_get_side_data(frame, AV_FRAME_DATA_CONTENT_LIGHT_LEVEL) == nullptr) {
-                            auto clm = av_content_light_metadata_create_side_data(frame);
-
-                            clm->MaxCLL = hdrMetadata.maxContentLightLevel;
-                            clm->MaxFALL = hdrMetadata.maxFrameAverageLightLevel;
-                        }
-                    }
+                    attachHdrMetadata(frame);
 
                     // Some encoders (like RDNA3's AV1 encoder) include excess padding and expect us
                     // to crop it off. If we find our received frame looks close to our requested
@@ -1983,15 +2357,20 @@ void FFmpegVideoDecoder::decoderThreadProc()
                     // Reset failed decodes count if we reached this far
                     m_ConsecutiveFailedDecodes = 0;
 
+                    if (m_RecoveryTier != RecoveryTier::None || s_FullResetStartUs != 0) {
+                        notifyRecoveryProgress();
+                    }
+
                     // Restore default log level after a successful decode
                     av_log_set_level(AV_LOG_INFO);
 
                     // Capture a frame timestamp to measuring pacing delay
                     frame->pkt_dts = LiGetMicroseconds();
 
-                    if (!m_FrameInfoQueue.isEmpty()) {
-                        // Data buffers in the DU are not valid here!
-                        DECODE_UNIT du = m_FrameInfoQueue.dequeue();
+                    if (m_FrameInfoCount > 0) {
+                        const FrameInfo& du = m_FrameInfoRing[m_FrameInfoHead];
+                        m_FrameInfoHead = (m_FrameInfoHead + 1) & (FRAME_INFO_RING_SIZE - 1);
+                        m_FrameInfoCount--;
 
                         // Count time in avcodec_send_packet() and avcodec_receive_frame()
                         // as time spent decoding. Also count time spent in the decode unit
@@ -2000,6 +2379,12 @@ void FFmpegVideoDecoder::decoderThreadProc()
 
                         // Store the presentation time (90 kHz timebase)
                         frame->pts = (int64_t)du.rtpTimestamp;
+
+                        // Tag the frame so later stages can find its timeline entry
+                        frame->opaque = (void*)(intptr_t)du.frameNumber;
+                        Session::get()->getFrameTimeline().recordStage(du.frameNumber,
+                                                                       FrameTimeline::StageReceiveFrame,
+                                                                       (uint64_t)frame->pkt_dts);
                     }
 
                     m_ActiveWndVideoStats.decodedFrames++;
@@ -2030,57 +2415,304 @@ void FFmpegVideoDecoder::decoderThreadProc()
                     m_Pacer->submitFrame(frame);
                 }
                 else if (err == AVERROR(EAGAIN)) {
-                    VIDEO_FRAME_HANDLE handle;
-                    PDECODE_UNIT du;
-
-                    // No output data, so let's try to submit more input data,
-                    // while we're waiting for this to frame to come back.
-                    if (LiPollNextVideoFrame(&handle, &du)) {
-                        // FIXME: Handle EAGAIN on avcodec_send_packet() properly?
-                        LiCompleteVideoFrame(handle, submitDecodeUnit(du));
-                    }
-                    else {
-                        // No output data or input data. Let's wait a little bit.
-                        SDL_Delay(2);
-                    }
+                    // No output data, so let's try to submit more input data while
+                    // we're waiting for this frame to come back. Decoders that finish
+                    // frames asynchronously may produce output without more input,
+                    // so only wait a bounded amount of time before checking again.
+                    // FIXME: Handle EAGAIN on avcodec_send_packet() properly?
+                    waitAndSubmitNextDecodeUnit(player, true);
                 }
                 else {
                     char errorstring[512];
 
-                    // FIXME: Should we pop an entry off m_FrameInfoQueue here?
+                    // FIXME: Should we pop an entry off m_FrameInfoRing here?
 
                     av_strerror(err, errorstring, sizeof(errorstring));
                     SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
                                 "avcodec_receive_frame() failed: %s (frame %d)",
                                 errorstring,
-                                !m_FrameInfoQueue.isEmpty() ? m_FrameInfoQueue.head().frameNumber : -1);
+                                m_FrameInfoCount > 0 ? m_FrameInfoRing[m_FrameInfoHead].frameNumber : -1);
 
                     if (++m_ConsecutiveFailedDecodes == FAILED_DECODES_RESET_THRESHOLD) {
-                        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                                     "Resetting decoder due to consistent failure");
-
-                        SDL_Event event;
-                        event.type = SDL_RENDER_DEVICE_RESET;
-                        SDL_PushEvent(&event);
-
-                        // Don't consume any additional data
-                        SDL_AtomicSet(&m_DecoderThreadShouldQuit, 1);
+                        recoverFromDecoderFailure();
                     }
 
                     // Just in case the error resulted in the loss of the frame,
                     // request an IDR frame to reset our decoder state.
-                    LiRequestIdrFrame();
+                    if (player == nullptr) {
+                        LiRequestIdrFrame();
+                    }
                 }
             } while (err == AVERROR(EAGAIN) && !SDL_AtomicGet(&m_DecoderThreadShouldQuit));
 
             if (err != 0) {
-                // Free the frame if we failed to submit it
-                av_frame_free(&frame);
+                // Return the frame if we failed to submit it
+                m_FramePool.release(&frame);
             }
         }
     }
 }
 
+void FFmpegVideoDecoder::recoverFromDecoderFailure()
+{
+    m_ConsecutiveFailedDecodes = 0;
+    m_FramesSinceRecovery = 0;
+
+    // Keep timing from the first failed tier, since that's when the picture stopped
+    if (m_RecoveryStartUs == 0) {
+        m_RecoveryStartUs = LiGetMicroseconds();
+    }
+
+    switch (m_RecoveryTier) {
+    case RecoveryTier::None:
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Flushing decoder due to consistent failure");
+        m_RecoveryTier = RecoveryTier::Flush;
+
+        avcodec_flush_buffers(m_VideoDecoderCtx);
+        resetDecoderInput();
+        return;
+
+    case RecoveryTier::Flush:
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Recreating decoder context due to consistent failure");
+        m_RecoveryTier = RecoveryTier::RebuildContext;
+
+        // Keep the renderer and Pacer, and just start over with a fresh codec context
+        avcodec_free_context(&m_VideoDecoderCtx);
+        if (openDecoderContext(m_Decoder, m_RequiredPixelFormat, &m_DecoderParams)) {
+            resetDecoderInput();
+            return;
+        }
+
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to recreate decoder context");
+        avcodec_free_context(&m_VideoDecoderCtx);
+        break;
+
+    default:
+        break;
+    }
+
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                 "Resetting decoder due to consistent failure");
+    m_RecoveryTier = RecoveryTier::FullReset;
+    s_FullResetStartUs = m_RecoveryStartUs;
+
+    // Generate a synthetic reset event to trigger the event
+    // loop to destroy and recreate the decoder and renderer.
+    SDL_Event event;
+    event.type = SDL_RENDER_DEVICE_RESET;
+    SDL_PushEvent(&event);
+
+    // Don't consume any additional data
+    SDL_AtomicSet(&m_DecoderThreadShouldQuit, 1);
+}
+
+void FFmpegVideoDecoder::resetDecoderInput()
+{
+    // Nothing queued in the decoder will be coming back out, so start over
+    // as if this was a new stream. submitDecodeUnit() will reject everything
+    // until the next IDR frame arrives.
+    m_FrameInfoHead = m_FrameInfoCount = 0;
+    m_FramesIn = m_FramesOut = 0;
+
+    if (Session::get()->getDecodeUnitPlayer() == nullptr) {
+        LiRequestIdrFrame();
+    }
+}
+
+void FFmpegVideoDecoder::notifyRecoveryProgress()
+{
+    uint64_t nowUs = LiGetMicroseconds();
+
+    // This is our first frame after the previous decoder escalated to a full reset.
+    // Ignore stale timestamps in case that session ended before the reset finished.
+    if (s_FullResetStartUs != 0) {
+        if (nowUs - s_FullResetStartUs < 10000000) {
+            m_RecoveryTier = RecoveryTier::FullReset;
+            m_RecoveryStartUs = s_FullResetStartUs;
+        }
+        s_FullResetStartUs = 0;
+    }
+
+    // This is the first frame decoded since recovery started
+    if (m_RecoveryStartUs != 0) {
+        m_LastRecoveryTier = m_RecoveryTier;
+        m_LastRecoveryTimeUs = nowUs - m_RecoveryStartUs;
+        m_RecoveryStartUs = 0;
+
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Decoder recovered after %s in %.1f ms",
+                    getRecoveryTierName(m_LastRecoveryTier),
+                    m_LastRecoveryTimeUs / 1000.0);
+    }
+
+    // Once things are stable again, the next failure starts back at the cheapest tier
+    if (++m_FramesSinceRecovery >= RECOVERY_STABLE_FRAMES) {
+        m_RecoveryTier = RecoveryTier::None;
+    }
+}
+
+const char* FFmpegVideoDecoder::getRecoveryTierName(RecoveryTier tier)
+{
+    switch (tier) {
+    case RecoveryTier::Flush:
+        return "flush and IDR";
+    case RecoveryTier::RebuildContext:
+        return "decoder context rebuild";
+    case RecoveryTier::FullReset:
+        return "full decoder reset";
+    default:
+        return "none";
+    }
+}
+
+Uint32 FFmpegVideoDecoder::eagainWaitTimerCallback(Uint32, void*)
+{
+    // Ends the decoder thread's wait for a DU
+    LiWakeWaitForVideoFrame();
+    return 0;
+}
+
+// If bounded is true, this waits at most DECODER_EAGAIN_MAX_WAIT_MS for
+// new input and returns false if none arrived in that time.
+bool FFmpegVideoDecoder::waitAndSubmitNextDecodeUnit(DecodeUnitPlayer* player, bool bounded)
+{
+    VIDEO_FRAME_HANDLE handle;
+    PDECODE_UNIT du;
+    bool gotFrame;
+
+    uint64_t waitStartUs = LiGetMicroseconds();
+    if (bounded && player != nullptr) {
+        gotFrame = player->waitForNextDecodeUnit(&du, DECODER_EAGAIN_MAX_WAIT_MS);
+    }
+    else if (bounded) {
+        // The host queue has no timed wait, so block on it with a timer
+        // to wake us if no DU arrives in time. Skip the timer if a DU
+        // is already waiting.
+        gotFrame = LiPollNextVideoFrame(&handle, &du);
+        if (!gotFrame) {
+            SDL_TimerID wakeTimer = SDL_AddTimer(DECODER_EAGAIN_MAX_WAIT_MS, eagainWaitTimerCallback, nullptr);
+            if (wakeTimer != 0) {
+                // A wakeup from a timer that fires after a DU arrived makes
+                // our next wait return early, which is harmless.
+                gotFrame = LiWaitForNextVideoFrame(&handle, &du);
+                SDL_RemoveTimer(wakeTimer);
+            }
+            else {
+                SDL_Delay(DECODER_EAGAIN_MAX_WAIT_MS);
+                gotFrame = LiPollNextVideoFrame(&handle, &du);
+            }
+        }
+    }
+    else if (player != nullptr) {
+        gotFrame = player->waitForNextDecodeUnit(&du);
+    }
+    else {
+        gotFrame = LiWaitForNextVideoFrame(&handle, &du);
+    }
+    addToHistogram(m_WaitTimeHistogram, LiGetMicroseconds() - waitStartUs);
+    m_TotalWaitTimeUs += LiGetMicroseconds() - waitStartUs;
+
+    if (!gotFrame) {
+        return false;
+    }
+
+    uint64_t submitStartUs = LiGetMicroseconds();
+    int drStatus = submitDecodeUnit(du);
+    addToHistogram(m_DecodeTimeHistogram, LiGetMicroseconds() - submitStartUs);
+    m_TotalDecodeTimeUs += LiGetMicroseconds() - submitStartUs;
+
+    if (player != nullptr) {
+        player->completeDecodeUnit(drStatus);
+    }
+    else {
+        LiCompleteVideoFrame(handle, drStatus);
+    }
+
+    return true;
+}
+
+// Returns the upper bound of the histogram bucket containing the given percentile
+uint64_t FFmpegVideoDecoder::getPacerLatencyPercentileUs(const VIDEO_STATS& stats, double percentile)
+{
+    uint32_t samples = 0;
+    for (int i = 0; i < PACER_LATENCY_HISTOGRAM_BUCKETS; i++) {
+        samples += stats.pacerLatencyHistogram[i];
+    }
+
+    uint32_t remaining = (uint32_t)(samples * (1.0 - percentile));
+    for (int i = PACER_LATENCY_HISTOGRAM_BUCKETS - 1; i > 0; i--) {
+        if (stats.pacerLatencyHistogram[i] > remaining) {
+            return (uint64_t)(i + 1) * PACER_LATENCY_HISTOGRAM_BUCKET_US;
+        }
+
+        remaining -= stats.pacerLatencyHistogram[i];
+    }
+
+    return PACER_LATENCY_HISTOGRAM_BUCKET_US;
+}
+
+void FFmpegVideoDecoder::addToHistogram(uint32_t* histogram, uint64_t durationUs)
+{
+    int bucket = 0;
+    uint64_t bucketLimitUs = DECODER_THREAD_HISTOGRAM_MIN_US;
+
+    while (durationUs >= bucketLimitUs && bucket < DECODER_THREAD_HISTOGRAM_BUCKETS - 1) {
+        bucketLimitUs *= 2;
+        bucket++;
+    }
+
+    histogram[bucket]++;
+}
+
+void FFmpegVideoDecoder::logDecoderThreadHistograms()
+{
+    uint64_t totalTimeUs = m_TotalWaitTimeUs + m_TotalDecodeTimeUs;
+    if (totalTimeUs == 0) {
+        return;
+    }
+
+    char histogramStr[512];
+    int offset = 0;
+    uint64_t bucketLimitUs = DECODER_THREAD_HISTOGRAM_MIN_US;
+
+    for (int i = 0; i < DECODER_THREAD_HISTOGRAM_BUCKETS; i++) {
+        int ret;
+
+        if (i == DECODER_THREAD_HISTOGRAM_BUCKETS - 1) {
+            ret = snprintf(&histogramStr[offset], sizeof(histogramStr) - offset,
+                           ">=%.2f ms: %u waits, %u decodes\n",
+                           bucketLimitUs / 2000.0,
+                           m_WaitTimeHistogram[i], m_DecodeTimeHistogram[i]);
+        }
+        else {
+            ret = snprintf(&histogramStr[offset], sizeof(histogramStr) - offset,
+                           "<%.2f ms: %u waits, %u decodes\n",
+                           bucketLimitUs / 1000.0,
+                           m_WaitTimeHistogram[i], m_DecodeTimeHistogram[i]);
+            bucketLimitUs *= 2;
+        }
+        if (ret < 0 || ret >= (int)sizeof(histogramStr) - offset) {
+            SDL_assert(false);
+            break;
+        }
+
+        offset += ret;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "\nDecoder thread time (%.1f%% waiting, %.1f%% decoding)\n------------------\n%s",
+                m_TotalWaitTimeUs * 100.0 / totalTimeUs,
+                m_TotalDecodeTimeUs * 100.0 / totalTimeUs,
+                histogramStr);
+
+    SDL_zero(m_WaitTimeHistogram);
+    SDL_zero(m_DecodeTimeHistogram);
+    m_TotalWaitTimeUs = m_TotalDecodeTimeUs = 0;
+}
+
 int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
 {
     PLENTRY entry = du->bufferList;
@@ -2088,6 +2720,10 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
 
     SDL_assert(m_CurrentTestMode != TestMode::TestFrameOnly);
 
+    if (Session::get()->getDecodeUnitRecorder() != nullptr) {
+        Session::get()->getDecodeUnitRecorder()->record(du);
+    }
+
     // If this is the first frame, reject anything that's not an IDR frame
     if (m_FramesIn == 0 && du->frameType != FRAME_TYPE_IDR) {
         return DR_NEED_IDR;
@@ -2107,19 +2743,29 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
     m_BwTracker.AddBytes(du->fullLength);
 
     // Flip stats windows roughly every second
-    if (LiGetMicroseconds() > m_ActiveWndVideoStats.measurementStartUs + 1000000) {
-        // Update overlay stats if it's enabled
-        if (Session::get()->getOverlayManager().isOverlayEnabled(Overlay::OverlayDebug)) {
-            VIDEO_STATS lastTwoWndStats = {};
-            addVideoStats(m_LastWndVideoStats, lastTwoWndStats);
-            addVideoStats(m_ActiveWndVideoStats, lastTwoWndStats);
-
-            stringifyVideoStats(lastTwoWndStats,
-                                Session::get()->getOverlayManager().getOverlayText(Overlay::OverlayDebug),
-                                Session::get()->getOverlayManager().getOverlayMaxTextLength());
-            Session::get()->getOverlayManager().setOverlayTextUpdated(Overlay::OverlayDebug);
+    bool windowElapsed = LiGetMicroseconds() > m_ActiveWndVideoStats.measurementStartUs + 1000000;
+    if (windowElapsed) {
+        // The adaptive pacing controller runs wherever frames are submitted to
+        // the Pacer, so sample its queue depth here with the rest of the window.
+        if (m_Pacer != nullptr && m_Pacer->getAdaptiveTargetQueueDepth() != 0) {
+            m_ActiveWndVideoStats.pacerQueueDepth = m_Pacer->getQueueDepthLimit();
+            m_ActiveWndVideoStats.pacerTargetQueueDepth = m_Pacer->getAdaptiveTargetQueueDepth();
         }
+    }
 
+    // Update overlay stats if it's enabled
+    if (windowElapsed && Session::get()->getOverlayManager().isOverlayEnabled(Overlay::OverlayDebug)) {
+        VIDEO_STATS lastTwoWndStats = {};
+        addVideoStats(m_LastWndVideoStats, lastTwoWndStats);
+        addVideoStats(m_ActiveWndVideoStats, lastTwoWndStats);
+
+        stringifyVideoStats(lastTwoWndStats,
+                            Session::get()->getOverlayManager().getOverlayText(Overlay::OverlayDebug),
+                            Session::get()->getOverlayManager().getOverlayMaxTextLength());
+        Session::get()->getOverlayManager().setOverlayTextUpdated(Overlay::OverlayDebug);
+    }
+
+    if (windowElapsed) {
         // Accumulate these values into the global stats
         addVideoStats(m_ActiveWndVideoStats, m_GlobalVideoStats);
 
@@ -2150,16 +2796,28 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
         requiredBufferSize += MAX_SPS_EXTRA_SIZE;
     }
 
-    // Ensure the decoder buffer is large enough
-    m_DecodeBuffer.reserve(requiredBufferSize + AV_INPUT_BUFFER_PADDING_SIZE);
+    // Assemble the packet into a refcounted buffer from our pool. Since the
+    // packet is refcounted, avcodec_send_packet() can take a reference rather
+    // than making its own copy, so each frame is copied exactly once.
+    AVBufferRef* packetBuffer = getPacketBuffer(requiredBufferSize);
+    if (packetBuffer == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to allocate packet buffer (%d bytes)",
+                     requiredBufferSize);
+        return DR_NEED_IDR;
+    }
 
     int offset = 0;
     while (entry != nullptr) {
-        writeBuffer(entry, offset);
+        writeBuffer(entry, packetBuffer->data, offset);
         entry = entry->next;
     }
 
-    m_Pkt->data = reinterpret_cast<uint8_t*>(m_DecodeBuffer.data());
+    // FFmpeg requires the padding to be zeroed
+    memset(&packetBuffer->data[offset], 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    m_Pkt->buf = packetBuffer;
+    m_Pkt->data = packetBuffer->data;
     m_Pkt->size = offset;
 
     if (du->frameType == FRAME_TYPE_IDR) {
@@ -2172,10 +2830,17 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
     m_ActiveWndVideoStats.totalReassemblyTimeUs += (du->enqueueTimeUs - du->receiveTimeUs);
 
     uint64_t sendStartUs = LiGetMicroseconds();
+    FrameTimeline& frameTimeline = Session::get()->getFrameTimeline();
+    frameTimeline.beginFrame(du->frameNumber, du->receiveTimeUs, du->enqueueTimeUs);
+    frameTimeline.recordStage(du->frameNumber, FrameTimeline::StageSendPacket, sendStartUs);
     err = avcodec_send_packet(m_VideoDecoderCtx, m_Pkt);
 #ifdef Q_OS_DARWIN
     ml_stat_add(&s_SendPacketStats, (double)(LiGetMicroseconds() - sendStartUs));
 #endif
+
+    // Drop our reference to the packet buffer. The decoder holds its own
+    // reference if it still needs the data.
+    av_packet_unref(m_Pkt);
     if (err < 0) {
         char errorstring[512];
         av_strerror(err, errorstring, sizeof(errorstring));
@@ -2184,25 +2849,31 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
                     errorstring,
                     du->frameNumber);
 
-        // If we've failed a bunch of decodes in a row, the decoder/renderer is
-        // clearly unhealthy, so let's generate a synthetic reset event to trigger
-        // the event loop to destroy and recreate the decoder.
+        // If we've failed a bunch of decodes in a row, the decoder is
+        // clearly unhealthy, so try to recover it.
         if (++m_ConsecutiveFailedDecodes == FAILED_DECODES_RESET_THRESHOLD) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "Resetting decoder due to consistent failure");
-
-            SDL_Event event;
-            event.type = SDL_RENDER_DEVICE_RESET;
-            SDL_PushEvent(&event);
-
-            // Don't consume any additional data
-            SDL_AtomicSet(&m_DecoderThreadShouldQuit, 1);
+            recoverFromDecoderFailure();
         }
 
         return DR_NEED_IDR;
     }
 
-    m_FrameInfoQueue.enqueue(*du);
+    if (m_FrameInfoCount == FRAME_INFO_RING_SIZE) {
+        // This shouldn't happen with any real decoder. Forget the oldest
+        // frame so we don't overwrite the info of one that may still come out.
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Too many frames queued in decoder. Dropping info for frame %d",
+                    m_FrameInfoRing[m_FrameInfoHead].frameNumber);
+        m_FrameInfoHead = (m_FrameInfoHead + 1) & (FRAME_INFO_RING_SIZE - 1);
+        m_FrameInfoCount--;
+        m_FramesOut++;
+    }
+
+    FrameInfo& info = m_FrameInfoRing[(m_FrameInfoHead + m_FrameInfoCount) & (FRAME_INFO_RING_SIZE - 1)];
+    info.frameNumber = du->frameNumber;
+    info.rtpTimestamp = du->rtpTimestamp;
+    info.enqueueTimeUs = du->enqueueTimeUs;
+    m_FrameInfoCount++;
 
     m_FramesIn++;
     return DR_OK;
@@ -1,19 +1,36 @@
 #pragma once
 
 #include <functional>
-#include <QQueue>
 #include <set>
 
 #include "../bandwidth.h"
 #include "decoder.h"
 #include "ffmpeg-renderers/renderer.h"
 #include "ffmpeg-renderers/pacer/pacer.h"
+#include "framepool.h"
 #include "streaming/video/videoenhancement.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
+// Bucket 0 holds durations under 250 us and each bucket after
+// that doubles the bound, with the last bucket being unbounded.
+#define DECODER_THREAD_HISTOGRAM_BUCKETS 8
+#define DECODER_THREAD_HISTOGRAM_MIN_US 250
+
+// Longest time the decoder thread waits for new input after EAGAIN before
+// checking the decoder for output again. The wait ends as soon as a new DU
+// arrives, but some hardware decoders complete frames asynchronously and can
+// produce output without any new input.
+#define DECODER_EAGAIN_MAX_WAIT_MS 1
+
+// Maximum number of frames that can be inside the decoder at once.
+// This must be a power of 2.
+#define FRAME_INFO_RING_SIZE 64
+
+class DecodeUnitPlayer;
+
 class FFmpegVideoDecoder : public IVideoDecoder {
 public:
     FFmpegVideoDecoder(bool testOnly);
@@ -30,6 +47,7 @@ public:
     virtual void renderFrameOnMainThread() override;
     virtual void setHdrMode(bool enabled) override;
     virtual bool notifyWindowChanged(PWINDOW_STATE_CHANGE_INFO info) override;
+    virtual bool startDecoding() override;
 
     virtual IFFmpegRenderer* getBackendRenderer();
 
@@ -61,6 +79,8 @@ private:
 
     bool createFrontendRenderer(PDECODER_PARAMETERS params, bool useAlternateFrontend);
 
+    bool openDecoderContext(const AVCodec* decoder, enum AVPixelFormat requiredFormat, PDECODER_PARAMETERS params);
+
     static
     bool isDecoderMatchForParams(const AVCodec *decoder, PDECODER_PARAMETERS params);
 
@@ -97,20 +117,68 @@ private:
 
     void reset();
 
-    void writeBuffer(PLENTRY entry, int& offset);
+    void attachHdrMetadata(AVFrame* frame);
+
+    void writeBuffer(PLENTRY entry, uint8_t* buffer, int& offset);
+
+    AVBufferRef* getPacketBuffer(int requiredSize);
+
+#if FF_API_BUFFER_SIZE_T
+    static AVBufferRef* allocPacketBuffer(void* opaque, int size);
+#else
+    static AVBufferRef* allocPacketBuffer(void* opaque, size_t size);
+#endif
 
     static
     enum AVPixelFormat ffGetFormat(AVCodecContext* context,
                                    const enum AVPixelFormat* pixFmts);
 
+    static
+    int ffGetBuffer2(AVCodecContext* context, AVFrame* frame, int flags);
+
     void decoderThreadProc();
 
+    bool waitAndSubmitNextDecodeUnit(DecodeUnitPlayer* player, bool bounded);
+
+    enum class RecoveryTier {
+        None,
+
+        // Flush the decoder and wait for an IDR frame
+        Flush,
+
+        // Recreate the codec context while keeping the renderer and Pacer
+        RebuildContext,
+
+        // Tear down and recreate the whole decoder from Session
+        FullReset
+    };
+
+    void recoverFromDecoderFailure();
+
+    void resetDecoderInput();
+
+    void notifyRecoveryProgress();
+
+    static
+    const char* getRecoveryTierName(RecoveryTier tier);
+
+    static
+    void addToHistogram(uint32_t* histogram, uint64_t durationUs);
+
+    static
+    uint64_t getPacerLatencyPercentileUs(const VIDEO_STATS& stats, double percentile);
+
+    void logDecoderThreadHistograms();
+
     static int decoderThreadProcThunk(void* context);
 
+    static Uint32 eagainWaitTimerCallback(Uint32 interval, void* param);
+
     AVPacket* m_Pkt;
     AVCodecContext* m_VideoDecoderCtx;
     enum AVPixelFormat m_RequiredPixelFormat;
-    QByteArray m_DecodeBuffer;
+    AVBufferPool* m_PacketBufferPool;
+    int m_PacketBufferPoolSize;
     const AVCodecHWConfig* m_HwDecodeCfg;
     IFFmpegRenderer* m_BackendRenderer;
     IFFmpegRenderer* m_FrontendRenderer;
@@ -137,8 +205,41 @@ private:
     SDL_atomic_t m_DecoderThreadShouldQuit;
     VideoEnhancement* m_VideoEnhancement;
 
-    // Data buffers in the queued DU are not valid
-    QQueue<DECODE_UNIT> m_FrameInfoQueue;
+    // The parts of each submitted DU we need once its frame is decoded
+    struct FrameInfo {
+        int frameNumber;
+        unsigned int rtpTimestamp;
+        uint64_t enqueueTimeUs;
+    };
+
+    FrameInfo m_FrameInfoRing[FRAME_INFO_RING_SIZE];
+    int m_FrameInfoHead;
+    int m_FrameInfoCount;
+
+    // Must outlive the Pacer, which returns frames to it
+    FramePool m_FramePool;
+
+    // HDR side data shared by all frames until the host's metadata changes
+    SS_HDR_METADATA m_HdrMetadata;
+    AVBufferRef* m_MasteringDisplayBuf;
+    AVBufferRef* m_ContentLightBuf;
+
+    // Per-session histograms of decoder thread time spent blocked waiting
+    // for input versus time spent inside the decoder
+    uint32_t m_WaitTimeHistogram[DECODER_THREAD_HISTOGRAM_BUCKETS];
+    uint32_t m_DecodeTimeHistogram[DECODER_THREAD_HISTOGRAM_BUCKETS];
+    uint64_t m_TotalWaitTimeUs;
+    uint64_t m_TotalDecodeTimeUs;
+
+    // Retained to recreate the codec context during soft recovery
+    const AVCodec* m_Decoder;
+    DECODER_PARAMETERS m_DecoderParams;
+
+    RecoveryTier m_RecoveryTier;
+    uint64_t m_RecoveryStartUs;
+    int m_FramesSinceRecovery;
+    RecoveryTier m_LastRecoveryTier;
+    uint64_t m_LastRecoveryTimeUs;
 
     static const uint8_t k_H264TestFrame[];
     static const uint8_t k_HEVCMainTestFrame[];
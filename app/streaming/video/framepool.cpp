@@ -0,0 +1,45 @@
+#include "framepool.h"
+
+FramePool::FramePool()
+    : m_FrameCount(0)
+{
+}
+
+FramePool::~FramePool()
+{
+    while (m_FrameCount > 0) {
+        av_frame_free(&m_Frames[--m_FrameCount]);
+    }
+}
+
+AVFrame* FramePool::take()
+{
+    QMutexLocker locker(&m_Lock);
+
+    if (m_FrameCount == 0) {
+        return nullptr;
+    }
+
+    return m_Frames[--m_FrameCount];
+}
+
+void FramePool::release(AVFrame** frame)
+{
+    if (*frame == nullptr) {
+        return;
+    }
+
+    // Drop the frame's buffers outside the lock since this
+    // may call back into the decoder or the GPU driver.
+    av_frame_unref(*frame);
+
+    m_Lock.lock();
+    if (m_FrameCount < FRAME_POOL_CAPACITY) {
+        m_Frames[m_FrameCount++] = *frame;
+        *frame = nullptr;
+    }
+    m_Lock.unlock();
+
+    // The pool is full, so just free it
+    av_frame_free(frame);
+}
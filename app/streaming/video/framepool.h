@@ -0,0 +1,34 @@
+#pragma once
+
+#include <QMutex>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// Maximum number of idle frame shells kept around for reuse. This only needs
+// to cover the frames in flight between the decoder and the Pacer.
+#define FRAME_POOL_CAPACITY 16
+
+// Recycles empty AVFrame shells between the decoder thread and the Pacer, so
+// a warm stream doesn't need to heap allocate a new AVFrame for each frame.
+// Frames are unreferenced when they are returned, which releases their data
+// buffers back to the decoder (or hwframe pool) just like av_frame_free().
+class FramePool
+{
+public:
+    FramePool();
+
+    ~FramePool();
+
+    // Returns an idle frame shell or nullptr if the pool is empty
+    AVFrame* take();
+
+    // Unreferences the frame and keeps the shell for reuse (or frees it if the pool is full)
+    void release(AVFrame** frame);
+
+private:
+    QMutex m_Lock;
+    AVFrame* m_Frames[FRAME_POOL_CAPACITY];
+    int m_FrameCount;
+};
@@ -0,0 +1,146 @@
+#include "frametimeline.h"
+#include "path.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+
+#include "SDL_compat.h"
+
+static_assert((FRAME_TIMELINE_CAPACITY & (FRAME_TIMELINE_CAPACITY - 1)) == 0,
+              "FRAME_TIMELINE_CAPACITY must be a power of 2");
+
+// Each span covers the interval between two stages and is drawn on its own track
+static const struct {
+    const char* name;
+    int tid;
+    FrameTimeline::Stage start;
+    FrameTimeline::Stage end;
+} k_Spans[] = {
+    { "Reassembly", 1, FrameTimeline::StageReceive, FrameTimeline::StageReassemblyDone },
+    { "Decode queue", 2, FrameTimeline::StageReassemblyDone, FrameTimeline::StageSendPacket },
+    { "Decode", 2, FrameTimeline::StageSendPacket, FrameTimeline::StageReceiveFrame },
+    { "Pacing", 3, FrameTimeline::StagePacerEnqueue, FrameTimeline::StageRenderStart },
+    { "Render", 4, FrameTimeline::StageRenderStart, FrameTimeline::StagePresent },
+};
+
+static const char* k_TrackNames[] = { nullptr, "Network", "Decoder", "Pacer", "Renderer" };
+
+FrameTimeline::FrameTimeline()
+{
+    for (Entry& entry : m_Entries) {
+        entry.frameNumber.store(-1, std::memory_order_relaxed);
+        for (std::atomic<uint64_t>& stageTime : entry.stageTimeUs) {
+            stageTime.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void FrameTimeline::beginFrame(int frameNumber, uint64_t receiveTimeUs, uint64_t reassemblyDoneTimeUs)
+{
+    Entry& entry = m_Entries[frameNumber & (FRAME_TIMELINE_CAPACITY - 1)];
+
+    // Invalidate the slot while we clear it so late writes for the evicted frame are ignored
+    entry.frameNumber.store(-1, std::memory_order_release);
+    for (std::atomic<uint64_t>& stageTime : entry.stageTimeUs) {
+        stageTime.store(0, std::memory_order_relaxed);
+    }
+    entry.stageTimeUs[StageReceive].store(receiveTimeUs, std::memory_order_relaxed);
+    entry.stageTimeUs[StageReassemblyDone].store(reassemblyDoneTimeUs, std::memory_order_relaxed);
+    entry.frameNumber.store(frameNumber, std::memory_order_release);
+}
+
+void FrameTimeline::recordStage(int frameNumber, Stage stage, uint64_t timeUs)
+{
+    Entry& entry = m_Entries[frameNumber & (FRAME_TIMELINE_CAPACITY - 1)];
+
+    if (entry.frameNumber.load(std::memory_order_acquire) == frameNumber) {
+        entry.stageTimeUs[stage].store(timeUs, std::memory_order_relaxed);
+    }
+}
+
+QString FrameTimeline::getDefaultDumpPath()
+{
+    QString path = qEnvironmentVariable("FRAME_TIMELINE_FILE");
+    if (!path.isEmpty()) {
+        return path;
+    }
+
+    return QDir(Path::getLogDir()).filePath(
+                QString("frame-timeline-%1.json").arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss")));
+}
+
+bool FrameTimeline::dumpChromeTrace(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to open frame timeline file %s: %s",
+                     qPrintable(path),
+                     qPrintable(file.errorString()));
+        return false;
+    }
+
+    QTextStream out(&file);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    // Name the tracks
+    bool first = true;
+    for (int tid = 1; tid < (int)SDL_arraysize(k_TrackNames); tid++) {
+        out << (first ? "" : ",\n")
+            << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+            << ",\"args\":{\"name\":\"" << k_TrackNames[tid] << "\"}}";
+        first = false;
+    }
+
+    int frames = 0;
+    for (Entry& entry : m_Entries) {
+        int frameNumber = entry.frameNumber.load(std::memory_order_acquire);
+        if (frameNumber < 0) {
+            continue;
+        }
+
+        uint64_t stageTimeUs[StageMax];
+        for (int i = 0; i < StageMax; i++) {
+            stageTimeUs[i] = entry.stageTimeUs[i].load(std::memory_order_relaxed);
+        }
+
+        for (const auto& span : k_Spans) {
+            uint64_t startUs = stageTimeUs[span.start];
+            uint64_t endUs = stageTimeUs[span.end];
+
+            // Skip stages the frame never reached (dropped, still in flight, etc)
+            if (startUs == 0 || endUs < startUs) {
+                continue;
+            }
+
+            out << ",\n{\"name\":\"" << span.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << span.tid
+                << ",\"ts\":" << startUs << ",\"dur\":" << (endUs - startUs)
+                << ",\"args\":{\"frame\":" << frameNumber;
+            if (span.end == StagePresent) {
+                out << ",\"endToEndUs\":" << (endUs - stageTimeUs[StageReceive]);
+            }
+            out << "}}";
+        }
+
+        frames++;
+    }
+
+    out << "\n]}\n";
+    out.flush();
+
+    if (file.error() != QFileDevice::NoError) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to write frame timeline file %s: %s",
+                     qPrintable(path),
+                     qPrintable(file.errorString()));
+        return false;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Wrote timeline of %d frames to %s",
+                frames,
+                qPrintable(path));
+    return true;
+}
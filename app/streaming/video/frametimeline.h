@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QString>
+
+#include <atomic>
+#include <cstdint>
+
+// Number of frames kept in the timeline. This must be a power of 2.
+#define FRAME_TIMELINE_CAPACITY 4096
+
+// Records per-frame timestamps for each stage of the video pipeline into a
+// fixed ring indexed by frame number. Each stage is written by a single thread
+// (network/decoder/render), so recording is just a handful of relaxed atomic
+// stores and never blocks. Dumping may observe a frame that is being recycled,
+// which is fine for a diagnostic tool.
+class FrameTimeline
+{
+public:
+    enum Stage {
+        StageReceive,           // First packet of the frame received
+        StageReassemblyDone,    // Frame fully reassembled by moonlight-common-c
+        StageSendPacket,        // Submitted to avcodec_send_packet()
+        StageReceiveFrame,      // Returned from avcodec_receive_frame()
+        StagePacerEnqueue,      // Submitted to the Pacer
+        StageRenderStart,       // Passed to the renderer
+        StagePresent,           // Renderer returned from presenting the frame
+        StageMax
+    };
+
+    FrameTimeline();
+
+    // Starts a new timeline entry, evicting any older frame in the same slot
+    void beginFrame(int frameNumber, uint64_t receiveTimeUs, uint64_t reassemblyDoneTimeUs);
+
+    void recordStage(int frameNumber, Stage stage, uint64_t timeUs);
+
+    // Writes all frames currently in the ring as Chrome trace-event JSON
+    bool dumpChromeTrace(const QString& path);
+
+    // Path from FRAME_TIMELINE_FILE, or a timestamped file in the log directory
+    static QString getDefaultDumpPath();
+
+private:
+    struct Entry {
+        std::atomic<int> frameNumber;
+        std::atomic<uint64_t> stageTimeUs[StageMax];
+    };
+
+    Entry m_Entries[FRAME_TIMELINE_CAPACITY];
+};
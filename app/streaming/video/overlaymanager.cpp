@@ -37,6 +37,11 @@ OverlayManager::~OverlayManager()
         if (m_Overlays[i].surface != nullptr) {
             SDL_FreeSurface(m_Overlays[i].surface);
         }
+        delete m_Overlays[i].batch;
+        delete m_Overlays[i].freeBatch;
+        if (m_Overlays[i].atlas != nullptr) {
+            SDL_FreeSurface(m_Overlays[i].atlas);
+        }
         if (m_Overlays[i].font != nullptr) {
             TTF_CloseFont(m_Overlays[i].font);
         }
@@ -86,6 +91,23 @@ SDL_Surface* OverlayManager::getUpdatedOverlaySurface(OverlayType type)
     return (SDL_Surface*)SDL_AtomicSetPtr((void**)&m_Overlays[type].surface, nullptr);
 }
 
+GlyphBatch* OverlayManager::getUpdatedOverlayGlyphBatch(OverlayType type)
+{
+    // If a new batch is available, return it. If not, return nullptr.
+    // Caller must pass the batch to releaseOverlayGlyphBatch() on success.
+    return (GlyphBatch*)SDL_AtomicSetPtr((void**)&m_Overlays[type].batch, nullptr);
+}
+
+void OverlayManager::releaseOverlayGlyphBatch(OverlayType type, GlyphBatch* batch)
+{
+    if (batch == nullptr) {
+        return;
+    }
+
+    // Keep one spare batch per overlay and free any other
+    delete (GlyphBatch*)SDL_AtomicSetPtr((void**)&m_Overlays[type].freeBatch, batch);
+}
+
 void OverlayManager::setOverlayTextUpdated(OverlayType type)
 {
     // Only update the overlay state if it's enabled. If it's not enabled,
@@ -149,22 +171,222 @@ void OverlayManager::notifyOverlayUpdated(OverlayType type)
         }
     }
 
-    // Exchange the old surface with the new one
-    SDL_Surface* oldSurface = (SDL_Surface*)SDL_AtomicSetPtr(
-        (void**)&m_Overlays[type].surface,
-        m_Overlays[type].enabled ?
-            // The _Wrapped variant is required for line breaks to work
-            TTF_RenderText_Blended_Wrapped(m_Overlays[type].font,
-                                           m_Overlays[type].text,
-                                           m_Overlays[type].color,
-                                           1024)
-            : nullptr);
+    // Rasterize the glyphs once, so text updates only need to copy them
+    if (m_Overlays[type].atlas == nullptr && !createGlyphAtlas(type)) {
+        return;
+    }
+
+    GlyphBatch* newBatch = m_Overlays[type].enabled ? layoutOverlayText(type) : nullptr;
+
+    if (m_Renderer->supportsOverlayGlyphBatches()) {
+        // Exchange the old batch with the new one
+        GlyphBatch* oldBatch = (GlyphBatch*)SDL_AtomicSetPtr((void**)&m_Overlays[type].batch, newBatch);
+
+        // Notify the renderer
+        m_Renderer->notifyOverlayUpdated(type);
+
+        // Recycle the old batch if the renderer never picked it up
+        releaseOverlayGlyphBatch(type, oldBatch);
+    }
+    else {
+        // Exchange the old surface with the new one
+        SDL_Surface* oldSurface = (SDL_Surface*)SDL_AtomicSetPtr(
+            (void**)&m_Overlays[type].surface,
+            newBatch ? renderGlyphBatch(type, newBatch) : nullptr);
+        releaseOverlayGlyphBatch(type, newBatch);
+
+        // Notify the renderer
+        m_Renderer->notifyOverlayUpdated(type);
+
+        // Free the old surface
+        if (oldSurface != nullptr) {
+            SDL_FreeSurface(oldSurface);
+        }
+    }
+}
+
+bool OverlayManager::createGlyphAtlas(OverlayType type)
+{
+    auto& overlay = m_Overlays[type];
+    SDL_Surface* glyphs[OVERLAY_ATLAS_GLYPH_COUNT] = {};
+    int atlasHeight = 0;
+    int x = 0;
+    int rowHeight = 0;
+
+    // Render each glyph and pack them into rows
+    for (int i = 0; i < OVERLAY_ATLAS_GLYPH_COUNT; i++) {
+        Uint16 ch = OVERLAY_ATLAS_FIRST_GLYPH + i;
+        int minX, maxX, minY, maxY;
+
+        if (TTF_GlyphMetrics(overlay.font, ch, &minX, &maxX, &minY, &maxY, &overlay.glyphAdvances[i]) != 0) {
+            overlay.glyphAdvances[i] = 0;
+        }
+
+        // Glyphs with nothing to draw (like space) only advance the pen
+        glyphs[i] = TTF_RenderGlyph_Blended(overlay.font, ch, overlay.color);
+        if (glyphs[i] == nullptr) {
+            overlay.glyphRects[i] = {};
+            continue;
+        }
+
+        if (x + glyphs[i]->w > OVERLAY_MAX_WIDTH) {
+            atlasHeight += rowHeight;
+            x = 0;
+            rowHeight = 0;
+        }
+
+        overlay.glyphRects[i] = { x, atlasHeight, glyphs[i]->w, glyphs[i]->h };
+        x += glyphs[i]->w;
+        rowHeight = SDL_max(rowHeight, glyphs[i]->h);
+    }
+    atlasHeight += rowHeight;
+
+    SDL_Surface* atlas = atlasHeight > 0 ?
+                SDL_CreateRGBSurfaceWithFormat(0, OVERLAY_MAX_WIDTH, atlasHeight, 32, SDL_PIXELFORMAT_ARGB8888) :
+                nullptr;
+    if (atlas == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to create overlay glyph atlas: %s",
+                     SDL_GetError());
+    }
+    else {
+        // Copy the glyphs in without blending
+        for (int i = 0; i < OVERLAY_ATLAS_GLYPH_COUNT; i++) {
+            if (glyphs[i] != nullptr) {
+                SDL_Rect dstRect = overlay.glyphRects[i];
+                SDL_SetSurfaceBlendMode(glyphs[i], SDL_BLENDMODE_NONE);
+                SDL_BlitSurface(glyphs[i], nullptr, atlas, &dstRect);
+            }
+        }
+
+        // Overlapping glyphs (like italics or kerned pairs) must blend
+        // together when they're copied into overlay surfaces
+        SDL_SetSurfaceBlendMode(atlas, SDL_BLENDMODE_BLEND);
+    }
+
+    for (int i = 0; i < OVERLAY_ATLAS_GLYPH_COUNT; i++) {
+        if (glyphs[i] != nullptr) {
+            SDL_FreeSurface(glyphs[i]);
+        }
+    }
+
+    overlay.atlas = atlas;
+    return atlas != nullptr;
+}
+
+static int getAtlasGlyphIndex(char c)
+{
+    int glyph = (unsigned char)c;
+    if (glyph < OVERLAY_ATLAS_FIRST_GLYPH || glyph > OVERLAY_ATLAS_LAST_GLYPH) {
+        glyph = '?';
+    }
+    return glyph - OVERLAY_ATLAS_FIRST_GLYPH;
+}
+
+int OverlayManager::measureOverlayWord(OverlayType type, const char* word)
+{
+    auto& overlay = m_Overlays[type];
+    Uint16 prevCh = 0;
+    int width = 0;
+
+    for (const char* c = word; *c != '\0' && *c != ' ' && *c != '\n'; c++) {
+        int glyph = getAtlasGlyphIndex(*c);
+        Uint16 ch = OVERLAY_ATLAS_FIRST_GLYPH + glyph;
+
+        if (prevCh != 0) {
+            width += TTF_GetFontKerningSizeGlyphs(overlay.font, prevCh, ch);
+        }
+        width += overlay.glyphAdvances[glyph];
+        prevCh = ch;
+    }
+
+    return width;
+}
 
-    // Notify the renderer
-    m_Renderer->notifyOverlayUpdated(type);
+GlyphBatch* OverlayManager::layoutOverlayText(OverlayType type)
+{
+    auto& overlay = m_Overlays[type];
+    int lineSkip = TTF_FontLineSkip(overlay.font);
+    int penX = 0, penY = 0;
+    Uint16 prevCh = 0;
 
-    // Free the old surface
-    if (oldSurface != nullptr) {
-        SDL_FreeSurface(oldSurface);
+    // Reuse a batch the renderer is done with, so the debug overlay
+    // doesn't allocate each time its text changes
+    GlyphBatch* batch = (GlyphBatch*)SDL_AtomicSetPtr((void**)&overlay.freeBatch, nullptr);
+    if (batch == nullptr) {
+        batch = new GlyphBatch();
     }
+    batch->atlas = overlay.atlas;
+    batch->width = 0;
+    batch->height = 0;
+    batch->quads.clear();
+
+    for (const char* c = overlay.text; *c != '\0'; c++) {
+        if (*c == '\n') {
+            penX = 0;
+            penY += lineSkip;
+            prevCh = 0;
+            continue;
+        }
+
+        // Wrap long lines at the start of the word that doesn't fit,
+        // like TTF_RenderText_Blended_Wrapped() did
+        if (penX > 0 && *c != ' ' && c[-1] == ' ' &&
+                penX + measureOverlayWord(type, c) > OVERLAY_MAX_WIDTH) {
+            penX = 0;
+            penY += lineSkip;
+            prevCh = 0;
+        }
+
+        int glyph = getAtlasGlyphIndex(*c);
+        Uint16 ch = OVERLAY_ATLAS_FIRST_GLYPH + glyph;
+        int kerning = prevCh != 0 ? TTF_GetFontKerningSizeGlyphs(overlay.font, prevCh, ch) : 0;
+
+        // Words too long for a line of their own are broken where they overflow
+        if (penX > 0 && penX + kerning + overlay.glyphAdvances[glyph] > OVERLAY_MAX_WIDTH) {
+            penX = 0;
+            penY += lineSkip;
+            kerning = 0;
+        }
+        penX += kerning;
+
+        const SDL_Rect& src = overlay.glyphRects[glyph];
+        if (src.w > 0 && src.h > 0) {
+            batch->quads.push_back({ src, { penX, penY, src.w, src.h } });
+            batch->width = SDL_max(batch->width, penX + src.w);
+            batch->height = SDL_max(batch->height, penY + src.h);
+        }
+
+        penX += overlay.glyphAdvances[glyph];
+        prevCh = ch;
+    }
+
+    return batch;
+}
+
+SDL_Surface* OverlayManager::renderGlyphBatch(OverlayType type, GlyphBatch* batch)
+{
+    if (batch->quads.empty()) {
+        return nullptr;
+    }
+
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, batch->width, batch->height, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (surface == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_CreateRGBSurfaceWithFormat() failed: %s",
+                     SDL_GetError());
+        return nullptr;
+    }
+
+    // Clear to the text color rather than transparent black, so blending
+    // the antialiased glyph edges in doesn't darken them
+    SDL_Color color = m_Overlays[type].color;
+    SDL_FillRect(surface, nullptr, SDL_MapRGBA(surface->format, color.r, color.g, color.b, 0));
+
+    for (const auto& quad : batch->quads) {
+        SDL_Rect dstRect = quad.dst;
+        SDL_BlitSurface(batch->atlas, &quad.src, surface, &dstRect);
+    }
+
+    return surface;
 }
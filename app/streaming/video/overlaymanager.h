@@ -2,9 +2,19 @@
 
 #include <QString>
 
+#include <vector>
+
 #include "SDL_compat.h"
 #include <SDL_ttf.h>
 
+// Printable ASCII characters are prerendered into each overlay's glyph atlas
+#define OVERLAY_ATLAS_FIRST_GLYPH 0x20
+#define OVERLAY_ATLAS_LAST_GLYPH 0x7E
+#define OVERLAY_ATLAS_GLYPH_COUNT (OVERLAY_ATLAS_LAST_GLYPH - OVERLAY_ATLAS_FIRST_GLYPH + 1)
+
+// Width of the glyph atlas and the point where long lines wrap
+#define OVERLAY_MAX_WIDTH 1024
+
 namespace Overlay {
 
 enum OverlayType {
@@ -14,12 +24,36 @@ enum OverlayType {
     OverlayMax
 };
 
+struct GlyphQuad {
+    // Glyph location in the atlas
+    SDL_Rect src;
+
+    // Glyph location relative to the top left of the overlay
+    SDL_Rect dst;
+};
+
+// Overlay text laid out as quads copied from the overlay's glyph atlas
+struct GlyphBatch {
+    // Owned by the OverlayManager and never changes once created
+    SDL_Surface* atlas;
+
+    int width;
+    int height;
+    std::vector<GlyphQuad> quads;
+};
+
 class IOverlayRenderer
 {
 public:
     virtual ~IOverlayRenderer() = default;
 
     virtual void notifyOverlayUpdated(OverlayType type) = 0;
+
+    // Renderers that can draw glyph batches themselves will receive them
+    // from getUpdatedOverlayGlyphBatch() instead of overlay surfaces
+    virtual bool supportsOverlayGlyphBatches() {
+        return false;
+    }
 };
 
 class OverlayManager
@@ -37,20 +71,36 @@ public:
     SDL_Color getOverlayColor(OverlayType type);
     int getOverlayFontSize(OverlayType type);
     SDL_Surface* getUpdatedOverlaySurface(OverlayType type);
+    GlyphBatch* getUpdatedOverlayGlyphBatch(OverlayType type);
+
+    // Hands a batch from getUpdatedOverlayGlyphBatch() back once the renderer
+    // is done with it, so the next layout can reuse its storage
+    void releaseOverlayGlyphBatch(OverlayType type, GlyphBatch* batch);
 
     void setOverlayRenderer(IOverlayRenderer* renderer);
 
 private:
     void notifyOverlayUpdated(OverlayType type);
+    bool createGlyphAtlas(OverlayType type);
+    GlyphBatch* layoutOverlayText(OverlayType type);
+    int measureOverlayWord(OverlayType type, const char* word);
+    SDL_Surface* renderGlyphBatch(OverlayType type, GlyphBatch* batch);
 
     struct {
         bool enabled;
         int fontSize;
         SDL_Color color;
-        char text[1024];
+        char text[2048];
 
         TTF_Font* font;
         SDL_Surface* surface;
+        GlyphBatch* batch;
+        GlyphBatch* freeBatch;
+
+        // Built once when the font is loaded
+        SDL_Surface* atlas;
+        SDL_Rect glyphRects[OVERLAY_ATLAS_GLYPH_COUNT];
+        int glyphAdvances[OVERLAY_ATLAS_GLYPH_COUNT];
     } m_Overlays[OverlayMax];
     IOverlayRenderer* m_Renderer;
     QByteArray m_FontData;
@@ -0,0 +1,179 @@
+#include "probescheduler.h"
+#include "streaming/session.h"
+#include "utils.h"
+
+#include <QRunnable>
+#include <QThread>
+
+#ifdef HAVE_FFMPEG
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+#endif
+
+// There are only a handful of codecs to check
+#define MAX_CONCURRENT_CHECKS 3
+
+class DecoderCheckTask : public QRunnable
+{
+public:
+    DecoderCheckTask(DecoderProbeScheduler* scheduler, int videoFormat)
+        : m_Scheduler(scheduler),
+          m_VideoFormat(videoFormat)
+    {
+    }
+
+private:
+    void run() override
+    {
+        m_Scheduler->runCodecCheck(m_VideoFormat);
+    }
+
+    DecoderProbeScheduler* m_Scheduler;
+    int m_VideoFormat;
+};
+
+DecoderProbeScheduler::DecoderProbeScheduler(SDL_Window* sharedWindow)
+    : m_SharedWindow(sharedWindow)
+{
+    int maxChecks;
+
+    if (!Utils::getEnvironmentVariableOverride("DECODER_PROBE_THREADS", &maxChecks)) {
+        maxChecks = qBound(1, QThread::idealThreadCount(), MAX_CONCURRENT_CHECKS);
+    }
+
+    m_ThreadPool.setMaxThreadCount(qMax(1, maxChecks));
+}
+
+DecoderProbeScheduler::~DecoderProbeScheduler()
+{
+    waitForDone();
+
+    // Write all new results at once rather than once per probe
+    DecoderCapabilityCache::get().flush();
+}
+
+void DecoderProbeScheduler::waitForDone()
+{
+    m_ThreadPool.waitForDone();
+}
+
+QString DecoderProbeScheduler::getProbeKey(StreamingPreferences::VideoDecoderSelection vds,
+                                           int videoFormat, int width, int height, int frameRate,
+                                           bool enableVideoEnhancement)
+{
+    return QString("%1/%2/%3x%4x%5/%6")
+            .arg(vds)
+            .arg(videoFormat, 0, 16)
+            .arg(width).arg(height).arg(frameRate)
+            .arg(enableVideoEnhancement);
+}
+
+bool DecoderProbeScheduler::hasFFmpegDecoder(int videoFormat)
+{
+#if defined(HAVE_FFMPEG) && !defined(HAVE_SLVIDEO)
+    AVCodecID codecId;
+
+    if (videoFormat & VIDEO_FORMAT_MASK_H264) {
+        codecId = AV_CODEC_ID_H264;
+    }
+    else if (videoFormat & VIDEO_FORMAT_MASK_H265) {
+        codecId = AV_CODEC_ID_HEVC;
+    }
+    else if (videoFormat & VIDEO_FORMAT_MASK_AV1) {
+        codecId = AV_CODEC_ID_AV1;
+    }
+    else {
+        return true;
+    }
+
+    // Only FFmpeg can decode this format, so a test
+    // decoder can't succeed if FFmpeg has no decoder.
+    const AVCodec* decoder;
+    void* it = nullptr;
+    while ((decoder = av_codec_iterate(&it))) {
+        if (decoder->id == codecId && av_codec_is_decoder(decoder)) {
+            return true;
+        }
+    }
+
+    return false;
+#else
+    // Other decoders may handle this format
+    Q_UNUSED(videoFormat);
+    return true;
+#endif
+}
+
+void DecoderProbeScheduler::runCodecCheck(int videoFormat)
+{
+    bool hasDecoder = hasFFmpegDecoder(videoFormat);
+
+    QMutexLocker locker(&m_Lock);
+
+    m_CodecChecks[videoFormat].hasDecoder = hasDecoder;
+    m_CodecChecks[videoFormat].done = true;
+    m_StateChanged.wakeAll();
+}
+
+void DecoderProbeScheduler::prefetch(StreamingPreferences::VideoDecoderSelection,
+                                     int videoFormat, int, int, int, bool)
+{
+    QMutexLocker locker(&m_Lock);
+
+    if (m_CodecChecks.contains(videoFormat)) {
+        return;
+    }
+
+    m_CodecChecks.insert(videoFormat, CodecCheckState { false, false });
+    m_ThreadPool.start(new DecoderCheckTask(this, videoFormat));
+}
+
+bool DecoderProbeScheduler::probe(StreamingPreferences::VideoDecoderSelection vds,
+                                  int videoFormat, int width, int height, int frameRate,
+                                  bool enableVideoEnhancement, DecoderProbeResult& result)
+{
+    QString key = getProbeKey(vds, videoFormat, width, height, frameRate, enableVideoEnhancement);
+    bool hasDecoder;
+
+    m_Lock.lock();
+    auto it = m_Probes.constFind(key);
+    if (it != m_Probes.constEnd()) {
+        result = *it;
+        m_Lock.unlock();
+        return result.available;
+    }
+
+    if (m_CodecChecks.contains(videoFormat)) {
+        while (!m_CodecChecks[videoFormat].done) {
+            m_StateChanged.wait(&m_Lock);
+        }
+        hasDecoder = m_CodecChecks[videoFormat].hasDecoder;
+        m_Lock.unlock();
+    }
+    else {
+        m_Lock.unlock();
+
+        // Nobody asked for this one ahead of time, so check it on this thread
+        hasDecoder = hasFFmpegDecoder(videoFormat);
+    }
+
+    if (hasDecoder) {
+        // This creates a renderer on the shared window, so it must run on this thread
+        Session::probeDecoder(vds, m_SharedWindow, videoFormat, width, height, frameRate,
+                              enableVideoEnhancement, result);
+    }
+    else {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "No FFmpeg decoder for video format 0x%x",
+                    videoFormat);
+        result = {};
+        result.available = false;
+    }
+
+    m_Lock.lock();
+    m_Probes.insert(key, result);
+    m_Lock.unlock();
+
+    return result.available;
+}
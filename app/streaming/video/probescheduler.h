@@ -0,0 +1,69 @@
+#pragma once
+
+#include "capabilitycache.h"
+#include "settings/streamingpreferences.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include "SDL_compat.h"
+
+// Schedules test-only decoder probes for Session.
+//
+// Renderers bind to the test window (EGL surfaces, swapchains, etc) and many
+// platforms only allow SDL video calls from one thread, so every probe that
+// creates a decoder runs serially on the calling thread with the shared test
+// window.
+//
+// The only work done concurrently is a pure FFmpeg check for whether any
+// decoder exists for a prefetched format. It doesn't touch SDL or the window,
+// and lets probe() skip the full test decoder for formats that FFmpeg can't
+// decode at all.
+//
+// Set DECODER_PROBE_THREADS to override the number of concurrent checks.
+class DecoderProbeScheduler
+{
+public:
+    explicit DecoderProbeScheduler(SDL_Window* sharedWindow);
+
+    // Waits for outstanding checks and saves new probe
+    // results to the capability cache
+    ~DecoderProbeScheduler();
+
+    // Starts the FFmpeg decoder check for a probe in the background
+    void prefetch(StreamingPreferences::VideoDecoderSelection vds,
+                  int videoFormat, int width, int height, int frameRate,
+                  bool enableVideoEnhancement);
+
+    // Returns the result of a probe, running it on this thread if needed
+    bool probe(StreamingPreferences::VideoDecoderSelection vds,
+               int videoFormat, int width, int height, int frameRate,
+               bool enableVideoEnhancement, DecoderProbeResult& result);
+
+    void waitForDone();
+
+private:
+    friend class DecoderCheckTask;
+
+    struct CodecCheckState {
+        bool done;
+        bool hasDecoder;
+    };
+
+    static QString getProbeKey(StreamingPreferences::VideoDecoderSelection vds,
+                               int videoFormat, int width, int height, int frameRate,
+                               bool enableVideoEnhancement);
+
+    static bool hasFFmpegDecoder(int videoFormat);
+
+    void runCodecCheck(int videoFormat);
+
+    SDL_Window* m_SharedWindow;
+    QThreadPool m_ThreadPool;
+    QMutex m_Lock;
+    QWaitCondition m_StateChanged;
+    QHash<int, CodecCheckState> m_CodecChecks;
+    QHash<QString, DecoderProbeResult> m_Probes;
+};
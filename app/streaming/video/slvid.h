@@ -34,6 +34,11 @@ public:
         return false;
     }
 
+    // Decode units are pushed to us, so there's nothing to start
+    virtual bool startDecoding() override {
+        return true;
+    }
+
 private:
     static void slLogCallback(void* context, ESLVideoLog logLevel, const char* message);
 
@@ -20,6 +20,12 @@ win32:!winrt {
     app.depends += AntiHooking
 }
 
+# Unit tests and simulations of the streaming core. Run them with "make check".
+unix:!macx:!disable-tests:qtHaveModule(testlib) {
+    SUBDIRS += tests
+    tests.depends = moonlight-common-c
+}
+
 # Support debug and release builds from command line for CI
 CONFIG += debug_and_release
 
@@ -0,0 +1,76 @@
+#!/bin/bash
+# Smoke test for the DRM renderer's framebuffer cache on vkms.
+#
+# Loads the vkms virtual KMS driver, replays a decode unit capture with the
+# DRM renderer on its CRTC, then checks the framebuffer lookup and commit
+# statistics. With the hardware decoder (like VAAPI on another GPU, whose
+# DMA-BUF surfaces come from a fixed pool), the number of framebuffer imports
+# must stay within the cache size instead of growing with each frame.
+#
+# Usage: test-drm-vkms.sh <capture file> [path to moonlight] [video decoder]
+#
+# Record a capture by streaming with DECODE_UNIT_CAPTURE_FILE set. Must be
+# run as root from a VT (not under X11 or Wayland) with vkms available.
+# Set DRM_FB_CACHE=0 to compare against importing a framebuffer every frame.
+
+fail()
+{
+	echo "$1" 1>&2
+	exit 1
+}
+
+CAPTURE_FILE=$1
+MOONLIGHT=${2:-$PWD/app/moonlight}
+DECODER=${3:-auto}
+
+# Keep this in sync with DRM_FB_CACHE_SIZE
+FB_CACHE_SIZE=32
+
+[ -n "$CAPTURE_FILE" ] || fail "Usage: $0 <capture file> [path to moonlight] [video decoder]"
+[ -f "$CAPTURE_FILE" ] || fail "Unable to find capture file '$CAPTURE_FILE'"
+[ -x "$MOONLIGHT" ] || fail "Unable to find moonlight at '$MOONLIGHT'"
+[ `id -u` -eq 0 ] || fail "This script must be run as root"
+
+modprobe vkms || fail "Unable to load vkms"
+
+VKMS_CARD=
+for card in /sys/class/drm/card[0-9]*; do
+	if [ "`basename \`readlink -f $card/device/driver\``" = "vkms" ]; then
+		VKMS_CARD=`basename $card`
+		break
+	fi
+done
+[ -n "$VKMS_CARD" ] || fail "Unable to find the vkms DRM device"
+
+LOG_FILE=`mktemp`
+trap 'rm -f $LOG_FILE' EXIT
+
+echo Replaying $CAPTURE_FILE on /dev/dri/$VKMS_CARD with the $DECODER decoder
+DRM_DEV=/dev/dri/$VKMS_CARD SDL_VIDEODRIVER=kmsdrm SDL_KMSDRM_DEVICE_INDEX=${VKMS_CARD#card} \
+	QT_QPA_PLATFORM=offscreen timeout 120 \
+	"$MOONLIGHT" replay "$CAPTURE_FILE" --video-decoder $DECODER >$LOG_FILE 2>&1
+RESULT=$?
+
+if [ $RESULT -ne 0 ]; then
+	cat $LOG_FILE
+	fail "Replay failed with exit code $RESULT"
+fi
+
+grep -q "Using DRM renderer" $LOG_FILE || { cat $LOG_FILE; fail "DRM renderer was not used"; }
+
+# The last lines are from the global stats for the whole replay
+LOOKUP_STATS=`grep "KMS framebuffer lookup time:" $LOG_FILE | tail -1`
+COMMIT_STATS=`grep "KMS commit time:" $LOG_FILE | tail -1`
+[ -n "$LOOKUP_STATS" ] || { cat $LOG_FILE; fail "No framebuffer lookups were timed"; }
+[ -n "$COMMIT_STATS" ] || { cat $LOG_FILE; fail "No KMS commits were timed"; }
+echo $LOOKUP_STATS
+echo $COMMIT_STATS
+
+# Software frames are uploaded into buffers of our own, which aren't cached
+if [ "$DECODER" = "hardware" ] && [ "$DRM_FB_CACHE" != "0" ]; then
+	IMPORTS=`echo $LOOKUP_STATS | sed -n 's/.*(\([0-9]*\) imports).*/\1/p'`
+	[ -n "$IMPORTS" ] || fail "Unable to parse the framebuffer import count"
+	[ $IMPORTS -le $FB_CACHE_SIZE ] || fail "$IMPORTS framebuffers were imported, so the cache isn't being hit"
+fi
+
+echo DRM vkms smoke test passed
@@ -0,0 +1,56 @@
+#!/bin/bash
+# Smoke test for the X11 Present V-sync source.
+#
+# Replays a decode unit capture under Xvfb with V-sync and frame pacing
+# enabled, then checks that the Pacer used the X11 Present V-sync source
+# and received V-sync ticks from the X server's fake CRTC.
+#
+# Usage: test-x11-present-vsync.sh <capture file> [path to moonlight]
+#
+# Record a capture by streaming with DECODE_UNIT_CAPTURE_FILE set.
+# Requires Xvfb and a Linux build with XCB Present support.
+
+fail()
+{
+	echo "$1" 1>&2
+	exit 1
+}
+
+CAPTURE_FILE=$1
+MOONLIGHT=${2:-$PWD/app/moonlight}
+
+[ -n "$CAPTURE_FILE" ] || fail "Usage: $0 <capture file> [path to moonlight]"
+[ -f "$CAPTURE_FILE" ] || fail "Unable to find capture file '$CAPTURE_FILE'"
+[ -x "$MOONLIGHT" ] || fail "Unable to find moonlight at '$MOONLIGHT'"
+command -v Xvfb >/dev/null 2>&1 || fail "Unable to find 'Xvfb' in your PATH!"
+
+LOG_FILE=`mktemp`
+DISPLAY_FILE=`mktemp`
+trap 'kill $XVFB_PID 2>/dev/null; rm -f $LOG_FILE $DISPLAY_FILE' EXIT
+
+echo Starting Xvfb
+Xvfb -displayfd 3 -screen 0 1920x1080x24 3>$DISPLAY_FILE &
+XVFB_PID=$!
+
+for i in `seq 50`; do
+	[ -s $DISPLAY_FILE ] && break
+	sleep 0.1
+done
+[ -s $DISPLAY_FILE ] || fail "Xvfb failed to start"
+export DISPLAY=:`cat $DISPLAY_FILE`
+
+echo Replaying $CAPTURE_FILE on display $DISPLAY
+SDL_VIDEODRIVER=x11 QT_QPA_PLATFORM=offscreen timeout 120 \
+	"$MOONLIGHT" replay "$CAPTURE_FILE" --vsync --frame-pacing --video-decoder software >$LOG_FILE 2>&1
+RESULT=$?
+
+if [ $RESULT -ne 0 ]; then
+	cat $LOG_FILE
+	fail "Replay failed with exit code $RESULT"
+fi
+
+grep -q "Using X11 Present V-sync source" $LOG_FILE || { cat $LOG_FILE; fail "X11 Present V-sync source was not used"; }
+grep -q "V-sync jitter:" $LOG_FILE || { cat $LOG_FILE; fail "No V-sync ticks were received"; }
+
+grep "V-sync jitter:" $LOG_FILE | tail -1
+echo X11 Present V-sync smoke test passed
@@ -0,0 +1,13 @@
+# Checks which decoder probe results DecoderCapabilityCache keeps in memory
+# and which it writes to disk. The cache file goes in a temporary directory.
+
+TARGET = tst_capabilitycache
+
+include(../tests.pri)
+
+DEFINES += VERSION_STR=\\\"$$cat($$APP_DIR/version.txt)\\\"
+
+SOURCES += \
+    tst_capabilitycache.cpp \
+    $$APP_DIR/path.cpp \
+    $$APP_DIR/streaming/video/capabilitycache.cpp
@@ -0,0 +1,144 @@
+#include "path.h"
+#include "streaming/video/capabilitycache.h"
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#define CACHE_FILE_NAME "decodercaps.json"
+
+// The cache is a process-wide singleton that loads the file on first use,
+// so these tests share one instance and run in order.
+class TestCapabilityCache : public QObject
+{
+    Q_OBJECT
+
+private:
+    static DecoderProbeResult makeResult(bool available)
+    {
+        DecoderProbeResult result = {};
+        result.available = available;
+        result.isHardwareAccelerated = available;
+        result.isHdrSupported = available;
+        result.maxResolution = available ? QSize(3840, 2160) : QSize();
+        result.capabilities = available ? 0x5 : 0;
+        result.colorspace = 9;
+        result.colorRange = 2;
+        return result;
+    }
+
+    static QJsonObject readCacheFile()
+    {
+        QFile cacheFile(Path::getCacheFileInfo(CACHE_FILE_NAME).absoluteFilePath());
+        if (!cacheFile.open(QIODevice::ReadOnly)) {
+            return QJsonObject();
+        }
+
+        return QJsonDocument::fromJson(cacheFile.readAll()).object();
+    }
+
+    QTemporaryDir m_CacheDir;
+
+private slots:
+    void initTestCase()
+    {
+        QVERIFY(m_CacheDir.isValid());
+        QVERIFY(qEnvironmentVariableIsEmpty("DECODER_CAPABILITY_CACHE"));
+
+        // Portable mode puts the cache under the current directory
+        QVERIFY(QDir::setCurrent(m_CacheDir.path()));
+        Path::initialize(true);
+
+        // Left behind by a different system configuration
+        QJsonObject staleEntry;
+        staleEntry.insert("available", true);
+        QJsonObject entries;
+        entries.insert("stale", staleEntry);
+        QJsonObject root;
+        root.insert("identity", "stale");
+        root.insert("entries", entries);
+        Path::writeCacheFile(CACHE_FILE_NAME, QJsonDocument(root).toJson(QJsonDocument::Compact));
+    }
+
+    void staleCacheIsIgnored()
+    {
+        DecoderProbeResult result;
+        QVERIFY(!DecoderCapabilityCache::get().lookup("stale", result));
+    }
+
+    void resultsRoundTrip()
+    {
+        DecoderProbeResult stored = makeResult(true);
+        DecoderCapabilityCache::get().store("roundtrip", stored);
+
+        DecoderProbeResult result = {};
+        QVERIFY(DecoderCapabilityCache::get().lookup("roundtrip", result));
+        QCOMPARE(result.available, stored.available);
+        QCOMPARE(result.isHardwareAccelerated, stored.isHardwareAccelerated);
+        QCOMPARE(result.isAlwaysFullScreen, stored.isAlwaysFullScreen);
+        QCOMPARE(result.isHdrSupported, stored.isHdrSupported);
+        QCOMPARE(result.maxResolution, stored.maxResolution);
+        QCOMPARE(result.capabilities, stored.capabilities);
+        QCOMPARE(result.colorspace, stored.colorspace);
+        QCOMPARE(result.colorRange, stored.colorRange);
+    }
+
+    void onlyAvailableResultsArePersisted()
+    {
+        DecoderCapabilityCache::get().store("available", makeResult(true));
+        DecoderCapabilityCache::get().store("failed", makeResult(false));
+        DecoderCapabilityCache::get().flush();
+
+        QJsonObject root = readCacheFile();
+        QVERIFY(!root.value("identity").toString().isEmpty());
+        QVERIFY(root.value("identity").toString() != "stale");
+
+        QJsonObject entries = root.value("entries").toObject();
+        QVERIFY(entries.contains("available"));
+        QVERIFY(entries.contains("roundtrip"));
+        QVERIFY(!entries.contains("failed"));
+        QVERIFY(!entries.contains("stale"));
+
+        // Failed probes are still remembered for this process
+        DecoderProbeResult result;
+        QVERIFY(DecoderCapabilityCache::get().lookup("failed", result));
+        QVERIFY(!result.available);
+    }
+
+    void failedResultsDontDirtyTheCache()
+    {
+        Path::deleteCacheFile(CACHE_FILE_NAME);
+
+        DecoderCapabilityCache::get().store("failed again", makeResult(false));
+        DecoderCapabilityCache::get().flush();
+        QVERIFY(!Path::getCacheFileInfo(CACHE_FILE_NAME).exists());
+
+        // A successful probe writes everything we know about
+        DecoderCapabilityCache::get().store("available again", makeResult(true));
+        DecoderCapabilityCache::get().flush();
+
+        QJsonObject entries = readCacheFile().value("entries").toObject();
+        QVERIFY(entries.contains("available"));
+        QVERIFY(entries.contains("available again"));
+        QVERIFY(!entries.contains("failed again"));
+    }
+
+    void invalidateDropsEverything()
+    {
+        DecoderCapabilityCache::get().invalidate();
+        QVERIFY(!Path::getCacheFileInfo(CACHE_FILE_NAME).exists());
+
+        DecoderProbeResult result;
+        QVERIFY(!DecoderCapabilityCache::get().lookup("available", result));
+        QVERIFY(!DecoderCapabilityCache::get().lookup("failed", result));
+
+        // Nothing is left to write
+        DecoderCapabilityCache::get().flush();
+        QVERIFY(!Path::getCacheFileInfo(CACHE_FILE_NAME).exists());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestCapabilityCache)
+#include "tst_capabilitycache.moc"
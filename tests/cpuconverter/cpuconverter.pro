@@ -0,0 +1,18 @@
+# Checks the 10-bit down-conversion kernels of CpuColorConverter against a
+# scalar reference and benchmarks them against swscale. "make check" runs
+# each benchmark once. Run the binary with the "benchmark" test function
+# for timings:
+#
+#   ./tst_cpuconverter benchmark
+#
+# Set CPU_CONVERTER_THREADS=1 to compare single-threaded throughput.
+
+TARGET = tst_cpuconverter
+
+include(../tests.pri)
+
+PKGCONFIG += libswscale
+
+SOURCES += \
+    tst_cpuconverter.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/cpucolorconverter.cpp
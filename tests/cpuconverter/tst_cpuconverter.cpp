@@ -0,0 +1,402 @@
+#include "streaming/video/ffmpeg-renderers/cpucolorconverter.h"
+
+#include <QtTest>
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+// The 2x2 ordered dither pattern of the dropped bits, in 10-bit code units
+static const int k_DitherPattern[2][2] = {
+    { 0, 2 },
+    { 3, 1 },
+};
+
+class TestCpuConverter : public QObject
+{
+    Q_OBJECT
+
+private:
+    static AVFrame* allocFrame(enum AVPixelFormat format, int width, int height)
+    {
+        AVFrame* frame = av_frame_alloc();
+        frame->format = format;
+        frame->width = width;
+        frame->height = height;
+        if (av_frame_get_buffer(frame, 0) < 0) {
+            av_frame_free(&frame);
+        }
+        return frame;
+    }
+
+    static uint16_t* sampleAt(AVFrame* frame, int plane, int x, int y)
+    {
+        return (uint16_t*)(frame->data[plane] + (ptrdiff_t)frame->linesize[plane] * y) + x;
+    }
+
+    static int codeAt(AVFrame* frame, int plane, int x, int y)
+    {
+        // P010 samples are MSB-aligned
+        int shift = frame->format == AV_PIX_FMT_P010 ? 6 : 0;
+        return *sampleAt(frame, plane, x, y) >> shift;
+    }
+
+    static void setCode(AVFrame* frame, int plane, int x, int y, int code)
+    {
+        int shift = frame->format == AV_PIX_FMT_P010 ? 6 : 0;
+        *sampleAt(frame, plane, x, y) = (uint16_t)(code << shift);
+    }
+
+    // Fills every sample with codes from fill(plane, x, y), where plane 1
+    // is U and plane 2 is V regardless of the layout
+    template <typename Fill>
+    static void fillFrame(AVFrame* frame, Fill fill)
+    {
+        int chromaWidth = (frame->width + 1) / 2;
+        int chromaHeight = (frame->height + 1) / 2;
+
+        for (int y = 0; y < frame->height; y++) {
+            for (int x = 0; x < frame->width; x++) {
+                setCode(frame, 0, x, y, fill(0, x, y));
+            }
+        }
+
+        for (int y = 0; y < chromaHeight; y++) {
+            for (int x = 0; x < chromaWidth; x++) {
+                if (frame->format == AV_PIX_FMT_P010) {
+                    setCode(frame, 1, x * 2, y, fill(1, x, y));
+                    setCode(frame, 1, x * 2 + 1, y, fill(2, x, y));
+                }
+                else {
+                    setCode(frame, 1, x, y, fill(1, x, y));
+                    setCode(frame, 2, x, y, fill(2, x, y));
+                }
+            }
+        }
+    }
+
+    static void fillRandom(AVFrame* frame, uint32_t seed)
+    {
+        fillFrame(frame, [&seed](int, int, int) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            return (int)(seed & 1023);
+        });
+    }
+
+    static int sourceChroma(AVFrame* frame, int plane, int x, int y)
+    {
+        if (frame->format == AV_PIX_FMT_P010) {
+            return codeAt(frame, 1, x * 2 + plane - 1, y);
+        }
+        else {
+            return codeAt(frame, plane, x, y);
+        }
+    }
+
+    static bool convert(AVFrame* src, AVFrame* dst)
+    {
+        CpuColorConverter converter;
+        if (!converter.initialize(src, AV_PIX_FMT_NV12)) {
+            return false;
+        }
+
+        converter.submitFrame(src, dst->data, dst->linesize);
+        return converter.finishFrame();
+    }
+
+private slots:
+    void cleanup()
+    {
+        qunsetenv("CPU_CONVERTER_DITHER");
+        qunsetenv("CPU_CONVERTER_KERNEL");
+        qunsetenv("CPU_CONVERTER_THREADS");
+    }
+
+    void matchesScalarReference_data()
+    {
+        QTest::addColumn<int>("format");
+        QTest::addColumn<int>("width");
+        QTest::addColumn<int>("height");
+        QTest::addColumn<bool>("dither");
+
+        const int formats[] = { AV_PIX_FMT_P010, AV_PIX_FMT_YUV420P10 };
+        for (int format : formats) {
+            const char* name = av_get_pix_fmt_name((enum AVPixelFormat)format);
+            QTest::addRow("%s 1920x1080 dithered", name) << format << 1920 << 1080 << true;
+            QTest::addRow("%s 1920x1080 rounded", name) << format << 1920 << 1080 << false;
+
+            // Odd sizes exercise the scalar tails of the SIMD kernels
+            QTest::addRow("%s 333x67 dithered", name) << format << 333 << 67 << true;
+            QTest::addRow("%s 333x67 rounded", name) << format << 333 << 67 << false;
+        }
+    }
+
+    void matchesScalarReference()
+    {
+        QFETCH(int, format);
+        QFETCH(int, width);
+        QFETCH(int, height);
+        QFETCH(bool, dither);
+
+        qputenv("CPU_CONVERTER_DITHER", dither ? "1" : "0");
+
+        AVFrame* src = allocFrame((enum AVPixelFormat)format, width, height);
+        AVFrame* dst = allocFrame(AV_PIX_FMT_NV12, width, height);
+        QVERIFY(src != nullptr && dst != nullptr);
+
+        fillRandom(src, 0x12345678);
+        QVERIFY(convert(src, dst));
+
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                int bias = dither ? k_DitherPattern[y & 1][x & 1] : 2;
+                int expected = SDL_min((codeAt(src, 0, x, y) + bias) >> 2, 255);
+                int actual = dst->data[0][(ptrdiff_t)dst->linesize[0] * y + x];
+                if (actual != expected) {
+                    QFAIL(qPrintable(QString("Luma at %1,%2 is %3, expected %4").arg(x).arg(y).arg(actual).arg(expected)));
+                }
+            }
+        }
+
+        for (int y = 0; y < (height + 1) / 2; y++) {
+            for (int x = 0; x < (width + 1) / 2; x++) {
+                // Both samples of a pair get the bias of the pair
+                int bias = dither ? k_DitherPattern[y & 1][x & 1] : 2;
+                for (int plane = 1; plane <= 2; plane++) {
+                    int expected = SDL_min((sourceChroma(src, plane, x, y) + bias) >> 2, 255);
+                    int actual = dst->data[1][(ptrdiff_t)dst->linesize[1] * y + x * 2 + plane - 1];
+                    if (actual != expected) {
+                        QFAIL(qPrintable(QString("Chroma %1 at %2,%3 is %4, expected %5")
+                                         .arg(plane).arg(x).arg(y).arg(actual).arg(expected)));
+                    }
+                }
+            }
+        }
+
+        av_frame_free(&src);
+        av_frame_free(&dst);
+    }
+
+    void kernelsMatchC_data()
+    {
+        QTest::addColumn<QString>("kernel");
+        QTest::addColumn<int>("format");
+        QTest::addColumn<int>("width");
+        QTest::addColumn<int>("height");
+        QTest::addColumn<bool>("dither");
+
+        const char* kernels[] = { "SSE2", "AVX2", "NEON" };
+        const int formats[] = { AV_PIX_FMT_P010, AV_PIX_FMT_YUV420P10 };
+        for (const char* kernel : kernels) {
+            for (int format : formats) {
+                const char* name = av_get_pix_fmt_name((enum AVPixelFormat)format);
+                QTest::addRow("%s %s 1920x1080 dithered", kernel, name) << kernel << format << 1920 << 1080 << true;
+                QTest::addRow("%s %s 1920x1080 rounded", kernel, name) << kernel << format << 1920 << 1080 << false;
+                QTest::addRow("%s %s 333x67 dithered", kernel, name) << kernel << format << 333 << 67 << true;
+                QTest::addRow("%s %s 333x67 rounded", kernel, name) << kernel << format << 333 << 67 << false;
+            }
+        }
+    }
+
+    void kernelsMatchC()
+    {
+        QFETCH(QString, kernel);
+        QFETCH(int, format);
+        QFETCH(int, width);
+        QFETCH(int, height);
+        QFETCH(bool, dither);
+
+        if (!CpuColorConverter::isDownConversionKernelSupported(qPrintable(kernel))) {
+            QSKIP("Kernel is not supported on this CPU");
+        }
+
+        qputenv("CPU_CONVERTER_DITHER", dither ? "1" : "0");
+
+        AVFrame* src = allocFrame((enum AVPixelFormat)format, width, height);
+        AVFrame* expected = allocFrame(AV_PIX_FMT_NV12, width, height);
+        AVFrame* actual = allocFrame(AV_PIX_FMT_NV12, width, height);
+        QVERIFY(src != nullptr && expected != nullptr && actual != nullptr);
+
+        fillRandom(src, 0xdeadbeef);
+
+        qputenv("CPU_CONVERTER_KERNEL", "C");
+        QVERIFY(convert(src, expected));
+        qputenv("CPU_CONVERTER_KERNEL", kernel.toLatin1());
+        QVERIFY(convert(src, actual));
+
+        // Chroma rows hold interleaved UV pairs, so they're as wide as luma rows
+        for (int plane = 0; plane < 2; plane++) {
+            int rows = plane == 0 ? height : (height + 1) / 2;
+            int rowBytes = plane == 0 ? width : (width + 1) / 2 * 2;
+            for (int y = 0; y < rows; y++) {
+                const uint8_t* expectedRow = expected->data[plane] + (ptrdiff_t)expected->linesize[plane] * y;
+                const uint8_t* actualRow = actual->data[plane] + (ptrdiff_t)actual->linesize[plane] * y;
+                if (memcmp(expectedRow, actualRow, rowBytes) != 0) {
+                    QFAIL(qPrintable(QString("Plane %1 row %2 differs from the C kernel").arg(plane).arg(y)));
+                }
+            }
+        }
+
+        av_frame_free(&src);
+        av_frame_free(&expected);
+        av_frame_free(&actual);
+    }
+
+    void ditherIsPerChromaPair_data()
+    {
+        QTest::addColumn<int>("format");
+
+        QTest::newRow("P010") << (int)AV_PIX_FMT_P010;
+        QTest::newRow("YUV420P10") << (int)AV_PIX_FMT_YUV420P10;
+    }
+
+    void ditherIsPerChromaPair()
+    {
+        QFETCH(int, format);
+
+        AVFrame* src = allocFrame((enum AVPixelFormat)format, 256, 16);
+        AVFrame* dst = allocFrame(AV_PIX_FMT_NV12, 256, 16);
+        QVERIFY(src != nullptr && dst != nullptr);
+
+        // Halfway between two 8-bit codes, so the dither decides the result
+        fillFrame(src, [](int, int, int) { return 514; });
+        QVERIFY(convert(src, dst));
+
+        for (int y = 0; y < 8; y++) {
+            const uint8_t* row = dst->data[1] + (ptrdiff_t)dst->linesize[1] * y;
+            for (int x = 0; x < 128; x++) {
+                // A grey source must stay grey, so U and V always match
+                QCOMPARE(row[x * 2], row[x * 2 + 1]);
+                if (x > 0) {
+                    // The pattern alternates from one pair to the next
+                    QVERIFY(row[x * 2] != row[(x - 1) * 2]);
+                }
+            }
+        }
+
+        av_frame_free(&src);
+        av_frame_free(&dst);
+    }
+
+    void toneMapAdjustsChroma()
+    {
+        AVFrame* src = allocFrame(AV_PIX_FMT_P010, 64, 64);
+        AVFrame* dst = allocFrame(AV_PIX_FMT_NV12, 64, 64);
+        AVFrame* untouched = allocFrame(AV_PIX_FMT_NV12, 64, 64);
+        QVERIFY(src != nullptr && dst != nullptr && untouched != nullptr);
+
+        // The left half is neutral, the right half is saturated. Luma
+        // covers everything from black to peak white from top to bottom.
+        src->color_range = AVCOL_RANGE_MPEG;
+        fillFrame(src, [](int plane, int x, int y) {
+            if (plane == 0) {
+                return 64 + y * 876 / 63;
+            }
+            else if (x < 16) {
+                return 512;
+            }
+            else {
+                return plane == 1 ? 512 + 200 : 512 - 200;
+            }
+        });
+
+        QVERIFY(convert(src, untouched));
+        src->color_trc = AVCOL_TRC_SMPTE2084;
+        QVERIFY(convert(src, dst));
+
+        bool chromaChanged = false;
+        for (int y = 0; y < 32; y++) {
+            const uint8_t* row = dst->data[1] + (ptrdiff_t)dst->linesize[1] * y;
+            const uint8_t* untouchedRow = untouched->data[1] + (ptrdiff_t)untouched->linesize[1] * y;
+            for (int x = 0; x < 32; x++) {
+                if (x < 16) {
+                    QCOMPARE((int)row[x * 2], 128);
+                    QCOMPARE((int)row[x * 2 + 1], 128);
+                }
+                else {
+                    // Hue is kept while saturation follows the luma
+                    QVERIFY(row[x * 2] >= 128);
+                    QVERIFY(row[x * 2 + 1] <= 128);
+                    chromaChanged |= row[x * 2] != untouchedRow[x * 2];
+                }
+            }
+        }
+        QVERIFY(chromaChanged);
+
+        av_frame_free(&src);
+        av_frame_free(&dst);
+        av_frame_free(&untouched);
+    }
+
+    void benchmark_data()
+    {
+        QTest::addColumn<int>("format");
+        QTest::addColumn<int>("width");
+        QTest::addColumn<int>("height");
+        QTest::addColumn<bool>("swscale");
+        QTest::addColumn<int>("threads");
+
+        // swscale converts on the calling thread, so compare it against the
+        // kernels on a single worker. The default worker count shows what
+        // slicing adds on top of that.
+        const int formats[] = { AV_PIX_FMT_P010, AV_PIX_FMT_YUV420P10 };
+        for (int format : formats) {
+            const char* name = av_get_pix_fmt_name((enum AVPixelFormat)format);
+            QTest::addRow("%s 1080p kernels 1 thread", name) << format << 1920 << 1080 << false << 1;
+            QTest::addRow("%s 1080p kernels", name) << format << 1920 << 1080 << false << 0;
+            QTest::addRow("%s 1080p swscale", name) << format << 1920 << 1080 << true << 1;
+            QTest::addRow("%s 2160p kernels 1 thread", name) << format << 3840 << 2160 << false << 1;
+            QTest::addRow("%s 2160p kernels", name) << format << 3840 << 2160 << false << 0;
+            QTest::addRow("%s 2160p swscale", name) << format << 3840 << 2160 << true << 1;
+        }
+    }
+
+    void benchmark()
+    {
+        QFETCH(int, format);
+        QFETCH(int, width);
+        QFETCH(int, height);
+        QFETCH(bool, swscale);
+        QFETCH(int, threads);
+
+        AVFrame* src = allocFrame((enum AVPixelFormat)format, width, height);
+        AVFrame* dst = allocFrame(AV_PIX_FMT_NV12, width, height);
+        QVERIFY(src != nullptr && dst != nullptr);
+        fillRandom(src, 0x9e3779b9);
+
+        if (swscale) {
+            // The cheapest swscale path
+            SwsContext* context = sws_getContext(width, height, (enum AVPixelFormat)format,
+                                                 width, height, AV_PIX_FMT_NV12,
+                                                 SWS_POINT, nullptr, nullptr, nullptr);
+            QVERIFY(context != nullptr);
+
+            QBENCHMARK {
+                sws_scale(context, src->data, src->linesize, 0, height, dst->data, dst->linesize);
+            }
+
+            sws_freeContext(context);
+        }
+        else {
+            if (threads != 0) {
+                qputenv("CPU_CONVERTER_THREADS", QByteArray::number(threads));
+            }
+
+            CpuColorConverter converter;
+            QVERIFY(converter.initialize(src, AV_PIX_FMT_NV12));
+
+            QBENCHMARK {
+                converter.submitFrame(src, dst->data, dst->linesize);
+                converter.finishFrame();
+            }
+        }
+
+        av_frame_free(&src);
+        av_frame_free(&dst);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestCpuConverter)
+#include "tst_cpuconverter.moc"
@@ -0,0 +1,11 @@
+# Stresses the Pacer's lock-free frame queue with a producer and a consumer
+# thread, including the producer dropping the oldest frame while the
+# consumer takes frames, and checks the consumer's wakeups and deadlines.
+
+TARGET = tst_framequeue
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_framequeue.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/pacer/framequeue.cpp
@@ -0,0 +1,276 @@
+#include "streaming/video/ffmpeg-renderers/pacer/framequeue.h"
+
+#include <QtTest>
+
+#include <algorithm>
+#include <atomic>
+
+#define STRESS_FRAMES 200000
+#define HANDOFF_FRAMES 20000
+
+// Like the Pacer's balanced mode
+#define DROP_QUEUE_DEPTH 3
+
+// Long enough that only a lost wakeup could time out
+#define WAKEUP_TIMEOUT_MS 5000
+
+// How late waitForFrameUntil() may return on a busy machine
+#define DEADLINE_SLACK_US 5000
+
+// The queue never touches the frames, so sequence numbers stand in for them
+static AVFrame* toFrame(int sequence)
+{
+    return (AVFrame*)(intptr_t)sequence;
+}
+
+static int toSequence(AVFrame* frame)
+{
+    return (int)(intptr_t)frame;
+}
+
+class TestFrameQueue : public QObject
+{
+    Q_OBJECT
+
+private:
+    static void drain(FrameQueue& queue, QVector<int>* sequences)
+    {
+        AVFrame* frame;
+        while ((frame = queue.dequeue()) != nullptr) {
+            sequences->append(toSequence(frame));
+        }
+    }
+
+private slots:
+    void preservesOrder()
+    {
+        VIDEO_STATS stats = {};
+        FrameQueue queue(&stats);
+
+        QThread* producer = QThread::create([&queue]() {
+            for (int i = 1; i <= STRESS_FRAMES; i++) {
+                while (!queue.enqueue(toFrame(i))) {
+                    QThread::yieldCurrentThread();
+                }
+            }
+        });
+        producer->start();
+
+        int outOfOrderFrames = 0;
+        int lostWakeups = 0;
+        for (int expected = 1; expected <= STRESS_FRAMES;) {
+            if (!queue.waitForFrame(WAKEUP_TIMEOUT_MS)) {
+                lostWakeups++;
+                continue;
+            }
+
+            AVFrame* frame = queue.dequeue();
+            if (frame == nullptr) {
+                // Only the consumer removes frames here
+                outOfOrderFrames++;
+                continue;
+            }
+
+            if (toSequence(frame) != expected) {
+                outOfOrderFrames++;
+            }
+            expected = toSequence(frame) + 1;
+        }
+
+        producer->wait();
+        delete producer;
+
+        QCOMPARE(lostWakeups, 0);
+        QCOMPARE(outOfOrderFrames, 0);
+        QVERIFY(queue.isEmpty());
+    }
+
+    void droppedFramesAreTakenOnce()
+    {
+        VIDEO_STATS stats = {};
+        FrameQueue queue(&stats);
+        QVector<int> dropped;
+        QVector<int> consumed;
+        std::atomic<bool> producerDone(false);
+        std::atomic<int> failedEnqueues(0);
+
+        // Like Pacer::dropFrameForEnqueue(), the producer makes room by taking
+        // the oldest frame, which races with the consumer taking the same one
+        QThread* producer = QThread::create([&]() {
+            for (int i = 1; i <= STRESS_FRAMES; i++) {
+                while (queue.count() >= DROP_QUEUE_DEPTH) {
+                    AVFrame* frame = queue.dequeue();
+                    if (frame != nullptr) {
+                        dropped.append(toSequence(frame));
+                    }
+                }
+
+                if (!queue.enqueue(toFrame(i))) {
+                    failedEnqueues++;
+                }
+            }
+
+            producerDone = true;
+        });
+        producer->start();
+
+        while (!producerDone) {
+            if (queue.waitForFrame(1)) {
+                AVFrame* frame = queue.dequeue();
+                if (frame != nullptr) {
+                    consumed.append(toSequence(frame));
+                }
+            }
+        }
+
+        producer->wait();
+        delete producer;
+        drain(queue, &consumed);
+
+        QCOMPARE(failedEnqueues.load(), 0);
+
+        // Each side sees the frames it took in order
+        for (int i = 1; i < dropped.count(); i++) {
+            QVERIFY(dropped[i] > dropped[i - 1]);
+        }
+        for (int i = 1; i < consumed.count(); i++) {
+            QVERIFY(consumed[i] > consumed[i - 1]);
+        }
+
+        // And together they saw every frame exactly once
+        QVector<int> all = dropped + consumed;
+        std::sort(all.begin(), all.end());
+        QCOMPARE(all.count(), STRESS_FRAMES);
+        for (int i = 0; i < all.count(); i++) {
+            QCOMPARE(all[i], i + 1);
+        }
+    }
+
+    void handoffsNeverLoseWakeups_data()
+    {
+        QTest::addColumn<int>("timeoutMs");
+
+        QTest::newRow("forever") << -1;
+        QTest::newRow("timeout") << WAKEUP_TIMEOUT_MS;
+    }
+
+    void handoffsNeverLoseWakeups()
+    {
+        QFETCH(int, timeoutMs);
+
+        VIDEO_STATS stats = {};
+        FrameQueue queue(&stats);
+        std::atomic<int> consumedFrames(0);
+        std::atomic<int> failedEnqueues(0);
+
+        // One frame at a time, so the consumer is always about to sleep or
+        // asleep when the next frame is enqueued. A lost wakeup would hang
+        // the consumer forever (or until it times out) with a frame queued.
+        QThread* producer = QThread::create([&]() {
+            for (int i = 1; i <= HANDOFF_FRAMES; i++) {
+                if (!queue.enqueue(toFrame(i))) {
+                    failedEnqueues++;
+                }
+                while (consumedFrames < i) {
+                    QThread::yieldCurrentThread();
+                }
+            }
+        });
+        producer->start();
+
+        int lostWakeups = 0;
+        int wrongFrames = 0;
+        for (int i = 1; i <= HANDOFF_FRAMES; i++) {
+            if (!queue.waitForFrame(timeoutMs)) {
+                lostWakeups++;
+                break;
+            }
+
+            if (toSequence(queue.dequeue()) != i) {
+                wrongFrames++;
+            }
+            consumedFrames = i;
+        }
+
+        if (lostWakeups != 0) {
+            // Let the producer finish so we can clean up
+            consumedFrames = HANDOFF_FRAMES;
+        }
+
+        producer->wait();
+        delete producer;
+        QVector<int> remaining;
+        drain(queue, &remaining);
+
+        QCOMPARE(failedEnqueues.load(), 0);
+        QCOMPARE(lostWakeups, 0);
+        QCOMPARE(wrongFrames, 0);
+        QVERIFY(stats.pacerWakeups <= HANDOFF_FRAMES);
+    }
+
+    void wakeWithoutFrame()
+    {
+        VIDEO_STATS stats = {};
+        FrameQueue queue(&stats);
+
+        QThread* waker = QThread::create([&queue]() {
+            QThread::msleep(10);
+            queue.wake();
+        });
+        waker->start();
+
+        // Shutdown wakes the consumer with nothing to take
+        QVERIFY(!queue.waitForFrame(-1));
+
+        waker->wait();
+        delete waker;
+    }
+
+    void deadlineIsAccurate_data()
+    {
+        QTest::addColumn<int>("timeoutUs");
+
+        QTest::newRow("sub-millisecond") << 500;
+        QTest::newRow("fractional milliseconds") << 2500;
+        QTest::newRow("whole milliseconds") << 10000;
+    }
+
+    void deadlineIsAccurate()
+    {
+        QFETCH(int, timeoutUs);
+
+        VIDEO_STATS stats = {};
+        FrameQueue queue(&stats);
+
+        uint64_t deadlineUs = LiGetMicroseconds() + timeoutUs;
+        QVERIFY(!queue.waitForFrameUntil(deadlineUs));
+
+        // Never early, and not much later than the deadline either
+        uint64_t nowUs = LiGetMicroseconds();
+        QVERIFY2(nowUs >= deadlineUs, qPrintable(QString("%1 us early").arg(deadlineUs - nowUs)));
+        QVERIFY2(nowUs - deadlineUs <= DEADLINE_SLACK_US, qPrintable(QString("%1 us late").arg(nowUs - deadlineUs)));
+    }
+
+    void frameEndsDeadlineWait()
+    {
+        VIDEO_STATS stats = {};
+        FrameQueue queue(&stats);
+
+        QThread* producer = QThread::create([&queue]() {
+            QThread::msleep(10);
+            queue.enqueue(toFrame(1));
+        });
+        producer->start();
+
+        uint64_t startUs = LiGetMicroseconds();
+        QVERIFY(queue.waitForFrameUntil(startUs + WAKEUP_TIMEOUT_MS * 1000ULL));
+        QVERIFY(LiGetMicroseconds() - startUs < WAKEUP_TIMEOUT_MS * 1000ULL);
+
+        producer->wait();
+        delete producer;
+        QCOMPARE(toSequence(queue.dequeue()), 1);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestFrameQueue)
+#include "tst_framequeue.moc"
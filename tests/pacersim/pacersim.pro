@@ -0,0 +1,28 @@
+# Runs the real Pacer against a mock V-sync source and renderer on virtual
+# time. Run it with "make check" for the regression tests, or run the binary
+# with the "report" test function to print metrics for every pacing mode:
+#
+#   ./tst_pacersim report
+#
+# Set PACERSIM_TRACE to a file of frame arrival times (one per line, in
+# microseconds) to add a recorded trace to the report.
+
+TARGET = tst_pacersim
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_pacersim.cpp \
+    pacersimulation.cpp \
+    virtualclock.cpp \
+    $$APP_DIR/path.cpp \
+    $$APP_DIR/streaming/streamutils.cpp \
+    $$APP_DIR/streaming/video/framepool.cpp \
+    $$APP_DIR/streaming/video/frametimeline.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/pacer/framequeue.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/pacer/pacer.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/pacer/softwarevsyncsource.cpp
+
+HEADERS += \
+    pacersimulation.h \
+    virtualclock.h
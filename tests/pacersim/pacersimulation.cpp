@@ -0,0 +1,326 @@
+#include "pacersimulation.h"
+#include "virtualclock.h"
+#include "streaming/video/framepool.h"
+#include "streaming/video/frametimeline.h"
+
+#include <QFile>
+#include <QTextStream>
+
+#include <cmath>
+#include <memory>
+
+// Matches the jittery and bursty DECODE_UNIT_REPLAY_PROFILE cadences
+#define JITTERY_MAX_DELAY_US 4000
+#define JITTERY_STALL_PERCENT 2
+#define JITTERY_STALL_MIN_US 20000
+#define JITTERY_STALL_MAX_US 50000
+#define BURSTY_GROUP_FRAMES 4
+
+// Virtual time starts here rather than at 0, which the Pacer treats as unset
+#define SIMULATION_START_US 1000000
+
+// Keep running this long after the last arrival to drain the queues
+#define SIMULATION_DRAIN_US 200000
+
+namespace {
+
+// A fixed-rate display. Its first vblank is deliberately out of phase with
+// the stream so that arrivals and vblanks don't tie.
+class SimDisplay
+{
+public:
+    SimDisplay(int refreshRate)
+        : m_PeriodUs(1000000.0 / refreshRate),
+          m_PhaseUs(SIMULATION_START_US + m_PeriodUs * 0.37)
+    {
+    }
+
+    // Returns the first vblank at or after the given time
+    uint64_t getNextVblankUs(uint64_t timeUs) const
+    {
+        double periods = SDL_max(std::ceil(((double)timeUs - m_PhaseUs) / m_PeriodUs), 0.0);
+        uint64_t vblankUs = (uint64_t)(m_PhaseUs + periods * m_PeriodUs);
+        if (vblankUs < timeUs) {
+            // Rounding put us just before the requested time
+            vblankUs = (uint64_t)(m_PhaseUs + (periods + 1) * m_PeriodUs);
+        }
+        return vblankUs;
+    }
+
+private:
+    double m_PeriodUs;
+    double m_PhaseUs;
+};
+
+class SimVsyncSource : public IVsyncSource
+{
+public:
+    SimVsyncSource(VirtualClock* clock, const SimDisplay* display)
+        : m_Clock(clock),
+          m_Display(display),
+          m_LastVsyncUs(0)
+    {
+    }
+
+    virtual bool initialize(SDL_Window*, int) override
+    {
+        return true;
+    }
+
+    virtual bool isAsync() override
+    {
+        return false;
+    }
+
+    virtual void waitForVsync() override
+    {
+        m_LastVsyncUs = m_Display->getNextVblankUs(m_Clock->getMicroseconds() + 1);
+        m_Clock->waitUntilUs(m_LastVsyncUs);
+    }
+
+    virtual uint64_t getLastVsyncTimeUs() override
+    {
+        return m_LastVsyncUs;
+    }
+
+private:
+    VirtualClock* m_Clock;
+    const SimDisplay* m_Display;
+    uint64_t m_LastVsyncUs;
+};
+
+// Takes a fixed time to render, then blocks until the flip like a V-synced
+// swap would. Without a display (VRR), the present is the refresh.
+class SimRenderer : public IFFmpegRenderer
+{
+public:
+    SimRenderer(VirtualClock* clock, const SimDisplay* display, uint32_t renderCostUs)
+        : IFFmpegRenderer(RendererType::Unknown),
+          m_Clock(clock),
+          m_Display(display),
+          m_RenderCostUs(renderCostUs)
+    {
+    }
+
+    virtual bool initialize(PDECODER_PARAMETERS) override
+    {
+        return true;
+    }
+
+    virtual bool prepareDecoderContext(AVCodecContext*, AVDictionary**) override
+    {
+        return true;
+    }
+
+    virtual void renderFrame(AVFrame*) override
+    {
+        m_Clock->waitUntilUs(m_Clock->getMicroseconds() + m_RenderCostUs);
+
+        if (m_Display != nullptr) {
+            m_Clock->waitUntilUs(m_Display->getNextVblankUs(m_Clock->getMicroseconds()));
+        }
+    }
+
+private:
+    VirtualClock* m_Clock;
+    const SimDisplay* m_Display;
+    uint32_t m_RenderCostUs;
+};
+
+// Same as FFmpegVideoDecoder::getPacerLatencyPercentileUs()
+uint64_t getQueueLatencyPercentileUs(const VIDEO_STATS& stats, double percentile)
+{
+    uint32_t samples = 0;
+    for (int i = 0; i < PACER_LATENCY_HISTOGRAM_BUCKETS; i++) {
+        samples += stats.pacerLatencyHistogram[i];
+    }
+
+    uint32_t remaining = (uint32_t)(samples * (1.0 - percentile));
+    for (int i = PACER_LATENCY_HISTOGRAM_BUCKETS - 1; i > 0; i--) {
+        if (stats.pacerLatencyHistogram[i] > remaining) {
+            return (uint64_t)(i + 1) * PACER_LATENCY_HISTOGRAM_BUCKET_US;
+        }
+
+        remaining -= stats.pacerLatencyHistogram[i];
+    }
+
+    return PACER_LATENCY_HISTOGRAM_BUCKET_US;
+}
+
+}
+
+ArrivalTrace ArrivalTrace::smooth(int frameRate, int frames)
+{
+    ArrivalTrace trace;
+    trace.name = "smooth";
+    for (int i = 0; i < frames; i++) {
+        trace.arrivalOffsetsUs.append((uint64_t)i * 1000000 / frameRate);
+    }
+    return trace;
+}
+
+ArrivalTrace ArrivalTrace::jittery(int frameRate, int frames, quint32 seed)
+{
+    ArrivalTrace trace;
+    trace.name = "jittery";
+
+    // xorshift32 gets stuck at zero
+    quint32 state = seed != 0 ? seed : 1;
+    auto nextRandom = [&state]() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    };
+
+    uint64_t lastOffsetUs = 0;
+    for (int i = 0; i < frames; i++) {
+        uint64_t offsetUs = (uint64_t)i * 1000000 / frameRate;
+        if (nextRandom() % 100 < JITTERY_STALL_PERCENT) {
+            offsetUs += JITTERY_STALL_MIN_US + nextRandom() % (JITTERY_STALL_MAX_US - JITTERY_STALL_MIN_US);
+        }
+        else {
+            offsetUs += nextRandom() % JITTERY_MAX_DELAY_US;
+        }
+
+        // Frames still arrive in order, so a delayed frame holds back the ones after it
+        lastOffsetUs = SDL_max(offsetUs, lastOffsetUs);
+        trace.arrivalOffsetsUs.append(lastOffsetUs);
+    }
+    return trace;
+}
+
+ArrivalTrace ArrivalTrace::bursty(int frameRate, int frames)
+{
+    ArrivalTrace trace;
+    trace.name = "bursty";
+    for (int i = 0; i < frames; i++) {
+        // Each group is released when its last frame would have arrived
+        int releaseIndex = i - i % BURSTY_GROUP_FRAMES + BURSTY_GROUP_FRAMES - 1;
+        trace.arrivalOffsetsUs.append((uint64_t)releaseIndex * 1000000 / frameRate);
+    }
+    return trace;
+}
+
+bool ArrivalTrace::load(const QString& path, ArrivalTrace* trace)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+
+    trace->name = "recorded";
+    trace->arrivalOffsetsUs.clear();
+
+    // Times may be absolute, so make them relative to the first arrival
+    QTextStream stream(&file);
+    uint64_t firstUs = 0;
+    while (!stream.atEnd()) {
+        QString line = stream.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+
+        bool ok;
+        uint64_t timeUs = line.toULongLong(&ok);
+        if (!ok) {
+            return false;
+        }
+
+        if (trace->arrivalOffsetsUs.isEmpty()) {
+            firstUs = timeUs;
+        }
+        else if (timeUs < firstUs + trace->arrivalOffsetsUs.last()) {
+            // Out of order
+            return false;
+        }
+
+        trace->arrivalOffsetsUs.append(timeUs - firstUs);
+    }
+
+    return !trace->arrivalOffsetsUs.isEmpty();
+}
+
+bool PacerResult::operator==(const PacerResult& other) const
+{
+    return submittedFrames == other.submittedFrames &&
+           renderedFrames == other.renderedFrames &&
+           pacerDroppedFrames == other.pacerDroppedFrames &&
+           missedRenderDeadlines == other.missedRenderDeadlines &&
+           meanQueueLatencyUs == other.meanQueueLatencyUs &&
+           p99QueueLatencyUs == other.p99QueueLatencyUs &&
+           meanJudderUs == other.meanJudderUs &&
+           maxJudderUs == other.maxJudderUs;
+}
+
+PacerResult runPacerScenario(const PacerScenario& scenario)
+{
+    bool vrr = scenario.pacingMode == StreamingPreferences::FPM_VRR;
+    bool useVsyncSource = scenario.enablePacing && !vrr;
+
+    // The stream runs on this thread, and the Pacer's render thread (and
+    // V-sync thread if it has a source) run alongside
+    VirtualClock clock(useVsyncSource ? 3 : 2, SIMULATION_START_US);
+
+    VIDEO_STATS stats = {};
+    std::unique_ptr<FrameTimeline> frameTimeline(new FrameTimeline());
+    FramePool framePool;
+    SimDisplay display(scenario.displayHz);
+    SimRenderer renderer(&clock, vrr && scenario.enablePacing ? nullptr : &display, scenario.renderCostUs);
+
+    Pacer* pacer = new Pacer(&renderer, &stats, frameTimeline.get(), &framePool, scenario.pacingMode, &clock);
+    pacer->initialize(useVsyncSource ? new SimVsyncSource(&clock, &display) : nullptr,
+                      scenario.displayHz, scenario.streamFps, scenario.enablePacing);
+
+    const QVector<uint64_t>& arrivals = scenario.trace.arrivalOffsetsUs;
+    for (int i = 0; i < arrivals.count(); i++) {
+        clock.waitUntilUs(SIMULATION_START_US + arrivals[i]);
+
+        AVFrame* frame = framePool.take();
+        if (frame == nullptr) {
+            frame = av_frame_alloc();
+        }
+
+        // RTP timestamps use a 90 kHz clock and wrap at 32 bits
+        frame->pts = (uint32_t)((uint64_t)i * 90000 / scenario.streamFps);
+        frame->pkt_dts = (int64_t)clock.getMicroseconds();
+        frame->opaque = (void*)(intptr_t)(i + 1);
+        pacer->submitFrame(frame);
+    }
+
+    clock.waitUntilUs(SIMULATION_START_US + (arrivals.isEmpty() ? 0 : arrivals.last()) + SIMULATION_DRAIN_US);
+
+    // Every other thread is waiting on the clock, so the stats are stable
+    PacerResult result = {};
+    result.submittedFrames = (uint32_t)arrivals.count();
+    result.renderedFrames = stats.renderedFrames;
+    result.pacerDroppedFrames = stats.pacerDroppedFrames;
+    result.missedRenderDeadlines = stats.missedRenderDeadlines;
+    result.meanQueueLatencyUs = stats.renderedFrames != 0 ? stats.totalPacerTimeUs / stats.renderedFrames : 0;
+    result.p99QueueLatencyUs = getQueueLatencyPercentileUs(stats, 0.99);
+    result.meanJudderUs = stats.judderSamples != 0 ? stats.totalJudderUs / stats.judderSamples : 0;
+    result.maxJudderUs = stats.maxJudderUs;
+
+    clock.stop();
+    delete pacer;
+
+    return result;
+}
+
+const char* getPacingModeName(StreamingPreferences::FramePacingMode pacingMode)
+{
+    switch (pacingMode) {
+    case StreamingPreferences::FPM_BALANCED:
+        return "balanced";
+    case StreamingPreferences::FPM_LOW_LATENCY:
+        return "low latency";
+    case StreamingPreferences::FPM_ULTRA_LOW:
+        return "ultra low";
+    case StreamingPreferences::FPM_ADAPTIVE:
+        return "adaptive";
+    case StreamingPreferences::FPM_VRR:
+        return "vrr";
+    }
+
+    return "unknown";
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "streaming/video/ffmpeg-renderers/pacer/pacer.h"
+
+#include <QString>
+#include <QVector>
+
+// Frame arrival times relative to the start of a simulated stream
+struct ArrivalTrace {
+    QString name;
+    QVector<uint64_t> arrivalOffsetsUs;
+
+    // A perfect cadence at the stream's frame rate
+    static ArrivalTrace smooth(int frameRate, int frames);
+
+    // The cadence plus up to 4 ms of Wi-Fi style delay, with 2% of
+    // frames stalled for 20-50 ms. The delays repeat for each seed.
+    static ArrivalTrace jittery(int frameRate, int frames, quint32 seed);
+
+    // The cadence, but released in groups of 4 frames
+    static ArrivalTrace bursty(int frameRate, int frames);
+
+    // One arrival time in microseconds per line
+    static bool load(const QString& path, ArrivalTrace* trace);
+};
+
+struct PacerScenario {
+    ArrivalTrace trace;
+    int streamFps;
+    int displayHz;
+    StreamingPreferences::FramePacingMode pacingMode;
+    bool enablePacing;
+    uint32_t renderCostUs;
+};
+
+struct PacerResult {
+    uint32_t submittedFrames;
+    uint32_t renderedFrames;
+    uint32_t pacerDroppedFrames;
+    uint32_t missedRenderDeadlines;
+    uint64_t meanQueueLatencyUs;
+    uint64_t p99QueueLatencyUs;
+    uint64_t meanJudderUs;
+    uint32_t maxJudderUs;
+
+    bool operator==(const PacerResult& other) const;
+};
+
+// Streams the scenario's frames through a real Pacer on virtual time. The
+// display is a fixed-rate V-sync source (or nothing for VRR and unpaced
+// modes), and the renderer takes a fixed time to present each frame.
+PacerResult runPacerScenario(const PacerScenario& scenario);
+
+const char* getPacingModeName(StreamingPreferences::FramePacingMode pacingMode);
@@ -0,0 +1,144 @@
+#include "pacersimulation.h"
+
+#include <QtTest>
+
+#define SMOOTH_TEST_FRAMES 600
+#define RENDER_COST_US 1000
+
+class TestPacerSim : public QObject
+{
+    Q_OBJECT
+
+private:
+    static PacerScenario makeScenario(const ArrivalTrace& trace, int streamFps, int displayHz,
+                                      StreamingPreferences::FramePacingMode pacingMode)
+    {
+        PacerScenario scenario;
+        scenario.trace = trace;
+        scenario.streamFps = streamFps;
+        scenario.displayHz = displayHz;
+        scenario.pacingMode = pacingMode;
+        scenario.enablePacing = true;
+        scenario.renderCostUs = RENDER_COST_US;
+        return scenario;
+    }
+
+private slots:
+    void smoothStreamIsNotDropped_data()
+    {
+        QTest::addColumn<int>("pacingMode");
+
+        QTest::newRow("balanced") << (int)StreamingPreferences::FPM_BALANCED;
+        QTest::newRow("low latency") << (int)StreamingPreferences::FPM_LOW_LATENCY;
+        QTest::newRow("ultra low") << (int)StreamingPreferences::FPM_ULTRA_LOW;
+        QTest::newRow("adaptive") << (int)StreamingPreferences::FPM_ADAPTIVE;
+    }
+
+    void smoothStreamIsNotDropped()
+    {
+        QFETCH(int, pacingMode);
+
+        PacerResult result = runPacerScenario(makeScenario(ArrivalTrace::smooth(60, SMOOTH_TEST_FRAMES), 60, 60,
+                                                           (StreamingPreferences::FramePacingMode)pacingMode));
+
+        // Shallow modes may drop a frame or two while the first frames settle
+        QCOMPARE(result.renderedFrames + result.pacerDroppedFrames, result.submittedFrames);
+        QVERIFY2(result.pacerDroppedFrames <= 2, qPrintable(QString::number(result.pacerDroppedFrames)));
+        QVERIFY2(result.missedRenderDeadlines <= 2, qPrintable(QString::number(result.missedRenderDeadlines)));
+    }
+
+    void highFrameRateIsDecimated()
+    {
+        // 120 FPS on a 60 Hz display shows every other frame
+        PacerResult result = runPacerScenario(makeScenario(ArrivalTrace::smooth(120, SMOOTH_TEST_FRAMES * 2), 120, 60,
+                                                           StreamingPreferences::FPM_BALANCED));
+
+        QCOMPARE(result.renderedFrames + result.pacerDroppedFrames, result.submittedFrames);
+        QVERIFY2(result.renderedFrames >= SMOOTH_TEST_FRAMES * 9 / 10 && result.renderedFrames <= SMOOTH_TEST_FRAMES * 11 / 10,
+                 qPrintable(QString::number(result.renderedFrames)));
+    }
+
+    void vrrCapsRefreshRate()
+    {
+        // 120 FPS on a display that can only refresh at up to 60 Hz
+        PacerResult result = runPacerScenario(makeScenario(ArrivalTrace::smooth(120, SMOOTH_TEST_FRAMES * 2), 120, 60,
+                                                           StreamingPreferences::FPM_VRR));
+
+        QCOMPARE(result.renderedFrames + result.pacerDroppedFrames, result.submittedFrames);
+        QVERIFY2(result.renderedFrames <= SMOOTH_TEST_FRAMES + 2, qPrintable(QString::number(result.renderedFrames)));
+    }
+
+    void simulationIsDeterministic()
+    {
+        PacerScenario scenario = makeScenario(ArrivalTrace::jittery(60, SMOOTH_TEST_FRAMES, 1), 60, 60,
+                                              StreamingPreferences::FPM_ADAPTIVE);
+
+        PacerResult first = runPacerScenario(scenario);
+        PacerResult second = runPacerScenario(scenario);
+        QVERIFY(first == second);
+    }
+
+    // Prints the metrics for each trace and pacing mode for comparing policies
+    void report()
+    {
+        struct TraceConfig {
+            ArrivalTrace trace;
+            int streamFps;
+            int displayHz;
+        };
+
+        QVector<TraceConfig> traces = {
+            { ArrivalTrace::smooth(60, SMOOTH_TEST_FRAMES), 60, 60 },
+            { ArrivalTrace::jittery(60, SMOOTH_TEST_FRAMES, 1), 60, 60 },
+            { ArrivalTrace::bursty(60, SMOOTH_TEST_FRAMES), 60, 60 },
+            { ArrivalTrace::smooth(120, SMOOTH_TEST_FRAMES * 2), 120, 60 },
+            { ArrivalTrace::smooth(60, SMOOTH_TEST_FRAMES), 60, 144 },
+        };
+
+        QString tracePath = qEnvironmentVariable("PACERSIM_TRACE");
+        if (!tracePath.isEmpty()) {
+            ArrivalTrace recorded;
+            QVERIFY2(ArrivalTrace::load(tracePath, &recorded), qPrintable(tracePath));
+            traces.append({ recorded,
+                            qEnvironmentVariableIntValue("PACERSIM_TRACE_FPS") > 0 ? qEnvironmentVariableIntValue("PACERSIM_TRACE_FPS") : 60,
+                            qEnvironmentVariableIntValue("PACERSIM_DISPLAY_HZ") > 0 ? qEnvironmentVariableIntValue("PACERSIM_DISPLAY_HZ") : 60 });
+        }
+
+        const StreamingPreferences::FramePacingMode pacingModes[] = {
+            StreamingPreferences::FPM_BALANCED,
+            StreamingPreferences::FPM_LOW_LATENCY,
+            StreamingPreferences::FPM_ULTRA_LOW,
+            StreamingPreferences::FPM_ADAPTIVE,
+            StreamingPreferences::FPM_VRR,
+        };
+
+        qInfo("%-16s %-12s %8s %8s %8s %10s %10s %10s %10s",
+              "trace", "mode", "rendered", "dropped", "missed",
+              "mean lat", "p99 lat", "mean jud", "max jud");
+
+        for (const TraceConfig& config : std::as_const(traces)) {
+            QString traceName = QString("%1 %2/%3").arg(config.trace.name).arg(config.streamFps).arg(config.displayHz);
+
+            for (StreamingPreferences::FramePacingMode pacingMode : pacingModes) {
+                PacerResult result = runPacerScenario(makeScenario(config.trace, config.streamFps,
+                                                                   config.displayHz, pacingMode));
+
+                qInfo("%-16s %-12s %8u %8u %8u %8.2fms %8.2fms %8.2fms %8.2fms",
+                      qPrintable(traceName),
+                      getPacingModeName(pacingMode),
+                      result.renderedFrames,
+                      result.pacerDroppedFrames,
+                      result.missedRenderDeadlines,
+                      result.meanQueueLatencyUs / 1000.0,
+                      result.p99QueueLatencyUs / 1000.0,
+                      result.meanJudderUs / 1000.0,
+                      result.maxJudderUs / 1000.0);
+
+                QCOMPARE(result.renderedFrames + result.pacerDroppedFrames, result.submittedFrames);
+            }
+        }
+    }
+};
+
+QTEST_GUILESS_MAIN(TestPacerSim)
+#include "tst_pacersim.moc"
@@ -0,0 +1,91 @@
+#include "virtualclock.h"
+
+#include <QtGlobal>
+
+VirtualClock::VirtualClock(int threadCount, uint64_t startUs)
+    : m_ThreadCount(threadCount),
+      m_NowUs(startUs),
+      m_Stopped(false)
+{
+
+}
+
+uint64_t VirtualClock::getMicroseconds()
+{
+    QMutexLocker locker(&m_Lock);
+    return m_NowUs;
+}
+
+void VirtualClock::waitUntilUs(uint64_t deadlineUs)
+{
+    wait(deadlineUs, nullptr);
+}
+
+bool VirtualClock::waitForFrame(FrameQueue& queue)
+{
+    wait(UINT64_MAX, &queue);
+    return !queue.isEmpty();
+}
+
+bool VirtualClock::waitForFrameUntil(FrameQueue& queue, uint64_t deadlineUs)
+{
+    wait(deadlineUs, &queue);
+    return !queue.isEmpty();
+}
+
+void VirtualClock::stop()
+{
+    QMutexLocker locker(&m_Lock);
+    m_Stopped = true;
+    m_Wakeup.wakeAll();
+}
+
+void VirtualClock::wait(uint64_t deadlineUs, FrameQueue* queue)
+{
+    QMutexLocker locker(&m_Lock);
+
+    if (m_Stopped) {
+        return;
+    }
+
+    // Even a wait that's already over goes through the scheduler,
+    // so threads due at the same time run in a fixed order.
+    Waiter waiter = { deadlineUs, queue, false };
+    m_Waiters.append(&waiter);
+    scheduleNextLocked();
+
+    while (!waiter.running && !m_Stopped) {
+        m_Wakeup.wait(&m_Lock);
+    }
+
+    if (!waiter.running) {
+        m_Waiters.removeOne(&waiter);
+    }
+}
+
+void VirtualClock::scheduleNextLocked()
+{
+    // Time can only move once no thread is running
+    if (m_Waiters.count() < m_ThreadCount) {
+        return;
+    }
+
+    Waiter* next = nullptr;
+    uint64_t nextUs = UINT64_MAX;
+    for (Waiter* waiter : std::as_const(m_Waiters)) {
+        uint64_t wakeUs = waiter->queue != nullptr && !waiter->queue->isEmpty() ? m_NowUs : waiter->deadlineUs;
+        if (next == nullptr || wakeUs < nextUs) {
+            next = waiter;
+            nextUs = wakeUs;
+        }
+    }
+
+    if (nextUs == UINT64_MAX) {
+        qFatal("Every simulated thread is waiting forever");
+    }
+
+    m_NowUs = qMax(m_NowUs, nextUs);
+    m_Waiters.removeOne(next);
+    next->running = true;
+    m_Wakeup.wakeAll();
+}
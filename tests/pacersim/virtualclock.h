@@ -0,0 +1,51 @@
+#pragma once
+
+#include "streaming/video/ffmpeg-renderers/pacer/pacer.h"
+
+#include <QMutex>
+#include <QVector>
+#include <QWaitCondition>
+
+// Runs a fixed number of threads on virtual time, one at a time. Once every
+// thread is waiting on the clock, time jumps straight to the earliest wakeup
+// and that thread runs until it waits again. A wait for a frame ends as soon
+// as another thread has queued one. Ties go to the thread that started
+// waiting first, so a simulation is deterministic and never really sleeps.
+//
+// Threads that block outside of the clock would stall it, so everything the
+// simulated threads wait on must go through here.
+class VirtualClock : public IPacerClock
+{
+public:
+    VirtualClock(int threadCount, uint64_t startUs);
+
+    virtual uint64_t getMicroseconds() override;
+
+    virtual void waitUntilUs(uint64_t deadlineUs) override;
+
+    virtual bool waitForFrame(FrameQueue& queue) override;
+
+    virtual bool waitForFrameUntil(FrameQueue& queue, uint64_t deadlineUs) override;
+
+    // Lets all threads run freely (and all waits return at once) so the
+    // simulated threads can be shut down
+    void stop();
+
+private:
+    struct Waiter {
+        uint64_t deadlineUs;
+        FrameQueue* queue;
+        bool running;
+    };
+
+    void wait(uint64_t deadlineUs, FrameQueue* queue);
+
+    void scheduleNextLocked();
+
+    QMutex m_Lock;
+    QWaitCondition m_Wakeup;
+    QVector<Waiter*> m_Waiters;
+    int m_ThreadCount;
+    uint64_t m_NowUs;
+    bool m_Stopped;
+};
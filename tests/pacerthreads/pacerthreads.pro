@@ -0,0 +1,17 @@
+# Runs the real Pacer on the system clock with its V-sync and render threads,
+# submitting jittery frames while another thread reads the queue depths that
+# the stats overlay shows.
+
+TARGET = tst_pacerthreads
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_pacerthreads.cpp \
+    $$APP_DIR/path.cpp \
+    $$APP_DIR/streaming/streamutils.cpp \
+    $$APP_DIR/streaming/video/framepool.cpp \
+    $$APP_DIR/streaming/video/frametimeline.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/pacer/framequeue.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/pacer/pacer.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/pacer/softwarevsyncsource.cpp
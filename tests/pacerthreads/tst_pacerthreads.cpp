@@ -0,0 +1,239 @@
+#include "streaming/video/ffmpeg-renderers/pacer/pacer.h"
+#include "streaming/streamutils.h"
+
+#include <QtTest>
+
+#include <Limelight.h>
+
+#include <atomic>
+#include <memory>
+
+#define STREAM_FPS 60
+#define DISPLAY_HZ 60
+#define TEST_FRAMES 300
+#define RENDER_COST_US 1000
+
+// Up to 4 ms of delay, with 2% of frames stalled for 20-50 ms like the
+// jittery pacersim trace
+#define MAX_DELAY_US 4000
+#define STALL_PERCENT 2
+#define STALL_MIN_US 20000
+#define STALL_MAX_US 50000
+
+// Long enough for the V-sync thread to render or drop everything queued
+#define DRAIN_US 200000
+
+// The deepest queue any mode (or the adaptive controller) may ask for
+#define MAX_QUEUE_DEPTH (PACER_MAX_OUTSTANDING_FRAMES - 2)
+
+namespace {
+
+// Wakes on a fixed vblank grid of the system clock
+class TimerVsyncSource : public IVsyncSource
+{
+public:
+    TimerVsyncSource()
+        : m_PeriodUs(0),
+          m_StartUs(0),
+          m_LastVsyncUs(0)
+    {
+    }
+
+    virtual bool initialize(SDL_Window*, int displayFps) override
+    {
+        m_PeriodUs = 1000000 / displayFps;
+        m_StartUs = LiGetMicroseconds();
+        return true;
+    }
+
+    virtual bool isAsync() override
+    {
+        return false;
+    }
+
+    virtual void waitForVsync() override
+    {
+        uint64_t periods = (LiGetMicroseconds() - m_StartUs) / m_PeriodUs + 1;
+        m_LastVsyncUs = m_StartUs + periods * m_PeriodUs;
+        StreamUtils::waitUntilUs(m_LastVsyncUs);
+    }
+
+    virtual uint64_t getLastVsyncTimeUs() override
+    {
+        return m_LastVsyncUs;
+    }
+
+private:
+    uint64_t m_PeriodUs;
+    uint64_t m_StartUs;
+    uint64_t m_LastVsyncUs;
+};
+
+// Takes a fixed time to render and checks that frames arrive in order.
+// Only the render thread touches this until the Pacer is gone.
+class OrderCheckingRenderer : public IFFmpegRenderer
+{
+public:
+    OrderCheckingRenderer()
+        : IFFmpegRenderer(RendererType::Unknown),
+          m_LastFrameNumber(0),
+          m_OutOfOrderFrames(0)
+    {
+    }
+
+    virtual bool initialize(PDECODER_PARAMETERS) override
+    {
+        return true;
+    }
+
+    virtual bool prepareDecoderContext(AVCodecContext*, AVDictionary**) override
+    {
+        return true;
+    }
+
+    virtual void renderFrame(AVFrame* frame) override
+    {
+        int frameNumber = (int)(intptr_t)frame->opaque;
+        if (frameNumber <= m_LastFrameNumber) {
+            m_OutOfOrderFrames++;
+        }
+        m_LastFrameNumber = frameNumber;
+
+        StreamUtils::waitUntilUs(LiGetMicroseconds() + RENDER_COST_US);
+    }
+
+    int getOutOfOrderFrames() const
+    {
+        return m_OutOfOrderFrames;
+    }
+
+private:
+    int m_LastFrameNumber;
+    int m_OutOfOrderFrames;
+};
+
+// Counts frames whose buffer has been released, so each frame must
+// come back to the pool exactly once whether it's rendered or dropped
+std::atomic<int> s_ReleasedFrames;
+uint8_t s_FrameData[1];
+
+void releaseFrameData(void*, uint8_t*)
+{
+    s_ReleasedFrames++;
+}
+
+}
+
+class TestPacerThreads : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void depthsStayInRangeWhileStreaming_data()
+    {
+        QTest::addColumn<int>("pacingMode");
+
+        QTest::newRow("balanced") << (int)StreamingPreferences::FPM_BALANCED;
+        QTest::newRow("adaptive") << (int)StreamingPreferences::FPM_ADAPTIVE;
+    }
+
+    void depthsStayInRangeWhileStreaming()
+    {
+        QFETCH(int, pacingMode);
+
+        VIDEO_STATS stats = {};
+        std::unique_ptr<FrameTimeline> frameTimeline(new FrameTimeline());
+        FramePool framePool;
+        OrderCheckingRenderer renderer;
+        s_ReleasedFrames = 0;
+
+        Pacer* pacer = new Pacer(&renderer, &stats, frameTimeline.get(), &framePool,
+                                 (StreamingPreferences::FramePacingMode)pacingMode);
+        TimerVsyncSource* vsyncSource = new TimerVsyncSource();
+        QVERIFY(vsyncSource->initialize(nullptr, DISPLAY_HZ));
+        QVERIFY(pacer->initialize(vsyncSource, DISPLAY_HZ, STREAM_FPS, true));
+
+        // The stats overlay reads these from the decoder thread while the
+        // controller moves them, so read them as fast as we can meanwhile
+        std::atomic<bool> stopReading(false);
+        std::atomic<int> badQueueDepthLimits(0);
+        std::atomic<int> badTargetQueueDepths(0);
+        std::atomic<int> depthReads(0);
+        QThread* reader = QThread::create([&]() {
+            while (!stopReading) {
+                int limit = pacer->getQueueDepthLimit();
+                if (limit < 1 || limit > MAX_QUEUE_DEPTH) {
+                    badQueueDepthLimits++;
+                }
+
+                // The target is 0 until the first frame is measured
+                int target = pacer->getAdaptiveTargetQueueDepth();
+                if (target < 0 || target > MAX_QUEUE_DEPTH) {
+                    badTargetQueueDepths++;
+                }
+
+                depthReads++;
+                QThread::yieldCurrentThread();
+            }
+        });
+        reader->start();
+
+        quint32 seed = 1;
+        auto nextRandom = [&seed]() {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            return seed;
+        };
+
+        uint64_t startUs = LiGetMicroseconds();
+        uint64_t lastArrivalUs = startUs;
+        for (int i = 0; i < TEST_FRAMES; i++) {
+            uint64_t arrivalUs = startUs + (uint64_t)i * 1000000 / STREAM_FPS;
+            if (nextRandom() % 100 < STALL_PERCENT) {
+                arrivalUs += STALL_MIN_US + nextRandom() % (STALL_MAX_US - STALL_MIN_US);
+            }
+            else {
+                arrivalUs += nextRandom() % MAX_DELAY_US;
+            }
+
+            // Frames still arrive in order, so a delayed frame holds back the ones after it
+            lastArrivalUs = SDL_max(arrivalUs, lastArrivalUs);
+            StreamUtils::waitUntilUs(lastArrivalUs);
+
+            AVFrame* frame = framePool.take();
+            if (frame == nullptr) {
+                frame = av_frame_alloc();
+            }
+
+            frame->buf[0] = av_buffer_create(s_FrameData, sizeof(s_FrameData), releaseFrameData, nullptr, 0);
+            QVERIFY(frame->buf[0] != nullptr);
+
+            // RTP timestamps use a 90 kHz clock and wrap at 32 bits
+            frame->pts = (uint32_t)((uint64_t)i * 90000 / STREAM_FPS);
+            frame->pkt_dts = (int64_t)LiGetMicroseconds();
+            frame->opaque = (void*)(intptr_t)(i + 1);
+            pacer->submitFrame(frame);
+        }
+
+        StreamUtils::waitUntilUs(LiGetMicroseconds() + DRAIN_US);
+
+        stopReading = true;
+        reader->wait();
+        delete reader;
+
+        // This joins the Pacer's threads, so the stats are stable after
+        delete pacer;
+
+        QCOMPARE(badQueueDepthLimits.load(), 0);
+        QCOMPARE(badTargetQueueDepths.load(), 0);
+        QVERIFY(depthReads > 0);
+
+        QCOMPARE(renderer.getOutOfOrderFrames(), 0);
+        QCOMPARE(stats.renderedFrames + stats.pacerDroppedFrames, (uint32_t)TEST_FRAMES);
+        QCOMPARE(s_ReleasedFrames.load(), TEST_FRAMES);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestPacerThreads)
+#include "tst_pacerthreads.moc"
@@ -0,0 +1,22 @@
+# Runs DecoderProbeScheduler with a stand-in for Session::probeDecoder(),
+# checking that probes stay on the calling thread while the FFmpeg decoder
+# checks they wait for run concurrently.
+
+TARGET = tst_probescheduler
+
+include(../tests.pri)
+
+QT += network
+PKGCONFIG += opus
+
+DEFINES += HAVE_FFMPEG
+DEFINES += VERSION_STR=\\\"$$cat($$APP_DIR/version.txt)\\\"
+
+# Session pulls in the input and backend headers
+INCLUDEPATH += $$PWD/../../qmdnsengine/qmdnsengine/src/include $$PWD/../../qmdnsengine
+
+SOURCES += \
+    tst_probescheduler.cpp \
+    $$APP_DIR/path.cpp \
+    $$APP_DIR/streaming/video/capabilitycache.cpp \
+    $$APP_DIR/streaming/video/probescheduler.cpp
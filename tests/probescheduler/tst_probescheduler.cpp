@@ -0,0 +1,163 @@
+#include "streaming/session.h"
+
+#include <QtTest>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#define STRESS_ITERATIONS 200
+
+namespace {
+
+QMutex s_ProbeLock;
+QVector<Qt::HANDLE> s_ProbeThreads;
+
+struct FormatInfo {
+    int videoFormat;
+    AVCodecID codecId;
+};
+
+const FormatInfo k_Formats[] = {
+    { VIDEO_FORMAT_H264, AV_CODEC_ID_H264 },
+    { VIDEO_FORMAT_H265, AV_CODEC_ID_HEVC },
+    { VIDEO_FORMAT_AV1_MAIN8, AV_CODEC_ID_AV1 },
+};
+
+}
+
+// Real probes create renderers on the test window, so the tests link this
+// stand-in instead of session.cpp. It records the thread each probe ran on.
+bool Session::probeDecoder(StreamingPreferences::VideoDecoderSelection,
+                           SDL_Window*, int videoFormat, int width, int height,
+                           int, bool, DecoderProbeResult& result)
+{
+    QMutexLocker locker(&s_ProbeLock);
+    s_ProbeThreads.append(QThread::currentThreadId());
+
+    result = {};
+    result.available = true;
+    result.maxResolution = QSize(width, height);
+    result.capabilities = videoFormat;
+    return true;
+}
+
+class TestProbeScheduler : public QObject
+{
+    Q_OBJECT
+
+private:
+    static int takeProbeCount()
+    {
+        QMutexLocker locker(&s_ProbeLock);
+        int count = s_ProbeThreads.count();
+        s_ProbeThreads.clear();
+        return count;
+    }
+
+    // The scheduler should skip the probe if FFmpeg has no decoder
+    static bool isDecodable(const FormatInfo& format)
+    {
+        return avcodec_find_decoder(format.codecId) != nullptr;
+    }
+
+private slots:
+    void init()
+    {
+        takeProbeCount();
+    }
+
+    void cleanup()
+    {
+        qunsetenv("DECODER_PROBE_THREADS");
+    }
+
+    void probesRunOnCallingThread()
+    {
+        {
+            DecoderProbeScheduler scheduler(nullptr);
+
+            for (const FormatInfo& format : k_Formats) {
+                scheduler.prefetch(StreamingPreferences::VDS_AUTO, format.videoFormat, 1920, 1080, 60, false);
+            }
+
+            for (const FormatInfo& format : k_Formats) {
+                DecoderProbeResult result;
+                QCOMPARE(scheduler.probe(StreamingPreferences::VDS_AUTO, format.videoFormat, 1920, 1080, 60, false, result),
+                         isDecodable(format));
+                if (result.available) {
+                    QCOMPARE(result.capabilities, format.videoFormat);
+                }
+            }
+        }
+
+        QMutexLocker locker(&s_ProbeLock);
+        for (Qt::HANDLE thread : std::as_const(s_ProbeThreads)) {
+            QCOMPARE(thread, QThread::currentThreadId());
+        }
+    }
+
+    void resultsAreReused()
+    {
+        const FormatInfo& format = k_Formats[0];
+        if (!isDecodable(format)) {
+            QSKIP("FFmpeg has no H.264 decoder");
+        }
+
+        DecoderProbeScheduler scheduler(nullptr);
+        DecoderProbeResult result;
+
+        QVERIFY(scheduler.probe(StreamingPreferences::VDS_AUTO, format.videoFormat, 1920, 1080, 60, false, result));
+        QVERIFY(scheduler.probe(StreamingPreferences::VDS_AUTO, format.videoFormat, 1920, 1080, 60, false, result));
+        QCOMPARE(takeProbeCount(), 1);
+
+        // Any other parameter is a different probe
+        QVERIFY(scheduler.probe(StreamingPreferences::VDS_AUTO, format.videoFormat, 3840, 2160, 60, false, result));
+        QCOMPARE(result.maxResolution, QSize(3840, 2160));
+        QVERIFY(scheduler.probe(StreamingPreferences::VDS_FORCE_SOFTWARE, format.videoFormat, 1920, 1080, 60, false, result));
+        QVERIFY(scheduler.probe(StreamingPreferences::VDS_AUTO, format.videoFormat, 1920, 1080, 120, false, result));
+        QVERIFY(scheduler.probe(StreamingPreferences::VDS_AUTO, format.videoFormat, 1920, 1080, 60, true, result));
+        QCOMPARE(takeProbeCount(), 4);
+    }
+
+    void prefetchRacesWithProbe_data()
+    {
+        QTest::addColumn<int>("threads");
+
+        QTest::newRow("1 thread") << 1;
+        QTest::newRow("3 threads") << 3;
+    }
+
+    void prefetchRacesWithProbe()
+    {
+        QFETCH(int, threads);
+
+        qputenv("DECODER_PROBE_THREADS", QByteArray::number(threads));
+
+        int expectedProbes = 0;
+        for (const FormatInfo& format : k_Formats) {
+            expectedProbes += isDecodable(format) ? 1 : 0;
+        }
+
+        // Probe each format right after its check was queued, so the probe
+        // usually has to wait for a check that's queued or still running.
+        for (int i = 0; i < STRESS_ITERATIONS; i++) {
+            DecoderProbeScheduler scheduler(nullptr);
+
+            for (const FormatInfo& format : k_Formats) {
+                scheduler.prefetch(StreamingPreferences::VDS_AUTO, format.videoFormat, 1920, 1080, 60, false);
+            }
+
+            for (int j = (int)SDL_arraysize(k_Formats) - 1; j >= 0; j--) {
+                DecoderProbeResult result;
+                QCOMPARE(scheduler.probe(StreamingPreferences::VDS_AUTO, k_Formats[j].videoFormat, 1920, 1080, 60, false, result),
+                         isDecodable(k_Formats[j]));
+            }
+
+            QCOMPARE(takeProbeCount(), expectedProbes);
+        }
+    }
+};
+
+QTEST_GUILESS_MAIN(TestProbeScheduler)
+#include "tst_probescheduler.moc"
@@ -0,0 +1,13 @@
+# Feeds SoftwareVsyncSource synthetic present timestamps from displays whose
+# real refresh rate differs from the nominal one, and checks that its PLL
+# predicts the real vblanks.
+
+TARGET = tst_softwarevsync
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_softwarevsync.cpp \
+    $$APP_DIR/path.cpp \
+    $$APP_DIR/streaming/streamutils.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/pacer/softwarevsyncsource.cpp
@@ -0,0 +1,169 @@
+#include "streaming/video/ffmpeg-renderers/pacer/softwarevsyncsource.h"
+
+#include <QtTest>
+
+// Arbitrary start of the synthetic timeline
+#define DISPLAY_START_US 1000000000.0
+
+// Presents return this long after the vblank, give or take the jitter
+#define PRESENT_LATENCY_US 200
+#define PRESENT_JITTER_US 250
+
+#define LOCK_PRESENTS 1200
+#define PREDICTED_VBLANKS 120
+#define MAX_PREDICTION_ERROR_US 500
+
+// Frames presented by a display with a fixed (but unknown to the source)
+// refresh rate, with deterministic scheduling noise
+class SimDisplay
+{
+public:
+    SimDisplay(double refreshRate)
+        : m_PeriodUs(1000000.0 / refreshRate),
+          m_StartUs(DISPLAY_START_US),
+          m_Seed(1)
+    {
+    }
+
+    double getPeriodUs() const
+    {
+        return m_PeriodUs;
+    }
+
+    // When a present for this vblank returns, on average
+    double getPresentUs(int vblank) const
+    {
+        return m_StartUs + vblank * m_PeriodUs + PRESENT_LATENCY_US;
+    }
+
+    uint64_t present(int vblank)
+    {
+        m_Seed ^= m_Seed << 13;
+        m_Seed ^= m_Seed >> 17;
+        m_Seed ^= m_Seed << 5;
+        return (uint64_t)(getPresentUs(vblank) + (int)(m_Seed % (PRESENT_JITTER_US * 2)) - PRESENT_JITTER_US);
+    }
+
+    // Like a display mode change
+    void shiftPhase(double offsetUs)
+    {
+        m_StartUs += offsetUs;
+    }
+
+private:
+    double m_PeriodUs;
+    double m_StartUs;
+    quint32 m_Seed;
+};
+
+class TestSoftwareVsync : public QObject
+{
+    Q_OBJECT
+
+private:
+    // Asks for the next vblank a quarter period ahead of each real one. The
+    // source predicts when presents return, so that's what we compare to.
+    static double getMaxPredictionErrorUs(SoftwareVsyncSource& source, const SimDisplay& display, int firstVblank)
+    {
+        double maxErrorUs = 0;
+
+        for (int i = firstVblank; i < firstVblank + PREDICTED_VBLANKS; i++) {
+            double expectedUs = display.getPresentUs(i);
+            uint64_t predictedUs = source.predictNextVsyncUs((uint64_t)(expectedUs - display.getPeriodUs() / 4));
+            maxErrorUs = qMax(maxErrorUs, qAbs((double)predictedUs - expectedUs));
+        }
+
+        return maxErrorUs;
+    }
+
+private slots:
+    void firstPresentSeedsPhase()
+    {
+        SoftwareVsyncSource source;
+        QVERIFY(source.initialize(nullptr, 60));
+
+        source.notifyPresent(1000000);
+
+        // The nominal period from the first present, with no lock needed
+        QVERIFY(qAbs((double)source.predictNextVsyncUs(1000000 + 1000) - (1000000 + 1000000.0 / 60)) <= 1);
+    }
+
+    void rejectsInvalidRefreshRate()
+    {
+        SoftwareVsyncSource source;
+        QVERIFY(!source.initialize(nullptr, 0));
+    }
+
+    void locksToRealRefreshRate_data()
+    {
+        QTest::addColumn<int>("nominalRate");
+        QTest::addColumn<double>("realRate");
+
+        QTest::newRow("60 Hz") << 60 << 60.0;
+        QTest::newRow("59.94 Hz") << 60 << 60000.0 / 1001;
+        QTest::newRow("119.88 Hz") << 120 << 120000.0 / 1001;
+        QTest::newRow("143.86 Hz") << 144 << 143.86;
+    }
+
+    void locksToRealRefreshRate()
+    {
+        QFETCH(int, nominalRate);
+        QFETCH(double, realRate);
+
+        SoftwareVsyncSource source;
+        SimDisplay display(realRate);
+        QVERIFY(source.initialize(nullptr, nominalRate));
+
+        for (int i = 0; i < LOCK_PRESENTS; i++) {
+            source.notifyPresent(display.present(i));
+        }
+
+        // Predicting 2 seconds out at the nominal period would be off by
+        // several milliseconds, so this only passes if the period is tracked
+        double maxErrorUs = getMaxPredictionErrorUs(source, display, LOCK_PRESENTS);
+        QVERIFY2(maxErrorUs <= MAX_PREDICTION_ERROR_US, qPrintable(QString::number(maxErrorUs)));
+    }
+
+    void ignoresMissedVsyncs()
+    {
+        SoftwareVsyncSource source;
+        SimDisplay display(60000.0 / 1001);
+        QVERIFY(source.initialize(nullptr, 60));
+
+        // Runs of presents half a period late, just short of losing lock
+        for (int i = 0; i < LOCK_PRESENTS; i++) {
+            uint64_t presentUs = display.present(i);
+            if (i % 50 >= 43) {
+                presentUs += (uint64_t)(display.getPeriodUs() / 2);
+            }
+            source.notifyPresent(presentUs);
+        }
+
+        double maxErrorUs = getMaxPredictionErrorUs(source, display, LOCK_PRESENTS);
+        QVERIFY2(maxErrorUs <= MAX_PREDICTION_ERROR_US, qPrintable(QString::number(maxErrorUs)));
+    }
+
+    void relocksAfterPhaseChange()
+    {
+        SoftwareVsyncSource source;
+        SimDisplay display(60000.0 / 1001);
+        QVERIFY(source.initialize(nullptr, 60));
+
+        int vblank = 0;
+        for (; vblank < LOCK_PRESENTS / 2; vblank++) {
+            source.notifyPresent(display.present(vblank));
+        }
+
+        // Every sample is now rejected until the source gives up and reseeds
+        display.shiftPhase(display.getPeriodUs() / 2);
+        for (; vblank < LOCK_PRESENTS; vblank++) {
+            source.notifyPresent(display.present(vblank));
+        }
+
+        double maxErrorUs = getMaxPredictionErrorUs(source, display, vblank);
+        QVERIFY2(maxErrorUs <= MAX_PREDICTION_ERROR_US, qPrintable(QString::number(maxErrorUs)));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestSoftwareVsync)
+#include "tst_softwarevsync.moc"
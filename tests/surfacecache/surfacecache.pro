@@ -0,0 +1,10 @@
+# Covers the per-surface cache that the EGL and DRM renderers keep their
+# imported EGLImages and framebuffers in, including flushes on a frames
+# context change and resets from the decoder thread.
+
+TARGET = tst_surfacecache
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_surfacecache.cpp
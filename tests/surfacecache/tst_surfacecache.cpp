@@ -0,0 +1,368 @@
+#include "streaming/video/ffmpeg-renderers/surfacecache.h"
+
+#include <QtTest>
+
+#include <cstring>
+#include <set>
+
+#define TEST_CACHE_SIZE 4
+
+namespace {
+
+// Like the EGLImage cache, which identifies a VAAPI surface by its ID and
+// the export flags used for it
+struct ImageKey {
+    uint64_t surface;
+    uint32_t exportFlags;
+
+    bool operator==(const ImageKey& other) const {
+        return surface == other.surface && exportFlags == other.exportFlags;
+    }
+};
+
+typedef SurfaceCache<ImageKey, int, TEST_CACHE_SIZE> ImageCache;
+
+// Like the KMS framebuffer cache, which identifies DMA-BUFs by inode along
+// with the layout of their planes
+struct FbKey {
+    uint64_t buffers[4];
+    uint32_t format;
+    uint64_t modifier;
+    uint32_t pitches[4];
+    uint32_t offsets[4];
+    int width;
+    int height;
+
+    bool operator==(const FbKey& other) const {
+        return memcmp(buffers, other.buffers, sizeof(buffers)) == 0 &&
+               memcmp(pitches, other.pitches, sizeof(pitches)) == 0 &&
+               memcmp(offsets, other.offsets, sizeof(offsets)) == 0 &&
+               format == other.format &&
+               modifier == other.modifier &&
+               width == other.width &&
+               height == other.height;
+    }
+};
+
+typedef SurfaceCache<FbKey, uint32_t, TEST_CACHE_SIZE> FbCache;
+
+FbKey makeNv12FbKey(uint64_t inode)
+{
+    FbKey key = {};
+    key.buffers[0] = inode;
+    key.format = 0x3231564e; // DRM_FORMAT_NV12
+    key.modifier = 0;
+    key.pitches[0] = key.pitches[1] = 1920;
+    key.offsets[1] = 1920 * 1088;
+    key.width = 1920;
+    key.height = 1080;
+    return key;
+}
+
+// Stands in for the DRM property setter, which keeps cached FBs alive
+// until they're released and no longer on a plane
+class FbRetainer
+{
+public:
+    void retainFb(uint32_t fbId)
+    {
+        QVERIFY(m_RetainedFbs.insert(fbId).second);
+    }
+
+    void releaseRetainedFb(uint32_t fbId)
+    {
+        QCOMPARE((int)m_RetainedFbs.erase(fbId), 1);
+    }
+
+    int getRetainedCount() const
+    {
+        return (int)m_RetainedFbs.size();
+    }
+
+private:
+    std::set<uint32_t> m_RetainedFbs;
+};
+
+}
+
+class TestSurfaceCache : public QObject
+{
+    Q_OBJECT
+
+private:
+    QVector<int> m_Released;
+
+    ImageCache::ReleaseCallback recordRelease()
+    {
+        return [this](int& value) {
+            m_Released.append(value);
+        };
+    }
+
+    // Only the address of the frames context matters to the cache
+    static AVFrame* allocFrame(AVBufferRef* framesCtx)
+    {
+        AVFrame* frame = av_frame_alloc();
+        frame->hw_frames_ctx = framesCtx != nullptr ? av_buffer_ref(framesCtx) : nullptr;
+        return frame;
+    }
+
+private slots:
+    void init()
+    {
+        m_Released.clear();
+    }
+
+    void findsInsertedValues()
+    {
+        ImageCache cache(recordRelease());
+        AVBufferRef* framesCtx = av_buffer_alloc(1);
+        AVFrame* frame = allocFrame(framesCtx);
+
+        // The first frame always starts a new generation
+        QVERIFY(cache.validate(frame));
+        QVERIFY(!cache.validate(frame));
+
+        int value;
+        QVERIFY(!cache.lookup({ 1, 0 }, &value));
+        QVERIFY(cache.insert({ 1, 0 }, 10));
+        QVERIFY(cache.insert({ 2, 0 }, 20));
+        QVERIFY(cache.insert({ 2, 1 }, 21));
+        QCOMPARE(cache.getCount(), 3);
+
+        QVERIFY(cache.lookup({ 2, 0 }, &value));
+        QCOMPARE(value, 20);
+        QVERIFY(cache.lookup({ 2, 1 }, &value));
+        QCOMPARE(value, 21);
+        QVERIFY(!cache.lookup({ 3, 0 }, &value));
+
+        av_frame_free(&frame);
+        av_buffer_unref(&framesCtx);
+    }
+
+    void fullCacheRejectsInserts()
+    {
+        ImageCache cache(recordRelease());
+
+        for (int i = 0; i < TEST_CACHE_SIZE; i++) {
+            QVERIFY(cache.insert({ (uint64_t)i, 0 }, i));
+        }
+
+        // The caller keeps ownership of what didn't fit
+        QVERIFY(!cache.insert({ TEST_CACHE_SIZE, 0 }, TEST_CACHE_SIZE));
+        QCOMPARE(cache.getCount(), TEST_CACHE_SIZE);
+
+        int value;
+        QVERIFY(!cache.lookup({ TEST_CACHE_SIZE, 0 }, &value));
+        QVERIFY(cache.lookup({ 0, 0 }, &value));
+        QCOMPARE(value, 0);
+
+        cache.flush();
+        QCOMPARE(m_Released.count(), TEST_CACHE_SIZE);
+    }
+
+    void newFramesContextFlushes()
+    {
+        ImageCache cache(recordRelease());
+        AVBufferRef* oldFramesCtx = av_buffer_alloc(1);
+        AVBufferRef* newFramesCtx = av_buffer_alloc(1);
+        AVFrame* oldFrame = allocFrame(oldFramesCtx);
+        AVFrame* newFrame = allocFrame(newFramesCtx);
+
+        QVERIFY(cache.validate(oldFrame));
+        QVERIFY(cache.insert({ 1, 0 }, 10));
+        QVERIFY(cache.insert({ 2, 0 }, 20));
+
+        // The cache holds its own reference, so the address of the old
+        // context can't be reused for a new one while entries refer to it
+        QCOMPARE(av_buffer_get_ref_count(oldFramesCtx), 3);
+
+        int generation = cache.getGeneration();
+        QVERIFY(cache.validate(newFrame));
+        QCOMPARE(cache.getGeneration(), generation + 1);
+        QCOMPARE(cache.getCount(), 0);
+        QCOMPARE(m_Released, QVector<int>({ 10, 20 }));
+        QCOMPARE(av_buffer_get_ref_count(oldFramesCtx), 2);
+        QCOMPARE(av_buffer_get_ref_count(newFramesCtx), 3);
+
+        // The same surface in the new context is a different surface
+        int value;
+        QVERIFY(!cache.lookup({ 1, 0 }, &value));
+
+        av_frame_free(&oldFrame);
+        av_frame_free(&newFrame);
+        av_buffer_unref(&oldFramesCtx);
+        av_buffer_unref(&newFramesCtx);
+    }
+
+    void resetFlushesOnNextValidate()
+    {
+        ImageCache cache(recordRelease());
+        AVBufferRef* framesCtx = av_buffer_alloc(1);
+        AVFrame* frame = allocFrame(framesCtx);
+
+        QVERIFY(cache.validate(frame));
+        QVERIFY(cache.insert({ 1, 0 }, 10));
+
+        // Like the decoder thread resetting its surface pool while the
+        // render thread is importing
+        QThread* decoder = QThread::create([&cache]() {
+            cache.reset();
+        });
+        decoder->start();
+        decoder->wait();
+        delete decoder;
+
+        // Nothing happens until the importing thread validates a frame,
+        // even one from the same frames context
+        QCOMPARE(cache.getCount(), 1);
+        QVERIFY(cache.validate(frame));
+        QCOMPARE(m_Released, QVector<int>({ 10 }));
+
+        // Once only
+        QVERIFY(cache.insert({ 1, 0 }, 11));
+        QVERIFY(!cache.validate(frame));
+        QCOMPARE(cache.getCount(), 1);
+
+        av_frame_free(&frame);
+        av_buffer_unref(&framesCtx);
+    }
+
+    void framesWithoutContextShareGeneration()
+    {
+        ImageCache cache(recordRelease());
+        AVBufferRef* framesCtx = av_buffer_alloc(1);
+        AVFrame* hwFrame = allocFrame(framesCtx);
+        AVFrame* swFrame = allocFrame(nullptr);
+
+        // A fresh cache has nothing to flush for frames without a context
+        QVERIFY(!cache.validate(swFrame));
+        QVERIFY(cache.insert({ 1, 0 }, 10));
+        QVERIFY(!cache.validate(swFrame));
+
+        // Switching between hardware and software frames flushes both ways
+        QVERIFY(cache.validate(hwFrame));
+        QCOMPARE(m_Released, QVector<int>({ 10 }));
+        QVERIFY(cache.insert({ 1, 0 }, 11));
+        QVERIFY(cache.validate(swFrame));
+        QCOMPARE(m_Released, QVector<int>({ 10, 11 }));
+        QCOMPARE(av_buffer_get_ref_count(framesCtx), 2);
+
+        av_frame_free(&hwFrame);
+        av_frame_free(&swFrame);
+        av_buffer_unref(&framesCtx);
+    }
+
+    void fbKeysCompareEveryField_data()
+    {
+        QTest::addColumn<int>("field");
+
+        QTest::newRow("buffer") << 0;
+        QTest::newRow("format") << 1;
+        QTest::newRow("modifier") << 2;
+        QTest::newRow("pitch") << 3;
+        QTest::newRow("offset") << 4;
+        QTest::newRow("size") << 5;
+    }
+
+    void fbKeysCompareEveryField()
+    {
+        QFETCH(int, field);
+
+        FbRetainer retainer;
+        FbCache cache([&retainer](uint32_t& fbId) {
+            retainer.releaseRetainedFb(fbId);
+        });
+
+        FbKey key = makeNv12FbKey(100);
+        QVERIFY(cache.insert(key, 1));
+        retainer.retainFb(1);
+
+        // The same surface, but imported with a different layout can't
+        // share the FB
+        FbKey otherKey = key;
+        switch (field) {
+        case 0:
+            otherKey.buffers[1] = 101;
+            break;
+        case 1:
+            otherKey.format = 0x30315050; // DRM_FORMAT_P010
+            break;
+        case 2:
+            otherKey.modifier = 1;
+            break;
+        case 3:
+            otherKey.pitches[1] = 2048;
+            break;
+        case 4:
+            otherKey.offsets[1] = 2048 * 1088;
+            break;
+        case 5:
+            otherKey.height = 1088;
+            break;
+        }
+
+        uint32_t fbId = 0;
+        QVERIFY(!cache.lookup(otherKey, &fbId));
+        QVERIFY(cache.lookup(makeNv12FbKey(100), &fbId));
+        QCOMPARE(fbId, 1U);
+
+        cache.flush();
+        QCOMPARE(retainer.getRetainedCount(), 0);
+    }
+
+    void decodeBufferPoolResetReleasesFbs()
+    {
+        FbRetainer retainer;
+        FbCache cache([&retainer](uint32_t& fbId) {
+            retainer.releaseRetainedFb(fbId);
+        });
+
+        // Frames decoded into our own dumb buffers have no frames context,
+        // so only a reset when the pool is reallocated can flush them
+        AVFrame* directFrame = allocFrame(nullptr);
+        QVERIFY(!cache.validate(directFrame));
+
+        // More surfaces than fit, like a decoder with a large pool. The
+        // ones that don't fit are imported each frame instead.
+        for (uint32_t fbId = 1; fbId <= TEST_CACHE_SIZE + 2; fbId++) {
+            if (cache.insert(makeNv12FbKey(fbId), fbId)) {
+                retainer.retainFb(fbId);
+            }
+        }
+        QCOMPARE(retainer.getRetainedCount(), TEST_CACHE_SIZE);
+
+        QVERIFY(!cache.validate(directFrame));
+        cache.reset();
+        QVERIFY(cache.validate(directFrame));
+        QCOMPARE(retainer.getRetainedCount(), 0);
+
+        // Inodes may be reused by the new pool's buffers
+        uint32_t fbId;
+        QVERIFY(!cache.lookup(makeNv12FbKey(1), &fbId));
+
+        av_frame_free(&directFrame);
+    }
+
+    void destructorReleasesEverything()
+    {
+        AVBufferRef* framesCtx = av_buffer_alloc(1);
+        AVFrame* frame = allocFrame(framesCtx);
+
+        {
+            ImageCache cache(recordRelease());
+            QVERIFY(cache.validate(frame));
+            QVERIFY(cache.insert({ 1, 0 }, 10));
+            QVERIFY(cache.insert({ 2, 0 }, 20));
+        }
+
+        QCOMPARE(m_Released, QVector<int>({ 10, 20 }));
+        QCOMPARE(av_buffer_get_ref_count(framesCtx), 2);
+
+        av_frame_free(&frame);
+        av_buffer_unref(&framesCtx);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestSurfaceCache)
+#include "tst_surfacecache.moc"
@@ -0,0 +1,12 @@
+# Reads back VAAPI (or Vulkan) surfaces through SwFrameMapper while another
+# thread prefetches them, like the Pacer and the DRM renderer do. Skipped if
+# neither hardware frame type is available.
+
+TARGET = tst_swframemapper
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_swframemapper.cpp \
+    $$APP_DIR/streaming/video/framepool.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/swframemapper.cpp
@@ -0,0 +1,265 @@
+#include "streaming/video/ffmpeg-renderers/swframemapper.h"
+
+#include <QtTest>
+
+#include <atomic>
+
+extern "C" {
+#include <libavutil/hwcontext.h>
+}
+
+#define SURFACE_WIDTH 256
+#define SURFACE_HEIGHT 128
+#define SURFACE_COUNT 6
+#define TEST_FRAMES 600
+
+// Frames queued between the prefetching thread and the renderer, like
+// the Pacer's render queue
+#define MAX_QUEUED_FRAMES 2
+
+// Every Nth frame is dropped instead of rendered, leaving its prefetched
+// readback for the mapper to discard
+#define DROP_INTERVAL 7
+
+namespace {
+
+// Only accepts NV12, so the mapper has to pick it for readback
+class Nv12Renderer : public IFFmpegRenderer
+{
+public:
+    Nv12Renderer()
+        : IFFmpegRenderer(RendererType::Unknown)
+    {
+    }
+
+    virtual bool initialize(PDECODER_PARAMETERS) override
+    {
+        return true;
+    }
+
+    virtual bool prepareDecoderContext(AVCodecContext*, AVDictionary**) override
+    {
+        return true;
+    }
+
+    virtual void renderFrame(AVFrame*) override
+    {
+    }
+
+    virtual AVPixelFormat getPreferredPixelFormat(int) override
+    {
+        return AV_PIX_FMT_NV12;
+    }
+};
+
+int getSurfaceLuma(int surface)
+{
+    return 16 + surface * 32;
+}
+
+}
+
+class TestSwFrameMapper : public QObject
+{
+    Q_OBJECT
+
+private:
+    AVBufferRef* m_FramesContext;
+    AVFrame* m_Surfaces[SURFACE_COUNT];
+
+    static AVBufferRef* createFramesContext()
+    {
+        const enum AVHWDeviceType deviceTypes[] = { AV_HWDEVICE_TYPE_VAAPI, AV_HWDEVICE_TYPE_VULKAN };
+
+        for (enum AVHWDeviceType deviceType : deviceTypes) {
+            AVBufferRef* deviceContext;
+            if (av_hwdevice_ctx_create(&deviceContext, deviceType, nullptr, nullptr, 0) < 0) {
+                continue;
+            }
+
+            AVBufferRef* framesContext = av_hwframe_ctx_alloc(deviceContext);
+            av_buffer_unref(&deviceContext);
+            if (framesContext == nullptr) {
+                continue;
+            }
+
+            auto hwFramesContext = (AVHWFramesContext*)framesContext->data;
+            hwFramesContext->format = deviceType == AV_HWDEVICE_TYPE_VAAPI ? AV_PIX_FMT_VAAPI : AV_PIX_FMT_VULKAN;
+            hwFramesContext->sw_format = AV_PIX_FMT_NV12;
+            hwFramesContext->width = SURFACE_WIDTH;
+            hwFramesContext->height = SURFACE_HEIGHT;
+            hwFramesContext->initial_pool_size = SURFACE_COUNT;
+            if (av_hwframe_ctx_init(framesContext) < 0) {
+                av_buffer_unref(&framesContext);
+                continue;
+            }
+
+            qInfo("Using %s surfaces", av_hwdevice_get_type_name(deviceType));
+            return framesContext;
+        }
+
+        return nullptr;
+    }
+
+    // Gives each surface its own luma so we can tell them apart after readback
+    static bool uploadSurface(AVFrame* surface, int luma)
+    {
+        AVFrame* swFrame = av_frame_alloc();
+        swFrame->format = AV_PIX_FMT_NV12;
+        swFrame->width = SURFACE_WIDTH;
+        swFrame->height = SURFACE_HEIGHT;
+        if (av_frame_get_buffer(swFrame, 0) < 0) {
+            av_frame_free(&swFrame);
+            return false;
+        }
+
+        for (int y = 0; y < SURFACE_HEIGHT; y++) {
+            memset(swFrame->data[0] + (ptrdiff_t)swFrame->linesize[0] * y, luma, SURFACE_WIDTH);
+        }
+        for (int y = 0; y < SURFACE_HEIGHT / 2; y++) {
+            memset(swFrame->data[1] + (ptrdiff_t)swFrame->linesize[1] * y, 128, SURFACE_WIDTH);
+        }
+
+        bool ret = av_hwframe_transfer_data(surface, swFrame, 0) >= 0;
+        av_frame_free(&swFrame);
+        return ret;
+    }
+
+    static bool hasSurfaceContent(AVFrame* swFrame, int luma)
+    {
+        if (swFrame->format != AV_PIX_FMT_NV12 || swFrame->width != SURFACE_WIDTH || swFrame->height != SURFACE_HEIGHT) {
+            return false;
+        }
+
+        const int rows[] = { 0, SURFACE_HEIGHT / 2, SURFACE_HEIGHT - 1 };
+        for (int y : rows) {
+            const uint8_t* lumaRow = swFrame->data[0] + (ptrdiff_t)swFrame->linesize[0] * y;
+            const uint8_t* chromaRow = swFrame->data[1] + (ptrdiff_t)swFrame->linesize[1] * (y / 2);
+            for (int x = 0; x < SURFACE_WIDTH; x++) {
+                if (lumaRow[x] != luma || chromaRow[x] != 128) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+private slots:
+    void initTestCase()
+    {
+        SDL_zero(m_Surfaces);
+
+        m_FramesContext = createFramesContext();
+        if (m_FramesContext == nullptr) {
+            QSKIP("No VAAPI or Vulkan device is available");
+        }
+
+        for (int i = 0; i < SURFACE_COUNT; i++) {
+            m_Surfaces[i] = av_frame_alloc();
+            QVERIFY(av_hwframe_get_buffer(m_FramesContext, m_Surfaces[i], 0) >= 0);
+            if (!uploadSurface(m_Surfaces[i], getSurfaceLuma(i))) {
+                QSKIP("Unable to upload to hardware surfaces");
+            }
+        }
+    }
+
+    void cleanupTestCase()
+    {
+        for (int i = 0; i < SURFACE_COUNT; i++) {
+            av_frame_free(&m_Surfaces[i]);
+        }
+        av_buffer_unref(&m_FramesContext);
+    }
+
+    void cleanup()
+    {
+        qunsetenv("SW_FRAME_ASYNC_READBACK");
+    }
+
+    void readsBackPrefetchedFrames_data()
+    {
+        QTest::addColumn<bool>("async");
+
+        QTest::newRow("sync") << false;
+        QTest::newRow("async") << true;
+    }
+
+    void readsBackPrefetchedFrames()
+    {
+        QFETCH(bool, async);
+
+        qputenv("SW_FRAME_ASYNC_READBACK", async ? "1" : "0");
+
+        Nv12Renderer renderer;
+        SwFrameMapper mapper(&renderer);
+        mapper.setVideoFormat(VIDEO_FORMAT_H264);
+
+        QMutex queueLock;
+        QWaitCondition queueChanged;
+        QQueue<AVFrame*> queue;
+
+        // Like the decoder thread submitting to the Pacer, which prefetches
+        // each frame as it's queued for rendering. Surfaces are reused, so
+        // only the pts and opaque tell frames of the same surface apart.
+        QThread* producer = QThread::create([&]() {
+            for (int i = 0; i < TEST_FRAMES; i++) {
+                AVFrame* frame = av_frame_clone(m_Surfaces[i % SURFACE_COUNT]);
+                frame->pts = i;
+                frame->opaque = (void*)(intptr_t)(i + 1);
+
+                mapper.prefetchSwFrame(frame);
+
+                QMutexLocker locker(&queueLock);
+                while (queue.count() >= MAX_QUEUED_FRAMES) {
+                    queueChanged.wait(&queueLock);
+                }
+                queue.enqueue(frame);
+                queueChanged.wakeAll();
+            }
+        });
+        producer->start();
+
+        int renderedFrames = 0;
+        int failedReadbacks = 0;
+        int wrongFrames = 0;
+        for (int i = 0; i < TEST_FRAMES; i++) {
+            AVFrame* frame;
+            {
+                QMutexLocker locker(&queueLock);
+                while (queue.isEmpty()) {
+                    queueChanged.wait(&queueLock);
+                }
+                frame = queue.dequeue();
+                queueChanged.wakeAll();
+            }
+
+            if (i % DROP_INTERVAL != DROP_INTERVAL - 1) {
+                AVFrame* swFrame = mapper.getSwFrameFromHwFrame(frame);
+                if (swFrame == nullptr) {
+                    failedReadbacks++;
+                }
+                else {
+                    // A stale prefetch would have another surface's content or pts
+                    if (swFrame->pts != frame->pts || !hasSurfaceContent(swFrame, getSurfaceLuma(i % SURFACE_COUNT))) {
+                        wrongFrames++;
+                    }
+                    mapper.releaseSwFrame(&swFrame);
+                    renderedFrames++;
+                }
+            }
+
+            av_frame_free(&frame);
+        }
+
+        producer->wait();
+        delete producer;
+
+        QCOMPARE(failedReadbacks, 0);
+        QCOMPARE(wrongFrames, 0);
+        QVERIFY(renderedFrames > 0);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestSwFrameMapper)
+#include "tst_swframemapper.moc"
@@ -0,0 +1,24 @@
+# Common settings for unit tests and benchmarks of the streaming core.
+# Tests compile the app sources they cover directly, so they build against
+# the same pkg-config dependencies as the Linux client.
+
+QT += core quick testlib
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+include(../globaldefs.pri)
+
+TEMPLATE = app
+
+DEFINES += QT_DEPRECATED_WARNINGS
+DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000
+
+CONFIG += link_pkgconfig
+PKGCONFIG += openssl sdl2 SDL2_ttf libavcodec libavutil
+
+APP_DIR = $$PWD/../app
+INCLUDEPATH += $$APP_DIR
+
+unix: LIBS += -L$$OUT_PWD/../../moonlight-common-c/ -lmoonlight-common-c
+INCLUDEPATH += $$PWD/../moonlight-common-c/moonlight-common-c/src
+DEPENDPATH += $$PWD/../moonlight-common-c/moonlight-common-c/src
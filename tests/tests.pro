@@ -0,0 +1,11 @@
+TEMPLATE = subdirs
+SUBDIRS = \
+    capabilitycache \
+    cpuconverter \
+    framequeue \
+    pacersim \
+    pacerthreads \
+    probescheduler \
+    softwarevsync \
+    surfacecache \
+    swframemapper